@@ -12,6 +12,7 @@ namespace Allocations {
 template <typename Offset>
 class AnchorChainLister : public Graph<Offset>::AnchorChainVisitor {
  public:
+  typedef typename Graph<Offset>::Anchors Anchors;
   AnchorChainLister(const InModuleDescriber<Offset>& inModuleDescriber,
                     const StackDescriber<Offset>& stackDescriber,
                     const Graph<Offset>& graph,
@@ -34,9 +35,8 @@ class AnchorChainLister : public Graph<Offset>::AnchorChainVisitor {
     // head vs whole chain
   }
 
-  bool VisitStaticAnchorChainHeader(const std::vector<Offset>& staticAddrs,
-                                    Offset address, Offset size,
-                                    const char* image) {
+  bool VisitStaticAnchorChainHeader(const Anchors& staticAddrs, Offset address,
+                                    Offset size, const char* image) {
     Commands::Output& output = _context.GetOutput();
     const bool isDirect = (address == _anchoree);
     if (!isDirect && (_numDirectStaticAnchorChainsShown > 0 ||
@@ -54,8 +54,8 @@ class AnchorChainLister : public Graph<Offset>::AnchorChainVisitor {
       ShowSignatureIfPresent(output, size, image);
       output << ".\n";
     }
-    for (typename std::vector<Offset>::const_iterator it = staticAddrs.begin();
-         it != staticAddrs.end(); ++it) {
+    for (const Offset* it = staticAddrs.begin(); it != staticAddrs.end();
+         ++it) {
       Offset staticAddr = *it;
       _inModuleDescriber.Describe(_context, staticAddr, false, true);
       output << "Static address 0x" << staticAddr;
@@ -73,9 +73,8 @@ class AnchorChainLister : public Graph<Offset>::AnchorChainVisitor {
     return false;
   }
 
-  bool VisitStackAnchorChainHeader(const std::vector<Offset>& stackAddrs,
-                                   Offset address, Offset size,
-                                   const char* image) {
+  bool VisitStackAnchorChainHeader(const Anchors& stackAddrs, Offset address,
+                                   Offset size, const char* image) {
     Commands::Output& output = _context.GetOutput();
     const bool isDirect = (address == _anchoree);
     if (!isDirect && (_numDirectStackAnchorChainsShown > 0 ||
@@ -94,8 +93,7 @@ class AnchorChainLister : public Graph<Offset>::AnchorChainVisitor {
       ShowSignatureIfPresent(output, size, image);
       output << ".\n";
     }
-    for (typename std::vector<Offset>::const_iterator it = stackAddrs.begin();
-         it != stackAddrs.end(); ++it) {
+    for (const Offset* it = stackAddrs.begin(); it != stackAddrs.end(); ++it) {
       Offset stackAddr = *it;
       _stackDescriber.Describe(_context, stackAddr, false, true);
       output << "Stack address 0x" << std::hex << stackAddr << " references"
@@ -0,0 +1,203 @@
+// Copyright (c) 2021 VMware, Inc. All Rights Reserved.
+// SPDX-License-Identifier: GPL-2.0
+
+#pragma once
+#include <stdint.h>
+#include <algorithm>
+#include <utility>
+#include <vector>
+#include "../AnalysisCache.h"
+
+namespace chap {
+namespace Allocations {
+/*
+ * An AnchorPointTable holds, for each allocation that is referenced from
+ * outside of any allocation in some particular way, such as from a static
+ * area or from a stack, the values that reference it.  The values for all
+ * the anchor points are kept in a single array, in increasing order of
+ * allocation index, and the anchor points are marked in a bit map with a
+ * running count per 64 bit word, so that finding the values for a given
+ * allocation takes constant time.
+ */
+template <typename Index, typename Offset>
+class AnchorPointTable {
+ public:
+  /*
+   * The values that reference a single anchor point, in the order in which
+   * they were added.
+   */
+  class Anchors {
+   public:
+    Anchors(const Offset* first, const Offset* limit)
+        : _first(first), _limit(limit) {}
+    const Offset* begin() const { return _first; }
+    const Offset* end() const { return _limit; }
+    size_t size() const { return _limit - _first; }
+    bool empty() const { return _first == _limit; }
+
+   private:
+    const Offset* _first;
+    const Offset* _limit;
+  };
+
+  AnchorPointTable(Index numAllocations)
+      : _numAllocations(numAllocations),
+        _isAnchorPoint((numAllocations + 63) / 64, 0),
+        _numBefore((numAllocations + 63) / 64, 0) {}
+
+  AnchorPointTable(const AnchorPointTable&) = delete;
+  AnchorPointTable& operator=(const AnchorPointTable&) = delete;
+
+  /*
+   * Record that the given value references the given allocation.  Values
+   * added by Add() are not visible until Finish() is called.
+   */
+  void Add(Index target, Offset anchor) {
+    _pending.push_back(std::make_pair(target, anchor));
+  }
+
+  /*
+   * Make all the values added since the last call visible.  The values
+   * for each anchor point keep the order in which they were added.
+   */
+  void Finish() {
+    if (_pending.empty()) {
+      return;
+    }
+    if (!_values.empty()) {
+      std::vector<std::pair<Index, Offset> > pending;
+      pending.reserve(_values.size() + _pending.size());
+      for (size_t i = 0; i < _targets.size(); i++) {
+        for (Offset anchor : _anchors[i]) {
+          pending.push_back(std::make_pair(_targets[i], anchor));
+        }
+      }
+      pending.insert(pending.end(), _pending.begin(), _pending.end());
+      _pending.swap(pending);
+    }
+    std::stable_sort(_pending.begin(), _pending.end(),
+                     [](const std::pair<Index, Offset>& left,
+                        const std::pair<Index, Offset>& right) {
+                       return left.first < right.first;
+                     });
+    _targets.clear();
+    _firstValues.clear();
+    _values.clear();
+    _values.reserve(_pending.size());
+    for (const auto& targetAndAnchor : _pending) {
+      if (_targets.empty() || _targets.back() != targetAndAnchor.first) {
+        _targets.push_back(targetAndAnchor.first);
+        _firstValues.push_back(_values.size());
+      }
+      _values.push_back(targetAndAnchor.second);
+    }
+    _firstValues.push_back(_values.size());
+    std::vector<std::pair<Index, Offset> >().swap(_pending);
+    BuildLookup();
+  }
+
+  size_t NumAnchorPoints() const { return _targets.size(); }
+
+  /*
+   * Return the index of the allocation for the given anchor point, where
+   * anchor points are numbered in increasing order of allocation index.
+   */
+  Index AnchorPoint(size_t anchorPointNumber) const {
+    return _targets[anchorPointNumber];
+  }
+
+  /*
+   * Return the values that reference the given allocation, or nullptr if
+   * the allocation is not an anchor point.
+   */
+  const Anchors* Find(Index target) const {
+    if (target >= _numAllocations) {
+      return nullptr;
+    }
+    uint64_t bits = _isAnchorPoint[target / 64];
+    uint64_t bit = ((uint64_t)(1)) << (target % 64);
+    if ((bits & bit) == 0) {
+      return nullptr;
+    }
+    return &_anchors[_numBefore[target / 64] +
+                     __builtin_popcountll(bits & (bit - 1))];
+  }
+
+  void SaveTo(AnalysisCache::Writer& writer) const {
+    writer.Write(_targets);
+    writer.Write(_firstValues);
+    writer.Write(_values);
+  }
+
+  /*
+   * Replace the contents of the table with those previously saved for the
+   * same number of allocations, returning false and leaving the table
+   * unchanged if that is not possible.
+   */
+  bool RestoreFrom(AnalysisCache::Reader& reader) {
+    std::vector<Index> targets;
+    std::vector<Offset> firstValues;
+    std::vector<Offset> values;
+    if (!reader.Read(targets) || !reader.Read(firstValues) ||
+        !reader.Read(values) || firstValues.size() != targets.size() + 1 ||
+        firstValues.back() != values.size()) {
+      return false;
+    }
+    for (size_t i = 0; i < targets.size(); i++) {
+      if (targets[i] >= _numAllocations ||
+          (i > 0 && targets[i] <= targets[i - 1]) ||
+          firstValues[i] > firstValues[i + 1]) {
+        return false;
+      }
+    }
+    _targets.swap(targets);
+    _firstValues.swap(firstValues);
+    _values.swap(values);
+    BuildLookup();
+    return true;
+  }
+
+  void Swap(AnchorPointTable& other) {
+    std::swap(_numAllocations, other._numAllocations);
+    _pending.swap(other._pending);
+    _targets.swap(other._targets);
+    _firstValues.swap(other._firstValues);
+    _values.swap(other._values);
+    _anchors.swap(other._anchors);
+    _isAnchorPoint.swap(other._isAnchorPoint);
+    _numBefore.swap(other._numBefore);
+  }
+
+ private:
+  Index _numAllocations;
+  std::vector<std::pair<Index, Offset> > _pending;
+  std::vector<Index> _targets;
+  std::vector<Offset> _firstValues;
+  std::vector<Offset> _values;
+  std::vector<Anchors> _anchors;
+  std::vector<uint64_t> _isAnchorPoint;
+  std::vector<Index> _numBefore;
+
+  /*
+   * Rebuild the bit map and the bounds of the values for each anchor point
+   * from _targets, _firstValues and _values.
+   */
+  void BuildLookup() {
+    std::fill(_isAnchorPoint.begin(), _isAnchorPoint.end(), 0);
+    _anchors.clear();
+    _anchors.reserve(_targets.size());
+    for (size_t i = 0; i < _targets.size(); i++) {
+      Index target = _targets[i];
+      _isAnchorPoint[target / 64] |= ((uint64_t)(1)) << (target % 64);
+      _anchors.emplace_back(_values.data() + _firstValues[i],
+                            _values.data() + _firstValues[i + 1]);
+    }
+    Index numBefore = 0;
+    for (size_t i = 0; i < _isAnchorPoint.size(); i++) {
+      _numBefore[i] = numBefore;
+      numBefore += __builtin_popcountll(_isAnchorPoint[i]);
+    }
+  }
+};
+}  // namespace Allocations
+}  // namespace chap
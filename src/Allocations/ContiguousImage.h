@@ -3,6 +3,8 @@
 
 #pragma once
 #include <string.h>
+#include <sys/mman.h>
+#include <new>
 #include "../VirtualAddressMap.h"
 #include "Directory.h"
 namespace chap {
@@ -19,20 +21,24 @@ class ContiguousImage {
         _numAllocations(directory.NumAllocations()),
         _index(_numAllocations),
         _maxAllocationSize(directory.MaxAllocationSize()),
-        _buffer((_maxAllocationSize / sizeof(Offset)) + 2, 0),
-        _bufferAsChars((char *)(&(_buffer[0]))),
-        _bufferAsOffsets((Offset *)(&(_buffer[0]))),
+        _bufferSize(((_maxAllocationSize / sizeof(Offset)) + 2) *
+                    sizeof(Offset)),
+        _bufferAsChars(MapBuffer(_bufferSize)),
+        _bufferAsOffsets((Offset *)(_bufferAsChars)),
         _pFirstChar(_bufferAsChars),
         _size(0),
         _pFirstOffset(_bufferAsOffsets),
         _pPastOffsets(_bufferAsOffsets),
         _addressMap(addressMap),
-        _iterator(_addressMap.end()),
-        _endIterator(_addressMap.end()),
         _regionImage(nullptr),
         _regionBase(0),
         _regionLimit(0) {}
 
+  ~ContiguousImage() { munmap(_bufferAsChars, _bufferSize); }
+
+  ContiguousImage(const ContiguousImage &) = delete;
+  ContiguousImage &operator=(const ContiguousImage &) = delete;
+
   void SetIndex(Index index) {
     if (index > _numAllocations) {
       index = _numAllocations;
@@ -48,17 +54,8 @@ class ContiguousImage {
         Offset size = allocation->Size();
         Offset limit = address + size;
         if (_regionBase > address || address >= _regionLimit) {
-          _regionImage = nullptr;
-          _regionBase = 0;
-          _regionLimit = 0;
-          _iterator = _addressMap.find(address);
-          if (_iterator != _endIterator) {
-            _regionImage = _iterator.GetImage();
-          }
-          if (_regionImage != nullptr) {
-            _regionBase = _iterator.Base();
-            _regionLimit = _iterator.Limit();
-          } else {
+          if (!_addressMap.FindImagedRange(address, &_regionImage,
+                                           &_regionBase, &_regionLimit)) {
             return;
           }
         }
@@ -74,19 +71,23 @@ class ContiguousImage {
           memcpy(_bufferAsChars, _regionImage + (address - _regionBase),
                  _regionLimit - address);
           Offset copiedTo = _regionLimit;
+          typename VirtualAddressMap<Offset>::const_iterator it =
+              _addressMap.find(address);
+          typename VirtualAddressMap<Offset>::const_iterator itEnd =
+              _addressMap.end();
           while (copiedTo < limit) {
             _regionBase = 0;
             _regionLimit = 0;
             _regionImage = nullptr;
-            if (++_iterator == _endIterator) {
+            if (++it == itEnd) {
               break;
             }
-            _regionImage = _iterator.GetImage();
+            _regionImage = it.GetImage();
             if (_regionImage == nullptr) {
               continue;
             }
-            _regionBase = _iterator.Base();
-            _regionLimit = _iterator.Limit();
+            _regionBase = it.Base();
+            _regionLimit = it.Limit();
             if (_regionBase > limit) {
               break;
             }
@@ -130,7 +131,7 @@ class ContiguousImage {
   const Index _numAllocations;
   Index _index;
   const Offset _maxAllocationSize;
-  std::vector<Offset> _buffer;
+  const size_t _bufferSize;
   char *_bufferAsChars;
   Offset *_bufferAsOffsets;
   const char *_pFirstChar;
@@ -138,11 +139,26 @@ class ContiguousImage {
   const Offset *_pFirstOffset;
   const Offset *_pPastOffsets;
   const VirtualAddressMap<Offset> &_addressMap;
-  typename VirtualAddressMap<Offset>::const_iterator _iterator;
-  typename VirtualAddressMap<Offset>::const_iterator _endIterator;
   const char *_regionImage;
   Offset _regionBase;
   Offset _regionLimit;
+
+  /*
+   * The buffer is large enough for the largest allocation but is needed
+   * only for allocations that are unmapped or that span regions, so it is
+   * mapped anonymously in order that only the pages actually written cost
+   * any memory.  Unwritten pages read as 0, as required for allocations
+   * that are not mapped at all.  This matters because there may be one
+   * such image per thread and the largest allocation can be very large.
+   */
+  static char *MapBuffer(size_t size) {
+    void *buffer = mmap(nullptr, size, PROT_READ | PROT_WRITE,
+                        MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (buffer == MAP_FAILED) {
+      throw std::bad_alloc();
+    }
+    return (char *)(buffer);
+  }
 };
 }  // namespace Allocations
 }  // namespace chap
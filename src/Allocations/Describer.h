@@ -23,14 +23,14 @@ class Describer : public chap::Describer<Offset> {
             const StackDescriber<Offset>& stackDescriber,
             const PatternDescriberRegistry<Offset>& patternDescriberRegistry,
             const ProcessImage<Offset>& processImage)
-      : _inModuleDescriber(inModuleDescriber),
+      : _processImage(processImage),
+        _inModuleDescriber(inModuleDescriber),
         _stackDescriber(stackDescriber),
         _patternDescriberRegistry(patternDescriberRegistry),
         _signatureDirectory(processImage.GetSignatureDirectory()),
         _anchorDirectory(processImage.GetAnchorDirectory()),
         _addressMap(processImage.GetVirtualAddressMap()),
-        _directory(processImage.GetAllocationDirectory()),
-        _graph(processImage.GetAllocationGraph()) {}
+        _directory(processImage.GetAllocationDirectory()) {}
 
   /*
    * If the address is understood, provide a description for the address,
@@ -40,13 +40,13 @@ class Describer : public chap::Describer<Offset> {
    */
   bool Describe(Commands::Context& context, Offset address, bool explain,
                 bool showAddresses) const {
-    if (_graph == 0) {
-      return false;
-    }
     AllocationIndex index = _directory.AllocationIndexOf(address);
     if (index == _directory.NumAllocations()) {
       return false;
     }
+    if (_processImage.GetAllocationGraph() == 0) {
+      return false;
+    }
     const Allocation* allocation = _directory.AllocationAt(index);
     if (allocation == 0) {
       abort();
@@ -70,6 +70,7 @@ class Describer : public chap::Describer<Offset> {
   void Describe(Commands::Context& context, AllocationIndex index,
                 const Allocation& allocation, bool explain,
                 Offset offsetInAllocation, bool showAddresses) const {
+    const Graph<Offset>* graph = _processImage.GetAllocationGraph();
     size_t size = allocation.Size();
     Commands::Output& output = context.GetOutput();
     bool isUsed = false;
@@ -78,9 +79,9 @@ class Describer : public chap::Describer<Offset> {
     bool isThreadCached = false;
     if (allocation.IsUsed()) {
       isUsed = true;
-      if (_graph->IsLeaked(index)) {
+      if (graph->IsLeaked(index)) {
         isLeaked = true;
-        if (_graph->IsUnreferenced(index)) {
+        if (graph->IsUnreferenced(index)) {
           isUnreferenced = true;
         }
       }
@@ -132,11 +133,11 @@ class Describer : public chap::Describer<Offset> {
       if (isUsed) {
         if (!isLeaked) {
           AnchorChainLister<Offset> anchorChainLister(
-              _inModuleDescriber, _stackDescriber, *_graph, _signatureDirectory,
+              _inModuleDescriber, _stackDescriber, *graph, _signatureDirectory,
               _anchorDirectory, context, address);
-          _graph->VisitStaticAnchorChains(index, anchorChainLister);
-          _graph->VisitRegisterAnchorChains(index, anchorChainLister);
-          _graph->VisitStackAnchorChains(index, anchorChainLister);
+          graph->VisitStaticAnchorChains(index, anchorChainLister);
+          graph->VisitRegisterAnchorChains(index, anchorChainLister);
+          graph->VisitStackAnchorChains(index, anchorChainLister);
         }
       }
     }
@@ -144,6 +145,7 @@ class Describer : public chap::Describer<Offset> {
   }
 
  private:
+  const ProcessImage<Offset>& _processImage;
   const InModuleDescriber<Offset>& _inModuleDescriber;
   const StackDescriber<Offset>& _stackDescriber;
   const PatternDescriberRegistry<Offset>& _patternDescriberRegistry;
@@ -151,7 +153,6 @@ class Describer : public chap::Describer<Offset> {
   const AnchorDirectory<Offset>& _anchorDirectory;
   const VirtualAddressMap<Offset>& _addressMap;
   const Directory<Offset>& _directory;
-  const Graph<Offset>* _graph;
 };
 }  // namespace Allocations
 }  // namespace chap
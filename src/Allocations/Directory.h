@@ -4,7 +4,9 @@
 #pragma once
 #include <algorithm>
 #include <functional>
+#include <memory>
 #include <vector>
+#include "../CandidateFilter.h"
 namespace chap {
 namespace Allocations {
 template <class Offset>
@@ -102,6 +104,15 @@ class Directory {
     static constexpr Offset MAX_FINDERS = 1 << NUM_FINDER_INDEX_BITS;
   };
 
+  /*
+   * This is the form in which a Finder reports a span of allocations.
+   */
+  struct FoundAllocation {
+    Offset _address;
+    Offset _size;
+    bool _isUsed;
+  };
+
   /*
    * This class is used to report a sequence of allocations just once, so
    * that information can be cached in a Directory.
@@ -139,6 +150,27 @@ class Directory {
      * Advance to the next allocation.
      */
     virtual void Advance() = 0;
+    /*
+     * Copy the next allocation, and possibly some of the allocations that
+     * follow it, to the given records, and return the number copied, which
+     * is between 1 and maxRecords unless there are no more allocations.  The
+     * finder is left at the last allocation copied, rather than past it, so
+     * the caller must call Advance() before asking for anything more.  This
+     * way any work that a finder does when advancing past its last allocation
+     * still happens only after all the allocations it reported have been
+     * assigned allocation indices in the Directory.
+     *
+     * By default this just copies the next allocation, but finders that can
+     * report a whole run or pool at a time in a tight loop should do so, so
+     * that the Directory does not make several virtual calls per allocation.
+     */
+    virtual size_t NextSpan(FoundAllocation* records, size_t maxRecords) {
+      if (Finished() || maxRecords == 0) {
+        return 0;
+      }
+      records[0] = {NextAddress(), NextSize(), NextIsUsed()};
+      return 1;
+    }
     /*
      * Return the smallest request size that might reasonably have resulted
      * in an allocation of the given size.
@@ -152,7 +184,10 @@ class Directory {
       : _allocationBoundariesResolved(false),
         _freeStatusFinalized(false),
         _hasThreadCached(false),
-        _maxAllocationSize(0) {}
+        _maxAllocationSize(0),
+        _envelopeBase(0),
+        _envelopeSize(0),
+        _firstChunk(0) {}
   ~Directory() {}
 
   size_t AddFinder(Finder* finder) {
@@ -189,27 +224,18 @@ class Directory {
     if (_allocationBoundariesResolved) {
       abort();
     }
-    std::vector<size_t> activeFinders;
+    std::vector<FinderSpan> activeSpans;
     size_t numFinders = _indexToFinder.size();
-    activeFinders.reserve(numFinders);
+    activeSpans.reserve(numFinders);
     for (size_t i = 0; i < numFinders; i++) {
-      Finder* finder = _indexToFinder[i];
-      if (!(finder->Finished())) {
-        activeFinders.push_back(i);
+      activeSpans.emplace_back(i, _indexToFinder[i]);
+      if (!activeSpans.back().Refill()) {
+        activeSpans.pop_back();
       }
     }
+    AppendRemainingAllocations(activeSpans);
 
-    if (!activeFinders.empty()) {
-      Offset numActiveFinders = activeFinders.size();
-      if (numActiveFinders == 1) {
-        AppendRemainingAllocationsFromFinder(activeFinders[0]);
-      } else if (numActiveFinders == 2) {
-        AppendRemainingAllocationsFromFinders(activeFinders[0],
-                                              activeFinders[1]);
-      } else {
-        AppendRemainingAllocationsFromFinders(activeFinders);
-      }
-    }
+    BuildPageIndex();
 
     _allocationBoundariesResolved = true;
     for (auto& callback : _resolutionDoneCallbacks) {
@@ -251,36 +277,55 @@ class Directory {
         limit = mid;
       }
     }
-    for (const std::vector<AllocationIndex>& level : _wrappers) {
-      /*
-       * If there are any wrappers, the address might be in one of them but
-       * not in any of the wrapped allocations it contains.
-       * Search progressively outward.  The most common case is that there
-       * are no wrappers at all.  The second most is that there are no wrappers
-       * that wrap other wrappers, as can happen, for example, if python
-       * allocates something using malloc() then further subdivides that thing
-       * into allocations.
-       */
-      limit = level.size();
-      base = 0;
-      while (base < limit) {
-        size_t mid = (base + limit) / 2;
-        size_t allocationIndex = level[mid];
-        const Allocation& allocation = _allocations[allocationIndex];
-        Offset allocationAddress = allocation.Address();
-        Offset allocationLimit = allocationAddress + allocation.Size();
-        if (addr >= allocationAddress) {
-          if (addr < allocationLimit) {
-            return allocationIndex;
-          } else {
-            base = mid + 1;
-          }
+    return WrapperIndexOf(addr);
+  }
+
+  /*
+   * This gives the same result as AllocationIndexOf but uses the page index
+   * built when the allocation boundaries were resolved.  Most addresses that
+   * are not in any allocation are rejected with a single bit test, and for
+   * the rest the search is limited to the allocations that start on the
+   * page that contains the address, plus the one that starts closest before
+   * that page.
+   */
+  AllocationIndex PagedAllocationIndexOf(Offset addr) const {
+    if (_pageIndexChunks.empty()) {
+      return AllocationIndexOf(addr);
+    }
+    Offset chunkIndex = (addr >> LOG2_PAGE_INDEX_CHUNK_SIZE) - _firstChunk;
+    if (chunkIndex >= _pageIndexChunks.size()) {
+      return _allocations.size();
+    }
+    const PageIndexChunk* chunk = _pageIndexChunks[chunkIndex].get();
+    if (chunk == nullptr) {
+      return _allocations.size();
+    }
+    size_t page = (addr >> LOG2_PAGE_INDEX_PAGE_SIZE) & (PAGES_PER_CHUNK - 1);
+    if ((chunk->_hasAllocations[page / 64] & (((uint64_t)1) << (page % 64))) ==
+        0) {
+      return _allocations.size();
+    }
+    size_t base = chunk->_numStartingBefore[page];
+    if (base > 0) {
+      base--;
+    }
+    size_t limit = chunk->_numStartingBefore[page + 1];
+    while (base < limit) {
+      size_t mid = (base + limit) / 2;
+      const Allocation& allocation = _allocations[mid];
+      Offset allocationAddress = allocation.Address();
+      Offset allocationLimit = allocationAddress + allocation.Size();
+      if (addr >= allocationAddress) {
+        if (addr < allocationLimit && !allocation.IsWrapper()) {
+          return (AllocationIndex)(mid);
         } else {
-          limit = mid;
+          base = mid + 1;
         }
+      } else {
+        limit = mid;
       }
     }
-    return _allocations.size();
+    return WrapperIndexOf(addr);
   }
 
   // null if index is not valid.
@@ -314,6 +359,22 @@ class Directory {
    */
   Offset MaxAllocationSize() const { return _maxAllocationSize; }
 
+  /*
+   * Return true if PagedAllocationIndexOf uses a page index, rather than
+   * falling back to a binary search over all the allocations.
+   */
+  bool HasPageIndex() const { return !_pageIndexChunks.empty(); }
+
+  /*
+   * Return a filter that accepts only values in the smallest range of
+   * addresses that covers all the allocations, for use in quickly rejecting
+   * most words that cannot possibly be references to allocations.  This
+   * accepts nothing before Resolve() has been called.
+   */
+  CandidateFilter<Offset> GetCandidateFilter() const {
+    return CandidateFilter<Offset>(_envelopeBase, _envelopeSize);
+  }
+
   /*
    * Mark the allocation at the given index as free or do nothing if the index
    * isn't valid.
@@ -367,14 +428,197 @@ class Directory {
   std::map<Finder*, size_t> _finderToIndex;
   std::vector<Finder*> _indexToFinder;
   std::vector<std::pair<AllocationIndex, Offset> > _limits;
+  /*
+   * While the allocation boundaries are being resolved, each finder that
+   * still has allocations to report has a FinderSpan, which holds the
+   * allocations most recently reported by that finder that have not yet
+   * been added to the directory.
+   */
+  static constexpr size_t MAX_ALLOCATIONS_PER_SPAN = 0x1000;
+  class FinderSpan {
+   public:
+    FinderSpan(size_t finderIndex, Finder* finder)
+        : _finderIndex(finderIndex),
+          _finder(finder),
+          _records(MAX_ALLOCATIONS_PER_SPAN),
+          _next(0),
+          _limit(0) {}
+    /*
+     * Get the next span from the finder, advancing past the previous one,
+     * if any.  Return false if the finder has no more allocations.
+     */
+    bool Refill() {
+      if (_limit != 0) {
+        _finder->Advance();
+      }
+      _next = 0;
+      _limit = _finder->NextSpan(_records.data(), _records.size());
+      return _limit != 0;
+    }
+    bool Exhausted() const { return _next == _limit; }
+    const FoundAllocation& Current() const { return _records[_next]; }
+    void Skip() { ++_next; }
+    size_t FinderIndex() const { return _finderIndex; }
+
+   private:
+    size_t _finderIndex;
+    Finder* _finder;
+    std::vector<FoundAllocation> _records;
+    size_t _next;
+    size_t _limit;
+  };
   std::vector<std::vector<AllocationIndex> > _wrappers;
   mutable std::vector<ResolutionDoneCallback> _resolutionDoneCallbacks;
 
-  void ConsumeCurrentAllocation(size_t finderIndex, Finder* finder) {
-    Offset address = finder->NextAddress();
-    Offset size = finder->NextSize();
+  /*
+   * The page index covers the address space used by allocations in chunks
+   * of 1 GB, each divided into 4 KB pages.  Chunks that do not overlap any
+   * allocations are not allocated.  For each page in a chunk the index keeps
+   * one bit that is set if any allocation overlaps the page, and the number
+   * of allocations that start before the page.
+   */
+  static constexpr int LOG2_PAGE_INDEX_PAGE_SIZE = 12;
+  static constexpr int LOG2_PAGE_INDEX_CHUNK_SIZE = 30;
+  static constexpr size_t PAGES_PER_CHUNK =
+      ((size_t)1) << (LOG2_PAGE_INDEX_CHUNK_SIZE - LOG2_PAGE_INDEX_PAGE_SIZE);
+  static constexpr size_t MAX_PAGE_INDEX_CHUNKS = ((size_t)1) << 24;
+  struct PageIndexChunk {
+    PageIndexChunk()
+        : _hasAllocations(PAGES_PER_CHUNK / 64, 0),
+          _numStartingBefore(PAGES_PER_CHUNK + 1, 0) {}
+    std::vector<uint64_t> _hasAllocations;
+    std::vector<AllocationIndex> _numStartingBefore;
+  };
+  Offset _envelopeBase;
+  Offset _envelopeSize;
+  Offset _firstChunk;
+  std::vector<std::unique_ptr<PageIndexChunk> > _pageIndexChunks;
+
+  AllocationIndex WrapperIndexOf(Offset addr) const {
+    for (const std::vector<AllocationIndex>& level : _wrappers) {
+      /*
+       * If there are any wrappers, the address might be in one of them but
+       * not in any of the wrapped allocations it contains.
+       * Search progressively outward.  The most common case is that there
+       * are no wrappers at all.  The second most is that there are no wrappers
+       * that wrap other wrappers, as can happen, for example, if python
+       * allocates something using malloc() then further subdivides that thing
+       * into allocations.
+       */
+      size_t limit = level.size();
+      size_t base = 0;
+      while (base < limit) {
+        size_t mid = (base + limit) / 2;
+        size_t allocationIndex = level[mid];
+        const Allocation& allocation = _allocations[allocationIndex];
+        Offset allocationAddress = allocation.Address();
+        Offset allocationLimit = allocationAddress + allocation.Size();
+        if (addr >= allocationAddress) {
+          if (addr < allocationLimit) {
+            return allocationIndex;
+          } else {
+            base = mid + 1;
+          }
+        } else {
+          limit = mid;
+        }
+      }
+    }
+    return _allocations.size();
+  }
+
+  void BuildPageIndex() {
+    if (_allocations.empty()) {
+      return;
+    }
+    Offset firstChunk = _allocations[0].Address() >> LOG2_PAGE_INDEX_CHUNK_SIZE;
+    Offset lastChunk = firstChunk;
+    _envelopeBase = _allocations[0].Address();
+    for (const Allocation& allocation : _allocations) {
+      if (allocation.Size() != 0) {
+        Offset lastByte = allocation.Address() + allocation.Size() - 1;
+        Offset lastByteChunk = lastByte >> LOG2_PAGE_INDEX_CHUNK_SIZE;
+        if (lastChunk < lastByteChunk) {
+          lastChunk = lastByteChunk;
+        }
+        if (_envelopeSize < lastByte - _envelopeBase + 1) {
+          _envelopeSize = lastByte - _envelopeBase + 1;
+        }
+      }
+    }
+    if (lastChunk - firstChunk >= MAX_PAGE_INDEX_CHUNKS) {
+      /*
+       * The allocations are too sparse for the index to be practical, so
+       * PagedAllocationIndexOf will just use AllocationIndexOf.
+       */
+      return;
+    }
+    _firstChunk = firstChunk;
+    _pageIndexChunks.resize(lastChunk - firstChunk + 1);
+
+    for (const Allocation& allocation : _allocations) {
+      if (allocation.Size() == 0) {
+        continue;
+      }
+      Offset firstPage = allocation.Address() >> LOG2_PAGE_INDEX_PAGE_SIZE;
+      Offset lastPage = (allocation.Address() + allocation.Size() - 1) >>
+                        LOG2_PAGE_INDEX_PAGE_SIZE;
+      for (Offset page = firstPage; page <= lastPage; page++) {
+        Offset chunkIndex = (page / PAGES_PER_CHUNK) - firstChunk;
+        std::unique_ptr<PageIndexChunk>& chunk = _pageIndexChunks[chunkIndex];
+        if (chunk == nullptr) {
+          chunk.reset(new PageIndexChunk());
+        }
+        size_t pageInChunk = page & (PAGES_PER_CHUNK - 1);
+        chunk->_hasAllocations[pageInChunk / 64] |= ((uint64_t)1)
+                                                    << (pageInChunk % 64);
+      }
+    }
+
+    size_t numAllocations = _allocations.size();
+    size_t numStartingBefore = 0;
+    for (size_t chunkIndex = 0; chunkIndex < _pageIndexChunks.size();
+         chunkIndex++) {
+      PageIndexChunk* chunk = _pageIndexChunks[chunkIndex].get();
+      if (chunk == nullptr) {
+        continue;
+      }
+      Offset pageAddress = (firstChunk + chunkIndex)
+                           << LOG2_PAGE_INDEX_CHUNK_SIZE;
+      for (size_t page = 0; page <= PAGES_PER_CHUNK; page++) {
+        while (numStartingBefore < numAllocations &&
+               _allocations[numStartingBefore].Address() < pageAddress) {
+          numStartingBefore++;
+        }
+        if (page == PAGES_PER_CHUNK && pageAddress == 0) {
+          /*
+           * The chunk is the last one in the address space, so all the
+           * allocations start before the end of it.
+           */
+          numStartingBefore = numAllocations;
+        }
+        chunk->_numStartingBefore[page] = numStartingBefore;
+        pageAddress += ((Offset)1) << LOG2_PAGE_INDEX_PAGE_SIZE;
+      }
+    }
+  }
+
+  /*
+   * Allocations are resolved in increasing order of address and, for
+   * allocations at the same address, decreasing order of size, so that any
+   * wrapper precedes the allocations it contains.
+   */
+  static bool Precedes(const FoundAllocation& left,
+                       const FoundAllocation& right) {
+    return left._address < right._address ||
+           (left._address == right._address && left._size > right._size);
+  }
+
+  void ConsumeFoundAllocation(const FoundAllocation& found,
+                              size_t finderIndex) {
+    Offset address = found._address;
+    Offset size = found._size;
     Offset limit = address + size;
-    bool isUsed = finder->NextIsUsed();
     bool isWrapped = false;
     while (!_limits.empty() && limit > _limits.back().second) {
       if (address < _limits.back().second) {
@@ -383,7 +627,6 @@ class Directory {
                   << ")\n... due to overlap with allocation at [0x" << std::hex
                   << _allocations[_limits.back().first].Address() << ", 0x"
                   << _limits.back().second << ")\n";
-        finder->Advance();
         return;
       }
       _limits.pop_back();
@@ -425,178 +668,55 @@ class Directory {
       }
     }
     _limits.emplace_back(_allocations.size(), limit);
-    _allocations.emplace_back(address, size, isUsed, finderIndex, isWrapped);
+    _allocations.emplace_back(address, size, found._isUsed, finderIndex,
+                              isWrapped);
     if (_maxAllocationSize < size) {
       _maxAllocationSize = size;
     }
-    finder->Advance();
-  }
-  void AppendRemainingAllocationsFromFinder(size_t finderIndex) {
-    Finder* finder = _indexToFinder[finderIndex];
-    while (!(finder->Finished())) {
-      ConsumeCurrentAllocation(finderIndex, finder);
-    }
-  }
-  void AppendRemainingAllocationsFromFinders(size_t finderIndex0,
-                                             size_t finderIndex1) {
-    Finder* finder0 = _indexToFinder[finderIndex0];
-    Offset address0 = finder0->NextAddress();
-    Offset size0 = finder0->NextSize();
-
-    Finder* finder1 = _indexToFinder[finderIndex1];
-    Offset address1 = finder1->NextAddress();
-    Offset size1 = finder1->NextSize();
-
-    while (true) {
-      if (address0 < address1 || (address0 == address1 && size0 > size1)) {
-        ConsumeCurrentAllocation(finderIndex0, finder0);
-        if (finder0->Finished()) {
-          AppendRemainingAllocationsFromFinder(finderIndex1);
-          return;
-        }
-        address0 = finder0->NextAddress();
-        size0 = finder0->NextSize();
-      } else {
-        ConsumeCurrentAllocation(finderIndex1, finder1);
-        if (finder1->Finished()) {
-          AppendRemainingAllocationsFromFinder(finderIndex0);
-          return;
-        }
-        address1 = finder1->NextAddress();
-        size1 = finder1->NextSize();
-      }
-    }
   }
 
-  void Place(Offset address, Offset size, size_t finderIndex,
-             std::vector<size_t>& activeFinders, size_t heapIndex) {
-    Offset heapSize = activeFinders.size();
-    Offset leftChild = 2 * heapIndex + 1;
-    Offset rightChild = leftChild + 1;
-    while (rightChild < heapSize) {
-      size_t leftFinderIndex = activeFinders[leftChild];
-      Finder* leftFinder = _indexToFinder[leftFinderIndex];
-      Offset leftAddress = leftFinder->NextAddress();
-      Offset leftSize = leftFinder->NextSize();
-      size_t rightFinderIndex = activeFinders[rightChild];
-      Finder* rightFinder = _indexToFinder[rightFinderIndex];
-      Offset rightAddress = rightFinder->NextAddress();
-      Offset rightSize = rightFinder->NextSize();
-      if (leftAddress < rightAddress ||
-          (leftAddress == rightAddress && leftSize > rightSize)) {
-        if (address < leftAddress ||
-            (address == leftAddress && address >= leftSize)) {
-          activeFinders[heapIndex] = finderIndex;
-          return;
-        }
-        activeFinders[heapIndex] = leftFinderIndex;
-        heapIndex = leftChild;
-      } else {
-        if (address < rightAddress ||
-            (address == rightAddress && address >= rightSize)) {
-          activeFinders[heapIndex] = finderIndex;
-          return;
+  /*
+   * Merge the spans reported by the given finders.  At each step, the span
+   * with the first pending allocation, favoring the finder added last in
+   * case of a tie, is found and its allocations are appended for as long as
+   * they precede the first pending allocation of every other span.  For
+   * allocations that are not interleaved with those of other finders, this
+   * means a whole span at a time.
+   */
+  void AppendRemainingAllocations(std::vector<FinderSpan>& activeSpans) {
+    while (!activeSpans.empty()) {
+      size_t numActiveSpans = activeSpans.size();
+      size_t first = 0;
+      size_t second = numActiveSpans;
+      for (size_t i = 1; i < numActiveSpans; i++) {
+        const FoundAllocation& candidate = activeSpans[i].Current();
+        if (!Precedes(activeSpans[first].Current(), candidate)) {
+          second = first;
+          first = i;
+        } else if (second == numActiveSpans ||
+                   !Precedes(activeSpans[second].Current(), candidate)) {
+          second = i;
         }
-        activeFinders[heapIndex] = rightFinderIndex;
-        heapIndex = rightChild;
       }
-    }
-    if (leftChild < heapSize) {
-      size_t leftFinderIndex = activeFinders[leftChild];
-      Finder* leftFinder = _indexToFinder[leftFinderIndex];
-      Offset leftAddress = leftFinder->NextAddress();
-      if ((address < leftAddress ||
-           (address == leftAddress && size > leftFinder->NextSize()))) {
-        activeFinders[heapIndex] = finderIndex;
-      } else {
-        activeFinders[heapIndex] = leftFinderIndex;
-        activeFinders[leftChild] = finderIndex;
-      }
-    } else {
-      activeFinders[heapIndex] = finderIndex;
-    }
-  }
-
-  void AppendRemainingAllocationsFromFinders(
-      std::vector<size_t>& activeFinders) {
-    size_t numActiveFinders = activeFinders.size();
-    std::make_heap(activeFinders.begin(), activeFinders.end(),
-                   [this](const size_t left, const size_t right) {
-                     Finder* leftFinder = this->_indexToFinder[left];
-                     Finder* rightFinder = this->_indexToFinder[right];
-                     Offset leftAddress = leftFinder->NextAddress();
-                     Offset rightAddress = rightFinder->NextAddress();
-                     return (leftAddress > rightAddress) ||
-                            ((leftAddress == rightAddress) &&
-                             leftFinder->NextSize() < rightFinder->NextSize());
-                   });
-    size_t topFinderIndex = activeFinders[0];
-    Finder* topFinder = _indexToFinder[topFinderIndex];
-    Offset topAddress = topFinder->NextAddress();
-    Offset topSize = topFinder->NextSize();
-
-    Finder* leftFinder = _indexToFinder[activeFinders[1]];
-    Offset leftAddress = leftFinder->NextAddress();
-    Offset leftSize = leftFinder->NextSize();
-
-    Finder* rightFinder = _indexToFinder[activeFinders[2]];
-    Offset rightAddress = rightFinder->NextAddress();
-    Offset rightSize = rightFinder->NextSize();
-
-    bool leftIsNext = (leftAddress < rightAddress) ||
-                      (leftAddress == rightAddress && leftSize >= rightSize);
-    Offset nextAddress = leftIsNext ? leftAddress : rightAddress;
-    Offset nextSize = leftIsNext ? leftSize : rightSize;
-
-    while (true) {
-      ConsumeCurrentAllocation(topFinderIndex, topFinder);
-      if (topFinder->Finished()) {
-        size_t lastFinderIndex = activeFinders[numActiveFinders - 1];
-        activeFinders.pop_back();
-        if (--numActiveFinders == 2) {
-          AppendRemainingAllocationsFromFinders(lastFinderIndex,
-                                                activeFinders[1]);
-          return;
-        }
-        activeFinders[0] = lastFinderIndex;
-        topFinderIndex = lastFinderIndex;
-        topFinder = _indexToFinder[topFinderIndex];
+      FinderSpan& span = activeSpans[first];
+      size_t finderIndex = span.FinderIndex();
+      if (second == numActiveSpans) {
+        do {
+          while (!span.Exhausted()) {
+            ConsumeFoundAllocation(span.Current(), finderIndex);
+            span.Skip();
+          }
+        } while (span.Refill());
+        activeSpans.clear();
+        return;
       }
-      topAddress = topFinder->NextAddress();
-      topSize = topFinder->NextSize();
-      if (nextAddress < topAddress ||
-          (nextAddress == topAddress && nextSize > topSize)) {
-        /*
-         * The top finder is no longer in the correct place.  This is expected
-         * not to happen all that often because many consecutive allocations
-         * will be from the same finder.
-         */
-        Offset address = topAddress;
-        Offset size = topSize;
-        Offset finderIndex = topFinderIndex;
-        topAddress = nextAddress;
-        topSize = nextSize;
-        if (leftIsNext) {
-          topFinderIndex = activeFinders[1];
-          activeFinders[0] = topFinderIndex;
-          topFinder = leftFinder;
-          Place(address, size, finderIndex, activeFinders, 1);
-          leftFinder = _indexToFinder[activeFinders[1]];
-          leftAddress = leftFinder->NextAddress();
-          leftSize = leftFinder->NextSize();
-        } else {
-          topFinderIndex = activeFinders[2];
-          activeFinders[0] = topFinderIndex;
-          topFinder = rightFinder;
-          Place(address, size, finderIndex, activeFinders, 2);
-          rightFinder = _indexToFinder[activeFinders[2]];
-          rightAddress = rightFinder->NextAddress();
-          rightSize = rightFinder->NextSize();
-        }
-        leftIsNext = (leftAddress < rightAddress) ||
-                     (leftAddress == rightAddress && leftSize >= rightSize);
-        nextAddress = leftIsNext ? leftAddress : rightAddress;
-        nextSize = leftIsNext ? leftSize : rightSize;
+      FoundAllocation bound = activeSpans[second].Current();
+      do {
+        ConsumeFoundAllocation(span.Current(), finderIndex);
+        span.Skip();
+      } while (!span.Exhausted() && Precedes(span.Current(), bound));
+      if (span.Exhausted() && !span.Refill()) {
+        activeSpans.erase(activeSpans.begin() + first);
       }
     }
   }
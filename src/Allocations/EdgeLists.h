@@ -0,0 +1,583 @@
+// Copyright (c) 2021 VMware, Inc. All Rights Reserved.
+// SPDX-License-Identifier: GPL-2.0
+
+#pragma once
+#include <stdint.h>
+#include <algorithm>
+#include <atomic>
+#include <iostream>
+#include <memory>
+#include <vector>
+#include "../AnalysisCache.h"
+#include "../SpillableBuffer.h"
+#include "../WorkerThreads.h"
+
+namespace chap {
+namespace Allocations {
+/*
+ * This holds what is common to all the instantiations of EdgeLists,
+ * including the choice of form for new edge lists, which is normally made
+ * just once, based on the command line.
+ */
+class EdgeListsBase {
+ public:
+  static bool IsCompactByDefault() { return CompactByDefault(); }
+  static void SetCompactByDefault(bool compact) {
+    CompactByDefault() = compact;
+  }
+
+  static void AppendVarint(uint64_t value, std::vector<uint8_t>& bytes) {
+    while (value >= 0x80) {
+      bytes.push_back((uint8_t)(value | 0x80));
+      value >>= 7;
+    }
+    bytes.push_back((uint8_t)(value));
+  }
+
+  static uint64_t ReadVarint(const uint8_t*& next) {
+    uint64_t value = *next & 0x7f;
+    for (unsigned int shift = 7; (*(next++) & 0x80) != 0; shift += 7) {
+      value |= ((uint64_t)(*next & 0x7f)) << shift;
+    }
+    return value;
+  }
+
+  /*
+   * Read a variable length integer that must end before the given limit,
+   * returning false if it does not.
+   */
+  static bool ReadVarint(const uint8_t*& next, const uint8_t* limit,
+                         uint64_t& value) {
+    value = 0;
+    for (unsigned int shift = 0; next < limit && shift < 64; shift += 7) {
+      uint8_t byte = *(next++);
+      value |= ((uint64_t)(byte & 0x7f)) << shift;
+      if ((byte & 0x80) == 0) {
+        return true;
+      }
+    }
+    return false;
+  }
+
+ protected:
+  /*
+   * Return a number not returned before, used to tell apart the contents
+   * of any lists that have ever existed in the process.
+   */
+  static uint64_t NewContentsId() {
+    static std::atomic<uint64_t> nextId(1);
+    return nextId++;
+  }
+
+ private:
+  static bool& CompactByDefault() {
+    static bool compact = false;
+    return compact;
+  }
+};
+
+/*
+ * An EdgeLists holds, for each node of a graph, the indices of the nodes
+ * at the other ends of the edges in one direction, in increasing order and
+ * without duplicates.
+ *
+ * The plain form keeps all the lists in a single array of indices, with a
+ * second array giving the position of the start of each list.  The compact
+ * form keeps, for each list, the number of indices and the number of bytes
+ * used by the remainder of the list, followed by the first index and the
+ * differences between successive indices, all as variable length integers.
+ * Only the position of the start of every NODES_PER_BLOCK-th list is kept,
+ * so finding a list may involve skipping the lists before it in the block.
+ * The compact form usually takes a fraction of the space of the plain form,
+ * which matters for cores with very large numbers of references, at the
+ * cost of decoding each list as it is visited.
+ */
+template <typename Index, typename EdgeIndex>
+class EdgeLists : public EdgeListsBase {
+ public:
+  static constexpr Index NODES_PER_BLOCK = 16;
+
+  /*
+   * An Iterator visits the indices in a single list, and can be compared
+   * only with iterators for the same list.  A default constructed Iterator
+   * is past the end of any list.
+   */
+  class Iterator {
+   public:
+    Iterator()
+        : _plain(nullptr), _encoded(nullptr), _value(0), _remaining(0) {}
+
+    Index operator*() const { return (_plain != nullptr) ? *_plain : _value; }
+
+    Iterator& operator++() {
+      --_remaining;
+      if (_plain != nullptr) {
+        ++_plain;
+      } else if (_remaining != 0) {
+        _value += (Index)(ReadVarint(_encoded));
+      }
+      return *this;
+    }
+
+    Iterator operator++(int) {
+      Iterator original(*this);
+      ++(*this);
+      return original;
+    }
+
+    bool operator==(const Iterator& other) const {
+      return _remaining == other._remaining;
+    }
+    bool operator!=(const Iterator& other) const {
+      return _remaining != other._remaining;
+    }
+    bool operator<(const Iterator& other) const {
+      return _remaining > other._remaining;
+    }
+    EdgeIndex operator-(const Iterator& other) const {
+      return other._remaining - _remaining;
+    }
+
+   private:
+    friend class EdgeLists;
+    Iterator(const Index* plain, EdgeIndex count)
+        : _plain(plain), _encoded(nullptr), _value(0), _remaining(count) {}
+    Iterator(const uint8_t* encoded, EdgeIndex count)
+        : _plain(nullptr), _encoded(encoded), _value(0), _remaining(count) {
+      if (_remaining != 0) {
+        _value = (Index)(ReadVarint(_encoded));
+      }
+    }
+    const Index* _plain;
+    const uint8_t* _encoded;
+    Index _value;
+    EdgeIndex _remaining;
+  };
+
+  /*
+   * A Run accepts the lists for consecutive nodes, starting at a multiple
+   * of NODES_PER_BLOCK, so that separate runs can be filled in parallel
+   * and then combined.
+   */
+  class Run {
+   public:
+    Run(EdgeLists& lists, Index firstNode)
+        : _lists(lists),
+          _firstNode(firstNode),
+          _nextNode(firstNode),
+          _numEdges(0) {
+      if ((firstNode % NODES_PER_BLOCK) != 0) {
+        std::cerr << "Fatal error: edge list run is not aligned to a block.\n";
+        abort();
+      }
+    }
+
+    Run(const Run&) = delete;
+    Run& operator=(const Run&) = delete;
+
+    /*
+     * Append the list for the next node, which must be in increasing order
+     * and without duplicates.
+     */
+    void Append(const Index* first, const Index* limit) {
+      EdgeIndex count = limit - first;
+      if (_lists._compact) {
+        if ((_nextNode % NODES_PER_BLOCK) == 0) {
+          _blockStarts.push_back(_encoded.Size());
+        }
+        _header.clear();
+        _deltas.clear();
+        AppendVarint(count, _header);
+        if (count != 0) {
+          Index previous = 0;
+          for (const Index* next = first; next != limit; ++next) {
+            AppendVarint(*next - previous, _deltas);
+            previous = *next;
+          }
+          AppendVarint(_deltas.size(), _header);
+        }
+        _encoded.Append(_header.data(), _header.data() + _header.size());
+        _encoded.Append(_deltas.data(), _deltas.data() + _deltas.size());
+      } else {
+        _lists._first[_nextNode] = count;
+        _plain.Append(first, limit);
+      }
+      _nextNode++;
+      _numEdges += count;
+    }
+
+   private:
+    friend class EdgeLists;
+    EdgeLists& _lists;
+    const Index _firstNode;
+    Index _nextNode;
+    EdgeIndex _numEdges;
+    SpillableBuffer<Index> _plain;
+    SpillableBuffer<uint8_t> _encoded;
+    std::vector<uint64_t> _blockStarts;
+    std::vector<uint8_t> _header;
+    std::vector<uint8_t> _deltas;
+  };
+
+  EdgeLists(Index numNodes)
+      : _compact(IsCompactByDefault()),
+        _numNodes(numNodes),
+        _numEdges(0),
+        _contentsId(NewContentsId()) {
+    if (!_compact) {
+      _first.resize(_numNodes + 1, 0);
+    }
+  }
+
+  bool IsCompact() const { return _compact; }
+  EdgeIndex NumEdges() const { return _numEdges; }
+
+  Iterator Begin(Index node) const {
+    if (!_compact) {
+      return Iterator(_plain.data() + _first[node],
+                      _first[node + 1] - _first[node]);
+    }
+    const uint8_t* next =
+        _encoded.data() + _blockStarts[node / NODES_PER_BLOCK];
+    for (Index skipped = node % NODES_PER_BLOCK; skipped != 0; --skipped) {
+      if (ReadVarint(next) != 0) {
+        uint64_t numBytes = ReadVarint(next);
+        next += numBytes;
+      }
+    }
+    EdgeIndex count = ReadVarint(next);
+    if (count != 0) {
+      ReadVarint(next);
+    }
+    return Iterator(next, count);
+  }
+
+  bool IsEmpty(Index node) const { return Begin(node) == Iterator(); }
+
+  /*
+   * Provide the bounds of the list for the given node, returning false if
+   * the lists are compact, in which case there is no such array.
+   */
+  bool GetPlain(Index node, const Index** first, const Index** limit) const {
+    if (_compact) {
+      return false;
+    }
+    *first = _plain.data() + _first[node];
+    *limit = _plain.data() + _first[node + 1];
+    return true;
+  }
+
+  /*
+   * Provide the bounds of the list for the given node as an array, in either
+   * form.  Compact lists can only be read in order, so the list is decoded
+   * into a buffer kept for the calling thread, which is reused while that
+   * thread keeps asking about the same list.  This makes a caller that looks
+   * up many values in one large list, such as one per bucket of a hash table,
+   * decode the list just once.  The bounds are valid until the same thread
+   * asks about a different list.
+   */
+  void GetArray(Index node, const Index** first, const Index** limit) const {
+    if (GetPlain(node, first, limit)) {
+      return;
+    }
+    static thread_local DecodedList decoded;
+    if (decoded._contentsId != _contentsId || decoded._node != node) {
+      decoded._contentsId = _contentsId;
+      decoded._node = node;
+      decoded._indices.clear();
+      for (Iterator it = Begin(node); it != Iterator(); ++it) {
+        decoded._indices.push_back(*it);
+      }
+    }
+    *first = decoded._indices.data();
+    *limit = *first + decoded._indices.size();
+  }
+
+  /*
+   * Replace the lists with those from the given runs, which together must
+   * cover all the nodes in order.  Each run is released once it has been
+   * copied.
+   */
+  void Combine(std::vector<std::unique_ptr<Run> >& runs) {
+    Index nextNode = 0;
+    _numEdges = 0;
+    _contentsId = NewContentsId();
+    for (const auto& run : runs) {
+      if (run->_firstNode != nextNode) {
+        std::cerr << "Fatal error: edge list runs are not contiguous.\n";
+        abort();
+      }
+      nextNode = run->_nextNode;
+      _numEdges += run->_numEdges;
+    }
+    if (nextNode != _numNodes) {
+      std::cerr << "Fatal error: edge list runs do not cover all nodes.\n";
+      abort();
+    }
+    if (_compact) {
+      std::vector<uint64_t> runStarts;
+      runStarts.reserve(runs.size());
+      uint64_t numBytes = 0;
+      for (const auto& run : runs) {
+        runStarts.push_back(numBytes);
+        numBytes += run->_encoded.Size();
+      }
+      _encoded.resize(numBytes);
+      _blockStarts.resize((_numNodes + NODES_PER_BLOCK - 1) / NODES_PER_BLOCK +
+                          1);
+      _blockStarts.back() = numBytes;
+      WorkerThreads::Run(runs.size(), [&](size_t runIndex, size_t) {
+        Run& run = *runs[runIndex];
+        uint64_t runStart = runStarts[runIndex];
+        std::copy(run._encoded.Data(),
+                  run._encoded.Data() + run._encoded.Size(),
+                  _encoded.begin() + runStart);
+        size_t firstBlock = run._firstNode / NODES_PER_BLOCK;
+        for (size_t i = 0; i < run._blockStarts.size(); i++) {
+          _blockStarts[firstBlock + i] = runStart + run._blockStarts[i];
+        }
+        runs[runIndex].reset();
+      });
+    } else {
+      /*
+       * Convert values in _first from edge counts to offsets of the first
+       * edges.
+       */
+      EdgeIndex numEdges = 0;
+      for (Index i = 0; i < _numNodes; i++) {
+        EdgeIndex count = _first[i];
+        _first[i] = numEdges;
+        numEdges += count;
+      }
+      _first[_numNodes] = numEdges;
+      _plain.resize(numEdges);
+      WorkerThreads::Run(runs.size(), [&](size_t runIndex, size_t) {
+        Run& run = *runs[runIndex];
+        std::copy(run._plain.Data(), run._plain.Data() + run._plain.Size(),
+                  _plain.begin() + _first[run._firstNode]);
+        runs[runIndex].reset();
+      });
+    }
+    runs.clear();
+  }
+
+  /*
+   * Replace the lists with the reverse of the given lists, which must be
+   * for the same nodes and in the same form.  For each node, the list will
+   * contain the nodes whose lists, in the given lists, contain that node.
+   */
+  void SetToReverseOf(const EdgeLists& forward) {
+    _contentsId = NewContentsId();
+    if (_compact) {
+      SetToCompactReverseOf(forward);
+      return;
+    }
+    for (Index target : forward._plain) {
+      _first[target]++;
+    }
+
+    /*
+     * Convert values in _first from edge counts to offsets just after the
+     * edges for each node.
+     */
+    for (Index i = 0; i < _numNodes; i++) {
+      _first[i + 1] = _first[i] + _first[i + 1];
+    }
+
+    /*
+     * Fill in the edges and convert values in _first to indicate the index
+     * of the first edge for the corresponding node.  Go backwards in the
+     * sources so that the edges for each node are in increasing order.
+     */
+    _numEdges = forward._numEdges;
+    _plain.resize(_numEdges, 0);
+    for (Index i = _numNodes; i > 0;) {
+      --i;
+      EdgeIndex edgeLimit = forward._first[i + 1];
+      for (EdgeIndex edgeIndex = forward._first[i]; edgeIndex < edgeLimit;
+           edgeIndex++) {
+        _plain[--_first[forward._plain[edgeIndex]]] = i;
+      }
+    }
+  }
+
+  void SaveTo(AnalysisCache::Writer& writer) const {
+    writer.Write((uint8_t)(_compact ? 1 : 0));
+    writer.Write(_first);
+    writer.Write(_plain);
+    writer.Write(_blockStarts);
+    writer.Write(_encoded);
+  }
+
+  /*
+   * Replace the lists with ones previously saved for the same number of
+   * nodes and in the same form, returning false and leaving the lists
+   * unchanged if that is not possible.
+   */
+  bool RestoreFrom(AnalysisCache::Reader& reader) {
+    uint8_t compact = 0;
+    std::vector<EdgeIndex> first;
+    std::vector<Index> plain;
+    std::vector<uint64_t> blockStarts;
+    std::vector<uint8_t> encoded;
+    if (!reader.Read(compact) || !reader.Read(first) || !reader.Read(plain) ||
+        !reader.Read(blockStarts) || !reader.Read(encoded)) {
+      return false;
+    }
+    if (compact != (_compact ? 1 : 0)) {
+      return false;
+    }
+    EdgeIndex numEdges = 0;
+    if (_compact) {
+      if (!first.empty() || !plain.empty() ||
+          !CountEncodedEdges(blockStarts, encoded, numEdges)) {
+        return false;
+      }
+    } else {
+      if (first.size() != _numNodes + 1 || first.back() != plain.size() ||
+          !blockStarts.empty() || !encoded.empty()) {
+        return false;
+      }
+      numEdges = plain.size();
+    }
+    _first.swap(first);
+    _plain.swap(plain);
+    _blockStarts.swap(blockStarts);
+    _encoded.swap(encoded);
+    _numEdges = numEdges;
+    _contentsId = NewContentsId();
+    return true;
+  }
+
+ private:
+  struct DecodedList {
+    DecodedList() : _contentsId(0), _node(0) {}
+    uint64_t _contentsId;
+    Index _node;
+    std::vector<Index> _indices;
+  };
+  bool _compact;
+  Index _numNodes;
+  EdgeIndex _numEdges;
+  uint64_t _contentsId;
+  std::vector<EdgeIndex> _first;
+  std::vector<Index> _plain;
+  std::vector<uint64_t> _blockStarts;
+  std::vector<uint8_t> _encoded;
+
+  /*
+   * Build the compact reverse of the given lists in slices of consecutive
+   * nodes, so that only the reversed edges for one slice at a time need be
+   * held as plain indices.  Each slice costs a pass over the given lists, so
+   * the slices are kept large enough that there are only a few of them.
+   */
+  void SetToCompactReverseOf(const EdgeLists& forward) {
+    std::vector<Index> counts(_numNodes, 0);
+    for (Index source = 0; source < _numNodes; source++) {
+      for (Iterator it = forward.Begin(source); it != Iterator(); ++it) {
+        counts[*it]++;
+      }
+    }
+    EdgeIndex maxEdgesPerSlice = forward._numEdges / 4;
+    if (maxEdgesPerSlice < (1 << 20)) {
+      maxEdgesPerSlice = 1 << 20;
+    }
+    std::vector<std::unique_ptr<Run> > runs;
+    std::vector<Index> sources;
+    std::vector<EdgeIndex> limits;
+    for (Index sliceBase = 0; sliceBase < _numNodes;) {
+      Index sliceLimit = sliceBase;
+      EdgeIndex numEdges = 0;
+      do {
+        Index blockLimit = (_numNodes - sliceLimit > NODES_PER_BLOCK)
+                               ? (sliceLimit + NODES_PER_BLOCK)
+                               : _numNodes;
+        for (; sliceLimit < blockLimit; sliceLimit++) {
+          numEdges += counts[sliceLimit];
+        }
+      } while (sliceLimit < _numNodes && numEdges < maxEdgesPerSlice);
+
+      /*
+       * Fill in the sources for each node in the slice, leaving limits[i]
+       * as the offset just past the sources for node sliceBase + i.
+       */
+      limits.assign(sliceLimit - sliceBase, 0);
+      EdgeIndex numBefore = 0;
+      for (Index i = 0; i < sliceLimit - sliceBase; i++) {
+        limits[i] = numBefore;
+        numBefore += counts[sliceBase + i];
+      }
+      sources.resize(numEdges);
+      for (Index source = 0; source < _numNodes; source++) {
+        for (Iterator it = forward.Begin(source); it != Iterator(); ++it) {
+          Index target = *it;
+          if (target >= sliceLimit) {
+            break;
+          }
+          if (target >= sliceBase) {
+            sources[limits[target - sliceBase]++] = source;
+          }
+        }
+      }
+
+      runs.emplace_back(new Run(*this, sliceBase));
+      EdgeIndex base = 0;
+      for (EdgeIndex limit : limits) {
+        runs.back()->Append(sources.data() + base, sources.data() + limit);
+        base = limit;
+      }
+      sliceBase = sliceLimit;
+    }
+    std::vector<Index>().swap(sources);
+    Combine(runs);
+  }
+
+  /*
+   * Check that the given compact lists have a well formed header for every
+   * node, with no list extending past the end of the encoded bytes, and
+   * provide the total number of edges, returning false if not.
+   */
+  bool CountEncodedEdges(const std::vector<uint64_t>& blockStarts,
+                         const std::vector<uint8_t>& encoded,
+                         EdgeIndex& numEdges) const {
+    size_t numBlocks = (_numNodes + NODES_PER_BLOCK - 1) / NODES_PER_BLOCK;
+    if (blockStarts.size() != numBlocks + 1 ||
+        blockStarts.back() != encoded.size() ||
+        (!encoded.empty() && (encoded.back() & 0x80) != 0)) {
+      return false;
+    }
+    const uint8_t* limit = encoded.data() + encoded.size();
+    numEdges = 0;
+    for (size_t block = 0; block < numBlocks; block++) {
+      if (blockStarts[block] > encoded.size()) {
+        return false;
+      }
+      const uint8_t* next = encoded.data() + blockStarts[block];
+      Index blockLimit = (_numNodes - block * NODES_PER_BLOCK > NODES_PER_BLOCK)
+                             ? NODES_PER_BLOCK
+                             : (_numNodes - block * NODES_PER_BLOCK);
+      for (Index i = 0; i < blockLimit; i++) {
+        uint64_t count;
+        uint64_t numBytes;
+        if (!ReadVarint(next, limit, count)) {
+          return false;
+        }
+        if (count == 0) {
+          continue;
+        }
+        if (!ReadVarint(next, limit, numBytes) || numBytes < count ||
+            numBytes > (uint64_t)(limit - next)) {
+          return false;
+        }
+        next += numBytes;
+        numEdges += count;
+      }
+      if (next != encoded.data() + blockStarts[block + 1]) {
+        return false;
+      }
+    }
+    return true;
+  }
+};
+}  // namespace Allocations
+}  // namespace chap
@@ -27,6 +27,7 @@ class ExtendedVisitor {
  public:
   typedef typename Directory<Offset>::AllocationIndex AllocationIndex;
   typedef typename Directory<Offset>::Allocation Allocation;
+  typedef typename Graph<Offset>::EdgeIterator EdgeIterator;
   ExtendedVisitor(
       Commands::Context& context, const ProcessImage<Offset>& processImage,
       const PatternDescriberRegistry<Offset>& patternDescriberRegistry,
@@ -165,6 +166,8 @@ class ExtendedVisitor {
 
     const SignatureDirectory<Offset>& signatureDirectory =
         processImage.GetSignatureDirectory();
+    const SignatureColumn<Offset>& signatureColumn =
+        processImage.GetSignatureColumn();
 
     /*
      * Create the extension rules in the calculated order.
@@ -172,8 +175,8 @@ class ExtendedVisitor {
 
     _rules.reserve(numSpecs);
     for (size_t i = 0; i < numSpecs; i++) {
-      _rules.emplace_back(signatureDirectory, _patternDescriberRegistry,
-                          _addressMap,
+      _rules.emplace_back(signatureDirectory, signatureColumn,
+                          _patternDescriberRegistry, _addressMap,
                           specifications[ruleIndexToArgumentIndex[i]]);
       Rule& rule = _rules.back();
       if (rule._memberSignatureChecker.UnrecognizedSignature()) {
@@ -238,7 +241,7 @@ class ExtendedVisitor {
     ExtensionContext(AllocationIndex memberIndex, size_t ruleIndex,
                      size_t numCandidatesLeft,
                      RuleCheckProgress ruleCheckProgress,
-                     const AllocationIndex* pNextCandidate)
+                     EdgeIterator pNextCandidate)
         : _memberIndex(memberIndex),
           _ruleIndex(ruleIndex),
           _numCandidatesLeft(numCandidatesLeft),
@@ -248,12 +251,18 @@ class ExtendedVisitor {
     size_t _ruleIndex;
     size_t _numCandidatesLeft;
     RuleCheckProgress _ruleCheckProgress;
-    const AllocationIndex* _pNextCandidate;
+    EdgeIterator _pNextCandidate;
   };
 
  public:
+  /*
+   * Visit the given member of the set, and any extensions of it, with the
+   * given visitor, which is normally a Visitor but is a RecordWriter if
+   * the /format switch was used.
+   */
+  template <class SetVisitor>
   void Visit(AllocationIndex memberIndex, const Allocation& allocation,
-             Visitor& visitor) {
+             SetVisitor& visitor) {
     /*
      * If the extended visitor is disabled, just visit members of the set.
      */
@@ -290,8 +299,8 @@ class ExtendedVisitor {
     size_t numCandidatesLeft = 0;
     size_t ruleIndexLimit = _stateToBase[state + 1];
     const Allocation* memberAllocation = &allocation;
-    const AllocationIndex* pNextCandidate = 0;
-    const AllocationIndex* pPastCandidates = 0;
+    EdgeIterator pNextCandidate;
+    EdgeIterator pPastCandidates;
     RuleCheckProgress ruleCheckProgress = RuleCheckProgress::NEW_RULE;
 
     while (true) {
@@ -535,6 +544,7 @@ class ExtendedVisitor {
   };
   struct Rule {
     Rule(const SignatureDirectory<Offset>& directory,
+         const SignatureColumn<Offset>& signatureColumn,
          const PatternDescriberRegistry<Offset>& patternDescriberRegistry,
          const VirtualAddressMap<Offset>& addressMap, const Specification& spec)
         : _offsetInMember(spec._offsetInMember),
@@ -543,10 +553,12 @@ class ExtendedVisitor {
           _useOffsetInExtension(spec._useOffsetInExtension),
           _referenceIsOutgoing(spec._referenceIsOutgoing),
           _extensionMustBeLeaked(spec._extensionMustBeLeaked),
-          _memberSignatureChecker(directory, patternDescriberRegistry,
-                                  addressMap, spec._memberSignature),
-          _extensionSignatureChecker(directory, patternDescriberRegistry,
-                                     addressMap, spec._extensionSignature),
+          _memberSignatureChecker(directory, signatureColumn,
+                                  patternDescriberRegistry, addressMap,
+                                  spec._memberSignature),
+          _extensionSignatureChecker(directory, signatureColumn,
+                                     patternDescriberRegistry, addressMap,
+                                     spec._extensionSignature),
           _baseState(spec._baseState),
           _newState(spec._newState) {}
 
@@ -3,15 +3,23 @@
 
 #pragma once
 #include <algorithm>
-#include <deque>
+#include <memory>
+#include <unordered_set>
+#include "../AnalysisCache.h"
+#include "../CandidateFilter.h"
 #include "../StackRegistry.h"
 #include "../ThreadMap.h"
+#include "../SpillableBuffer.h"
 #include "../VirtualAddressMap.h"
+#include "../WorkerThreads.h"
+#include "AnchorPointTable.h"
 #include "ContiguousImage.h"
 #include "Directory.h"
+#include "EdgeLists.h"
 #include "ExternalAnchorPointChecker.h"
 #include "IndexedDistances.h"
 #include "ObscuredReferenceChecker.h"
+#include "SortedTargetResolver.h"
 
 namespace chap {
 namespace Allocations {
@@ -22,17 +30,19 @@ class Graph {
   typedef typename Directory<Offset>::Allocation Allocation;
   typedef typename Directory<Offset>::AllocationIndex Index;
   typedef Offset EdgeIndex;
+  typedef typename EdgeLists<Index, EdgeIndex>::Iterator EdgeIterator;
+  typedef typename AnchorPointTable<Index, Offset>::Anchors Anchors;
   typedef typename VirtualAddressMap<Offset>::Reader Reader;
   typedef typename VirtualAddressMap<Offset>::NotMapped NotMapped;
 
   class AnchorChainVisitor {
    public:
-    virtual bool VisitStaticAnchorChainHeader(
-        const std::vector<Offset> &staticAddrs, Offset address, Offset size,
-        const char *image) = 0;
-    virtual bool VisitStackAnchorChainHeader(
-        const std::vector<Offset> &stackAddrs, Offset address, Offset size,
-        const char *image) = 0;
+    virtual bool VisitStaticAnchorChainHeader(const Anchors &staticAddrs,
+                                              Offset address, Offset size,
+                                              const char *image) = 0;
+    virtual bool VisitStackAnchorChainHeader(const Anchors &stackAddrs,
+                                             Offset address, Offset size,
+                                             const char *image) = 0;
     virtual bool VisitRegisterAnchorChainHeader(
         const std::vector<std::pair<size_t, const char *> > &anchors,
         Offset address, Offset size, const char *image) = 0;
@@ -45,19 +55,33 @@ class Graph {
         const StackRegistry<Offset> &stackRegistry,
         const std::map<Offset, Offset> &staticAnchorLimits,
         const ExternalAnchorPointChecker<Offset> *externalAnchorPointChecker,
-        const ObscuredReferenceChecker<Offset> *obscuredReferenceChecker)
+        const ObscuredReferenceChecker<Offset> *obscuredReferenceChecker,
+        AnalysisCache::Reader *cachedAnalysis = nullptr)
       : _directory(directory),
         _addressMap(addressMap),
         _threadMap(threadMap),
         _stackRegistry(stackRegistry),
         _externalAnchorPointChecker(externalAnchorPointChecker),
         _obscuredReferenceChecker(obscuredReferenceChecker),
+        _candidateFilter(directory.GetCandidateFilter()),
         _numAllocations(directory.NumAllocations()),
-        _totalEdges(0),
+        _skipKnownZeroPages(
+            !_candidateFilter.Accepts(0) &&
+            (obscuredReferenceChecker == nullptr ||
+             obscuredReferenceChecker->AllocationIndexOf(0) ==
+                 _numAllocations)),
+        _outgoing(_numAllocations),
+        _incoming(_numAllocations),
         _staticAnchorDistances(_numAllocations),
         _stackAnchorDistances(_numAllocations),
         _registerAnchorDistances(_numAllocations),
-        _externalAnchorDistances(_numAllocations) {
+        _externalAnchorDistances(_numAllocations),
+        _staticAnchorPoints(_numAllocations),
+        _stackAnchorPoints(_numAllocations),
+        _registerAnchorPoints(_numAllocations) {
+    if (cachedAnalysis != nullptr && RestoreFrom(*cachedAnalysis)) {
+      return;
+    }
     FindEdges();
     FindStaticAnchorPoints(staticAnchorLimits);
     FindStackAnchorPoints();
@@ -66,54 +90,64 @@ class Graph {
     MarkLeakedChunks();
   }
 
+  /*
+   * Save the edges and the information about anchors, in a form that can
+   * be used by the constructor in place of finding them again.
+   */
+  void SaveTo(AnalysisCache::Writer &writer) const {
+    _outgoing.SaveTo(writer);
+    _incoming.SaveTo(writer);
+    writer.Write(std::vector<uint8_t>(_leaked.begin(), _leaked.end()));
+    _staticAnchorPoints.SaveTo(writer);
+    _stackAnchorPoints.SaveTo(writer);
+    _registerAnchorPoints.SaveTo(writer);
+    _staticAnchorDistances.SaveTo(writer);
+    _stackAnchorDistances.SaveTo(writer);
+    _registerAnchorDistances.SaveTo(writer);
+    _externalAnchorDistances.SaveTo(writer);
+  }
+
   const Directory<Offset> &GetAllocationDirectory() const { return _directory; }
 
   const VirtualAddressMap<Offset> &GetAddressMap() const { return _addressMap; }
 
-  void GetIncoming(Index target, const Index **pFirstIncoming,
-                   const Index **pPastIncoming) const {
-    if (target < _numAllocations) {
-      *pFirstIncoming = &(_incoming[_firstIncoming[target]]);
-      *pPastIncoming = &(_incoming[_firstIncoming[target + 1]]);
-    } else {
-      *pFirstIncoming = (const Index *)(0);
-      *pPastIncoming = (const Index *)(0);
-    }
+  void GetIncoming(Index target, EdgeIterator *pFirstIncoming,
+                   EdgeIterator *pPastIncoming) const {
+    *pFirstIncoming = (target < _numAllocations) ? _incoming.Begin(target)
+                                                 : EdgeIterator();
+    *pPastIncoming = EdgeIterator();
   }
 
-  void GetOutgoing(Index source, const Index **pFirstOutgoing,
-                   const Index **pPastOutgoing) const {
-    if (source < _numAllocations) {
-      *pFirstOutgoing = &(_outgoing[_firstOutgoing[source]]);
-      *pPastOutgoing = &(_outgoing[_firstOutgoing[source + 1]]);
-    } else {
-      *pFirstOutgoing = (const Index *)(0);
-      *pPastOutgoing = (const Index *)(0);
-    }
+  void GetOutgoing(Index source, EdgeIterator *pFirstOutgoing,
+                   EdgeIterator *pPastOutgoing) const {
+    *pFirstOutgoing = (source < _numAllocations) ? _outgoing.Begin(source)
+                                                 : EdgeIterator();
+    *pPastOutgoing = EdgeIterator();
   }
 
   bool HasNoOutgoing(Index source) {
-    return (source >= _numAllocations) ||
-           (_firstOutgoing[source] == _firstOutgoing[source + 1]);
+    return (source >= _numAllocations) || _outgoing.IsEmpty(source);
   }
 
   Index TargetAllocationIndex(Index source, Offset addr) const {
-    if (source < _numAllocations) {
-      EdgeIndex base = _firstOutgoing[source];
-      EdgeIndex limit = _firstOutgoing[source + 1];
-      while (base < limit) {
-        size_t mid = (base + limit) / 2;
-        Index target = _outgoing[mid];
-        const Allocation &allocation = *(_directory.AllocationAt(target));
-        if (addr >= allocation.Address()) {
-          if (addr < allocation.Address() + allocation.Size()) {
-            return target;
-          } else {
-            base = mid + 1;
-          }
+    const Index *first;
+    const Index *limit;
+    if (source >= _numAllocations) {
+      return _numAllocations;
+    }
+    _outgoing.GetArray(source, &first, &limit);
+    while (first < limit) {
+      const Index *mid = first + (limit - first) / 2;
+      Index target = *mid;
+      const Allocation &allocation = *(_directory.AllocationAt(target));
+      if (addr >= allocation.Address()) {
+        if (addr < allocation.Address() + allocation.Size()) {
+          return target;
         } else {
-          limit = mid;
+          first = mid + 1;
         }
+      } else {
+        limit = mid;
       }
     }
     return _numAllocations;
@@ -146,14 +180,11 @@ class Graph {
            _staticAnchorDistances.GetDistance(index) == 1;
   }
 
-  const std::vector<Offset> *GetStaticAnchors(Index index) const {
-    const std::vector<Offset> *result = 0;
+  const Anchors *GetStaticAnchors(Index index) const {
+    const Anchors *result = 0;
     if (index < _numAllocations &&
         _staticAnchorDistances.GetDistance(index) == 1) {
-      AnchorPointMapConstIterator it = _staticAnchorPoints.find(index);
-      if (it != _staticAnchorPoints.end()) {
-        result = &(it->second);
-      }
+      result = _staticAnchorPoints.Find(index);
     }
     return result;
   }
@@ -168,14 +199,11 @@ class Graph {
            _stackAnchorDistances.GetDistance(index) == 1;
   }
 
-  const std::vector<Offset> *GetStackAnchors(Index index) const {
-    const std::vector<Offset> *result = 0;
+  const Anchors *GetStackAnchors(Index index) const {
+    const Anchors *result = 0;
     if (index < _numAllocations &&
         _stackAnchorDistances.GetDistance(index) == 1) {
-      AnchorPointMapConstIterator it = _stackAnchorPoints.find(index);
-      if (it != _stackAnchorPoints.end()) {
-        result = &(it->second);
-      }
+      result = _stackAnchorPoints.Find(index);
     }
     return result;
   }
@@ -196,14 +224,10 @@ class Graph {
     anchors.clear();
     if (index < _numAllocations &&
         _registerAnchorDistances.GetDistance(index) == 1) {
-      AnchorPointMapConstIterator it = _registerAnchorPoints.find(index);
-      if (it != _registerAnchorPoints.end()) {
+      const Anchors *encodedAnchors = _registerAnchorPoints.Find(index);
+      if (encodedAnchors != nullptr) {
         size_t numRegisters = _threadMap.GetNumRegisters();
-        const std::vector<Offset> &encodedAnchors = it->second;
-        for (typename std::vector<Offset>::const_iterator it =
-                 encodedAnchors.begin();
-             it != encodedAnchors.end(); ++it) {
-          Offset anchor = *it;
+        for (Offset anchor : *encodedAnchors) {
           size_t threadNum = anchor / numRegisters;
           const char *regName =
               _threadMap.GetRegisterName(anchor % numRegisters);
@@ -246,9 +270,9 @@ class Graph {
                               const char *image) const {
     if (index < _numAllocations &&
         _staticAnchorDistances.GetDistance(index) == 1) {
-      AnchorPointMapConstIterator it = _staticAnchorPoints.find(index);
-      if (it != _staticAnchorPoints.end()) {
-        return visitor.VisitStaticAnchorChainHeader(it->second, address, size,
+      const Anchors *anchors = _staticAnchorPoints.Find(index);
+      if (anchors != nullptr) {
+        return visitor.VisitStaticAnchorChainHeader(*anchors, address, size,
                                                     image);
       }
     }
@@ -265,9 +289,9 @@ class Graph {
                              const char *image) const {
     if (index < _numAllocations &&
         _stackAnchorDistances.GetDistance(index) == 1) {
-      AnchorPointMapConstIterator it = _stackAnchorPoints.find(index);
-      if (it != _stackAnchorPoints.end()) {
-        return visitor.VisitStackAnchorChainHeader(it->second, address, size,
+      const Anchors *anchors = _stackAnchorPoints.Find(index);
+      if (anchors != nullptr) {
+        return visitor.VisitStackAnchorChainHeader(*anchors, address, size,
                                                    image);
       }
     }
@@ -284,15 +308,11 @@ class Graph {
                                 const char *image) const {
     if (index < _numAllocations &&
         _registerAnchorDistances.GetDistance(index) == 1) {
-      AnchorPointMapConstIterator it = _registerAnchorPoints.find(index);
-      if (it != _registerAnchorPoints.end()) {
+      const Anchors *encodedAnchors = _registerAnchorPoints.Find(index);
+      if (encodedAnchors != nullptr) {
         std::vector<std::pair<size_t, const char *> > anchors;
         size_t numRegisters = _threadMap.GetNumRegisters();
-        const std::vector<Offset> &encodedAnchors = it->second;
-        for (typename std::vector<Offset>::const_iterator it =
-                 encodedAnchors.begin();
-             it != encodedAnchors.end(); ++it) {
-          Offset anchor = *it;
+        for (Offset anchor : *encodedAnchors) {
           size_t threadNum = anchor / numRegisters;
           const char *regName =
               _threadMap.GetRegisterName(anchor % numRegisters);
@@ -373,27 +393,25 @@ class Graph {
     // At this point the starting allocation is not directly anchored under
     // the given anchor type so we are interested in whether there is any
     // indirect anchoring.
-    EdgeIndex edgeIndex = _firstIncoming[index];
-    if (edgeIndex != _firstIncoming[index + 1]) {
+    if (!_incoming.IsEmpty(index)) {
       // There is at least one incoming edge.
-      std::vector<bool> visited;
-      visited.reserve(_numAllocations);
-      visited.resize(_numAllocations, false);
-      for (Index freeIndex = 0; freeIndex < _numAllocations; freeIndex++) {
-        if (!_directory.AllocationAt(freeIndex)->IsUsed()) {
-          visited[freeIndex] = true;
-        }
-      }
+      /*
+       * Only allocations that reference some allocation already on the path
+       * are ever marked as visited, so the cost of explaining a single
+       * allocation depends on the part of the graph near the anchor chains
+       * that lead to it rather than on the total number of allocations.
+       */
+      std::unordered_set<Index> visited;
 
       // The edge target is already considered visited.
-      visited[index] = true;
-      std::vector<std::pair<Index, EdgeIndex> > edgesToVisit;
-      edgesToVisit.push_back(std::make_pair(index, edgeIndex - 1));
+      visited.insert(index);
+      std::vector<std::pair<Index, EdgeIterator> > edgesToVisit;
+      edgesToVisit.push_back(std::make_pair(index, _incoming.Begin(index)));
       while (!edgesToVisit.empty()) {
-        edgeIndex = ++(edgesToVisit.back().second);
+        EdgeIterator &nextIncoming = edgesToVisit.back().second;
         Index targetIndex = edgesToVisit.back().first;
 
-        if (edgeIndex >= _firstIncoming[targetIndex + 1]) {
+        if (nextIncoming == EdgeIterator()) {
           // We have checked for any anchor paths that involve the
           // allocation corresponding to the target index as the target
           // of an edge.
@@ -401,17 +419,16 @@ class Graph {
           continue;
         }
 
-        Index sourceIndex = _incoming[edgeIndex];
-        if (visited[sourceIndex]) {
+        Index sourceIndex = *(nextIncoming++);
+        if (!visited.insert(sourceIndex).second) {
+          continue;
+        }
+        // The graph has both used and free nodes but here we are only
+        // interested in paths involving used nodes.
+        const Allocation *sourceAllocation =
+            _directory.AllocationAt(sourceIndex);
+        if (sourceAllocation == 0 || !sourceAllocation->IsUsed()) {
           continue;
-        } else {
-          // The graph has both used and free nodes but here we are only
-          // interested in paths involving used nodes.
-          visited[sourceIndex] = true;
-          const Allocation *allocation = _directory.AllocationAt(sourceIndex);
-          if (allocation == 0 || !allocation->IsUsed()) {
-            continue;
-          }
         }
 
         Index sourceAnchorDistance = distances.GetDistance(sourceIndex);
@@ -431,7 +448,7 @@ class Graph {
           }
 
           for (typename std::vector<
-                   std::pair<Index, EdgeIndex> >::const_reverse_iterator it =
+                   std::pair<Index, EdgeIterator> >::const_reverse_iterator it =
                    edgesToVisit.rbegin();
                it != edgesToVisit.rend(); ++it) {
             Offset linkIndex = it->first;
@@ -452,8 +469,8 @@ class Graph {
           }
         }
 
-        edgeIndex = _firstIncoming[sourceIndex];
-        edgesToVisit.push_back(std::make_pair(sourceIndex, edgeIndex - 1));
+        edgesToVisit.push_back(
+            std::make_pair(sourceIndex, _incoming.Begin(sourceIndex)));
       }
     }
     return false;
@@ -462,11 +479,9 @@ class Graph {
   bool IsUnreferenced(Index index) const {
     bool isUnreferenced = false;
     if (index < _numAllocations && _leaked[index]) {
-      const Index *pFirstIncomingIndex = &(_incoming[_firstIncoming[index]]);
-      const Index *pPastIncomingIndex = &(_incoming[_firstIncoming[index + 1]]);
       isUnreferenced = true;
-      for (const Index *pIncomingIndex = pFirstIncomingIndex;
-           pIncomingIndex != pPastIncomingIndex; pIncomingIndex++) {
+      for (EdgeIterator pIncomingIndex = _incoming.Begin(index);
+           pIncomingIndex != EdgeIterator(); ++pIncomingIndex) {
         if (_directory.AllocationAt((*pIncomingIndex))->IsUsed()) {
           isUnreferenced = false;
           break;
@@ -480,37 +495,100 @@ class Graph {
   typedef std::vector<Offset> OffsetVector;
   typedef typename OffsetVector::iterator OffsetVectorIterator;
   typedef typename OffsetVector::const_iterator OffsetVectorConstIterator;
-  typedef std::map<Index, OffsetVector> AnchorPointMap;
-  typedef typename AnchorPointMap::iterator AnchorPointMapIterator;
-  typedef typename AnchorPointMap::const_iterator AnchorPointMapConstIterator;
+  typedef AnchorPointTable<Index, Offset> AnchorPoints;
+  typedef typename SortedTargetResolver<Offset>::Candidate Candidate;
+  /*
+   * The number of candidates gathered from the images of consecutive
+   * allocations before they are resolved together, when the candidates are
+   * resolved by merging.
+   */
+  static constexpr size_t MAX_CANDIDATES_PER_MERGE = 0x40000;
+  struct MergeBuffers {
+    std::vector<Candidate> _candidates;
+    std::vector<Candidate> _scratch;
+    std::vector<Candidate> _resolvedByChecker;
+    std::vector<size_t> _sourceStarts;
+  };
   const Directory<Offset> &_directory;
   const AddressMap &_addressMap;
   const ThreadMap<Offset> &_threadMap;
   const StackRegistry<Offset> &_stackRegistry;
   const ExternalAnchorPointChecker<Offset> *_externalAnchorPointChecker;
   const ObscuredReferenceChecker<Offset> *_obscuredReferenceChecker;
+  CandidateFilter<Offset> _candidateFilter;
   Index _numAllocations;
-  EdgeIndex _totalEdges;
-  std::vector<Index> _outgoing;
-  std::vector<Index> _incoming;
-  std::vector<EdgeIndex> _firstOutgoing;
-  std::vector<EdgeIndex> _firstIncoming;
+  /*
+   * This is true if a word that is 0 cannot be a reference to an
+   * allocation, so that pages known to be all zero need not be scanned.
+   */
+  bool _skipKnownZeroPages;
+  EdgeLists<Index, EdgeIndex> _outgoing;
+  EdgeLists<Index, EdgeIndex> _incoming;
   IndexedDistances<Index> _staticAnchorDistances;
   IndexedDistances<Index> _stackAnchorDistances;
   IndexedDistances<Index> _registerAnchorDistances;
   IndexedDistances<Index> _externalAnchorDistances;
   std::vector<bool> _leaked;
-  AnchorPointMap _staticAnchorPoints;
-  AnchorPointMap _stackAnchorPoints;
-  AnchorPointMap _registerAnchorPoints;
+  AnchorPoints _staticAnchorPoints;
+  AnchorPoints _stackAnchorPoints;
+  AnchorPoints _registerAnchorPoints;
   std::map<Index, const char *> _externalAnchorPoints;
 
+  /*
+   * Replace the edges and the information about anchors with what was saved
+   * by SaveTo() for the same allocations, returning false and leaving the
+   * graph unchanged if that is not possible.  External anchor points are
+   * not saved because the reasons for them are not persistent, so nothing
+   * is restored if there is an external anchor point checker.
+   */
+  bool RestoreFrom(AnalysisCache::Reader &reader) {
+    if (_externalAnchorPointChecker != nullptr) {
+      return false;
+    }
+    EdgeLists<Index, EdgeIndex> outgoing(_numAllocations);
+    EdgeLists<Index, EdgeIndex> incoming(_numAllocations);
+    std::vector<uint8_t> leaked;
+    AnchorPoints staticAnchorPoints(_numAllocations);
+    AnchorPoints stackAnchorPoints(_numAllocations);
+    AnchorPoints registerAnchorPoints(_numAllocations);
+    IndexedDistances<Index> staticAnchorDistances(_numAllocations);
+    IndexedDistances<Index> stackAnchorDistances(_numAllocations);
+    IndexedDistances<Index> registerAnchorDistances(_numAllocations);
+    IndexedDistances<Index> externalAnchorDistances(_numAllocations);
+    if (!outgoing.RestoreFrom(reader) || !incoming.RestoreFrom(reader) ||
+        !reader.Read(leaked) ||
+        !staticAnchorPoints.RestoreFrom(reader) ||
+        !stackAnchorPoints.RestoreFrom(reader) ||
+        !registerAnchorPoints.RestoreFrom(reader) ||
+        !staticAnchorDistances.RestoreFrom(reader) ||
+        !stackAnchorDistances.RestoreFrom(reader) ||
+        !registerAnchorDistances.RestoreFrom(reader) ||
+        !externalAnchorDistances.RestoreFrom(reader)) {
+      return false;
+    }
+    if (outgoing.NumEdges() != incoming.NumEdges() ||
+        leaked.size() != _numAllocations) {
+      return false;
+    }
+    std::swap(_outgoing, outgoing);
+    std::swap(_incoming, incoming);
+    _leaked.assign(leaked.begin(), leaked.end());
+    _staticAnchorPoints.Swap(staticAnchorPoints);
+    _stackAnchorPoints.Swap(stackAnchorPoints);
+    _registerAnchorPoints.Swap(registerAnchorPoints);
+    _staticAnchorDistances = staticAnchorDistances;
+    _stackAnchorDistances = stackAnchorDistances;
+    _registerAnchorDistances = registerAnchorDistances;
+    _externalAnchorDistances = externalAnchorDistances;
+    return true;
+  }
+
   /*
    * Attempt to interpret the given target candidate as a reference to
    * an allocation, returning an index for that allocation if so.
    */
-  Index EdgeTargetIndex(Offset targetCandidate) {
-    Index targetIndex = _directory.AllocationIndexOf(targetCandidate);
+  Index EdgeTargetIndex(Offset targetCandidate) const {
+    Index targetIndex = _directory.PagedAllocationIndexOf(targetCandidate);
     if (targetIndex == _numAllocations &&
         _obscuredReferenceChecker != nullptr) {
       targetIndex =
@@ -519,224 +597,284 @@ class Graph {
     return targetIndex;
   }
 
-  void FindEdges() {
-    if (_numAllocations == 0) {
-      return;
+  /*
+   * Call the given visitor with a pointer to each word in [first, limit)
+   * that might be a reference to an allocation.  Values outside of the range
+   * covered by the allocations can be skipped in bulk unless there is a
+   * checker for obscured references, which might be anywhere.
+   */
+  template <typename Visitor>
+  void VisitTargetCandidates(const Offset *first, const Offset *limit,
+                             Visitor visitor) const {
+    if (_obscuredReferenceChecker == nullptr) {
+      _candidateFilter.Visit(first, limit, visitor);
+    } else {
+      for (const Offset *check = first; check < limit; check++) {
+        visitor(check);
+      }
     }
+  }
 
-    Offset maxAllocationSize = _directory.MaxAllocationSize();
-    std::vector<Index> targets;
-    targets.reserve(maxAllocationSize);
-
-    _firstIncoming.reserve(_numAllocations + 1);
-    _firstIncoming.resize(_numAllocations + 1, 0);
-    _firstOutgoing.reserve(_numAllocations + 1);
-    _firstOutgoing.resize(_numAllocations + 1, 0);
+  /*
+   * Call the given visitor with a pointer to each word in [first, limit),
+   * the image of the memory starting at the given address, that might be a
+   * reference to an allocation, skipping any pages known to be all zero if
+   * that cannot change the result.
+   */
+  template <typename Visitor>
+  void VisitImageTargetCandidates(Offset address, const Offset *first,
+                                  const Offset *limit, Visitor visitor) const {
+    Offset numBytes = (Offset)((limit - first) * sizeof(Offset));
+    if (!_skipKnownZeroPages || numBytes < KnownZeroPages::BYTES_PER_PAGE) {
+      VisitTargetCandidates(first, limit, visitor);
+      return;
+    }
+    _addressMap.VisitWordsNotKnownZero(
+        address, first, limit,
+        [&](const Offset *spanFirst, const Offset *spanLimit) {
+          VisitTargetCandidates(spanFirst, spanLimit, visitor);
+        });
+  }
 
+  /*
+   * Fill in the given vector with the indices of all the allocations
+   * referenced by the allocation with the given index, in increasing order
+   * of index and without duplicates.
+   */
+  void FindTargets(ContiguousImage<Offset> &contiguousImage, Index i,
+                   std::vector<Index> &targets) const {
+    contiguousImage.SetIndex(i);
     /*
-     * Count all the edges, but don't store them yet.  At the end of this
-     * first pass, _firstOutgoing[i] will be set correctly to the index of
-     * the first outgoing edge for allocation i in the array _outgoing,
-     * but _firstIncoming[i] will have a temporary value of the number
-     * of incoming edges for allocation i, rather than the correct index
-     * into _incoming.
+     * Note that we find all the edges, regardless of whether the source
+     * or target is used or free.  Code that uses the graph is expected to
+     * check the source and/or the target when one particular usage status
+     * is required.
      */
-    ContiguousImage<Offset> contiguousImage(_addressMap, _directory);
-    Reader reader(_addressMap);
-    for (Index i = 0; i < _numAllocations; i++) {
-      contiguousImage.SetIndex(i);
-      _firstOutgoing[i] = _totalEdges;
-      // const Allocation *allocation = _directory.AllocationAt(i);
-
-      /*
-       * Note that we find all the edges, regardless of whether the source
-       * or target is used or free.  Code that uses the graph is expected to
-       * check the source and/or the target when one particular usage status
-       * is required.
-       */
-      targets.clear();
-      Index prevTarget = _numAllocations;
-      const Offset *offsetLimit = contiguousImage.OffsetLimit();
-      for (const Offset *check = contiguousImage.FirstOffset();
-           check < offsetLimit; check++) {
-        Index target = EdgeTargetIndex(*check);
-        if (target != _numAllocations && target != i && target != prevTarget) {
-          targets.push_back(target);
-          prevTarget = target;
-        }
-      }
-      if (!targets.empty()) {
-        if (targets.size() > 1) {
-          std::sort(targets.begin(), targets.end());
-        }
-        Index prevTarget = _numAllocations;
-        for (Offset target : targets) {
-          if (target != prevTarget) {
-            _firstIncoming[target]++;
-            _totalEdges++;
+    targets.clear();
+    Index prevTarget = _numAllocations;
+    VisitImageTargetCandidates(
+        _directory.AllocationAt(i)->Address(), contiguousImage.FirstOffset(),
+        contiguousImage.OffsetLimit(), [&](const Offset *check) {
+          Index target = EdgeTargetIndex(*check);
+          if (target != _numAllocations && target != i &&
+              target != prevTarget) {
+            targets.push_back(target);
             prevTarget = target;
           }
-        }
-      }
+        });
+    if (targets.size() > 1) {
+      std::sort(targets.begin(), targets.end());
+      targets.erase(std::unique(targets.begin(), targets.end()),
+                    targets.end());
     }
-    _firstOutgoing[_numAllocations] = _totalEdges;
-
-    /*
-     * Convert values in _firstIncoming from incoming edge counts to offsets
-     * just after incoming edges.
-     */
+  }
 
-    for (Index i = 0; i < _numAllocations; i++) {
-      _firstIncoming[i + 1] = _firstIncoming[i] + _firstIncoming[i + 1];
-    }
-    _outgoing.reserve(_totalEdges);
-    _outgoing.resize(_totalEdges, 0);
-    _incoming.reserve(_totalEdges);
-    _incoming.resize(_totalEdges, 0);
+  /*
+   * Append to the given run the outgoing edges of each allocation in
+   * [first, limit), giving the same targets as FindTargets, but resolving
+   * the candidates of many allocations at once with the given resolver.
+   * Candidates outside the envelope of the allocations, and candidates in
+   * the envelope that are in no allocation, are given to the checker for
+   * obscured references, if there is one.  The resolved targets are then
+   * scattered back by source and sorted for each source.
+   */
+  void FindRunTargetsByMerge(const SortedTargetResolver<Offset> &resolver,
+                             ContiguousImage<Offset> &contiguousImage,
+                             Index first, Index limit, MergeBuffers &buffers,
+                             std::vector<Index> &targets,
+                             typename EdgeLists<Index, EdgeIndex>::Run &edges) {
+    std::vector<Candidate> &candidates = buffers._candidates;
+    std::vector<Candidate> &resolvedByChecker = buffers._resolvedByChecker;
+    std::vector<size_t> &sourceStarts = buffers._sourceStarts;
+    Index batchBase = first;
+    while (batchBase < limit) {
+      candidates.clear();
+      resolvedByChecker.clear();
+      Index batchLimit = batchBase;
+      do {
+        contiguousImage.SetIndex(batchLimit);
+        VisitImageTargetCandidates(
+            _directory.AllocationAt(batchLimit)->Address(),
+            contiguousImage.FirstOffset(), contiguousImage.OffsetLimit(),
+            [&](const Offset *check) {
+              Offset value = *check;
+              if (resolver.InEnvelope(value)) {
+                candidates.push_back({value, batchLimit, _numAllocations});
+              } else if (_obscuredReferenceChecker != nullptr) {
+                Index target =
+                    _obscuredReferenceChecker->AllocationIndexOf(value);
+                if (target != _numAllocations) {
+                  resolvedByChecker.push_back({value, batchLimit, target});
+                }
+              }
+            });
+        batchLimit++;
+      } while (batchLimit < limit &&
+               candidates.size() < MAX_CANDIDATES_PER_MERGE);
 
-    /*
-     * Fill in the outgoing and incoming edges and convert values in
-     * _firstIncoming to indicate the index of the first incoming edge
-     * for the corresponding node in _incoming.  Go backwards in the
-     * sources so that the incoming edges in _incoming have subranges
-     * in increasing order of target, where the values in each subrange
-     * are the sources in increasing order.
-     */
+      if (!candidates.empty()) {
+        resolver.Resolve(candidates, buffers._scratch);
+      }
+      if (_obscuredReferenceChecker != nullptr) {
+        for (Candidate &candidate : candidates) {
+          if (candidate._target == _numAllocations) {
+            candidate._target =
+                _obscuredReferenceChecker->AllocationIndexOf(candidate._value);
+          }
+        }
+      }
+      candidates.insert(candidates.end(), resolvedByChecker.begin(),
+                        resolvedByChecker.end());
 
-    for (Index i = _numAllocations; i > 0;) {
-      contiguousImage.SetIndex(--i);
       /*
-       * Note that we find all the edges, regardless of whether the source
-       * or target is used or free.  Code that uses the graph is expected to
-       * check the source and/or the target when one particular usage status
-       * is required.
+       * Scatter the targets by source.  Once this is done, the targets for
+       * the source at offset s in the batch are in
+       * [sourceStarts[s - 1], sourceStarts[s]), taking sourceStarts[-1] as 0.
        */
-      targets.clear();
-      Index prevTarget = _numAllocations;
-      const Offset *offsetLimit = contiguousImage.OffsetLimit();
-      for (const Offset *check = contiguousImage.FirstOffset();
-           check < offsetLimit; check++) {
-        Index target = EdgeTargetIndex(*check);
-        if (target != _numAllocations && target != i && target != prevTarget) {
-          targets.push_back(target);
-          prevTarget = target;
+      Index numSources = batchLimit - batchBase;
+      sourceStarts.assign(numSources, 0);
+      for (const Candidate &candidate : candidates) {
+        if (candidate._target != _numAllocations &&
+            candidate._target != candidate._source) {
+          sourceStarts[candidate._source - batchBase]++;
         }
       }
-      if (!targets.empty()) {
-        if (targets.size() > 1) {
-          std::sort(targets.begin(), targets.end());
-        }
-        Index prevTarget = _numAllocations;
-        EdgeIndex nextOutgoing = _firstOutgoing[i];
-        for (Offset target : targets) {
-          if (target != prevTarget) {
-            _incoming[--_firstIncoming[target]] = i;
-            _outgoing[nextOutgoing++] = target;
-            prevTarget = target;
-          }
+      size_t numTargets = 0;
+      for (size_t &start : sourceStarts) {
+        size_t numForSource = start;
+        start = numTargets;
+        numTargets += numForSource;
+      }
+      targets.resize(numTargets);
+      for (const Candidate &candidate : candidates) {
+        if (candidate._target != _numAllocations &&
+            candidate._target != candidate._source) {
+          targets[sourceStarts[candidate._source - batchBase]++] =
+              candidate._target;
         }
       }
-    }
-  }
-
-  void MarkAnchoredChunks(AnchorPointMap &anchorPoints,
-                          IndexedDistances<Index> &anchorDistance) {
-    std::vector<bool> visited;
-    visited.reserve(_numAllocations);
-    visited.resize(_numAllocations, false);
-    for (Index index = 0; index < _numAllocations; index++) {
-      if (!_directory.AllocationAt(index)->IsUsed()) {
-        visited[index] = true;
-      }
-    }
-    std::deque<Index> toVisit;
-    AnchorPointMapConstIterator itEnd = anchorPoints.end();
-    for (AnchorPointMapConstIterator it = anchorPoints.begin(); it != itEnd;
-         ++it) {
-      Index index = it->first;
-      visited[index] = true;
-      _leaked[index] = false;
-      anchorDistance.SetDistance(index, 1);
-      toVisit.push_back(index);
-    }
-    while (!toVisit.empty()) {
-      Index sourceIndex = toVisit.front();
-      Index newDistance = anchorDistance.GetDistance(sourceIndex) + 1;
-      toVisit.pop_front();
-      EdgeIndex edgeLimit = _firstOutgoing[sourceIndex + 1];
-      for (EdgeIndex edgeIndex = _firstOutgoing[sourceIndex];
-           edgeIndex < edgeLimit; edgeIndex++) {
-        Index targetIndex = _outgoing[edgeIndex];
-        if (!visited[targetIndex]) {
-          visited[targetIndex] = true;
-          _leaked[targetIndex] = false;
-          anchorDistance.SetDistance(targetIndex, newDistance);
-          toVisit.push_back(targetIndex);
+      Index *sourceTargets = targets.data();
+      for (Index s = 0; s < numSources; s++) {
+        Index *sourceLimit = targets.data() + sourceStarts[s];
+        if (sourceLimit - sourceTargets > 1) {
+          std::sort(sourceTargets, sourceLimit);
+          edges.Append(sourceTargets, std::unique(sourceTargets, sourceLimit));
+        } else {
+          edges.Append(sourceTargets, sourceLimit);
         }
+        sourceTargets = sourceLimit;
       }
+      batchBase = batchLimit;
     }
   }
 
-  void MarkAnchoredChunks(std::map<Index, const char *> &anchorPoints,
-                          IndexedDistances<Index> &anchorDistance) {
-    std::vector<bool> visited;
-    visited.reserve(_numAllocations);
-    visited.resize(_numAllocations, false);
-    for (Index index = 0; index < _numAllocations; index++) {
-      if (!_directory.AllocationAt(index)->IsUsed()) {
-        visited[index] = true;
-      }
+  /*
+   * Find all the edges, reading and resolving the image of each allocation
+   * just once.  The allocations are split into runs of consecutive
+   * allocation indices, and each run is scanned by a single worker, which
+   * appends the outgoing edges for each allocation in the run to a separate
+   * EdgeLists::Run.  Combining the runs in order yields _outgoing, and
+   * _incoming is derived from _outgoing.  The runs may be scanned in
+   * parallel, depending on the number of worker threads.
+   *
+   * The candidates are resolved either one at a time, using the page index
+   * if there is one, or a batch at a time, by sorting each batch and
+   * merging it with the allocations, depending on which is expected to be
+   * faster for the directory, as measured by the AllocationLookup
+   * benchmark.
+   */
+  void FindEdges() {
+    typedef typename EdgeLists<Index, EdgeIndex>::Run Run;
+    size_t numWorkers = WorkerThreads::NumWorkersFor(_numAllocations);
+    Index runSize = _numAllocations / (numWorkers * 64);
+    if (runSize < 0x400) {
+      runSize = 0x400;
     }
-    std::deque<Index> toVisit;
-    typename std::map<Index, const char *>::const_iterator itEnd =
-        anchorPoints.end();
-    for (typename std::map<Index, const char *>::const_iterator it =
-             anchorPoints.begin();
-         it != itEnd; ++it) {
-      Index index = it->first;
-      visited[index] = true;
-      _leaked[index] = false;
-      anchorDistance.SetDistance(index, 1);
-      toVisit.push_back(index);
-    }
-    while (!toVisit.empty()) {
-      Index sourceIndex = toVisit.front();
-      Index newDistance = anchorDistance.GetDistance(sourceIndex) + 1;
-      toVisit.pop_front();
-      EdgeIndex edgeLimit = _firstOutgoing[sourceIndex + 1];
-      for (EdgeIndex edgeIndex = _firstOutgoing[sourceIndex];
-           edgeIndex < edgeLimit; edgeIndex++) {
-        Index targetIndex = _outgoing[edgeIndex];
-        if (!visited[targetIndex]) {
-          visited[targetIndex] = true;
-          _leaked[targetIndex] = false;
-          anchorDistance.SetDistance(targetIndex, newDistance);
-          toVisit.push_back(targetIndex);
-        }
-      }
+    runSize -= runSize % EdgeLists<Index, EdgeIndex>::NODES_PER_BLOCK;
+    size_t numRuns = (_numAllocations + runSize - 1) / runSize;
+    std::unique_ptr<SortedTargetResolver<Offset> > resolver;
+    if (SortedTargetResolver<Offset>::IsPreferredFor(_directory)) {
+      resolver.reset(new SortedTargetResolver<Offset>(_directory));
     }
+    std::vector<std::unique_ptr<Run> > runEdges(numRuns);
+    std::vector<std::unique_ptr<ContiguousImage<Offset> > > contiguousImages(
+        numWorkers);
+    std::vector<std::vector<Index> > targets(numWorkers);
+    std::vector<MergeBuffers> mergeBuffers(resolver ? numWorkers : 0);
+    WorkerThreads::Run(numRuns, [&](size_t runIndex, size_t workerIndex) {
+      if (contiguousImages[workerIndex] == nullptr) {
+        contiguousImages[workerIndex].reset(
+            new ContiguousImage<Offset>(_addressMap, _directory));
+        targets[workerIndex].reserve(_directory.MaxAllocationSize());
+      }
+      ContiguousImage<Offset> &contiguousImage = *contiguousImages[workerIndex];
+      std::vector<Index> &workerTargets = targets[workerIndex];
+      Index runBase = runIndex * runSize;
+      Index runLimit = (_numAllocations - runBase > runSize)
+                           ? (runBase + runSize)
+                           : _numAllocations;
+      runEdges[runIndex].reset(new Run(_outgoing, runBase));
+      Run &edges = *runEdges[runIndex];
+      if (resolver) {
+        FindRunTargetsByMerge(*resolver, contiguousImage, runBase, runLimit,
+                              mergeBuffers[workerIndex], workerTargets, edges);
+        return;
+      }
+      for (Index i = runBase; i < runLimit; i++) {
+        FindTargets(contiguousImage, i, workerTargets);
+        edges.Append(workerTargets.data(),
+                     workerTargets.data() + workerTargets.size());
+      }
+    });
+    contiguousImages.clear();
+    targets.clear();
+    mergeBuffers.clear();
+
+    _outgoing.Combine(runEdges);
+    _incoming.SetToReverseOf(_outgoing);
   }
 
+  /*
+   * Find the anchor points in the given range, considering only the words
+   * that are at a multiple of the word size from the start of the range and
+   * are fully contained in a single mapped range in the image.
+   */
   void FindAnchorPoints(Offset rangeBase, Offset rangeEnd,
-                        AnchorPointMap &anchorPoints) {
-    Reader reader(_addressMap);
-    for (Offset anchor = rangeBase; anchor < rangeEnd;
-         anchor += sizeof(Offset)) {
-      try {
-        Offset candidateTarget = reader.ReadOffset(anchor);
-        Index targetIndex = EdgeTargetIndex(candidateTarget);
-        const Allocation *target = _directory.AllocationAt(targetIndex);
-        if ((target != 0) && target->IsUsed()) {
-          AnchorPointMapIterator it = anchorPoints.find(targetIndex);
-          if (it == anchorPoints.end()) {
-            it = anchorPoints
-                     .insert(std::make_pair(targetIndex, std::vector<Offset>()))
-                     .first;
-          }
-          it->second.push_back(anchor);
-        }
-      } catch (NotMapped &) {
+                        AnchorPoints &anchorPoints) {
+    typename AddressMap::const_iterator itEnd = _addressMap.end();
+    for (typename AddressMap::const_iterator itRange =
+             _addressMap.upper_bound(rangeBase);
+         itRange != itEnd && itRange.Base() < rangeEnd; ++itRange) {
+      const char *image = itRange.GetImage();
+      if (image == nullptr) {
+        continue;
+      }
+      Offset base = itRange.Base();
+      Offset limit = itRange.Limit();
+      if (limit > rangeEnd) {
+        limit = rangeEnd;
+      }
+      Offset firstAnchor = rangeBase;
+      if (firstAnchor < base) {
+        firstAnchor += ((base - rangeBase + sizeof(Offset) - 1) /
+                        sizeof(Offset)) *
+                       sizeof(Offset);
+      }
+      if (firstAnchor >= limit) {
+        continue;
       }
+      const Offset *first = (const Offset *)(image + (firstAnchor - base));
+      const Offset *past = first + (limit - firstAnchor) / sizeof(Offset);
+      VisitImageTargetCandidates(
+          firstAnchor, first, past, [&](const Offset *check) {
+            Index targetIndex = EdgeTargetIndex(*check);
+            const Allocation *target = _directory.AllocationAt(targetIndex);
+            if ((target != 0) && target->IsUsed()) {
+              anchorPoints.Add(targetIndex,
+                               firstAnchor + (Offset)((const char *)check -
+                                                      (const char *)first));
+            }
+          });
     }
   }
 
@@ -749,6 +887,7 @@ class Graph {
          it != itEnd; ++it) {
       FindAnchorPoints(it->first, it->second, _staticAnchorPoints);
     }
+    _staticAnchorPoints.Finish();
   }
 
   void FindStackAnchorPoints() {
@@ -770,6 +909,7 @@ class Graph {
                        regionLimit, _stackAnchorPoints);
       return true;
     });
+    _stackAnchorPoints.Finish();
   }
 
   void FindRegisterAnchorPoints() {
@@ -786,19 +926,13 @@ class Graph {
           Index targetIndex = _directory.AllocationIndexOf(candidateTarget);
           const Allocation *target = _directory.AllocationAt(targetIndex);
           if ((target != 0) && target->IsUsed()) {
-            AnchorPointMapIterator itAnchor =
-                _registerAnchorPoints.find(targetIndex);
-            if (itAnchor == _registerAnchorPoints.end()) {
-              itAnchor = _registerAnchorPoints
-                             .insert(std::make_pair(targetIndex,
-                                                    std::vector<Offset>()))
-                             .first;
-            }
-            itAnchor->second.push_back(it->_threadNum * numRegisters + i);
+            _registerAnchorPoints.Add(targetIndex,
+                                      it->_threadNum * numRegisters + i);
           }
         }
       }
     }
+    _registerAnchorPoints.Finish();
   }
 
   void FindExternalAnchorPoints() {
@@ -818,6 +952,243 @@ class Graph {
     }
   }
 
+  /*
+   * The anchor types are static, stack, register and external, in that
+   * order.  A frontier entry is an allocation index and a bit mask of the
+   * anchor types for which the allocation is in the frontier.
+   */
+  static constexpr size_t NUM_ANCHOR_TYPES = 4;
+  typedef std::pair<Index, uint8_t> FrontierEntry;
+  static constexpr size_t FRONTIER_ENTRIES_PER_TASK = 1024;
+  static constexpr size_t BIT_MAP_WORDS_PER_TASK = 256;
+  /*
+   * The next frontier is found bottom-up if the frontier is larger than
+   * 1/BOTTOM_UP_RATIO of what has not been reached, unless the frontier is
+   * smaller than 1/TOP_DOWN_RATIO of the used allocations, counting each
+   * allocation once per anchor type in both cases.
+   */
+  static constexpr size_t BOTTOM_UP_RATIO = 14;
+  static constexpr size_t TOP_DOWN_RATIO = 24;
+
+  /*
+   * Set the distance from the nearest anchor point of each type, where an
+   * anchor point is at distance 1, for every allocation reachable from an
+   * anchor point of that type, and clear the leaked flag for each such
+   * allocation.  Free allocations are not followed unless they are anchor
+   * points.
+   *
+   * All the anchor types are handled together, one distance at a time.
+   * Each step finds the next frontier either top-down, by following the
+   * outgoing edges from the frontier, or bottom-up, by following the
+   * incoming edges to each allocation not yet reached until one from the
+   * frontier is found.  Bottom-up is cheaper when the frontier is large,
+   * because then most outgoing edges lead to allocations already reached.
+   * Either way the frontier is the set of allocations at a given distance,
+   * so the distances are the same as for a breadth first search from the
+   * anchor points of each type.
+   */
+  void MarkAnchoredChunks(const std::vector<Index> *anchorPoints,
+                          IndexedDistances<Index> **anchorDistances) {
+    size_t numWords = (_numAllocations + 63) / 64;
+
+    /*
+     * Free allocations, and any bits past the last allocation, are
+     * considered to be already reached so that they are never added to a
+     * frontier other than as anchor points.
+     */
+    std::vector<uint64_t> unused(numWords, 0);
+    size_t numUsed = 0;
+    for (Index index = 0; index < _numAllocations; index++) {
+      if (_directory.AllocationAt(index)->IsUsed()) {
+        numUsed++;
+      } else {
+        unused[index / 64] |= ((uint64_t)(1)) << (index % 64);
+      }
+    }
+    if ((_numAllocations % 64) != 0) {
+      unused.back() |= ~((((uint64_t)(1)) << (_numAllocations % 64)) - 1);
+    }
+
+    std::vector<uint64_t> reached[NUM_ANCHOR_TYPES];
+    std::vector<uint64_t> inFrontier[NUM_ANCHOR_TYPES];
+    size_t numUnreached[NUM_ANCHOR_TYPES];
+    size_t numInFrontier[NUM_ANCHOR_TYPES];
+    std::vector<FrontierEntry> frontier;
+    for (size_t type = 0; type < NUM_ANCHOR_TYPES; type++) {
+      reached[type] = unused;
+      numUnreached[type] = numUsed;
+      numInFrontier[type] = anchorPoints[type].size();
+      for (Index index : anchorPoints[type]) {
+        uint64_t &word = reached[type][index / 64];
+        uint64_t bit = ((uint64_t)(1)) << (index % 64);
+        if ((word & bit) == 0) {
+          word |= bit;
+          numUnreached[type]--;
+        }
+        anchorDistances[type]->SetDistance(index, 1);
+        frontier.emplace_back(index, 1 << type);
+      }
+    }
+
+    for (Index distance = 2; !frontier.empty(); distance++) {
+      size_t totalInFrontier = 0;
+      size_t totalUnreached = 0;
+      for (size_t type = 0; type < NUM_ANCHOR_TYPES; type++) {
+        totalInFrontier += numInFrontier[type];
+        totalUnreached += numUnreached[type];
+      }
+      bool bottomUp =
+          totalInFrontier * BOTTOM_UP_RATIO > totalUnreached &&
+          totalInFrontier * TOP_DOWN_RATIO >= numUsed * NUM_ANCHOR_TYPES;
+      size_t numTasks =
+          bottomUp ? ((numWords + BIT_MAP_WORDS_PER_TASK - 1) /
+                      BIT_MAP_WORDS_PER_TASK)
+                   : ((frontier.size() + FRONTIER_ENTRIES_PER_TASK - 1) /
+                      FRONTIER_ENTRIES_PER_TASK);
+      size_t numWorkers = WorkerThreads::NumWorkersFor(numTasks);
+      std::vector<std::vector<FrontierEntry> > next(numWorkers);
+      std::vector<size_t> numFound(numWorkers * NUM_ANCHOR_TYPES, 0);
+
+      if (bottomUp) {
+        for (size_t type = 0; type < NUM_ANCHOR_TYPES; type++) {
+          inFrontier[type].assign(numWords, 0);
+        }
+        for (const FrontierEntry &entry : frontier) {
+          for (size_t type = 0; type < NUM_ANCHOR_TYPES; type++) {
+            if ((entry.second & (1 << type)) != 0) {
+              inFrontier[type][entry.first / 64] |= ((uint64_t)(1))
+                                                    << (entry.first % 64);
+            }
+          }
+        }
+        /*
+         * Each task owns a range of words of the bit maps, so the words of
+         * the reached bit maps can be updated without atomic operations.
+         */
+        WorkerThreads::Run(numTasks, [&](size_t taskIndex,
+                                         size_t workerIndex) {
+          std::vector<FrontierEntry> &found = next[workerIndex];
+          size_t *numFoundByType = &numFound[workerIndex * NUM_ANCHOR_TYPES];
+          size_t firstWord = taskIndex * BIT_MAP_WORDS_PER_TASK;
+          size_t limitWord = firstWord + BIT_MAP_WORDS_PER_TASK;
+          if (limitWord > numWords) {
+            limitWord = numWords;
+          }
+          for (size_t wordIndex = firstWord; wordIndex < limitWord;
+               wordIndex++) {
+            uint64_t unreached[NUM_ANCHOR_TYPES];
+            uint64_t anyUnreached = 0;
+            for (size_t type = 0; type < NUM_ANCHOR_TYPES; type++) {
+              unreached[type] = ~reached[type][wordIndex];
+              anyUnreached |= unreached[type];
+            }
+            for (; anyUnreached != 0; anyUnreached &= anyUnreached - 1) {
+              int bitIndex = __builtin_ctzll(anyUnreached);
+              uint64_t bit = ((uint64_t)(1)) << bitIndex;
+              Index target = wordIndex * 64 + bitIndex;
+              uint8_t types = 0;
+              for (size_t type = 0; type < NUM_ANCHOR_TYPES; type++) {
+                if ((unreached[type] & bit) != 0) {
+                  types |= 1 << type;
+                }
+              }
+              uint8_t newTypes = 0;
+              for (EdgeIterator it = _incoming.Begin(target);
+                   types != 0 && it != EdgeIterator(); ++it) {
+                Index source = *it;
+                uint64_t sourceBit = ((uint64_t)(1)) << (source % 64);
+                for (size_t type = 0; type < NUM_ANCHOR_TYPES; type++) {
+                  if ((types & (1 << type)) != 0 &&
+                      (inFrontier[type][source / 64] & sourceBit) != 0) {
+                    types &= ~(1 << type);
+                    newTypes |= 1 << type;
+                    reached[type][wordIndex] |= bit;
+                    numFoundByType[type]++;
+                  }
+                }
+              }
+              if (newTypes != 0) {
+                found.emplace_back(target, newTypes);
+              }
+            }
+          }
+        });
+      } else {
+        /*
+         * Different tasks may reach the same allocation, so each bit is
+         * claimed with an atomic operation on the word that holds it.
+         */
+        WorkerThreads::Run(numTasks, [&](size_t taskIndex,
+                                         size_t workerIndex) {
+          std::vector<FrontierEntry> &found = next[workerIndex];
+          size_t *numFoundByType = &numFound[workerIndex * NUM_ANCHOR_TYPES];
+          size_t firstEntry = taskIndex * FRONTIER_ENTRIES_PER_TASK;
+          size_t limitEntry = firstEntry + FRONTIER_ENTRIES_PER_TASK;
+          if (limitEntry > frontier.size()) {
+            limitEntry = frontier.size();
+          }
+          for (size_t i = firstEntry; i < limitEntry; i++) {
+            uint8_t types = frontier[i].second;
+            for (EdgeIterator it = _outgoing.Begin(frontier[i].first);
+                 it != EdgeIterator(); ++it) {
+              Index target = *it;
+              uint64_t bit = ((uint64_t)(1)) << (target % 64);
+              uint8_t newTypes = 0;
+              for (size_t type = 0; type < NUM_ANCHOR_TYPES; type++) {
+                uint64_t *word = &reached[type][target / 64];
+                if ((types & (1 << type)) != 0 &&
+                    (__atomic_load_n(word, __ATOMIC_RELAXED) & bit) == 0 &&
+                    (__atomic_fetch_or(word, bit, __ATOMIC_RELAXED) & bit) ==
+                        0) {
+                  newTypes |= 1 << type;
+                  numFoundByType[type]++;
+                }
+              }
+              if (newTypes != 0) {
+                found.emplace_back(target, newTypes);
+              }
+            }
+          }
+        });
+      }
+
+      for (size_t type = 0; type < NUM_ANCHOR_TYPES; type++) {
+        numInFrontier[type] = 0;
+        for (size_t worker = 0; worker < numWorkers; worker++) {
+          numInFrontier[type] += numFound[worker * NUM_ANCHOR_TYPES + type];
+        }
+        numUnreached[type] -= numInFrontier[type];
+        if (numInFrontier[type] != 0) {
+          anchorDistances[type]->AllowDistance(distance);
+        }
+      }
+      WorkerThreads::Run(numWorkers, [&](size_t worker, size_t) {
+        for (const FrontierEntry &entry : next[worker]) {
+          for (size_t type = 0; type < NUM_ANCHOR_TYPES; type++) {
+            if ((entry.second & (1 << type)) != 0) {
+              anchorDistances[type]->SetDistance(entry.first, distance);
+            }
+          }
+        }
+      });
+      frontier.clear();
+      for (const std::vector<FrontierEntry> &found : next) {
+        frontier.insert(frontier.end(), found.begin(), found.end());
+      }
+    }
+
+    for (size_t wordIndex = 0; wordIndex < numWords; wordIndex++) {
+      uint64_t anyReached = 0;
+      for (size_t type = 0; type < NUM_ANCHOR_TYPES; type++) {
+        anyReached |= reached[type][wordIndex];
+      }
+      for (anyReached &= ~unused[wordIndex]; anyReached != 0;
+           anyReached &= anyReached - 1) {
+        _leaked[wordIndex * 64 + __builtin_ctzll(anyReached)] = false;
+      }
+    }
+  }
+
   void MarkLeakedChunks() {
     _leaked.reserve(_numAllocations);
     _leaked.resize(_numAllocations, true);
@@ -826,10 +1197,23 @@ class Graph {
         _leaked[i] = false;
       }
     }
-    MarkAnchoredChunks(_staticAnchorPoints, _staticAnchorDistances);
-    MarkAnchoredChunks(_stackAnchorPoints, _stackAnchorDistances);
-    MarkAnchoredChunks(_registerAnchorPoints, _registerAnchorDistances);
-    MarkAnchoredChunks(_externalAnchorPoints, _externalAnchorDistances);
+    std::vector<Index> anchorPoints[NUM_ANCHOR_TYPES];
+    const AnchorPoints *anchorPointTables[] = {
+        &_staticAnchorPoints, &_stackAnchorPoints, &_registerAnchorPoints};
+    for (size_t type = 0; type < 3; type++) {
+      size_t numAnchorPoints = anchorPointTables[type]->NumAnchorPoints();
+      anchorPoints[type].reserve(numAnchorPoints);
+      for (size_t i = 0; i < numAnchorPoints; ++i) {
+        anchorPoints[type].push_back(anchorPointTables[type]->AnchorPoint(i));
+      }
+    }
+    for (const auto &indexAndReason : _externalAnchorPoints) {
+      anchorPoints[3].push_back(indexAndReason.first);
+    }
+    IndexedDistances<Index> *anchorDistances[NUM_ANCHOR_TYPES] = {
+        &_staticAnchorDistances, &_stackAnchorDistances,
+        &_registerAnchorDistances, &_externalAnchorDistances};
+    MarkAnchoredChunks(anchorPoints, anchorDistances);
   }
 };
 }  // namespace Allocations
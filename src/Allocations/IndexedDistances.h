@@ -2,6 +2,7 @@
 // SPDX-License-Identifier: GPL-2.0
 
 #pragma once
+#include "../AnalysisCache.h"
 namespace chap {
 namespace Allocations {
 template <typename Index>
@@ -17,6 +18,24 @@ class IndexedDistances {
   }
 
   void SetDistance(Index index, Index distance) {
+    AllowDistance(distance);
+    if (_distanceBits == 8) {
+      _distances8[index] = distance & 0xFF;
+    } else if (_distanceBits == 16) {
+      _distances16[index] = distance & 0xFFFF;
+    } else {
+      _distances32[index] = distance & 0xFFFFFFFF;
+    }
+  }
+
+  /*
+   * Make sure that the given distance can be stored without widening the
+   * distances.  After this, SetDistance() for distances no larger than the
+   * given one does not change anything other than the distance for the
+   * given index, so it may be called for different indices on different
+   * threads.
+   */
+  void AllowDistance(Index distance) {
     while (distance > _maxDistance) {
       if (_distanceBits == _maxDistanceBits) {
         abort();
@@ -45,13 +64,6 @@ class IndexedDistances {
         abort();
       }
     }
-    if (_distanceBits == 8) {
-      _distances8[index] = distance & 0xFF;
-    } else if (_distanceBits == 16) {
-      _distances16[index] = distance & 0xFFFF;
-    } else {
-      _distances32[index] = distance & 0xFFFFFFFF;
-    }
   }
 
   Index GetDistance(Index index) const {
@@ -64,6 +76,45 @@ class IndexedDistances {
     }
   }
 
+  void SaveTo(AnalysisCache::Writer& writer) const {
+    writer.Write(_distanceBits);
+    writer.Write(_distances8);
+    writer.Write(_distances16);
+    writer.Write(_distances32);
+  }
+
+  /*
+   * Replace the distances with ones previously saved for the same number of
+   * indices, returning false and leaving the distances unchanged if that is
+   * not possible.
+   */
+  bool RestoreFrom(AnalysisCache::Reader& reader) {
+    uint16_t distanceBits = 0;
+    std::vector<uint8_t> distances8;
+    std::vector<uint16_t> distances16;
+    std::vector<uint32_t> distances32;
+    if (!reader.Read(distanceBits) || !reader.Read(distances8) ||
+        !reader.Read(distances16) || !reader.Read(distances32)) {
+      return false;
+    }
+    size_t numDistances = (distanceBits == 8)
+                              ? distances8.size()
+                              : (distanceBits == 16) ? distances16.size()
+                                                     : distances32.size();
+    if ((distanceBits != 8 && distanceBits != 16 && distanceBits != 32) ||
+        numDistances != _numIndices) {
+      return false;
+    }
+    _distanceBits = distanceBits;
+    _maxDistance = (distanceBits == 8)
+                       ? 0xFF
+                       : (distanceBits == 16) ? 0xFFFF : 0xFFFFFFFF;
+    _distances8.swap(distances8);
+    _distances16.swap(distances16);
+    _distances32.swap(distances32);
+    return true;
+  }
+
  private:
   Index _numIndices;
   uint16_t _distanceBits;
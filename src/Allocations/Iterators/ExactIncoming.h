@@ -68,6 +68,7 @@ class ExactIncoming {
   };
   typedef typename Directory<Offset>::AllocationIndex AllocationIndex;
   typedef typename Directory<Offset>::Allocation Allocation;
+  typedef typename Graph<Offset>::EdgeIterator EdgeIterator;
 
   ExactIncoming(const Directory<Offset>& directory, const Graph<Offset>& graph,
                 const VirtualAddressMap<Offset>& addressMap,
@@ -110,8 +111,8 @@ class ExactIncoming {
   const VirtualAddressMap<Offset>& _addressMap;
   AllocationIndex _index;
   AllocationIndex _numAllocations;
-  const AllocationIndex* _pNextIncoming;
-  const AllocationIndex* _pPastIncoming;
+  EdgeIterator _pNextIncoming;
+  EdgeIterator _pPastIncoming;
   Offset _target;
 };
 }  // namespace Iterators
@@ -67,6 +67,7 @@ class FreeOutgoing {
   };
   typedef typename Directory<Offset>::AllocationIndex AllocationIndex;
   typedef typename Directory<Offset>::Allocation Allocation;
+  typedef typename Graph<Offset>::EdgeIterator EdgeIterator;
 
   FreeOutgoing(const Directory<Offset>& directory, const Graph<Offset>& graph,
                AllocationIndex index, AllocationIndex numAllocations)
@@ -96,8 +97,8 @@ class FreeOutgoing {
   const Graph<Offset>& _graph;
   AllocationIndex _index;
   AllocationIndex _numAllocations;
-  const AllocationIndex* _pNextOutgoing;
-  const AllocationIndex* _pPastOutgoing;
+  EdgeIterator _pNextOutgoing;
+  EdgeIterator _pPastOutgoing;
 };
 }  // namespace Iterators
 }  // namespace Allocations
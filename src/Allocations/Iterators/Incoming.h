@@ -65,6 +65,7 @@ class Incoming {
   };
   typedef typename Directory<Offset>::AllocationIndex AllocationIndex;
   typedef typename Directory<Offset>::Allocation Allocation;
+  typedef typename Graph<Offset>::EdgeIterator EdgeIterator;
 
   Incoming(const Directory<Offset>& directory, const Graph<Offset>& graph,
            AllocationIndex index, AllocationIndex numAllocations)
@@ -93,8 +94,8 @@ class Incoming {
   const Graph<Offset>& _graph;
   AllocationIndex _index;
   AllocationIndex _numAllocations;
-  const AllocationIndex* _pNextIncoming;
-  const AllocationIndex* _pPastIncoming;
+  EdgeIterator _pNextIncoming;
+  EdgeIterator _pPastIncoming;
 };
 }  // namespace Iterators
 }  // namespace Allocations
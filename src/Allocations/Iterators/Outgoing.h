@@ -65,6 +65,7 @@ class Outgoing {
   };
   typedef typename Directory<Offset>::AllocationIndex AllocationIndex;
   typedef typename Directory<Offset>::Allocation Allocation;
+  typedef typename Graph<Offset>::EdgeIterator EdgeIterator;
 
   Outgoing(const Directory<Offset>& directory, const Graph<Offset>& graph,
            AllocationIndex index, AllocationIndex numAllocations)
@@ -94,8 +95,8 @@ class Outgoing {
   const Graph<Offset>& _graph;
   AllocationIndex _index;
   AllocationIndex _numAllocations;
-  const AllocationIndex* _pNextOutgoing;
-  const AllocationIndex* _pPastOutgoing;
+  EdgeIterator _pNextOutgoing;
+  EdgeIterator _pPastOutgoing;
 };
 }  // namespace Iterators
 }  // namespace Allocations
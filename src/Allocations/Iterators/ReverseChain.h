@@ -90,6 +90,7 @@ class ReverseChain {
   };
   typedef typename Directory<Offset>::AllocationIndex AllocationIndex;
   typedef typename Directory<Offset>::Allocation Allocation;
+  typedef typename Graph<Offset>::EdgeIterator EdgeIterator;
 
   ReverseChain(const Directory<Offset>& directory, const Graph<Offset>& graph,
                const VirtualAddressMap<Offset>& addressMap,
@@ -111,8 +112,8 @@ class ReverseChain {
       }
       if (target->Size() >= _targetOffset) {
         Offset targetAddress = target->Address();
-        const AllocationIndex* pNextIncoming;
-        const AllocationIndex* pPastIncoming;
+        EdgeIterator pNextIncoming;
+        EdgeIterator pPastIncoming;
         _graph.GetIncoming(_index, &pNextIncoming, &pPastIncoming);
 
         _index = _numAllocations;
@@ -17,9 +17,7 @@ class PatternDescriber {
         _processImage(processImage),
         _addressMap(processImage.GetVirtualAddressMap()),
         _directory(processImage.GetAllocationDirectory()),
-        _graph(processImage.GetAllocationGraph()),
-        _moduleDirectory(processImage.GetModuleDirectory()),
-        _tagHolder(*(processImage.GetAllocationTagHolder())) {}
+        _moduleDirectory(processImage.GetModuleDirectory()) {}
 
   const std::string& GetName() const { return _name; }
 
@@ -35,9 +33,19 @@ class PatternDescriber {
   const ProcessImage<Offset>& _processImage;
   const VirtualAddressMap<Offset>& _addressMap;
   const Directory<Offset>& _directory;
-  const Graph<Offset>* _graph;
   const ModuleDirectory<Offset>& _moduleDirectory;
-  const Allocations::TagHolder<Offset>& _tagHolder;
+
+  /*
+   * The graph and the tags are calculated on first use, so they are not
+   * fetched until a describer needs them.
+   */
+  const Graph<Offset>& GetGraph() const {
+    return *(_processImage.GetAllocationGraph());
+  }
+
+  const Allocations::TagHolder<Offset>& GetTagHolder() const {
+    return *(_processImage.GetAllocationTagHolder());
+  }
 };
 }  // namespace Allocations
 }  // namespace chap
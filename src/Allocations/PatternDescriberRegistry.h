@@ -2,6 +2,7 @@
 // SPDX-License-Identifier: GPL-2.0
 
 #pragma once
+#include <mutex>
 #include "../ProcessImage.h"
 #include "Directory.h"
 #include "Graph.h"
@@ -19,22 +20,15 @@ class PatternDescriberRegistry {
   typedef typename std::multimap<std::string, PatternDescriber<Offset>*>
       DescriberMap;
   PatternDescriberRegistry(const ProcessImage<Offset>& processImage)
-      : _tagHolder(*(processImage.GetAllocationTagHolder())),
-        _numTags(_tagHolder.GetNumTags()) {
-    _tagToDescribers.reserve(_numTags);
-    _tagToDescribers.resize(_numTags);
-  }
+      : _processImage(processImage) {}
 
+  /*
+   * Register the given describer.  The describer is associated with the
+   * corresponding tags only when the tags are first needed, because the
+   * tags are calculated on first use.
+   */
   void Register(PatternDescriber<Offset>& describer) {
-    std::string fullTagName("%");
-    fullTagName.append(describer.GetName());
-    const typename TagHolder<Offset>::TagIndices* indices =
-        _tagHolder.GetTagIndices(fullTagName);
-    if (indices != nullptr) {
-      for (TagIndex tagIndex : *indices) {
-        _tagToDescribers[(size_t)(tagIndex)].push_back(&describer);
-      }
-    }
+    _describers.push_back(&describer);
   }
 
   /*
@@ -46,7 +40,8 @@ class PatternDescriberRegistry {
   void Describe(Commands::Context& context, AllocationIndex index,
                 const Allocation& allocation, bool /* isUnsigned */,
                 bool explain) const {
-    for (auto describer : _tagToDescribers[_tagHolder.GetTagIndex(index)]) {
+    const TagHolder<Offset>& tagHolder = GetTagHolder();
+    for (auto describer : _tagToDescribers[tagHolder.GetTagIndex(index)]) {
       describer->Describe(context, index, allocation, explain);
     }
   }
@@ -57,18 +52,38 @@ class PatternDescriberRegistry {
    */
   const TagIndices* GetTagIndices(const std::string& tagName) const {
     return (!tagName.empty() && tagName[0] == '%')
-               ? _tagHolder.GetTagIndices(tagName)
+               ? GetTagHolder().GetTagIndices(tagName)
                : nullptr;
   }
 
   const TagIndex GetTagIndex(AllocationIndex index) const {
-    return _tagHolder.GetTagIndex(index);
+    return GetTagHolder().GetTagIndex(index);
   }
 
  private:
-  const TagHolder<Offset>& _tagHolder;
-  size_t _numTags;
-  std::vector<std::list<PatternDescriber<Offset>*> > _tagToDescribers;
+  const ProcessImage<Offset>& _processImage;
+  std::vector<PatternDescriber<Offset>*> _describers;
+  mutable std::once_flag _tagToDescribersOnce;
+  mutable std::vector<std::list<PatternDescriber<Offset>*> > _tagToDescribers;
+
+  const TagHolder<Offset>& GetTagHolder() const {
+    const TagHolder<Offset>& tagHolder =
+        *(_processImage.GetAllocationTagHolder());
+    std::call_once(_tagToDescribersOnce, [this, &tagHolder]() {
+      _tagToDescribers.resize(tagHolder.GetNumTags());
+      for (PatternDescriber<Offset>* describer : _describers) {
+        std::string fullTagName("%");
+        fullTagName.append(describer->GetName());
+        const TagIndices* indices = tagHolder.GetTagIndices(fullTagName);
+        if (indices != nullptr) {
+          for (TagIndex tagIndex : *indices) {
+            _tagToDescribers[(size_t)(tagIndex)].push_back(describer);
+          }
+        }
+      }
+    });
+    return tagHolder;
+  }
 };
 }  // namespace Allocations
 }  // namespace chap
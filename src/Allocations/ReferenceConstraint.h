@@ -18,18 +18,20 @@ class ReferenceConstraint {
  public:
   typedef typename Directory<Offset>::AllocationIndex AllocationIndex;
   typedef typename Directory<Offset>::Allocation Allocation;
+  typedef typename Graph<Offset>::EdgeIterator EdgeIterator;
   enum BoundaryType { MINIMUM, MAXIMUM };
   enum ReferenceType { INCOMING, OUTGOING };
   ReferenceConstraint(
       const SignatureDirectory<Offset>& signatureDirectory,
+      const SignatureColumn<Offset>& signatureColumn,
       const PatternDescriberRegistry<Offset>& patternDescriberRegistry,
       const VirtualAddressMap<Offset>& addressMap, const std::string& signature,
       size_t count, bool wantUsed, BoundaryType boundaryType,
       ReferenceType referenceType, const Directory<Offset>& directory,
       const Graph<Offset>& graph)
 
-      : _signatureChecker(signatureDirectory, patternDescriberRegistry,
-                          addressMap, signature),
+      : _signatureChecker(signatureDirectory, signatureColumn,
+                          patternDescriberRegistry, addressMap, signature),
         _count(count),
         _wantUsed(wantUsed),
         _boundaryType(boundaryType),
@@ -44,15 +46,14 @@ class ReferenceConstraint {
   }
   bool Check(AllocationIndex index) const {
     size_t numMatchingEdges = 0;
-    const AllocationIndex* pFirstEdge;
-    const AllocationIndex* pPastEdge;
+    EdgeIterator pFirstEdge;
+    EdgeIterator pPastEdge;
     if (_referenceType == INCOMING) {
       _graph.GetIncoming(index, &pFirstEdge, &pPastEdge);
     } else {
       _graph.GetOutgoing(index, &pFirstEdge, &pPastEdge);
     }
-    for (const AllocationIndex* pEdge = pFirstEdge; pEdge != pPastEdge;
-         pEdge++) {
+    for (EdgeIterator pEdge = pFirstEdge; pEdge != pPastEdge; pEdge++) {
       const Allocation& allocation = *(_directory.AllocationAt(*pEdge));
       if ((allocation.IsUsed() == _wantUsed) &&
           (_signatureChecker.Check(*pEdge, allocation))) {
@@ -3,6 +3,8 @@
 
 #pragma once
 #include <memory>
+#include <mutex>
+#include <vector>
 #include "Directory.h"
 #include "Set.h"
 namespace chap {
@@ -10,18 +12,56 @@ namespace Allocations {
 template <class Offset>
 class SetCache {
  public:
+  /*
+   * A Visited object gives a command exclusive use of a set for tracking
+   * visited allocations for as long as the object exists.  Commands that
+   * run one at a time always get the same set, but commands that run at
+   * the same time, as in batch mode, each get a set of their own.
+   */
+  class Visited {
+   public:
+    Visited(SetCache& setCache)
+        : _setCache(setCache), _set(setCache.AcquireVisited()) {}
+    ~Visited() { _setCache.ReleaseVisited(_set); }
+    Visited(const Visited&) = delete;
+    Visited& operator=(const Visited&) = delete;
+    Set<Offset>& Get() { return *_set; }
+
+   private:
+    SetCache& _setCache;
+    Set<Offset>* _set;
+  };
+
   SetCache(typename Directory<Offset>::AllocationIndex numAllocations)
-      : _numAllocations(numAllocations),
-        _visited(numAllocations),
-        _derived(numAllocations) {}
-  Set<Offset>& GetVisited() { return _visited; }
+      : _numAllocations(numAllocations), _derived(numAllocations) {
+    _visitedSets.emplace_back(new Set<Offset>(numAllocations));
+    _freeVisitedSets.push_back(_visitedSets.back().get());
+  }
   Set<Offset>& GetDerived() { return _derived; }
   const Set<Offset>& GetDerived() const { return _derived; }
 
  private:
   typename Directory<Offset>::AllocationIndex _numAllocations;
-  Set<Offset> _visited;
+  std::mutex _visitedMutex;
+  std::vector<std::unique_ptr<Set<Offset> > > _visitedSets;
+  std::vector<Set<Offset>*> _freeVisitedSets;
   Set<Offset> _derived;
+
+  Set<Offset>* AcquireVisited() {
+    std::lock_guard<std::mutex> lock(_visitedMutex);
+    if (_freeVisitedSets.empty()) {
+      _visitedSets.emplace_back(new Set<Offset>(_numAllocations));
+      return _visitedSets.back().get();
+    }
+    Set<Offset>* visited = _freeVisitedSets.back();
+    _freeVisitedSets.pop_back();
+    return visited;
+  }
+
+  void ReleaseVisited(Set<Offset>* visited) {
+    std::lock_guard<std::mutex> lock(_visitedMutex);
+    _freeVisitedSets.push_back(visited);
+  }
 };
 }  // namespace Allocations
 }  // namespace chap
@@ -5,9 +5,11 @@
 #include <iostream>
 #include <set>
 #include <sstream>
+#include <vector>
 #include "../VirtualAddressMap.h"
 #include "Directory.h"
 #include "PatternDescriberRegistry.h"
+#include "SignatureColumn.h"
 #include "SignatureDirectory.h"
 
 namespace chap {
@@ -16,6 +18,7 @@ template <class Offset>
 class SignatureChecker {
  public:
   typedef typename Directory<Offset>::Allocation Allocation;
+  typedef typename SignatureDirectory<Offset>::SignatureId SignatureId;
   enum CheckType {
     NO_CHECK_NEEDED,         // This signature checker does nothing
     UNRECOGNIZED_SIGNATURE,  // Error code - indicates unknown signature
@@ -27,10 +30,12 @@ class SignatureChecker {
   };
   SignatureChecker(
       const SignatureDirectory<Offset>& directory,
+      const SignatureColumn<Offset>& signatureColumn,
       const PatternDescriberRegistry<Offset>& patternDescriberRegistry,
       const VirtualAddressMap<Offset>& addressMap, const std::string& signature)
       : _checkType(NO_CHECK_NEEDED),
         _directory(directory),
+        _signatureColumn(signatureColumn),
         _patternDescriberRegistry(patternDescriberRegistry),
         _addressMap(addressMap),
         _signature((signature[0] != '%') ? signature : ""),
@@ -78,6 +83,21 @@ class SignatureChecker {
 
     _checkType =
         (_signatures.empty()) ? UNRECOGNIZED_SIGNATURE : SIGNATURE_CHECK;
+
+    /*
+     * If all the requested signatures are known, as is the case unless a
+     * number that is not a signature was given, the check can be made
+     * using the signature column.
+     */
+    _signatureIdMatches.assign(_directory.SignatureIdLimit(), false);
+    for (Offset requested : _signatures) {
+      SignatureId signatureId = _directory.GetSignatureId(requested);
+      if (signatureId == SignatureDirectory<Offset>::NO_SIGNATURE_ID) {
+        _signatureIdMatches.clear();
+        break;
+      }
+      _signatureIdMatches[signatureId] = true;
+    }
   }
   bool UnrecognizedSignature() const {
     return _checkType == UNRECOGNIZED_SIGNATURE;
@@ -97,9 +117,19 @@ class SignatureChecker {
       case UNRECOGNIZED_PATTERN:
         return false;
       case PATTERN_CHECK:
+        return _tagIndices->find(_patternDescriberRegistry.GetTagIndex(
+                   index)) != _tagIndices->end();
       case UNSIGNED_ONLY:
+        return _signatureColumn[index] ==
+               SignatureDirectory<Offset>::NO_SIGNATURE_ID;
       case UNRECOGNIZED_ONLY:
+        return _signatureColumn[index] ==
+                   SignatureDirectory<Offset>::NO_SIGNATURE_ID &&
+               _patternDescriberRegistry.GetTagIndex(index) == 0;
       case SIGNATURE_CHECK:
+        if (!_signatureIdMatches.empty()) {
+          return _signatureIdMatches[_signatureColumn[index]];
+        }
         const char* image;
         Offset numBytesFound =
             _addressMap.FindMappedMemoryImage(allocation.Address(), &image);
@@ -111,21 +141,8 @@ class SignatureChecker {
            */
           size = numBytesFound;
         }
-
-        if (_checkType == PATTERN_CHECK) {
-          return _tagIndices->find(_patternDescriberRegistry.GetTagIndex(
-                     index)) != _tagIndices->end();
-        } else if (_checkType == UNSIGNED_ONLY) {
-          return ((size < sizeof(Offset)) ||
-                  !_directory.IsMapped(*((Offset*)image)));
-        } else if (_checkType == UNRECOGNIZED_ONLY) {
-          return (((size < sizeof(Offset)) ||
-                   !_directory.IsMapped(*((Offset*)image)))) &&
-                 (_patternDescriberRegistry.GetTagIndex(index) == 0);
-        } else {
-          return ((size >= sizeof(Offset)) &&
-                  !(_signatures.find(*((Offset*)image)) == _signatures.end()));
-        }
+        return ((size >= sizeof(Offset)) &&
+                !(_signatures.find(*((Offset*)image)) == _signatures.end()));
     }
     return false;
   }
@@ -133,11 +150,13 @@ class SignatureChecker {
  private:
   enum CheckType _checkType;
   const SignatureDirectory<Offset>& _directory;
+  const SignatureColumn<Offset>& _signatureColumn;
   const PatternDescriberRegistry<Offset>& _patternDescriberRegistry;
   const VirtualAddressMap<Offset>& _addressMap;
   const std::string _signature;
   const std::string _patternName;
   std::set<Offset> _signatures;
+  std::vector<bool> _signatureIdMatches;
   const typename PatternDescriberRegistry<Offset>::TagIndices* _tagIndices;
 };
 }  // namespace Allocations
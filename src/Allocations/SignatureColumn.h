@@ -0,0 +1,84 @@
+// Copyright (c) 2021 VMware, Inc. All Rights Reserved.
+// SPDX-License-Identifier: GPL-2.0
+
+#pragma once
+#include <vector>
+#include "../VirtualAddressMap.h"
+#include "../WorkerThreads.h"
+#include "Directory.h"
+#include "SignatureDirectory.h"
+
+namespace chap {
+namespace Allocations {
+/*
+ * A SignatureColumn holds, for each allocation, the ID of the signature at
+ * the start of the allocation, or SignatureDirectory::NO_SIGNATURE_ID if the
+ * allocation is too small or starts with something other than a signature.
+ * This allows checks by signature to be made without reading the image of
+ * each allocation and looking up the first word.
+ *
+ * Because signature IDs are only ever added, an ID in the column can also be
+ * checked with HasSignatureId() against any earlier copy of the signature
+ * directory, such as the one preserved for tagging.
+ */
+template <class Offset>
+class SignatureColumn {
+ public:
+  typedef typename Directory<Offset>::AllocationIndex AllocationIndex;
+  typedef typename SignatureDirectory<Offset>::SignatureId SignatureId;
+  static constexpr AllocationIndex ALLOCATIONS_PER_TASK = 0x10000;
+
+  SignatureColumn() : _signatureIdLimit(0) {}
+
+  /*
+   * Return true if the column was filled from the given directories as they
+   * are now.
+   */
+  bool IsCurrent(const Directory<Offset>& directory,
+                 const SignatureDirectory<Offset>& signatureDirectory) const {
+    return _signatureIds.size() == directory.NumAllocations() &&
+           _signatureIdLimit == signatureDirectory.SignatureIdLimit();
+  }
+
+  void Fill(const Directory<Offset>& directory,
+            const VirtualAddressMap<Offset>& addressMap,
+            const SignatureDirectory<Offset>& signatureDirectory) {
+    AllocationIndex numAllocations = directory.NumAllocations();
+    _signatureIds.assign(numAllocations,
+                         SignatureDirectory<Offset>::NO_SIGNATURE_ID);
+    _signatureIdLimit = signatureDirectory.SignatureIdLimit();
+    size_t numTasks =
+        (numAllocations + ALLOCATIONS_PER_TASK - 1) / ALLOCATIONS_PER_TASK;
+    WorkerThreads::Run(numTasks, [&](size_t taskIndex, size_t) {
+      AllocationIndex first = taskIndex * ALLOCATIONS_PER_TASK;
+      AllocationIndex limit = (numAllocations - first > ALLOCATIONS_PER_TASK)
+                                  ? first + ALLOCATIONS_PER_TASK
+                                  : numAllocations;
+      for (AllocationIndex index = first; index < limit; index++) {
+        const typename Directory<Offset>::Allocation* allocation =
+            directory.AllocationAt(index);
+        if (allocation->Size() < sizeof(Offset)) {
+          continue;
+        }
+        const char* image;
+        if (addressMap.FindMappedMemoryImage(allocation->Address(), &image) >=
+            sizeof(Offset)) {
+          _signatureIds[index] =
+              signatureDirectory.GetSignatureId(*((const Offset*)image));
+        }
+      }
+    });
+  }
+
+  SignatureId operator[](AllocationIndex index) const {
+    return _signatureIds[index];
+  }
+
+  const SignatureId* data() const { return _signatureIds.data(); }
+
+ private:
+  std::vector<SignatureId> _signatureIds;
+  size_t _signatureIdLimit;
+};
+}  // namespace Allocations
+}  // namespace chap
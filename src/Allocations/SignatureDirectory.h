@@ -2,8 +2,11 @@
 // SPDX-License-Identifier: GPL-2.0
 
 #pragma once
+#include <stdint.h>
 #include <map>
 #include <set>
+#include <unordered_map>
+#include <vector>
 
 /*
  * This keeps mappings from signature to name and name to set of signatures.
@@ -25,7 +28,8 @@ class SignatureDirectory {
     WRITABLE_VTABLE_WITH_NAME_FROM_PROCESS_IMAGE,
     VTABLE_WITH_NAME_FROM_BINARY,
     WRITABLE_MODULE_REFERENCE,
-    VTABLE_WITH_NAME_FROM_BINDEFS
+    VTABLE_WITH_NAME_FROM_BINDEFS,
+    UNWRITABLE_WITH_NAME_FROM_BINARY
   };
 
   typedef std::map<Offset, std::pair<std::string, Status> >
@@ -38,7 +42,17 @@ class SignatureDirectory {
   typedef typename NameToSignaturesMap::const_iterator
       NameToSignaturesConstIterator;
 
-  SignatureDirectory() : _multipleSignaturesPerName(false) {}
+  /*
+   * Each signature is given a dense ID, in the order in which signatures
+   * are first mapped, so that per-signature state can be kept in arrays.
+   * The ID of a signature never changes, even if its name does.  ID 0 is
+   * used for values that are not signatures.
+   */
+  typedef uint32_t SignatureId;
+  static constexpr SignatureId NO_SIGNATURE_ID = 0;
+
+  SignatureDirectory()
+      : _multipleSignaturesPerName(false), _idToSignature(1, 0) {}
 
   void MapSignatureNameAndStatus(Offset signature, std::string name,
                                  Status status) {
@@ -80,6 +94,8 @@ class SignatureDirectory {
       knownStatus = status;
     } else {
       _signatureToName[signature] = std::make_pair(name, status);
+      _signatureToId[signature] = (SignatureId)(_idToSignature.size());
+      _idToSignature.push_back(signature);
     }
     if (!name.empty()) {
       std::set<Offset>& signatures = _nameToSignatures[name];
@@ -98,6 +114,26 @@ class SignatureDirectory {
     return _signatureToName.find(signature) != _signatureToName.end();
   }
 
+  SignatureId GetSignatureId(Offset signature) const {
+    typename std::unordered_map<Offset, SignatureId>::const_iterator it =
+        _signatureToId.find(signature);
+    return (it == _signatureToId.end()) ? NO_SIGNATURE_ID : it->second;
+  }
+
+  /*
+   * Return the limit of the signature IDs in use, counting ID 0.
+   */
+  size_t SignatureIdLimit() const { return _idToSignature.size(); }
+
+  bool HasSignatureId(SignatureId signatureId) const {
+    return signatureId != NO_SIGNATURE_ID &&
+           signatureId < _idToSignature.size();
+  }
+
+  Offset SignatureForId(SignatureId signatureId) const {
+    return _idToSignature[signatureId];
+  }
+
   bool IsKnownVtablePointer(Offset signature) const {
     SignatureNameAndStatusConstIterator it = _signatureToName.find(signature);
     if (it != _signatureToName.end()) {
@@ -120,6 +156,8 @@ class SignatureDirectory {
           return false;
         case VTABLE_WITH_NAME_FROM_BINDEFS:
           return false;
+        case UNWRITABLE_WITH_NAME_FROM_BINARY:
+          return false;
       }
     }
     return false;
@@ -156,8 +194,14 @@ class SignatureDirectory {
   bool _multipleSignaturesPerName;
   SignatureNameAndStatusMap _signatureToName;
   NameToSignaturesMap _nameToSignatures;
+  std::unordered_map<Offset, SignatureId> _signatureToId;
+  std::vector<Offset> _idToSignature;
   std::string NO_NAME;
   std::set<Offset> NO_SIGNATURES;
 };
+
+template <class Offset>
+constexpr typename SignatureDirectory<Offset>::SignatureId
+    SignatureDirectory<Offset>::NO_SIGNATURE_ID;
 }  // namespace Allocations
 }  // namespace chap
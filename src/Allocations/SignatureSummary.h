@@ -4,8 +4,11 @@
 #pragma once
 #include <algorithm>
 #include <map>
-#include <set>
+#include <string>
+#include <unordered_map>
+#include <vector>
 #include "Directory.h"
+#include "SignatureColumn.h"
 #include "SignatureDirectory.h"
 #include "TagHolder.h"
 namespace chap {
@@ -24,27 +27,33 @@ class SignatureSummary {
     Offset _count;
     Offset _bytes;
   };
-  typedef std::map<Offset, Offset> SizeToCount;
+  /*
+   * Allocations are tallied by tag index, for tagged allocations, and
+   * otherwise by signature ID, taken from the signature column, in flat
+   * arrays, so that no images, strings or names are looked at until the
+   * summary is filled.  Counts by size, needed only for tagged and unsigned
+   * allocations, are kept in hash tables and sorted when the summary is
+   * filled.
+   */
+  typedef std::unordered_map<Offset, Offset> SizeToCount;
   struct TallyWithSizeSubtotals {
     Tally _tally;
     SizeToCount _sizeToCount;
     void Bump(Offset size) {
       _tally.Bump(size);
-      typename SizeToCount::iterator it = _sizeToCount.find(size);
-      if (it == _sizeToCount.end()) {
-        _sizeToCount[size] = 1;
-      } else {
-        it->second = it->second + 1;
+      ++_sizeToCount[size];
+    }
+    void Add(const TallyWithSizeSubtotals& other) {
+      _tally._count += other._tally._count;
+      _tally._bytes += other._tally._bytes;
+      for (const auto& sizeAndCount : other._sizeToCount) {
+        _sizeToCount[sizeAndCount.first] += sizeAndCount.second;
       }
     }
   };
-  typedef std::map<Offset, Tally> OffsetToTally;
-  typedef typename OffsetToTally::iterator OffsetToTallyIterator;
-  typedef typename OffsetToTally::const_iterator OffsetToTallyConstIterator;
-  typedef std::map<std::string, Tally> NameToTally;
-  typedef typename NameToTally::iterator NameToTallyIterator;
-  typedef typename NameToTally::const_iterator NameToTallyConstIterator;
   typedef typename Directory<Offset>::AllocationIndex AllocationIndex;
+  typedef typename TagHolder<Offset>::TagIndex TagIndex;
+  typedef typename SignatureDirectory<Offset>::SignatureId SignatureId;
   struct Item {
     std::string _name;
     Tally _totals;
@@ -55,27 +64,25 @@ class SignatureSummary {
   };
 
   SignatureSummary(const SignatureDirectory<Offset>& directory,
+                   const SignatureColumn<Offset>& signatureColumn,
                    const TagHolder<Offset>& tagHolder)
-      : _directory(directory), _tagHolder(tagHolder) {}
+      : _directory(directory),
+        _signatureColumn(signatureColumn),
+        _tagHolder(tagHolder),
+        _tagTallies(tagHolder.GetNumTags()),
+        _signatureTallies(directory.SignatureIdLimit()) {}
 
-  bool AdjustTally(AllocationIndex index, Offset size, const char* image) {
-    const std::string& tagName = _tagHolder.GetTagName(index);
-    if (!tagName.empty()) {
+  bool AdjustTally(AllocationIndex index, Offset size) {
+    TagIndex tagIndex = _tagHolder.GetTagIndex(index);
+    if (tagIndex != 0) {
       /*
        * Tags take precedent over any signature.
        */
-      _talliesWithSizeSubtotals[tagName].Bump(size);
+      _tagTallies[tagIndex].Bump(size);
     } else {
-      Offset signature = 0;
-      if (size >= sizeof(Offset)) {
-        signature = *((Offset*)image);
-      }
-      if (_directory.IsMapped(signature)) {
-        TallyBySignature(signature, size);
-        std::string name = _directory.Name(signature);
-        if (!name.empty()) {
-          TallyByName(name, size);
-        }
+      SignatureId signatureId = _signatureColumn[index];
+      if (signatureId != SignatureDirectory<Offset>::NO_SIGNATURE_ID) {
+        _signatureTallies[signatureId].Bump(size);
       } else {
         _unsignedTallyWithSizeSubtotals.Bump(size);
       }
@@ -107,93 +114,100 @@ class SignatureSummary {
 
  private:
   const SignatureDirectory<Offset>& _directory;
+  const SignatureColumn<Offset>& _signatureColumn;
   const TagHolder<Offset>& _tagHolder;
-  OffsetToTally _signatureToTally;
-  NameToTally _nameToTally;
   TallyWithSizeSubtotals _unsignedTallyWithSizeSubtotals;
-  std::unordered_map<std::string, TallyWithSizeSubtotals>
-      _talliesWithSizeSubtotals;
+  std::vector<TallyWithSizeSubtotals> _tagTallies;
+  std::vector<Tally> _signatureTallies;
 
-  void TallyBySignature(Offset signature, Offset size) {
-    OffsetToTallyIterator it = _signatureToTally.find(signature);
-    if (it != _signatureToTally.end()) {
-      it->second._count++;
-      it->second._bytes += size;
-    } else {
-      _signatureToTally[signature] = Tally(1, size);
-    }
-  }
-  void TallyByName(std::string name, Offset size) {
-    NameToTallyIterator it = _nameToTally.find(name);
-    if (it != _nameToTally.end()) {
-      it->second._count++;
-      it->second._bytes += size;
-    } else {
-      _nameToTally[name] = Tally(1, size);
+  /*
+   * Add an item with the given name and totals and with a subtotal for
+   * each size, in increasing order of size.
+   */
+  static void AddSizedItem(const std::string& name,
+                           const TallyWithSizeSubtotals& tallyWithSizes,
+                           std::vector<Item>& items) {
+    items.push_back(Item());
+    Item& item = items.back();
+    item._name = name;
+    item._totals = tallyWithSizes._tally;
+    std::vector<std::pair<Offset, Offset> > sizesAndCounts(
+        tallyWithSizes._sizeToCount.begin(), tallyWithSizes._sizeToCount.end());
+    std::sort(sizesAndCounts.begin(), sizesAndCounts.end());
+    for (const auto& sizeAndCount : sizesAndCounts) {
+      item.AddSubtotal(
+          sizeAndCount.first,
+          Tally(sizeAndCount.second, sizeAndCount.first * sizeAndCount.second));
     }
   }
 
   void FillItems(std::vector<Item>& items) const {
     items.clear();
     if (_unsignedTallyWithSizeSubtotals._tally._count > 0) {
-      items.push_back(Item());
-      Item& item = items.back();
-      item._name = "?";
-      item._totals = _unsignedTallyWithSizeSubtotals._tally;
-      for (typename std::map<Offset, Offset>::const_iterator it =
-               _unsignedTallyWithSizeSubtotals._sizeToCount.begin();
-           it != _unsignedTallyWithSizeSubtotals._sizeToCount.end(); ++it) {
-        item.AddSubtotal(it->first, Tally(it->second, it->first * it->second));
-      }
+      AddSizedItem("?", _unsignedTallyWithSizeSubtotals, items);
     }
-    for (const auto nameAndTally : _talliesWithSizeSubtotals) {
-      items.push_back(Item());
-      Item& item = items.back();
-      item._name = nameAndTally.first;
-      TallyWithSizeSubtotals tallyWithSizeSubtotals = nameAndTally.second;
-      item._totals = tallyWithSizeSubtotals._tally;
-      for (typename std::map<Offset, Offset>::const_iterator it =
-               tallyWithSizeSubtotals._sizeToCount.begin();
-           it != tallyWithSizeSubtotals._sizeToCount.end(); ++it) {
-        item.AddSubtotal(it->first, Tally(it->second, it->first * it->second));
+    FillTags(items);
+    FillSignatures(items);
+  }
+
+  /*
+   * More than one tag index may have the same name, so the tallies are
+   * combined by name.
+   */
+  void FillTags(std::vector<Item>& items) const {
+    std::map<std::string, TallyWithSizeSubtotals> nameToTally;
+    for (TagIndex tagIndex = 1; tagIndex < _tagTallies.size(); tagIndex++) {
+      const TallyWithSizeSubtotals& tally = _tagTallies[tagIndex];
+      if (tally._tally._count > 0) {
+        nameToTally[_tagHolder.GetTagNameForIndex(tagIndex)].Add(tally);
       }
     }
-    FillUnnamedSignatures(items);
-    FillNamedSignatures(items);
+    for (const auto& nameAndTally : nameToTally) {
+      AddSizedItem(nameAndTally.first, nameAndTally.second, items);
+    }
   }
 
-  void FillUnnamedSignatures(std::vector<Item>& items) const {
-    for (OffsetToTallyConstIterator it = _signatureToTally.begin();
-         it != _signatureToTally.end(); ++it) {
-      std::string name = _directory.Name(it->first);
+  /*
+   * Each unnamed signature gets its own item, and the signatures for each
+   * name share an item with a subtotal for each signature.
+   */
+  void FillSignatures(std::vector<Item>& items) const {
+    std::map<std::string, Tally> nameToTally;
+    for (SignatureId signatureId = 1; signatureId < _signatureTallies.size();
+         signatureId++) {
+      const Tally& tally = _signatureTallies[signatureId];
+      if (tally._count == 0) {
+        continue;
+      }
+      Offset signature = _directory.SignatureForId(signatureId);
+      const std::string& name = _directory.Name(signature);
       if (name.empty()) {
         items.push_back(Item());
         Item& item = items.back();
-        item._totals = it->second;
-        item.AddSubtotal(it->first, it->second);
+        item._totals = tally;
+        item.AddSubtotal(signature, tally);
+      } else {
+        Tally& nameTally = nameToTally[name];
+        nameTally._count += tally._count;
+        nameTally._bytes += tally._bytes;
       }
     }
-  }
-  void FillNamedSignatures(std::vector<Item>& items) const {
-    for (NameToTallyConstIterator it = _nameToTally.begin();
-         it != _nameToTally.end(); ++it) {
-      const std::string& name = it->first;
+    for (const auto& nameAndTally : nameToTally) {
+      const std::string& name = nameAndTally.first;
       items.push_back(Item());
       Item& item = items.back();
       item._name = name;
-      item._totals = it->second;
-
-      const std::set<Offset>& signatures = _directory.Signatures(name);
-      for (typename std::set<Offset>::const_iterator itSig = signatures.begin();
-           itSig != signatures.end(); ++itSig) {
-        Offset signature = *itSig;
-        OffsetToTallyConstIterator itTally = _signatureToTally.find(signature);
-        if (itTally != _signatureToTally.end()) {
-          item.AddSubtotal(signature, itTally->second);
+      item._totals = nameAndTally.second;
+      for (Offset signature : _directory.Signatures(name)) {
+        const Tally& tally =
+            _signatureTallies[_directory.GetSignatureId(signature)];
+        if (tally._count > 0) {
+          item.AddSubtotal(signature, tally);
         }
       }
     }
   }
+
   struct CompareSubtotalsByCount {
     bool operator()(const std::pair<Offset, Tally>& left,
                     const std::pair<Offset, Tally>& right) {
@@ -0,0 +1,245 @@
+// Copyright (c) 2021 VMware, Inc. All Rights Reserved.
+// SPDX-License-Identifier: GPL-2.0
+
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+#include <algorithm>
+#include <utility>
+#include <vector>
+#include "Directory.h"
+
+namespace chap {
+namespace Allocations {
+/*
+ * A SortedTargetResolver maps a batch of candidate values to the indices of
+ * the allocations that contain them, giving the same answers as
+ * Directory::AllocationIndexOf, by sorting the batch by value and then
+ * making a single forward pass over the sorted values and the allocations.
+ * This touches the allocations in address order, rather than once per
+ * candidate in no particular order, which matters when the batch is large
+ * compared to the number of pages that hold allocations.
+ *
+ * The allocations that are not wrappers do not overlap, so they are kept as
+ * sorted arrays of starts, limits and indices.  The wrappers are flattened
+ * into non-overlapping segments, each labeled with the innermost wrapper
+ * that covers it, for values that are in a wrapper but in none of the
+ * allocations it contains.
+ */
+template <class Offset>
+class SortedTargetResolver {
+ public:
+  typedef typename Directory<Offset>::AllocationIndex Index;
+  typedef typename Directory<Offset>::Allocation Allocation;
+
+  /*
+   * A Candidate is a value that might be a reference to an allocation,
+   * with the index of the allocation that holds the value and, once the
+   * batch has been resolved, the index of the allocation that contains the
+   * value, or the number of allocations if there is none.
+   */
+  struct Candidate {
+    Offset _value;
+    Index _source;
+    Index _target;
+  };
+
+  SortedTargetResolver(const Directory<Offset>& directory)
+      : _numAllocations(directory.NumAllocations()),
+        _envelopeBase(0),
+        _envelopeLimit(0) {
+    std::vector<std::pair<Offset, Index> > wrapperStack;  // limit, index
+    Offset wrapperPosition = 0;
+    for (Index i = 0; i < _numAllocations; i++) {
+      const Allocation* allocation = directory.AllocationAt(i);
+      Offset address = allocation->Address();
+      Offset size = allocation->Size();
+      if (size == 0) {
+        continue;
+      }
+      Offset limit = address + size;
+      if (_envelopeBase == _envelopeLimit) {
+        _envelopeBase = address;
+      }
+      if (_envelopeLimit < limit) {
+        _envelopeLimit = limit;
+      }
+      if (!allocation->IsWrapper()) {
+        _starts.push_back(address);
+        _limits.push_back(limit);
+        _indices.push_back(i);
+        continue;
+      }
+      /*
+       * The wrappers are visited in increasing order of address and any
+       * wrapper is visited before the wrappers it contains, so a stack of
+       * the wrappers that contain the current position suffices to label
+       * each segment with the innermost one.
+       */
+      CloseWrapperSegments(address, wrapperStack, wrapperPosition);
+      wrapperStack.emplace_back(limit, i);
+      wrapperPosition = address;
+    }
+    CloseWrapperSegments(_envelopeLimit, wrapperStack, wrapperPosition);
+  }
+
+  /*
+   * Return true if a forward merge is expected to be faster than a lookup
+   * per candidate for the given directory, based on the AllocationLookup
+   * benchmark.  Without a page index each lookup is a binary search over all
+   * the allocations, which the merge always beats.  With a page index, the
+   * merge wins only where there are many small allocations per page, each of
+   * which the page index must search.
+   */
+  static bool IsPreferredFor(const Directory<Offset>& directory) {
+    Index numAllocations = directory.NumAllocations();
+    if (numAllocations < MIN_ALLOCATIONS_FOR_MERGE) {
+      return false;
+    }
+    if (!directory.HasPageIndex()) {
+      return true;
+    }
+    Offset totalSize = 0;
+    Offset numCounted = 0;
+    for (Index i = 0; i < numAllocations; i++) {
+      const Allocation* allocation = directory.AllocationAt(i);
+      if (!allocation->IsWrapper()) {
+        totalSize += allocation->Size();
+        numCounted++;
+      }
+    }
+    return totalSize < numCounted * MAX_MEAN_SIZE_FOR_MERGE;
+  }
+
+  /*
+   * Return true if the given value is in the smallest range of addresses
+   * that covers all the allocations.  Only such values may be resolved.
+   */
+  bool InEnvelope(Offset value) const {
+    return (Offset)(value - _envelopeBase) <
+           (Offset)(_envelopeLimit - _envelopeBase);
+  }
+
+  /*
+   * Sort the given candidates, all of which must be in the envelope, by
+   * value, using the given vector as scratch space, and set the target of
+   * each.
+   */
+  void Resolve(std::vector<Candidate>& candidates,
+               std::vector<Candidate>& scratch) const {
+    Sort(candidates, scratch);
+    size_t numIntervals = _starts.size();
+    size_t numSegments = _segmentStarts.size();
+    size_t interval = 0;
+    size_t segment = 0;
+    for (Candidate& candidate : candidates) {
+      Offset value = candidate._value;
+      while (interval < numIntervals && _limits[interval] <= value) {
+        interval++;
+      }
+      if (interval < numIntervals && _starts[interval] <= value) {
+        candidate._target = _indices[interval];
+        continue;
+      }
+      while (segment < numSegments && _segmentLimits[segment] <= value) {
+        segment++;
+      }
+      candidate._target =
+          (segment < numSegments && _segmentStarts[segment] <= value)
+              ? _segmentIndices[segment]
+              : _numAllocations;
+    }
+  }
+
+ private:
+  static constexpr Index MIN_ALLOCATIONS_FOR_MERGE = 0x1000;
+  static constexpr Offset MAX_MEAN_SIZE_FOR_MERGE = 0x200;
+  static constexpr int BITS_PER_DIGIT = 11;
+  static constexpr size_t NUM_BUCKETS = ((size_t)1) << BITS_PER_DIGIT;
+
+  const Index _numAllocations;
+  Offset _envelopeBase;
+  Offset _envelopeLimit;
+  std::vector<Offset> _starts;
+  std::vector<Offset> _limits;
+  std::vector<Index> _indices;
+  std::vector<Offset> _segmentStarts;
+  std::vector<Offset> _segmentLimits;
+  std::vector<Index> _segmentIndices;
+
+  void AddSegment(Offset start, Offset limit, Index index) {
+    if (start < limit) {
+      _segmentStarts.push_back(start);
+      _segmentLimits.push_back(limit);
+      _segmentIndices.push_back(index);
+    }
+  }
+
+  /*
+   * Label the part of the address space from the given position up to the
+   * given address with the wrappers on the stack, popping those that end
+   * by that address.
+   */
+  void CloseWrapperSegments(Offset address,
+                            std::vector<std::pair<Offset, Index> >& stack,
+                            Offset& position) {
+    while (!stack.empty() && stack.back().first <= address) {
+      AddSegment(position, stack.back().first, stack.back().second);
+      position = stack.back().first;
+      stack.pop_back();
+    }
+    if (!stack.empty()) {
+      AddSegment(position, address, stack.back().second);
+    }
+    position = address;
+  }
+
+  /*
+   * Sort the candidates by value with a least significant digit radix sort
+   * on the offset of the value in the envelope, skipping any digit that is
+   * the same for all the candidates.
+   */
+  void Sort(std::vector<Candidate>& candidates,
+            std::vector<Candidate>& scratch) const {
+    size_t numCandidates = candidates.size();
+    scratch.resize(numCandidates);
+    Offset span = _envelopeLimit - _envelopeBase;
+    std::vector<size_t> counts(NUM_BUCKETS);
+    for (int shift = 0; shift < (int)(8 * sizeof(Offset)) && (span >> shift);
+         shift += BITS_PER_DIGIT) {
+      std::fill(counts.begin(), counts.end(), 0);
+      for (const Candidate& candidate : candidates) {
+        counts[Digit(candidate._value, shift)]++;
+      }
+      if (counts[Digit(candidates[0]._value, shift)] == numCandidates) {
+        continue;
+      }
+      size_t position = 0;
+      for (size_t& count : counts) {
+        size_t numInBucket = count;
+        count = position;
+        position += numInBucket;
+      }
+      for (const Candidate& candidate : candidates) {
+        scratch[counts[Digit(candidate._value, shift)]++] = candidate;
+      }
+      candidates.swap(scratch);
+    }
+  }
+
+  size_t Digit(Offset value, int shift) const {
+    return (size_t)(((value - _envelopeBase) >> shift) & (NUM_BUCKETS - 1));
+  }
+};
+
+template <class Offset>
+constexpr typename SortedTargetResolver<Offset>::Index
+    SortedTargetResolver<Offset>::MIN_ALLOCATIONS_FOR_MERGE;
+template <class Offset>
+constexpr Offset SortedTargetResolver<Offset>::MAX_MEAN_SIZE_FOR_MERGE;
+template <class Offset>
+constexpr int SortedTargetResolver<Offset>::BITS_PER_DIGIT;
+template <class Offset>
+constexpr size_t SortedTargetResolver<Offset>::NUM_BUCKETS;
+}  // namespace Allocations
+}  // namespace chap
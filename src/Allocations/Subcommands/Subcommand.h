@@ -13,6 +13,7 @@
 #include "../ReferenceConstraint.h"
 #include "../SetCache.h"
 #include "../SignatureChecker.h"
+#include "../Visitors/RecordWriter.h"
 namespace chap {
 namespace Allocations {
 namespace Subcommands {
@@ -55,6 +56,8 @@ class Subcommand : public Commands::Subcommand {
         _processImage.GetSignatureDirectory();
     const VirtualAddressMap<Offset>& addressMap =
         _processImage.GetVirtualAddressMap();
+    const SignatureColumn<Offset>& signatureColumn =
+        _processImage.GetSignatureColumn();
 
     std::string signatureString;
     if (nextPositional < numPositionals) {
@@ -70,9 +73,9 @@ class Subcommand : public Commands::Subcommand {
     }
 
     bool signatureOrPatternError = false;
-    SignatureChecker<Offset> signatureChecker(signatureDirectory,
-                                              _patternDescriberRegistry,
-                                              addressMap, signatureString);
+    SignatureChecker<Offset> signatureChecker(
+        signatureDirectory, signatureColumn, _patternDescriberRegistry,
+        addressMap, signatureString);
     bool switchError = false;
     bool allowMissingSignatures = false;
     if (!context.ParseBooleanSwitch("allowMissingSignatures",
@@ -144,7 +147,7 @@ class Subcommand : public Commands::Subcommand {
         context.GetNumArguments("geometricSample");
     if (numGeometricSampleArguments > 0) {
       if (numGeometricSampleArguments > 1) {
-        std::cerr << "At most one /geometricSample switch is allowed.\n";
+        error << "At most one /geometricSample switch is allowed.\n";
         switchError = true;
       }
       const std::string& geometricSampleBaseString =
@@ -166,7 +169,7 @@ class Subcommand : public Commands::Subcommand {
     size_t numSetOperationArguments = context.GetNumArguments("setOperation");
     if (numSetOperationArguments > 0) {
       if (numSetOperationArguments > 1) {
-        std::cerr << "At most one /setOperation switch is allowed.\n";
+        error << "At most one /setOperation switch is allowed.\n";
         switchError = true;
       }
       const std::string& operation = context.Argument("setOperation", 0);
@@ -175,12 +178,13 @@ class Subcommand : public Commands::Subcommand {
       } else if (operation == "subtract") {
         subtractFromDefault = true;
       } else {
-        std::cerr << "Set operation " << operation << " is not supported.\n";
+        error << "Set operation " << operation << " is not supported.\n";
         switchError = true;
       }
     }
 
-    Set<Offset>& visited = _setCache.GetVisited();
+    typename SetCache<Offset>::Visited visitedLease(_setCache);
+    Set<Offset>& visited = visitedLease.Get();
 
     std::vector<ReferenceConstraint<Offset> > referenceConstraints;
     const Graph<Offset>* graph = 0;
@@ -197,9 +201,8 @@ class Subcommand : public Commands::Subcommand {
       // This is done lazily because it is an expensive calculation.
       graph = _processImage.GetAllocationGraph();
       if (graph == 0) {
-        std::cerr
-            << "Constraints were placed on incoming or outgoing references\n"
-               "but it was not possible to calculate the graph.";
+        error << "Constraints were placed on incoming or outgoing references\n"
+                 "but it was not possible to calculate the graph.\n";
         return;
       }
 
@@ -240,25 +243,51 @@ class Subcommand : public Commands::Subcommand {
               allowMissingSignatures);
     }
 
+    if (context.GetNumArguments("format") > 0) {
+      if (!_visitorFactory.AllowsRecordFormats()) {
+        error << "The /format switch is not supported by \""
+              << _visitorFactory.GetCommandName() << "\".\n";
+        switchError = true;
+      }
+      bool commentExtensions = false;
+      if (context.ParseBooleanSwitch("commentExtensions", commentExtensions) &&
+          commentExtensions) {
+        error << "The /commentExtensions switch cannot be used with /format.\n";
+        switchError = true;
+      }
+    }
+
     ExtendedVisitor<Offset, Visitor> extendedVisitor(
         context, _processImage, _patternDescriberRegistry,
         allowMissingSignatures, visited);
     if (extendedVisitor.HasErrors() || switchError || signatureOrPatternError) {
       return;
     }
-    std::unique_ptr<Visitor> visitor;
-    visitor.reset(_visitorFactory.MakeVisitor(context, _processImage));
-    if (visitor.get() == 0) {
+
+    /*
+     * If the /format switch was used, one record is written for each
+     * member of the set, rather than the usual output of the visitor.
+     */
+    std::unique_ptr<Visitors::RecordWriter<Offset> > recordWriter;
+    recordWriter.reset(Visitors::RecordWriter<Offset>::Make(
+        context, _processImage, switchError));
+    if (switchError) {
       return;
     }
-    Visitor& visitorRef = *(visitor.get());
+    std::unique_ptr<Visitor> visitor;
+    if (recordWriter.get() == 0) {
+      visitor.reset(_visitorFactory.MakeVisitor(context, _processImage));
+      if (visitor.get() == 0) {
+        return;
+      }
+    }
 
     bool extendedVisitorIsEnabled = extendedVisitor.IsEnabled();
 
     const std::vector<std::string>& taints = _iteratorFactory.GetTaints();
     if (!taints.empty()) {
       error << "The output of this command cannot be trusted:\n";
-      if (isRedirected) {
+      if (isRedirected && recordWriter.get() == 0) {
         output << "The output of this command cannot be trusted:\n";
       }
       for (std::vector<std::string>::const_iterator it = taints.begin();
@@ -310,11 +339,18 @@ class Subcommand : public Commands::Subcommand {
         nextInGeometricSample *= geometricSampleBase;
       }
 
-      if (extendedVisitorIsEnabled) {
-        extendedVisitor.Visit(index, *allocation, visitorRef);
+      if (recordWriter.get() != 0) {
+        if (extendedVisitorIsEnabled) {
+          extendedVisitor.Visit(index, *allocation, *recordWriter);
+        } else {
+          visited.Add(index);
+          recordWriter->Visit(index, *allocation);
+        }
+      } else if (extendedVisitorIsEnabled) {
+        extendedVisitor.Visit(index, *allocation, *visitor);
       } else {
         visited.Add(index);
-        visitorRef.Visit(index, *allocation);
+        visitor->Visit(index, *allocation);
       }
     }
     if (assignDefault) {
@@ -358,6 +394,10 @@ class Subcommand : public Commands::Subcommand {
            " be used for automated bug detection.\n\n"
            "/geometricSample <base-in-decimal> causes only entries 1, b, "
            "b**2, b**3...\n to be visited.\n\n"
+           "For count, summarize, enumerate, list and describe, /format "
+           "jsonl|csv|binary\n causes one record to be written per member of "
+           "the set instead, with the\n address, size, status, signature, "
+           "tag and reference counts.  See\n USERGUIDE.md for details.\n\n"
            "After restrictions have been applied, the /extend switch can be"
            " used to extend\n"
            " the set to adjacent allocations.  See USERGUIDE.md for details.\n";
@@ -403,9 +443,11 @@ class Subcommand : public Commands::Subcommand {
           switchError = true;
         }
       }
-      constraints.emplace_back(signatureDirectory, _patternDescriberRegistry,
-                               addressMap, signature, count, wantUsed,
-                               boundaryType, referenceType, directory, graph);
+      constraints.emplace_back(signatureDirectory,
+                               _processImage.GetSignatureColumn(),
+                               _patternDescriberRegistry, addressMap, signature,
+                               count, wantUsed, boundaryType, referenceType,
+                               directory, graph);
       if (constraints.back().UnrecognizedSignature()) {
         if (!allowMissingSignatures) {
           error << "Signature \"" << signature << "\" is not recognized.\n";
@@ -25,8 +25,8 @@ class SummarizeSignatures : public Commands::Subcommand {
     Commands::Output& output = context.GetOutput();
     Offset numSignatures = 0;
     std::vector<size_t> counts;
-    counts.resize(SignatureDirectory<Offset>::VTABLE_WITH_NAME_FROM_BINDEFS + 1,
-                  0);
+    counts.resize(
+        SignatureDirectory<Offset>::UNWRITABLE_WITH_NAME_FROM_BINARY + 1, 0);
     typename SignatureDirectory<Offset>::SignatureNameAndStatusConstIterator
         itEnd = _signatureDirectory.EndSignatures();
     for (typename SignatureDirectory<
@@ -86,6 +86,12 @@ class SummarizeSignatures : public Commands::Subcommand {
       output << count << " signatures are vtable pointers "
                          "with names from the .bindefs file.\n";
     }
+    count =
+        counts[SignatureDirectory<Offset>::UNWRITABLE_WITH_NAME_FROM_BINARY];
+    if (count > 0) {
+      output << count << " signatures are unwritable addresses "
+                         "with names from libraries or executables.\n";
+    }
 
     output << numSignatures << " signatures in total were found.\n";
   }
@@ -4,6 +4,7 @@
 #pragma once
 #include <set>
 #include <unordered_map>
+#include "../AnalysisCache.h"
 #include "Directory.h"
 
 namespace chap {
@@ -21,23 +22,145 @@ class TagHolder {
    */
   typedef std::set<TagIndex> TagIndices;
 
+  /*
+   * A Speculation records what happens when taggers are run on allocations
+   * ahead of their turn, against a speculative TagHolder, so that the results
+   * can later be applied in allocation order, as long as the tags that were
+   * read in the process have not changed in the meantime.  Each allocation
+   * examined this way is one step.  Tags proposed by a step are visible to
+   * later steps in the same Speculation, but not to other Speculations until
+   * they have been applied.
+   */
+  class Speculation {
+   public:
+    Speculation() {}
+
+    void Clear() {
+      _steps.clear();
+      _reads.clear();
+      _writes.clear();
+      _proposedTags.clear();
+    }
+
+    void BeginStep(AllocationIndex allocationIndex) {
+      _steps.push_back({allocationIndex, _reads.size(), _writes.size(), false});
+    }
+
+    /*
+     * Note that the current step cannot be applied as is and that the
+     * allocation must be examined again in allocation order.
+     */
+    void RequireOrderedRun() { _steps.back()._needsOrderedRun = true; }
+
+    size_t NumSteps() const { return _steps.size(); }
+
+    AllocationIndex StepAllocationIndex(size_t step) const {
+      return _steps[step]._allocationIndex;
+    }
+
+   private:
+    friend class TagHolder;
+    struct Step {
+      AllocationIndex _allocationIndex;
+      size_t _firstRead;
+      size_t _firstWrite;
+      bool _needsOrderedRun;
+    };
+    struct Access {
+      AllocationIndex _allocationIndex;
+      TagIndex _tagIndex;
+    };
+    struct ProposedTag {
+      TagIndex _tagIndex;
+      size_t _step;
+    };
+    std::vector<Step> _steps;
+    std::vector<Access> _reads;
+    std::vector<Access> _writes;
+    std::unordered_map<AllocationIndex, ProposedTag> _proposedTags;
+
+    TagIndex Read(AllocationIndex allocationIndex,
+                  const TagHolder& actualTags) {
+      size_t step = _steps.size() - 1;
+      TagIndex tagIndex;
+      typename std::unordered_map<AllocationIndex, ProposedTag>::iterator it =
+          _proposedTags.find(allocationIndex);
+      if (it != _proposedTags.end()) {
+        /*
+         * A tag proposed by the current step depends only on what that step
+         * has already read, so there is no need to record reading it again.
+         */
+        if (it->second._step == step) {
+          return it->second._tagIndex;
+        }
+        tagIndex = it->second._tagIndex;
+      } else {
+        tagIndex = actualTags.LoadTag(allocationIndex);
+      }
+      if (_reads.size() == _steps.back()._firstRead ||
+          _reads.back()._allocationIndex != allocationIndex ||
+          _reads.back()._tagIndex != tagIndex) {
+        _reads.push_back({allocationIndex, tagIndex});
+      }
+      return tagIndex;
+    }
+
+    void Write(AllocationIndex allocationIndex, TagIndex tagIndex) {
+      ProposedTag& proposedTag = _proposedTags[allocationIndex];
+      proposedTag._tagIndex = tagIndex;
+      proposedTag._step = _steps.size() - 1;
+      _writes.push_back({allocationIndex, tagIndex});
+    }
+  };
+
+  /*
+   * The tags are kept in a column of one byte per allocation as long as
+   * there are at most 0x100 tags, including the empty one, which is widened
+   * to two bytes per allocation if more tags are registered.
+   */
   TagHolder(const AllocationIndex numAllocations)
-      : _numAllocations(numAllocations) {
-    _tags.reserve(numAllocations);
-    _tags.resize(numAllocations, 0);
+      : _numAllocations(numAllocations),
+        _tagBits(8),
+        _actualTags(nullptr),
+        _speculation(nullptr) {
+    _tags8.reserve(numAllocations);
+    _tags8.resize(numAllocations, 0);
     _indexToName.push_back("");
-    _tagIsStrong.push_back(false);
+    _strongTags.push_back(0);
   }
 
+  /*
+   * Create a speculative TagHolder, with the same registered tags as the
+   * given one, that reads the tags of the given one but records any tags
+   * read or proposed in the given Speculation rather than changing them.
+   * The given TagHolder must be changed only by ApplySpeculation() and
+   * only after all tags have been registered.
+   */
+  TagHolder(const TagHolder& actualTags, Speculation& speculation)
+      : _numAllocations(actualTags._numAllocations),
+        _tagBits(actualTags._tagBits),
+        _indexToName(actualTags._indexToName),
+        _strongTags(actualTags._strongTags),
+        _nameToTagIndices(actualTags._nameToTagIndices),
+        _actualTags(&actualTags),
+        _speculation(&speculation) {}
+
   TagIndex RegisterTag(const char* name, bool tagIsStrong = true) {
     TagIndex newIndex = _indexToName.size();
-    if (_indexToName.size() == 0x255) {
-      std::cerr
-          << "255 tags reached - change the implementation of TagHolder\n";
+    if (newIndex == 0x10000) {
+      std::cerr << "Too many tags were registered.\n";
       abort();
     }
+    if (newIndex == 0x100) {
+      WidenTags();
+    }
     _indexToName.push_back(name);
-    _tagIsStrong.push_back(tagIsStrong);
+    if ((newIndex & 0x3f) == 0) {
+      _strongTags.push_back(0);
+    }
+    if (tagIsStrong) {
+      _strongTags[newIndex >> 6] |= ((uint64_t)(1) << (newIndex & 0x3f));
+    }
     _nameToTagIndices[name].insert(newIndex);
     return newIndex;
   }
@@ -51,20 +174,68 @@ class TagHolder {
       std::cerr << "Invalid allocation index " << allocationIndex << "\n";
       abort();
     }
-    TagIndex oldTag = _tags[allocationIndex];
-    if (oldTag == 0 || (_tagIsStrong[tagIndex] && !_tagIsStrong[oldTag])) {
-      _tags[allocationIndex] = tagIndex;
+    TagIndex oldTag = TagAt(allocationIndex);
+    if (oldTag == 0 || (IsStrongTag(tagIndex) && !IsStrongTag(oldTag))) {
+      if (_speculation != nullptr) {
+        _speculation->Write(allocationIndex, tagIndex);
+      } else {
+        StoreTag(allocationIndex, tagIndex);
+      }
       return true;
     }
     return false;
   }
 
+  /*
+   * Return true if and only if this TagHolder is speculative, in which case
+   * the allocation currently being examined will be examined again in
+   * allocation order, so the caller should give up on that allocation
+   * without any side effects.  This is for use before anything, other than
+   * tagging, that may affect the examination of other allocations or that
+   * is visible to the user.
+   */
+  bool DeferToOrderedRun() {
+    if (_speculation == nullptr) {
+      return false;
+    }
+    _speculation->RequireOrderedRun();
+    return true;
+  }
+
+  /*
+   * Apply the tags proposed by the given step of the given Speculation, in
+   * the order proposed, returning true, if all the tags read by that step
+   * still match.  Otherwise return false and leave the tags unchanged.
+   */
+  bool ApplySpeculation(const Speculation& speculation, size_t step) {
+    const typename Speculation::Step& s = speculation._steps[step];
+    if (s._needsOrderedRun) {
+      return false;
+    }
+    bool isLast = (step + 1 == speculation._steps.size());
+    size_t readsLimit = isLast ? speculation._reads.size()
+                               : speculation._steps[step + 1]._firstRead;
+    size_t writesLimit = isLast ? speculation._writes.size()
+                                : speculation._steps[step + 1]._firstWrite;
+    for (size_t i = s._firstRead; i < readsLimit; i++) {
+      const typename Speculation::Access& read = speculation._reads[i];
+      if (LoadTag(read._allocationIndex) != read._tagIndex) {
+        return false;
+      }
+    }
+    for (size_t i = s._firstWrite; i < writesLimit; i++) {
+      const typename Speculation::Access& write = speculation._writes[i];
+      StoreTag(write._allocationIndex, write._tagIndex);
+    }
+    return true;
+  }
+
   TagIndex GetTagIndex(AllocationIndex allocationIndex) const {
     if (allocationIndex >= _numAllocations) {
       std::cerr << "Invalid allocation index " << allocationIndex << "\n";
       abort();
     }
-    return _tags[allocationIndex];
+    return TagAt(allocationIndex);
   }
 
   const std::string& GetTagName(AllocationIndex allocationIndex) const {
@@ -72,7 +243,11 @@ class TagHolder {
       std::cerr << "Invalid allocation index " << allocationIndex << "\n";
       abort();
     }
-    return _indexToName[_tags[allocationIndex]];
+    return _indexToName[TagAt(allocationIndex)];
+  }
+
+  const std::string& GetTagNameForIndex(TagIndex tagIndex) const {
+    return _indexToName[tagIndex];
   }
 
   const TagIndices* GetTagIndices(std::string tagName) const {
@@ -85,15 +260,106 @@ class TagHolder {
 
   bool IsStronglyTagged(AllocationIndex allocationIndex) const {
     return (allocationIndex < _numAllocations &&
-            _tagIsStrong[_tags[allocationIndex]]);
+            IsStrongTag(TagAt(allocationIndex)));
+  }
+
+  void SaveTo(AnalysisCache::Writer& writer) const {
+    writer.Write((uint64_t)(_indexToName.size()));
+    writer.Write(_tagBits);
+    writer.Write(_tags8);
+    writer.Write(_tags16);
+  }
+
+  /*
+   * Replace the tags with ones saved by SaveTo() after the same tags were
+   * registered, returning false and leaving the tags unchanged if that is
+   * not possible.
+   */
+  bool RestoreFrom(AnalysisCache::Reader& reader) {
+    uint64_t numTags = 0;
+    uint16_t tagBits = 0;
+    std::vector<uint8_t> tags8;
+    std::vector<uint16_t> tags16;
+    if (!reader.Read(numTags) || !reader.Read(tagBits) ||
+        !reader.Read(tags8) || !reader.Read(tags16)) {
+      return false;
+    }
+    if (numTags != _indexToName.size() || tagBits != _tagBits ||
+        ((tagBits == 8) ? tags8.size() : tags16.size()) != _numAllocations) {
+      return false;
+    }
+    if (tagBits == 8) {
+      for (uint8_t tag : tags8) {
+        if (tag >= numTags) {
+          return false;
+        }
+      }
+    } else {
+      for (uint16_t tag : tags16) {
+        if (tag >= numTags) {
+          return false;
+        }
+      }
+    }
+    _tags8.swap(tags8);
+    _tags16.swap(tags16);
+    return true;
   }
 
  private:
   const AllocationIndex _numAllocations;
-  std::vector<TagIndex> _tags;
+  uint16_t _tagBits;
+  std::vector<uint8_t> _tags8;
+  std::vector<uint16_t> _tags16;
   std::vector<std::string> _indexToName;
-  std::vector<bool> _tagIsStrong;
+  /*
+   * This has one bit per tag index, set if the tag is strong.
+   */
+  std::vector<uint64_t> _strongTags;
   std::unordered_map<std::string, TagIndices> _nameToTagIndices;
+  const TagHolder* const _actualTags;
+  Speculation* const _speculation;
+
+  bool IsStrongTag(TagIndex tagIndex) const {
+    return ((_strongTags[tagIndex >> 6] >> (tagIndex & 0x3f)) & 1) != 0;
+  }
+
+  void WidenTags() {
+    _tags16.reserve(_tags8.size());
+    _tags16.resize(_tags8.size(), 0);
+    for (size_t i = 0; i < _tags8.size(); ++i) {
+      _tags16[i] = _tags8[i];
+    }
+    _tagBits = 16;
+    std::vector<uint8_t> tags8;
+    tags8.swap(_tags8);
+  }
+
+  /*
+   * The tags are accessed atomically because, while allocations are being
+   * tagged, they may be read by speculative TagHolders on other threads.
+   */
+  TagIndex LoadTag(AllocationIndex allocationIndex) const {
+    return (_tagBits == 8)
+               ? __atomic_load_n(&_tags8[allocationIndex], __ATOMIC_RELAXED)
+               : __atomic_load_n(&_tags16[allocationIndex], __ATOMIC_RELAXED);
+  }
+
+  void StoreTag(AllocationIndex allocationIndex, TagIndex tagIndex) {
+    if (_tagBits == 8) {
+      __atomic_store_n(&_tags8[allocationIndex], (uint8_t)(tagIndex),
+                       __ATOMIC_RELAXED);
+    } else {
+      __atomic_store_n(&_tags16[allocationIndex], (uint16_t)(tagIndex),
+                       __ATOMIC_RELAXED);
+    }
+  }
+
+  TagIndex TagAt(AllocationIndex allocationIndex) const {
+    return (_speculation == nullptr)
+               ? LoadTag(allocationIndex)
+               : _speculation->Read(allocationIndex, *_actualTags);
+  }
 };
 }  // namespace Allocations
 }  // namespace chap
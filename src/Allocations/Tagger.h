@@ -4,6 +4,7 @@
 #pragma once
 #include "ContiguousImage.h"
 #include "Directory.h"
+#include "TagHolder.h"
 
 namespace chap {
 namespace Allocations {
@@ -66,6 +67,18 @@ class Tagger {
       const AllocationIndex* /* unresolvedOutgoing */) {
     return true;
   }
+
+  /*
+   * Return a new tagger, owned by the caller, that behaves like this one but
+   * tags using the given TagHolder, which has the same tags registered, or
+   * return nullptr if the tagger does not support this.  This is used to
+   * examine allocations on multiple threads, so the copy must share no
+   * state with the original that could be changed while examining an
+   * allocation, other than the tags.
+   */
+  virtual Tagger* Copy(TagHolder<Offset>& /* tagHolder */) const {
+    return nullptr;
+  }
 };
 }  // namespace Allocations
 }  // namespace chap
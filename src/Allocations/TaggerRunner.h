@@ -2,9 +2,14 @@
 // SPDX-License-Identifier: GPL-2.0
 
 #pragma once
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include "../WorkerThreads.h"
 #include "ContiguousImage.h"
 #include "Directory.h"
 #include "Graph.h"
+#include "SignatureColumn.h"
 #include "SignatureDirectory.h"
 #include "TagHolder.h"
 #include "Tagger.h"
@@ -19,6 +24,15 @@ namespace Allocations {
  * and/or possibly tagging allocations reached from that allocation by following
  * references.  An attempt here is to avoid the most expensive checks when
  * possible and to pick the best match when there is some minor ambiguity.
+ *
+ * The results depend on the order in which allocations are examined, because
+ * examining one allocation can tag others, so when multiple threads are used
+ * each thread examines a chunk of allocations speculatively, against a
+ * speculative TagHolder, and the results are then applied in allocation
+ * order.  Any allocation for which the tags read during the speculative
+ * examination no longer match, or for which a tagger asked for it, is simply
+ * examined again at that point, so the tags are exactly the same as if all
+ * the allocations had been examined in order on a single thread.
  */
 template <typename Offset>
 class TaggerRunner {
@@ -27,16 +41,19 @@ class TaggerRunner {
   typedef typename Directory<Offset>::Allocation Allocation;
   typedef typename Tagger<Offset>::Phase Phase;
   typedef typename VirtualAddressMap<Offset>::Reader Reader;
+  typedef typename TagHolder<Offset>::Speculation Speculation;
 
-  TaggerRunner(const Graph<Offset>& graph, const TagHolder<Offset>& tagHolder,
-               const SignatureDirectory<Offset>& signatureDirectory)
+  TaggerRunner(const Graph<Offset>& graph, TagHolder<Offset>& tagHolder,
+               const SignatureDirectory<Offset>& signatureDirectory,
+               const SignatureColumn<Offset>& signatureColumn)
       : _addressMap(graph.GetAddressMap()),
         _graph(graph),
         _directory(graph.GetAllocationDirectory()),
-        _contiguousImage(_addressMap, _directory),
+        _candidateFilter(_directory.GetCandidateFilter()),
         _numAllocations(_directory.NumAllocations()),
         _tagHolder(tagHolder),
-        _signatureDirectory(signatureDirectory) {}
+        _signatureDirectory(signatureDirectory),
+        _signatureColumn(signatureColumn) {}
 
   ~TaggerRunner() {
     for (auto tagger : _taggers) {
@@ -46,38 +63,71 @@ class TaggerRunner {
 
   void RegisterTagger(Tagger<Offset>* t) { _taggers.push_back(t); }
   void ResolveAllAllocationTags() {
-    _numTaggers = _taggers.size();
-    _finishedWithPass.reserve(_numTaggers);
-    _finishedWithPass.resize(_numTaggers, false);
-    TagFromAllocations();
-    TagFromReferenced();
+    Examiner examiner(*this, _taggers, _tagHolder);
+    size_t targetNumChunks = WorkerThreads::GetNumThreads() * CHUNKS_PER_THREAD;
+    AllocationIndex chunkSize =
+        (_numAllocations + targetNumChunks - 1) / targetNumChunks;
+    if (chunkSize < MIN_ALLOCATIONS_PER_CHUNK) {
+      chunkSize = MIN_ALLOCATIONS_PER_CHUNK;
+    }
+    size_t numChunks = (_numAllocations + chunkSize - 1) / chunkSize;
+    size_t numWorkers = WorkerThreads::NumWorkersFor(numChunks);
+    std::vector<std::unique_ptr<Lane> > lanes;
+    if (numWorkers > 1) {
+      for (size_t i = 0; i < numWorkers; i++) {
+        lanes.emplace_back(new Lane(*this));
+        if (!lanes.back()->_supported) {
+          lanes.clear();
+          break;
+        }
+      }
+    }
+    if (lanes.empty()) {
+      for (AllocationIndex i = 0; i < _numAllocations; i++) {
+        examiner.TagFromAllocation(i);
+      }
+      for (AllocationIndex i = 0; i < _numAllocations; i++) {
+        examiner.TagFromReferenced(i);
+      }
+    } else {
+      RunPass(&Examiner::TagFromAllocation, examiner, lanes, chunkSize,
+              numChunks);
+      RunPass(&Examiner::TagFromReferenced, examiner, lanes, chunkSize,
+              numChunks);
+    }
   }
 
  private:
-  const VirtualAddressMap<Offset> _addressMap;
-  const Graph<Offset>& _graph;
-  const Directory<Offset>& _directory;
-  ContiguousImage<Offset> _contiguousImage;
-  const AllocationIndex _numAllocations;
-  const TagHolder<Offset>& _tagHolder;
-  const SignatureDirectory<Offset>& _signatureDirectory;
-  std::vector<Tagger<Offset>*> _taggers;
-  size_t _numTaggers;
-  std::vector<bool> _finishedWithPass;
-  size_t _numFinishedWithPass;
-
   /*
-   * For each used allocation, attempt to tag it and any referenced
-   * allocations for which the tag is implied directly as a result
-   * of the newly added tag.
+   * An Examiner has what is needed to examine allocations on one thread,
+   * using the given taggers, which tag using the given TagHolder.
    */
+  class Examiner {
+   public:
+    Examiner(const TaggerRunner& runner,
+             const std::vector<Tagger<Offset>*>& taggers,
+             TagHolder<Offset>& tagHolder)
+        : _runner(runner),
+          _directory(runner._directory),
+          _numAllocations(runner._numAllocations),
+          _taggers(taggers),
+          _numTaggers(taggers.size()),
+          _tagHolder(tagHolder),
+          _contiguousImage(runner._addressMap, _directory),
+          _reader(runner._addressMap),
+          _finishedWithPass(_numTaggers, false),
+          _numFinishedWithPass(0) {}
 
-  void TagFromAllocations() {
-    Reader reader(_addressMap);
-    for (AllocationIndex i = 0; i < _numAllocations; i++) {
+    /*
+     * If the allocation is used, attempt to tag it and any referenced
+     * allocations for which the tag is implied directly as a result
+     * of the newly added tag.
+     */
+
+    void TagFromAllocation(AllocationIndex i) {
       const Allocation* allocation = _directory.AllocationAt(i);
       if (!allocation->IsUsed()) {
-        continue;
+        return;
       }
       _contiguousImage.SetIndex(i);
       for (size_t taggersIndex = 0; taggersIndex < _numTaggers;
@@ -85,118 +135,240 @@ class TaggerRunner {
         _finishedWithPass[taggersIndex] = false;
       }
       _numFinishedWithPass = 0;
-      bool isUnsigned = true;
-      if (allocation->Size() >= sizeof(Offset)) {
-        Offset signatureCandidate =
-            reader.ReadOffset(allocation->Address(), 0xbad);
-        if (_signatureDirectory.IsMapped(signatureCandidate)) {
-          isUnsigned = false;
-        }
-      }
-      if (!RunTagFromAllocationPhase(reader, i, Phase::QUICK_INITIAL_CHECK,
-                                     *allocation, isUnsigned) &&
-          !RunTagFromAllocationPhase(reader, i, Phase::MEDIUM_CHECK,
+      bool isUnsigned = !_runner._signatureDirectory.HasSignatureId(
+          _runner._signatureColumn[i]);
+      if (!RunTagFromAllocationPhase(i, Phase::QUICK_INITIAL_CHECK,
                                      *allocation, isUnsigned) &&
-          !RunTagFromAllocationPhase(reader, i, Phase::SLOW_CHECK, *allocation,
+          !RunTagFromAllocationPhase(i, Phase::MEDIUM_CHECK, *allocation,
+                                     isUnsigned) &&
+          !RunTagFromAllocationPhase(i, Phase::SLOW_CHECK, *allocation,
                                      isUnsigned)) {
-        RunTagFromAllocationPhase(reader, i, Phase::WEAK_CHECK, *allocation,
+        RunTagFromAllocationPhase(i, Phase::WEAK_CHECK, *allocation,
                                   isUnsigned);
       }
     }
-  }
 
-  /*
-   * For each used allocation, regardless of whether it has already been
-   * tagged, use the contents of that allocation to attempt to tag any
-   * allocations referenced by it that have not yet been tagged.
-   */
+    /*
+     * If the allocation is used, regardless of whether it has already been
+     * tagged, use the contents of that allocation to attempt to tag any
+     * allocations referenced by it that have not yet been tagged.
+     */
 
-  void TagFromReferenced() {
-    Reader reader(_addressMap);
-    std::vector<AllocationIndex> unresolvedOutgoing;
-    unresolvedOutgoing.reserve(_directory.MaxAllocationSize());
-    for (AllocationIndex i = 0; i < _numAllocations; i++) {
+    void TagFromReferenced(AllocationIndex i) {
       const Allocation* allocation = _directory.AllocationAt(i);
       if (!allocation->IsUsed()) {
-        continue;
+        return;
       }
       _contiguousImage.SetIndex(i);
-      unresolvedOutgoing.clear();
-      size_t numUnresolved = 0;
+      const Offset* firstOffset = _contiguousImage.FirstOffset();
       const Offset* offsetLimit = _contiguousImage.OffsetLimit();
-      for (const Offset* check = _contiguousImage.FirstOffset();
-           check < offsetLimit; check++) {
-        AllocationIndex targetIndex = _graph.TargetAllocationIndex(i, *check);
-        if (targetIndex != _numAllocations) {
-          if (_tagHolder.IsStronglyTagged(targetIndex)) {
-            targetIndex = _numAllocations;
-          } else {
-            numUnresolved++;
-          }
-        }
-        unresolvedOutgoing.push_back(targetIndex);
-      }
+      _unresolvedOutgoing.assign(offsetLimit - firstOffset, _numAllocations);
+      size_t numUnresolved = 0;
+      _runner._candidateFilter.Visit(
+          firstOffset, offsetLimit, [&](const Offset* check) {
+            AllocationIndex targetIndex =
+                _runner._graph.TargetAllocationIndex(i, *check);
+            if (targetIndex != _numAllocations &&
+                !_tagHolder.IsStronglyTagged(targetIndex)) {
+              _unresolvedOutgoing[check - firstOffset] = targetIndex;
+              numUnresolved++;
+            }
+          });
       if (numUnresolved == 0) {
-        continue;
+        return;
       }
       for (size_t taggersIndex = 0; taggersIndex < _numTaggers;
            ++taggersIndex) {
         _finishedWithPass[taggersIndex] = false;
       }
       _numFinishedWithPass = 0;
-      AllocationIndex* pUnresolvedOutgoing = &(unresolvedOutgoing[0]);
-      if (!RunTagFromReferencedPhase(reader, i, Phase::QUICK_INITIAL_CHECK,
-                                     *allocation, pUnresolvedOutgoing) &&
-          !RunTagFromReferencedPhase(reader, i, Phase::MEDIUM_CHECK,
+      AllocationIndex* pUnresolvedOutgoing = &(_unresolvedOutgoing[0]);
+      if (!RunTagFromReferencedPhase(i, Phase::QUICK_INITIAL_CHECK,
                                      *allocation, pUnresolvedOutgoing) &&
-          !RunTagFromReferencedPhase(reader, i, Phase::SLOW_CHECK, *allocation,
+          !RunTagFromReferencedPhase(i, Phase::MEDIUM_CHECK, *allocation,
+                                     pUnresolvedOutgoing) &&
+          !RunTagFromReferencedPhase(i, Phase::SLOW_CHECK, *allocation,
                                      pUnresolvedOutgoing)) {
-        RunTagFromReferencedPhase(reader, i, Phase::WEAK_CHECK, *allocation,
+        RunTagFromReferencedPhase(i, Phase::WEAK_CHECK, *allocation,
                                   pUnresolvedOutgoing);
       }
     }
-  }
 
-  bool RunTagFromAllocationPhase(Reader& reader, AllocationIndex index,
-                                 Phase phase, const Allocation& allocation,
-                                 bool isUnsigned) {
-    size_t resolvedIndex = 0;
-    for (auto tagger : _taggers) {
-      if (_finishedWithPass[resolvedIndex]) {
+   private:
+    const TaggerRunner& _runner;
+    const Directory<Offset>& _directory;
+    const AllocationIndex _numAllocations;
+    const std::vector<Tagger<Offset>*>& _taggers;
+    const size_t _numTaggers;
+    TagHolder<Offset>& _tagHolder;
+    ContiguousImage<Offset> _contiguousImage;
+    Reader _reader;
+    std::vector<bool> _finishedWithPass;
+    size_t _numFinishedWithPass;
+    std::vector<AllocationIndex> _unresolvedOutgoing;
+
+    bool RunTagFromAllocationPhase(AllocationIndex index, Phase phase,
+                                   const Allocation& allocation,
+                                   bool isUnsigned) {
+      size_t resolvedIndex = 0;
+      for (auto tagger : _taggers) {
+        if (_finishedWithPass[resolvedIndex]) {
+          ++resolvedIndex;
+          continue;
+        }
+        if (tagger->TagFromAllocation(_contiguousImage, _reader, index, phase,
+                                      allocation, isUnsigned)) {
+          _finishedWithPass[resolvedIndex] = true;
+          if (++_numFinishedWithPass == _numTaggers) {
+            return true;
+          }
+        }
         ++resolvedIndex;
-        continue;
       }
-      if (tagger->TagFromAllocation(_contiguousImage, reader, index, phase,
-                                    allocation, isUnsigned)) {
-        _finishedWithPass[resolvedIndex] = true;
-        if (++_numFinishedWithPass == _numTaggers) {
-          return true;
+      return false;
+    }
+
+    bool RunTagFromReferencedPhase(AllocationIndex index, Phase phase,
+                                   const Allocation& allocation,
+                                   AllocationIndex* unresolvedOutgoing) {
+      size_t resolvedIndex = 0;
+      for (auto tagger : _taggers) {
+        if (_finishedWithPass[resolvedIndex]) {
+          ++resolvedIndex;
+          continue;
         }
+        if (tagger->TagFromReferenced(_contiguousImage, _reader, index, phase,
+                                      allocation, unresolvedOutgoing)) {
+          _finishedWithPass[resolvedIndex] = true;
+          if (++_numFinishedWithPass == _numTaggers) {
+            return true;
+          }
+        }
+        ++resolvedIndex;
       }
-      ++resolvedIndex;
+      return false;
     }
-    return false;
-  }
+  };
 
-  bool RunTagFromReferencedPhase(Reader& reader, AllocationIndex index,
-                                 Phase phase, const Allocation& allocation,
-                                 AllocationIndex* unresolvedOutgoing) {
-    size_t resolvedIndex = 0;
-    for (auto tagger : _taggers) {
-      if (_finishedWithPass[resolvedIndex]) {
-        ++resolvedIndex;
-        continue;
+  /*
+   * A Lane has what is needed for one worker thread to examine allocations
+   * speculatively, using its own copies of the taggers.  It is not supported
+   * if any of the taggers cannot be copied.
+   */
+  struct Lane {
+    Lane(const TaggerRunner& runner)
+        : _tagHolder(runner._tagHolder, _speculation),
+          _taggers(CopyTaggers(runner._taggers, _tagHolder)),
+          _supported(_taggers.size() == runner._taggers.size()),
+          _examiner(runner, _taggers, _tagHolder) {}
+    ~Lane() {
+      for (auto tagger : _taggers) {
+        delete tagger;
       }
-      if (tagger->TagFromReferenced(_contiguousImage, reader, index, phase,
-                                    allocation, unresolvedOutgoing)) {
-        _finishedWithPass[resolvedIndex] = true;
-        if (++_numFinishedWithPass == _numTaggers) {
-          return true;
+    }
+    Speculation _speculation;
+    TagHolder<Offset> _tagHolder;
+    std::vector<Tagger<Offset>*> _taggers;
+    bool _supported;
+    Examiner _examiner;
+
+    static std::vector<Tagger<Offset>*> CopyTaggers(
+        const std::vector<Tagger<Offset>*>& taggers,
+        TagHolder<Offset>& tagHolder) {
+      std::vector<Tagger<Offset>*> copies;
+      for (auto tagger : taggers) {
+        Tagger<Offset>* copy = tagger->Copy(tagHolder);
+        if (copy == nullptr) {
+          for (auto copied : copies) {
+            delete copied;
+          }
+          copies.clear();
+          break;
         }
+        copies.push_back(copy);
       }
-      ++resolvedIndex;
+      return copies;
     }
-    return false;
+  };
+
+  typedef void (Examiner::*Examine)(AllocationIndex);
+
+  /*
+   * Allocations are examined in chunks of consecutive allocations, with
+   * enough chunks that the threads stay busy even if the cost of examining
+   * the chunks varies a lot, but not so many that the cost of taking turns
+   * to apply the results matters.
+   */
+  static constexpr size_t CHUNKS_PER_THREAD = 16;
+  static constexpr AllocationIndex MIN_ALLOCATIONS_PER_CHUNK = 0x40;
+
+  const VirtualAddressMap<Offset>& _addressMap;
+  const Graph<Offset>& _graph;
+  const Directory<Offset>& _directory;
+  const CandidateFilter<Offset> _candidateFilter;
+  const AllocationIndex _numAllocations;
+  TagHolder<Offset>& _tagHolder;
+  const SignatureDirectory<Offset>& _signatureDirectory;
+  const SignatureColumn<Offset>& _signatureColumn;
+  std::vector<Tagger<Offset>*> _taggers;
+
+  /*
+   * Do one pass through all the allocations, examining each chunk
+   * speculatively on whatever thread is available, then waiting for all
+   * earlier chunks to be finished before applying the results, examining
+   * allocations again with the original taggers as needed.
+   */
+  void RunPass(Examine examine, Examiner& examiner,
+               std::vector<std::unique_ptr<Lane> >& lanes,
+               AllocationIndex chunkSize, size_t numChunks) {
+    std::mutex mutex;
+    std::condition_variable turnChanged;
+    size_t turn = 0;
+    bool abandoned = false;
+    WorkerThreads::Run(numChunks, [&](size_t chunk, size_t worker) {
+      Lane& lane = *(lanes[worker]);
+      Speculation& speculation = lane._speculation;
+      speculation.Clear();
+      AllocationIndex base = chunk * chunkSize;
+      AllocationIndex limit = (_numAllocations - base < chunkSize)
+                                  ? _numAllocations
+                                  : base + chunkSize;
+      for (AllocationIndex i = base; i < limit; i++) {
+        speculation.BeginStep(i);
+        try {
+          (lane._examiner.*examine)(i);
+        } catch (...) {
+          speculation.RequireOrderedRun();
+        }
+      }
+      {
+        std::unique_lock<std::mutex> lock(mutex);
+        turnChanged.wait(lock, [&] { return turn == chunk || abandoned; });
+        if (abandoned) {
+          return;
+        }
+      }
+      try {
+        size_t numSteps = speculation.NumSteps();
+        for (size_t step = 0; step < numSteps; step++) {
+          if (!_tagHolder.ApplySpeculation(speculation, step)) {
+            (examiner.*examine)(speculation.StepAllocationIndex(step));
+          }
+        }
+      } catch (...) {
+        {
+          std::lock_guard<std::mutex> lock(mutex);
+          abandoned = true;
+        }
+        turnChanged.notify_all();
+        throw;
+      }
+      {
+        std::lock_guard<std::mutex> lock(mutex);
+        turn++;
+      }
+      turnChanged.notify_all();
+    });
   }
 };
 }  // namespace Allocations
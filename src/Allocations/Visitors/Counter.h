@@ -22,6 +22,7 @@ class Counter {
       return new Counter(context);
     }
     const std::string& GetCommandName() const { return _commandName; }
+    bool AllowsRecordFormats() const { return true; }
     // TODO: allow adding taints
     const std::vector<std::string>& GetTaints() const { return _taints; }
     void ShowHelpMessage(Commands::Context& context) {
@@ -24,6 +24,7 @@ class Explainer {
       return new Explainer(context, _describer);
     }
     const std::string& GetCommandName() const { return _commandName; }
+    bool AllowsRecordFormats() const { return false; }
     // TODO: allow adding taints
     const std::vector<std::string>& GetTaints() const { return _taints; }
     void ShowHelpMessage(Commands::Context& context) {
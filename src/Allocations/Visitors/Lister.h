@@ -24,6 +24,7 @@ class Lister {
                         processImage.GetVirtualAddressMap());
     }
     const std::string& GetCommandName() const { return _commandName; }
+    bool AllowsRecordFormats() const { return true; }
     // TODO: allow adding taints
     const std::vector<std::string>& GetTaints() const { return _taints; }
     void ShowHelpMessage(Commands::Context& context) {
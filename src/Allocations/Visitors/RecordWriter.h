@@ -0,0 +1,316 @@
+// Copyright (c) 2021 VMware, Inc. All Rights Reserved.
+// SPDX-License-Identifier: GPL-2.0
+
+#pragma once
+#include <stdint.h>
+#include <string.h>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "../../Commands/Runner.h"
+#include "../../ProcessImage.h"
+#include "../Directory.h"
+#include "../Graph.h"
+#include "../SignatureDirectory.h"
+#include "../TagHolder.h"
+namespace chap {
+namespace Allocations {
+namespace Visitors {
+/*
+ * A RecordWriter replaces the usual visitor of a set when the /format switch
+ * is used, writing one record per visited allocation, with the address,
+ * size, status (free, anchored or leaked), signature and its name, if any,
+ * tag name, if any, and numbers of incoming and outgoing references.  The
+ * jsonl and csv formats are written as the allocations are visited.  The
+ * binary format is columnar, and so is written only after the last
+ * allocation has been visited.  See USERGUIDE.md for the layout.
+ */
+template <class Offset>
+class RecordWriter {
+ public:
+  typedef typename Directory<Offset>::AllocationIndex AllocationIndex;
+  typedef typename Directory<Offset>::Allocation Allocation;
+  typedef typename Graph<Offset>::EdgeIterator EdgeIterator;
+  enum Format { JSONL, CSV, BINARY };
+  enum Status : uint8_t { FREE = 0, ANCHORED = 1, LEAKED = 2, USED = 3 };
+  static constexpr uint32_t NO_STRING = 0xffffffff;
+
+  /*
+   * Return a new RecordWriter if the /format switch was given, or nullptr
+   * if it was not or if the switch was not valid, in which case an error
+   * is reported and switchError is set.
+   */
+  static RecordWriter* Make(Commands::Context& context,
+                            const ProcessImage<Offset>& processImage,
+                            bool& switchError) {
+    size_t numFormatArguments = context.GetNumArguments("format");
+    if (numFormatArguments == 0) {
+      return nullptr;
+    }
+    Commands::Error& error = context.GetError();
+    if (numFormatArguments > 1) {
+      error << "At most one /format switch is allowed.\n";
+      switchError = true;
+      return nullptr;
+    }
+    const std::string& formatName = context.Argument("format", 0);
+    Format format;
+    if (formatName == "jsonl") {
+      format = JSONL;
+    } else if (formatName == "csv") {
+      format = CSV;
+    } else if (formatName == "binary") {
+      format = BINARY;
+      if (!context.IsRedirected()) {
+        error << "The binary format can be used only if the output is "
+                 "redirected.\n";
+        switchError = true;
+        return nullptr;
+      }
+    } else {
+      error << "Unknown /format argument \"" << formatName << "\"\n";
+      switchError = true;
+      return nullptr;
+    }
+    return new RecordWriter(context, processImage, format);
+  }
+
+  RecordWriter(Commands::Context& context,
+               const ProcessImage<Offset>& processImage, Format format)
+      : _output(context.GetOutput()),
+        _format(format),
+        _addressMap(processImage.GetVirtualAddressMap()),
+        _signatureDirectory(processImage.GetSignatureDirectory()),
+        _graph(processImage.GetAllocationGraph()),
+        _tagHolder(processImage.GetAllocationTagHolder()) {
+    if (_format == CSV) {
+      _output << "address,size,status,signature,signatureName,tag,incoming,"
+                 "outgoing\n";
+    }
+  }
+
+  ~RecordWriter() {
+    if (_format == BINARY) {
+      WriteColumns();
+    }
+  }
+
+  void Visit(AllocationIndex index, const Allocation& allocation) {
+    Offset address = allocation.Address();
+    Offset size = allocation.Size();
+    Status status = FREE;
+    if (allocation.IsUsed()) {
+      status = (_graph == nullptr)
+                   ? USED
+                   : (_graph->IsLeaked(index) ? LEAKED : ANCHORED);
+    }
+    Offset signature = 0;
+    const std::string* signatureName = nullptr;
+    if (size >= sizeof(Offset)) {
+      const char* image;
+      if (_addressMap.FindMappedMemoryImage(address, &image) >=
+          sizeof(Offset)) {
+        Offset candidate = *((Offset*)image);
+        if (_signatureDirectory.IsMapped(candidate)) {
+          signature = candidate;
+          signatureName = &_signatureDirectory.Name(candidate);
+          if (signatureName->empty()) {
+            signatureName = nullptr;
+          }
+        }
+      }
+    }
+    const std::string* tagName = nullptr;
+    if (_tagHolder != nullptr) {
+      tagName = &_tagHolder->GetTagName(index);
+      if (tagName->empty()) {
+        tagName = nullptr;
+      }
+    }
+    uint32_t numIncoming = 0;
+    uint32_t numOutgoing = 0;
+    if (_graph != nullptr) {
+      EdgeIterator it;
+      EdgeIterator itEnd;
+      _graph->GetIncoming(index, &it, &itEnd);
+      for (; it != itEnd; ++it) {
+        numIncoming++;
+      }
+      _graph->GetOutgoing(index, &it, &itEnd);
+      for (; it != itEnd; ++it) {
+        numOutgoing++;
+      }
+    }
+
+    switch (_format) {
+      case JSONL:
+        _output << "{\"address\":\"0x" << std::hex << address
+                << "\",\"size\":" << std::dec << size << ",\"status\":\""
+                << StatusName(status) << "\",\"signature\":";
+        if (signature == 0) {
+          _output << "null";
+        } else {
+          _output << "\"0x" << std::hex << signature << "\"";
+        }
+        _output << ",\"signatureName\":";
+        WriteJsonString(signatureName);
+        _output << ",\"tag\":";
+        WriteJsonString(tagName);
+        _output << ",\"incoming\":" << std::dec << numIncoming
+                << ",\"outgoing\":" << numOutgoing << "}\n";
+        break;
+      case CSV:
+        _output << "0x" << std::hex << address << "," << std::dec << size
+                << "," << StatusName(status) << ",";
+        if (signature != 0) {
+          _output << "0x" << std::hex << signature;
+        }
+        _output << ",";
+        WriteCsvString(signatureName);
+        _output << ",";
+        WriteCsvString(tagName);
+        _output << "," << std::dec << numIncoming << "," << numOutgoing
+                << "\n";
+        break;
+      case BINARY:
+        _addresses.push_back(address);
+        _sizes.push_back(size);
+        _signatures.push_back(signature);
+        _signatureNames.push_back(StringIndex(signatureName));
+        _tags.push_back(StringIndex(tagName));
+        _incoming.push_back(numIncoming);
+        _outgoing.push_back(numOutgoing);
+        _statuses.push_back(status);
+        break;
+    }
+  }
+
+ private:
+  Commands::Output& _output;
+  const Format _format;
+  const VirtualAddressMap<Offset>& _addressMap;
+  const SignatureDirectory<Offset>& _signatureDirectory;
+  const Graph<Offset>* _graph;
+  const TagHolder<Offset>* _tagHolder;
+  std::vector<uint64_t> _addresses;
+  std::vector<uint64_t> _sizes;
+  std::vector<uint64_t> _signatures;
+  std::vector<uint32_t> _signatureNames;
+  std::vector<uint32_t> _tags;
+  std::vector<uint32_t> _incoming;
+  std::vector<uint32_t> _outgoing;
+  std::vector<uint8_t> _statuses;
+  std::vector<const std::string*> _strings;
+  std::unordered_map<std::string, uint32_t> _stringIndices;
+
+  static const char* StatusName(Status status) {
+    switch (status) {
+      case FREE:
+        return "free";
+      case ANCHORED:
+        return "anchored";
+      case LEAKED:
+        return "leaked";
+      default:
+        return "used";
+    }
+  }
+
+  void WriteJsonString(const std::string* value) {
+    if (value == nullptr) {
+      _output << "null";
+      return;
+    }
+    std::string escaped("\"");
+    for (char c : *value) {
+      if (c == '"' || c == '\\') {
+        escaped.push_back('\\');
+        escaped.push_back(c);
+      } else if ((unsigned char)(c) < ' ') {
+        const char* hexDigits = "0123456789abcdef";
+        escaped.append("\\u00");
+        escaped.push_back(hexDigits[(c >> 4) & 0xf]);
+        escaped.push_back(hexDigits[c & 0xf]);
+      } else {
+        escaped.push_back(c);
+      }
+    }
+    escaped.push_back('"');
+    _output << escaped;
+  }
+
+  void WriteCsvString(const std::string* value) {
+    if (value == nullptr) {
+      return;
+    }
+    if (value->find_first_of(",\"\n\r") == std::string::npos) {
+      _output << *value;
+      return;
+    }
+    std::string quoted("\"");
+    for (char c : *value) {
+      if (c == '"') {
+        quoted.push_back('"');
+      }
+      quoted.push_back(c);
+    }
+    quoted.push_back('"');
+    _output << quoted;
+  }
+
+  uint32_t StringIndex(const std::string* value) {
+    if (value == nullptr) {
+      return NO_STRING;
+    }
+    auto inserted = _stringIndices.emplace(*value, (uint32_t)_strings.size());
+    if (inserted.second) {
+      _strings.push_back(&(inserted.first->first));
+    }
+    return inserted.first->second;
+  }
+
+  template <typename T>
+  void WriteColumn(std::ostream& stream, const std::vector<T>& column) {
+    static const char padding[8] = {0, 0, 0, 0, 0, 0, 0, 0};
+    size_t numBytes = column.size() * sizeof(T);
+    stream.write((const char*)(column.data()), numBytes);
+    stream.write(padding, (8 - (numBytes & 7)) & 7);
+  }
+
+  /*
+   * Write the header, each column, padded to a multiple of 8 bytes, then
+   * the offsets of the strings, which refer to the bytes that follow them.
+   */
+  void WriteColumns() {
+    std::ostream& stream = _output.GetTopOutputStream();
+    std::vector<uint64_t> stringOffsets;
+    stringOffsets.reserve(_strings.size() + 1);
+    std::string stringBytes;
+    for (const std::string* s : _strings) {
+      stringOffsets.push_back(stringBytes.size());
+      stringBytes.append(*s);
+    }
+    stringOffsets.push_back(stringBytes.size());
+    std::vector<uint64_t> header;
+    uint64_t magic;
+    memcpy(&magic, "CHAPREC1", sizeof(magic));
+    header.push_back(magic);
+    header.push_back(_addresses.size());
+    header.push_back(_strings.size());
+    header.push_back(stringBytes.size());
+    WriteColumn(stream, header);
+    WriteColumn(stream, _addresses);
+    WriteColumn(stream, _sizes);
+    WriteColumn(stream, _signatures);
+    WriteColumn(stream, _signatureNames);
+    WriteColumn(stream, _tags);
+    WriteColumn(stream, _incoming);
+    WriteColumn(stream, _outgoing);
+    WriteColumn(stream, _statuses);
+    WriteColumn(stream, stringOffsets);
+    stream.write(stringBytes.data(), stringBytes.size());
+  }
+};
+}  // namespace Visitors
+}  // namespace Allocations
+}  // namespace chap
@@ -28,6 +28,7 @@ class Shower {
                         processImage.GetVirtualAddressMap(), showAscii);
     }
     const std::string& GetCommandName() const { return _commandName; }
+    bool AllowsRecordFormats() const { return false; }
     // TODO: allow adding taints
     const std::vector<std::string>& GetTaints() const { return _taints; }
     void ShowHelpMessage(Commands::Context& context) {
@@ -41,10 +41,12 @@ class Summarizer {
         }
       }
       return new Summarizer(context, processImage.GetSignatureDirectory(),
+                            processImage.GetSignatureColumn(),
                             *(processImage.GetAllocationTagHolder()),
                             processImage.GetVirtualAddressMap(), sortByCount);
     }
     const std::string& GetCommandName() const { return _commandName; }
+    bool AllowsRecordFormats() const { return true; }
     // TODO: allow adding taints
     const std::vector<std::string>& GetTaints() const { return _taints; }
     void ShowHelpMessage(Commands::Context& context) {
@@ -64,10 +66,11 @@ class Summarizer {
 
   Summarizer(Commands::Context& context,
              const SignatureDirectory<Offset>& signatureDirectory,
+             const SignatureColumn<Offset>& signatureColumn,
              const TagHolder<Offset>& tagHolder,
              const VirtualAddressMap<Offset>& addressMap, bool sortByCount)
       : _context(context),
-        _signatureSummary(signatureDirectory, tagHolder),
+        _signatureSummary(signatureDirectory, signatureColumn, tagHolder),
         _addressMap(addressMap),
         _sizedTally(context, "allocations"),
         _sortByCount(sortByCount) {}
@@ -90,7 +93,7 @@ class Summarizer {
       size = numBytesFound;
     }
     _sizedTally.AdjustTally(size);
-    _signatureSummary.AdjustTally(index, size, image);
+    _signatureSummary.AdjustTally(index, size);
   }
 
  private:
@@ -0,0 +1,296 @@
+// Copyright (c) 2021 VMware, Inc. All Rights Reserved.
+// SPDX-License-Identifier: GPL-2.0
+
+#pragma once
+extern "C" {
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+};
+#include <iostream>
+#include <string>
+#include <vector>
+
+namespace chap {
+/*
+ * An AnalysisCache is a file, kept next to a core, that holds the results
+ * of the most expensive parts of the analysis of that core, so that those
+ * parts can be skipped when the same core is opened again.  The file starts
+ * with a Key that identifies the core and the version of the file format,
+ * followed by a sequence of values and arrays, each aligned so that the
+ * file can be mapped and the arrays copied out as they are, without any
+ * parsing.  The producer and consumer of the results are responsible for
+ * writing and reading them in the same order.
+ *
+ * Use of the cache is off by default, because it creates a file that may
+ * be as large as a significant fraction of the core.
+ */
+class AnalysisCache {
+ public:
+  /*
+   * This must be changed whenever the layout of the file or the meaning of
+   * anything stored in it changes, including any change to the analysis
+   * that would give different results for the same core.
+   */
+  static constexpr uint32_t FORMAT_VERSION = 3;
+  static constexpr uint64_t ALIGNMENT = 64;
+
+  struct Key {
+    Key() { memset(this, 0, sizeof(*this)); }
+    char _magic[8];
+    uint32_t _formatVersion;
+    uint32_t _offsetSize;
+    uint64_t _coreSize;
+    int64_t _coreModificationSeconds;
+    int64_t _coreModificationNanoseconds;
+    uint64_t _headersHash;
+    uint64_t _allocationsHash;
+    uint64_t _numAllocations;
+    bool operator==(const Key& other) const {
+      return memcmp(this, &other, sizeof(*this)) == 0;
+    }
+  };
+
+  static bool IsEnabled() { return Enabled(); }
+  static void SetEnabled(bool enabled) { Enabled() = enabled; }
+
+  static std::string PathFor(const std::string& corePath) {
+    return corePath + ".chapcache";
+  }
+
+  /*
+   * Return a key for the given core and allocations, or a key with no magic
+   * number, which never matches, if the core cannot be checked.
+   */
+  static Key MakeKey(int coreFd, uint32_t offsetSize, uint64_t headersHash,
+                     uint64_t allocationsHash, uint64_t numAllocations) {
+    Key key;
+    struct stat statBuf;
+    if (fstat(coreFd, &statBuf) != 0) {
+      return key;
+    }
+    memcpy(key._magic, MAGIC, sizeof(key._magic));
+    key._formatVersion = FORMAT_VERSION;
+    key._offsetSize = offsetSize;
+    key._coreSize = statBuf.st_size;
+    key._coreModificationSeconds = statBuf.st_mtim.tv_sec;
+    key._coreModificationNanoseconds = statBuf.st_mtim.tv_nsec;
+    key._headersHash = headersHash;
+    key._allocationsHash = allocationsHash;
+    key._numAllocations = numAllocations;
+    return key;
+  }
+
+  /*
+   * Compute a 64 bit FNV-1a hash of the given bytes, continuing from the
+   * given hash if one is provided.
+   */
+  static uint64_t Hash(const void* data, size_t size,
+                       uint64_t hash = 0xcbf29ce484222325ULL) {
+    const unsigned char* bytes = (const unsigned char*)(data);
+    for (const unsigned char* limit = bytes + size; bytes < limit; bytes++) {
+      hash = (hash ^ *bytes) * 0x100000001b3ULL;
+    }
+    return hash;
+  }
+
+  /*
+   * A Reader maps an existing cache file and reads values from it in the
+   * order they were written.  Any failure, including a read past the end of
+   * the file or a mismatch in the size of the elements of an array, makes
+   * that read and all subsequent reads fail, so the caller need only check
+   * the result of the last read of a group of values before using them.
+   */
+  class Reader {
+   public:
+    Reader(const std::string& path, const Key& expectedKey)
+        : _image(nullptr), _size(0), _next(0), _failed(true) {
+      int fd = open(path.c_str(), O_RDONLY);
+      if (fd < 0) {
+        return;
+      }
+      struct stat statBuf;
+      if (fstat(fd, &statBuf) == 0 &&
+          (uint64_t)(statBuf.st_size) >= sizeof(Key)) {
+        void* image =
+            mmap(nullptr, statBuf.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (image != MAP_FAILED) {
+          _image = (const char*)(image);
+          _size = statBuf.st_size;
+          _failed = !(*((const Key*)(_image)) == expectedKey);
+          _next = Aligned(sizeof(Key));
+        }
+      }
+      close(fd);
+    }
+
+    Reader(const Reader&) = delete;
+    Reader& operator=(const Reader&) = delete;
+
+    ~Reader() {
+      if (_image != nullptr) {
+        munmap((void*)(_image), _size);
+      }
+    }
+
+    bool IsValid() const { return !_failed; }
+
+    template <typename T>
+    bool Read(T& value) {
+      const char* image = Take(sizeof(T), 1);
+      if (image == nullptr) {
+        return false;
+      }
+      memcpy(&value, image, sizeof(T));
+      return true;
+    }
+
+    template <typename T>
+    bool Read(std::vector<T>& values) {
+      uint64_t elementSize = 0;
+      uint64_t numElements = 0;
+      if (!Read(elementSize) || !Read(numElements)) {
+        return false;
+      }
+      if (elementSize != sizeof(T)) {
+        _failed = true;
+        return false;
+      }
+      const char* image = Take(sizeof(T), numElements);
+      if (image == nullptr) {
+        return false;
+      }
+      values.resize(numElements);
+      memcpy(values.data(), image, numElements * sizeof(T));
+      return true;
+    }
+
+    /*
+     * Return true if the entire file has been read successfully.
+     */
+    bool Finished() const { return !_failed && _next == _size; }
+
+   private:
+    const char* _image;
+    uint64_t _size;
+    uint64_t _next;
+    bool _failed;
+
+    const char* Take(uint64_t elementSize, uint64_t numElements) {
+      if (_failed || numElements > (_size - _next) / elementSize) {
+        _failed = true;
+        return nullptr;
+      }
+      const char* image = _image + _next;
+      _next = Aligned(_next + elementSize * numElements);
+      if (_next > _size) {
+        _next = _size;
+      }
+      return image;
+    }
+  };
+
+  /*
+   * A Writer creates a temporary file, to which values are appended, and
+   * which replaces any existing cache file only when Commit() is called,
+   * so that a partially written cache is never visible.
+   */
+  class Writer {
+   public:
+    Writer(const std::string& path, const Key& key)
+        : _path(path), _tempPath(path + ".XXXXXX"), _file(nullptr), _size(0) {
+      std::vector<char> tempPathChars(_tempPath.begin(), _tempPath.end());
+      tempPathChars.push_back('\000');
+      int fd = mkstemp(tempPathChars.data());
+      if (fd < 0) {
+        return;
+      }
+      _tempPath.assign(tempPathChars.data());
+      _file = fdopen(fd, "w");
+      if (_file == nullptr) {
+        close(fd);
+        unlink(_tempPath.c_str());
+        return;
+      }
+      Write(key);
+    }
+
+    Writer(const Writer&) = delete;
+    Writer& operator=(const Writer&) = delete;
+
+    ~Writer() {
+      if (_file != nullptr) {
+        fclose(_file);
+        unlink(_tempPath.c_str());
+      }
+    }
+
+    template <typename T>
+    void Write(const T& value) {
+      Append(&value, sizeof(T));
+    }
+
+    template <typename T>
+    void Write(const std::vector<T>& values) {
+      Write((uint64_t)(sizeof(T)));
+      Write((uint64_t)(values.size()));
+      Append(values.data(), values.size() * sizeof(T));
+    }
+
+    /*
+     * Make the cache visible under its final name, returning true on
+     * success.
+     */
+    bool Commit() {
+      if (_file == nullptr) {
+        return false;
+      }
+      bool succeeded = (fclose(_file) == 0);
+      _file = nullptr;
+      if (succeeded && rename(_tempPath.c_str(), _path.c_str()) == 0) {
+        return true;
+      }
+      unlink(_tempPath.c_str());
+      return false;
+    }
+
+   private:
+    const std::string _path;
+    std::string _tempPath;
+    FILE* _file;
+    uint64_t _size;
+
+    void Append(const void* data, uint64_t numBytes) {
+      static const char padding[ALIGNMENT] = {0};
+      if (_file == nullptr) {
+        return;
+      }
+      uint64_t paddingSize = Aligned(_size + numBytes) - (_size + numBytes);
+      if (fwrite(data, 1, numBytes, _file) != numBytes ||
+          fwrite(padding, 1, paddingSize, _file) != paddingSize) {
+        fclose(_file);
+        unlink(_tempPath.c_str());
+        _file = nullptr;
+        return;
+      }
+      _size += numBytes + paddingSize;
+    }
+  };
+
+ private:
+  static constexpr const char* MAGIC = "CHAPCACH";
+
+  static bool& Enabled() {
+    static bool enabled = false;
+    return enabled;
+  }
+
+  static uint64_t Aligned(uint64_t size) {
+    return (size + ALIGNMENT - 1) & ~(ALIGNMENT - 1);
+  }
+};
+}  // namespace chap
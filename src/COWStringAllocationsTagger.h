@@ -19,6 +19,7 @@ class COWStringAllocationsTagger : public Allocations::Tagger<Offset> {
   typedef typename Allocations::ContiguousImage<Offset> ContiguousImage;
   typedef typename Tagger::Phase Phase;
   typedef typename Directory::AllocationIndex AllocationIndex;
+  typedef typename Graph::Anchors Anchors;
   typedef typename Directory::Allocation Allocation;
   typedef typename VirtualAddressMap<Offset>::Reader Reader;
   typedef typename Allocations::TagHolder<Offset> TagHolder;
@@ -34,7 +35,8 @@ class COWStringAllocationsTagger : public Allocations::Tagger<Offset> {
         _staticAnchorReader(_addressMap),
         _stackAnchorReader(_addressMap),
         _enabled(true),
-        _tagIndex(_tagHolder.RegisterTag("%COWStringBody")) {
+        _tagIndex(_tagHolder.RegisterTag("%COWStringBody")),
+        _votesNeeded(_ownVotesNeeded) {
     _votesNeeded.resize(_numAllocations, 0xff);
     bool foundCheckableLibrary = false;
     for (typename ModuleDirectory<Offset>::const_iterator it =
@@ -89,6 +91,28 @@ class COWStringAllocationsTagger : public Allocations::Tagger<Offset> {
     }
   }
 
+  /*
+   * Note that a copy shares the votes of the original, which are changed
+   * only for allocations examined in allocation order.
+   */
+  COWStringAllocationsTagger(const COWStringAllocationsTagger& other,
+                             TagHolder& tagHolder)
+      : _graph(other._graph),
+        _tagHolder(tagHolder),
+        _directory(other._directory),
+        _numAllocations(other._numAllocations),
+        _addressMap(other._addressMap),
+        _charsImage(_addressMap, _directory),
+        _staticAnchorReader(_addressMap),
+        _stackAnchorReader(_addressMap),
+        _enabled(other._enabled),
+        _tagIndex(other._tagIndex),
+        _votesNeeded(other._votesNeeded) {}
+
+  Tagger* Copy(TagHolder& tagHolder) const {
+    return new COWStringAllocationsTagger(*this, tagHolder);
+  }
+
   bool TagFromAllocation(const ContiguousImage& contiguousImage,
                          Reader& /* reader */, AllocationIndex index,
                          Phase phase, const Allocation& allocation,
@@ -144,7 +168,8 @@ class COWStringAllocationsTagger : public Allocations::Tagger<Offset> {
   typename VirtualAddressMap<Offset>::Reader _stackAnchorReader;
   bool _enabled;
   TagIndex _tagIndex;
-  std::vector<uint8_t> _votesNeeded;
+  std::vector<uint8_t> _ownVotesNeeded;
+  std::vector<uint8_t>& _votesNeeded;
   Offset _stringLength;    // valid only during TagFromAllocation
   int32_t _numRefsMinus1;  // valid only during TagFromAllocation
 
@@ -215,6 +240,9 @@ class COWStringAllocationsTagger : public Allocations::Tagger<Offset> {
         if (size < 10 * sizeof(Offset)) {
           if (strlen(contiguousImage.FirstChar() + 3 * sizeof(Offset)) ==
               _stringLength) {
+            if (_tagHolder.DeferToOrderedRun()) {
+              return true;
+            }
             _votesNeeded[index] =
                 (_numRefsMinus1 < 0x10) ? (_numRefsMinus1 + 1) : 0x10;
 
@@ -227,6 +255,9 @@ class COWStringAllocationsTagger : public Allocations::Tagger<Offset> {
         // May be expensive, match must be solid
         if (strlen(contiguousImage.FirstChar() + 3 * sizeof(Offset)) ==
             _stringLength) {
+          if (_tagHolder.DeferToOrderedRun()) {
+            return true;
+          }
           _votesNeeded[index] =
               (_numRefsMinus1 < 0x10) ? (_numRefsMinus1 + 1) : 0x10;
 
@@ -252,9 +283,7 @@ class COWStringAllocationsTagger : public Allocations::Tagger<Offset> {
   }
   bool TallyAnchorVotes(AllocationIndex bodyIndex,
                         const Allocation& bodyAllocation,
-
-                        const std::vector<Offset>* anchors,
-                        Reader& anchorReader) {
+                        const Anchors* anchors, Reader& anchorReader) {
     Offset charsAddress = bodyAllocation.Address() + (3 * sizeof(Offset));
     if (anchors != nullptr) {
       for (Offset anchor : *anchors) {
@@ -313,13 +342,25 @@ class COWStringAllocationsTagger : public Allocations::Tagger<Offset> {
       if (_tagHolder.IsStronglyTagged(charsIndex)) {
         continue;
       }
-      if (_votesNeeded[charsIndex] == 0xff) {
+      /*
+       * The votes are read atomically here because allocations may be
+       * examined speculatively on some threads while the votes are changed
+       * on another.
+       */
+      uint8_t votesNeeded =
+          __atomic_load_n(&_votesNeeded[charsIndex], __ATOMIC_RELAXED);
+      if (votesNeeded == 0xff) {
         continue;
       }
       Offset charsAddress = check[0];
       if ((_directory.AllocationAt(charsIndex)->Address() +
            3 * sizeof(Offset)) == charsAddress) {
-        if (--(_votesNeeded[charsIndex]) == 0) {
+        if (_tagHolder.DeferToOrderedRun()) {
+          return;
+        }
+        __atomic_store_n(&_votesNeeded[charsIndex], --votesNeeded,
+                         __ATOMIC_RELAXED);
+        if (votesNeeded == 0) {
           _tagHolder.TagAllocation(charsIndex, _tagIndex);
         }
       }
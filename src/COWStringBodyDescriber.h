@@ -3,6 +3,7 @@
 
 #pragma once
 #include <string.h>
+#include <mutex>
 #include "Allocations/ContiguousImage.h"
 #include "Allocations/PatternDescriber.h"
 #include "ProcessImage.h"
@@ -27,6 +28,7 @@ class COWStringBodyDescriber : public Allocations::PatternDescriber<Offset> {
   virtual void Describe(Commands::Context& context, AllocationIndex index,
                         const Allocation& /* allocation */,
                         bool explain) const {
+    std::lock_guard<std::mutex> lock(_contiguousImageMutex);
     _contiguousImage.SetIndex(index);
     const Offset* asOffsets = _contiguousImage.FirstOffset();
 
@@ -59,6 +61,7 @@ class COWStringBodyDescriber : public Allocations::PatternDescriber<Offset> {
   }
 
  private:
+  mutable std::mutex _contiguousImageMutex;
   mutable Allocations::ContiguousImage<Offset> _contiguousImage;
 };
 }  // namespace chap
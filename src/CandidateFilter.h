@@ -0,0 +1,213 @@
+// Copyright (c) 2021 VMware, Inc. All Rights Reserved.
+// SPDX-License-Identifier: GPL-2.0
+
+#pragma once
+#include <stdint.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define CHAP_CANDIDATE_FILTER_X86 1
+#endif
+
+namespace chap {
+/*
+ * A CandidateFilter is used when scanning a large number of words, such as
+ * the image of an allocation or a range of static memory, for values that
+ * might be references to something in a given range of addresses.  Most
+ * words in such images are small integers, flags, characters or pointers
+ * to things other than allocations, so the filter checks blocks of words
+ * against the range using vector instructions where possible, and only the
+ * words that survive are passed to the possibly much more expensive lookup.
+ * The implementation is selected at run time, based on what the processor
+ * supports.
+ */
+template <class Offset>
+class CandidateFilter {
+ public:
+  enum Implementation { SCALAR, SSE2, AVX2, BEST_AVAILABLE };
+
+  /*
+   * Accept values v such that base <= v < base + size.  A size of 0 means
+   * that no values are accepted.
+   */
+  CandidateFilter(Offset base, Offset size,
+                  Implementation implementation = BEST_AVAILABLE)
+      : _base(base), _size(size) {
+    if (implementation == BEST_AVAILABLE) {
+      implementation = BestAvailable();
+    } else if (!IsAvailable(implementation)) {
+      implementation = SCALAR;
+    }
+    _implementation = implementation;
+    switch (implementation) {
+#ifdef CHAP_CANDIDATE_FILTER_X86
+      case AVX2:
+        _blockMask = AVX2BlockMask;
+        break;
+      case SSE2:
+        _blockMask = SSE2BlockMask;
+        break;
+#endif
+      default:
+        _blockMask = ScalarBlockMask;
+        break;
+    }
+  }
+
+  static bool IsAvailable(Implementation implementation) {
+    switch (implementation) {
+      case SCALAR:
+      case BEST_AVAILABLE:
+        return true;
+#ifdef CHAP_CANDIDATE_FILTER_X86
+      case SSE2:
+        return __builtin_cpu_supports("sse2");
+      case AVX2:
+        return __builtin_cpu_supports("avx2");
+#endif
+      default:
+        return false;
+    }
+  }
+
+  static Implementation BestAvailable() {
+    static const Implementation best =
+        IsAvailable(AVX2) ? AVX2 : IsAvailable(SSE2) ? SSE2 : SCALAR;
+    return best;
+  }
+
+  Implementation GetImplementation() const { return _implementation; }
+
+  bool Accepts(Offset value) const { return (Offset)(value - _base) < _size; }
+
+  /*
+   * Call the given visitor, in increasing order of address, with a pointer
+   * to each word in [first, limit) that has an accepted value.
+   */
+  template <typename Visitor>
+  void Visit(const Offset* first, const Offset* limit, Visitor visitor) const {
+    const Offset* check = first;
+    if (_size == 0) {
+      return;
+    }
+    for (; limit - check >= WORDS_PER_BLOCK; check += WORDS_PER_BLOCK) {
+      uint64_t mask = _blockMask(check, _base, _size);
+      while (mask != 0) {
+        visitor(check + __builtin_ctzll(mask));
+        mask &= mask - 1;
+      }
+    }
+    for (; check < limit; check++) {
+      if (Accepts(*check)) {
+        visitor(check);
+      }
+    }
+  }
+
+ private:
+  static constexpr int WORDS_PER_BLOCK = 64;
+  static constexpr Offset SIGN_BIT = ((Offset)1) << (sizeof(Offset) * 8 - 1);
+  typedef uint64_t (*BlockMask)(const Offset* block, Offset base, Offset size);
+
+  Offset _base;
+  Offset _size;
+  Implementation _implementation;
+  BlockMask _blockMask;
+
+  /*
+   * Each of the following returns a mask with bit i set if and only if
+   * word i of the given block of WORDS_PER_BLOCK words is accepted.
+   */
+
+  static uint64_t ScalarBlockMask(const Offset* block, Offset base,
+                                  Offset size) {
+    uint64_t mask = 0;
+    for (int i = 0; i < WORDS_PER_BLOCK; i++) {
+      mask |= ((uint64_t)((Offset)(block[i] - base) < size)) << i;
+    }
+    return mask;
+  }
+
+#ifdef CHAP_CANDIDATE_FILTER_X86
+  /*
+   * SSE2 has no 64 bit comparison, so an unsigned 64 bit comparison is
+   * built from 32 bit signed comparisons of values with the sign bits of
+   * the 32 bit halves flipped.  The result is valid in the upper half of
+   * each 64 bit lane, and is then copied to the lower half.
+   */
+  __attribute__((target("sse2"))) static inline __m128i SSE2LessThanU64(
+      __m128i a, __m128i b) {
+    const __m128i flip = _mm_set1_epi32((int)0x80000000);
+    __m128i aFlipped = _mm_xor_si128(a, flip);
+    __m128i bFlipped = _mm_xor_si128(b, flip);
+    __m128i greater = _mm_cmpgt_epi32(bFlipped, aFlipped);
+    __m128i equal = _mm_cmpeq_epi32(b, a);
+    __m128i lowGreater = _mm_shuffle_epi32(greater, _MM_SHUFFLE(2, 2, 0, 0));
+    __m128i less = _mm_or_si128(greater, _mm_and_si128(equal, lowGreater));
+    return _mm_shuffle_epi32(less, _MM_SHUFFLE(3, 3, 1, 1));
+  }
+
+  __attribute__((target("sse2"))) static uint64_t SSE2BlockMask(
+      const Offset* block, Offset base, Offset size) {
+    uint64_t mask = 0;
+    const __m128i* vectors = (const __m128i*)(block);
+    constexpr int WORDS_PER_VECTOR = sizeof(__m128i) / sizeof(Offset);
+    if (sizeof(Offset) == 8) {
+      const __m128i baseVector = _mm_set1_epi64x((long long)base);
+      const __m128i sizeVector = _mm_set1_epi64x((long long)size);
+      for (int i = 0; i < WORDS_PER_BLOCK / WORDS_PER_VECTOR; i++) {
+        __m128i delta = _mm_sub_epi64(_mm_loadu_si128(vectors + i), baseVector);
+        __m128i less = SSE2LessThanU64(delta, sizeVector);
+        mask |= ((uint64_t)_mm_movemask_pd(_mm_castsi128_pd(less)))
+                << (i * WORDS_PER_VECTOR);
+      }
+    } else {
+      const __m128i baseVector = _mm_set1_epi32((int)base);
+      const __m128i flippedSize = _mm_set1_epi32((int)(size ^ SIGN_BIT));
+      const __m128i flip = _mm_set1_epi32((int)0x80000000);
+      for (int i = 0; i < WORDS_PER_BLOCK / WORDS_PER_VECTOR; i++) {
+        __m128i delta = _mm_sub_epi32(_mm_loadu_si128(vectors + i), baseVector);
+        __m128i less =
+            _mm_cmpgt_epi32(flippedSize, _mm_xor_si128(delta, flip));
+        mask |= ((uint64_t)_mm_movemask_ps(_mm_castsi128_ps(less)))
+                << (i * WORDS_PER_VECTOR);
+      }
+    }
+    return mask;
+  }
+
+  __attribute__((target("avx2"))) static uint64_t AVX2BlockMask(
+      const Offset* block, Offset base, Offset size) {
+    uint64_t mask = 0;
+    const __m256i* vectors = (const __m256i*)(block);
+    constexpr int WORDS_PER_VECTOR = sizeof(__m256i) / sizeof(Offset);
+    if (sizeof(Offset) == 8) {
+      const __m256i baseVector = _mm256_set1_epi64x((long long)base);
+      const __m256i flippedSize =
+          _mm256_set1_epi64x((long long)(size ^ SIGN_BIT));
+      const __m256i flip = _mm256_set1_epi64x((long long)SIGN_BIT);
+      for (int i = 0; i < WORDS_PER_BLOCK / WORDS_PER_VECTOR; i++) {
+        __m256i delta =
+            _mm256_sub_epi64(_mm256_loadu_si256(vectors + i), baseVector);
+        __m256i less =
+            _mm256_cmpgt_epi64(flippedSize, _mm256_xor_si256(delta, flip));
+        mask |= ((uint64_t)_mm256_movemask_pd(_mm256_castsi256_pd(less)))
+                << (i * WORDS_PER_VECTOR);
+      }
+    } else {
+      const __m256i baseVector = _mm256_set1_epi32((int)base);
+      const __m256i flippedSize = _mm256_set1_epi32((int)(size ^ SIGN_BIT));
+      const __m256i flip = _mm256_set1_epi32((int)0x80000000);
+      for (int i = 0; i < WORDS_PER_BLOCK / WORDS_PER_VECTOR; i++) {
+        __m256i delta =
+            _mm256_sub_epi32(_mm256_loadu_si256(vectors + i), baseVector);
+        __m256i less =
+            _mm256_cmpgt_epi32(flippedSize, _mm256_xor_si256(delta, flip));
+        mask |= ((uint64_t)_mm256_movemask_ps(_mm256_castsi256_ps(less)))
+                << (i * WORDS_PER_VECTOR);
+      }
+    }
+    return mask;
+  }
+#endif
+};
+}  // namespace chap
@@ -2,15 +2,19 @@
 // SPDX-License-Identifier: GPL-2.0
 
 #pragma once
+#include <string.h>
 #include <fstream>
 #include <functional>
 #include <iostream>
 #include <list>
 #include <map>
+#include <memory>
+#include <set>
 #include <sstream>
 #include <stack>
 #include <string>
 #include <vector>
+#include "../WorkerThreads.h"
 #include "LineInfo.h"
 
 #include <replxx.h>
@@ -29,16 +33,17 @@ class Input {
     _inputStack.push(&std::cin);
   }
   ~Input() {}
-  bool StartScript(const std::string& inputPath) {
+  bool StartScript(const std::string& inputPath,
+                   std::ostream& errors = std::cerr) {
     std::ifstream* input = new std::ifstream();
 
     input->open(inputPath.c_str());
     if (input->fail()) {
       delete input;
-      std::cerr << "Failed to open script \"" << inputPath << "\".\n";
+      errors << "Failed to open script \"" << inputPath << "\".\n";
       char* openFailCause = strerror(errno);
       if (openFailCause) {
-        std::cerr << openFailCause << "\n";
+        errors << openFailCause << "\n";
       }
       return false;
     }
@@ -154,9 +159,10 @@ class Input {
 class Output {
  public:
   Output() { _outputStack.push(&std::cout); }
+  Output(std::ostream& base) { _outputStack.push(&base); }
   ~Output() {}
   bool PushTarget(const std::string& outputPath) {
-    std::ofstream* output = new std::ofstream();
+    std::ofstream* output = new BufferedFileStream();
 
     output->open(outputPath.c_str());
     if (output->fail()) {
@@ -174,53 +180,191 @@ class Output {
 
   void width(int width) { _outputStack.top()->width(width); }
 
-  void HexDump(const uint64_t* image, uint64_t numBytes,
-               bool showTrailingAscii) {
-    int headerWidth = 0;
-    if (numBytes > 0x20) {
-      headerWidth = 1;
-      for (size_t widthLimit = 0x10; numBytes > widthLimit; widthLimit <<= 4) {
-        headerWidth++;
+  /*
+   * Write the given value as std::ostream would, given the current base,
+   * width and fill of the top stream, but without going through the locale
+   * machinery, which is the main cost of commands that write one or more
+   * numbers for each of very many allocations.  Any formatting flags not
+   * otherwise used in chap cause the value to be written by std::ostream.
+   */
+  void WriteUnsigned(uint64_t value) {
+    std::ostream& topStream = *_outputStack.top();
+    std::ios_base::fmtflags flags = topStream.flags();
+    std::ios_base::fmtflags base = flags & std::ios_base::basefield;
+    if ((flags & (std::ios_base::showbase | std::ios_base::uppercase |
+                  std::ios_base::showpos | std::ios_base::left |
+                  std::ios_base::internal)) != 0 ||
+        base == std::ios_base::oct) {
+      topStream << value;
+      return;
+    }
+    char digits[MAX_DIGITS];
+    char* limit = digits + MAX_DIGITS;
+    char* first = (base == std::ios_base::hex) ? FormatHex(value, limit)
+                                               : FormatDecimal(value, limit);
+    std::streamsize numDigits = limit - first;
+    std::streamsize width = topStream.width();
+    if (width != 0) {
+      for (char fill = topStream.fill(); width > numDigits; width--) {
+        topStream.put(fill);
       }
+      topStream.width(0);
     }
-    int offset = 0;
+    topStream.write(first, numDigits);
+  }
+
+  void HexDump(const uint64_t* image, uint64_t numBytes,
+               bool showTrailingAscii) {
+    HexDumpWords(image, numBytes, showTrailingAscii);
+  }
+
+  void HexDump(const uint32_t* image, uint32_t numBytes,
+               bool showTrailingAscii) {
+    HexDumpWords(image, numBytes, showTrailingAscii);
+  }
+
+  /*
+   * The goal here is not to escape things in some reversable way but only
+   * to make it so the output is all printable ascii.
+   */
+  void ShowEscapedAscii(const char* chars, size_t numBytes) {
     std::ostream& topStream = *_outputStack.top();
-    topStream << std::hex;
-    for (const uint64_t* limit =
-             image + ((numBytes + sizeof(uint64_t) - 1) / sizeof(uint64_t));
-         image < limit; image++) {
-      if ((offset & 0x1f) == 0 && headerWidth != 0) {
-        topStream.width(headerWidth);
-        topStream << offset << ": ";
-      }
-      topStream.width(sizeof(uint64_t) * 2);
-      topStream << *image;
-      offset += sizeof(uint64_t);
-      if (offset & 0x1f) {
-        topStream << " ";
+    const char* hexDigits = "0123456789abcdef";
+    std::string escaped;
+    escaped.reserve(numBytes);
+    bool anyEscaped = false;
+    const char* limit = chars + numBytes;
+    while (chars < limit) {
+      char c = *(chars++);
+      if ((c < ' ' || c > '~') && (c != '\t') && (c != '\r') && (c != '\n')) {
+        escaped.append("\\x");
+        escaped.push_back(hexDigits[((int)(c >> 4)) & 0xf]);
+        escaped.push_back(hexDigits[((int)(c)) & 0xf]);
+        anyEscaped = true;
       } else {
-        if (showTrailingAscii) {
-          ShowTrailingAscii(topStream, 3, ((const char*)(image + 1)) - 0x20,
-                            0x20);
-        }
-        topStream << std::endl;
+        escaped.push_back(c);
       }
     }
-    size_t trailing = offset & 0x1f;
-    if (trailing != 0) {
-      if (showTrailingAscii) {
-        size_t missing =
-            (0x20 - trailing) / sizeof(uint64_t) * (2 * sizeof(uint64_t) + 1) +
-            2;
-        ShowTrailingAscii(topStream, missing, ((const char*)(image)) - trailing,
-                          trailing);
+    if (anyEscaped) {
+      /*
+       * Callers may depend on the top stream being left in hexadecimal
+       * mode after escaping.
+       */
+      topStream << std::hex;
+    }
+    topStream.write(escaped.data(), escaped.size());
+  }
+
+ private:
+  /*
+   * Redirected output is often very large, so it is collected in a buffer
+   * much larger than the default for std::filebuf, and written with a
+   * single system call each time that buffer fills.
+   */
+  class BufferedFileStream : public std::ofstream {
+   public:
+    BufferedFileStream() : _buffer(new char[BUFFER_SIZE]) {
+      rdbuf()->pubsetbuf(_buffer.get(), BUFFER_SIZE);
+    }
+    ~BufferedFileStream() {
+      // The buffer must be flushed before it is freed.
+      close();
+    }
+
+   private:
+    static constexpr std::streamsize BUFFER_SIZE = 1 << 20;
+    std::unique_ptr<char[]> _buffer;
+  };
+
+  /*
+   * Tables of the digits for each value of a byte in hexadecimal and for
+   * each value less than 100 in decimal, so that numbers can be formatted
+   * two digits at a time.
+   */
+  struct DigitPairs {
+    DigitPairs() {
+      const char* hexDigits = "0123456789abcdef";
+      for (size_t i = 0; i < 0x100; i++) {
+        _hex[2 * i] = hexDigits[i >> 4];
+        _hex[2 * i + 1] = hexDigits[i & 0xf];
+      }
+      for (size_t i = 0; i < 100; i++) {
+        _decimal[2 * i] = '0' + (i / 10);
+        _decimal[2 * i + 1] = '0' + (i % 10);
       }
-      topStream << std::endl;
     }
+    char _hex[0x200];
+    char _decimal[200];
+  };
+
+  static const DigitPairs& GetDigitPairs() {
+    static const DigitPairs digitPairs;
+    return digitPairs;
   }
 
-  void HexDump(const uint32_t* image, uint32_t numBytes,
-               bool showTrailingAscii) {
+  static constexpr size_t MAX_DIGITS = 20;
+
+  /*
+   * Format the value in hexadecimal into the digits ending at the given
+   * limit, returning the position of the first digit.
+   */
+  static char* FormatHex(uint64_t value, char* limit) {
+    const char* pairs = GetDigitPairs()._hex;
+    char* first = limit;
+    while (value >= 0x100) {
+      first -= 2;
+      memcpy(first, pairs + 2 * (value & 0xff), 2);
+      value >>= 8;
+    }
+    if (value >= 0x10) {
+      first -= 2;
+      memcpy(first, pairs + 2 * value, 2);
+    } else {
+      *(--first) = pairs[2 * value + 1];
+    }
+    return first;
+  }
+
+  /*
+   * Format the value in decimal into the digits ending at the given limit,
+   * returning the position of the first digit.
+   */
+  static char* FormatDecimal(uint64_t value, char* limit) {
+    const char* pairs = GetDigitPairs()._decimal;
+    char* first = limit;
+    while (value >= 100) {
+      first -= 2;
+      memcpy(first, pairs + 2 * (value % 100), 2);
+      value /= 100;
+    }
+    if (value >= 10) {
+      first -= 2;
+      memcpy(first, pairs + 2 * value, 2);
+    } else {
+      *(--first) = pairs[2 * value + 1];
+    }
+    return first;
+  }
+
+  static void AppendHex(std::string& line, uint64_t value, size_t width,
+                        char fill) {
+    char digits[MAX_DIGITS];
+    char* limit = digits + MAX_DIGITS;
+    char* first = FormatHex(value, limit);
+    size_t numDigits = limit - first;
+    if (width > numDigits) {
+      line.append(width - numDigits, fill);
+    }
+    line.append(first, numDigits);
+  }
+
+  /*
+   * Show the given words in hexadecimal, 0x20 bytes per line, building
+   * each line before writing it.
+   */
+  template <typename Word>
+  void HexDumpWords(const Word* image, uint64_t numBytes,
+                    bool showTrailingAscii) {
     int headerWidth = 0;
     if (numBytes > 0x20) {
       headerWidth = 1;
@@ -231,72 +375,53 @@ class Output {
     int offset = 0;
     std::ostream& topStream = *_outputStack.top();
     topStream << std::hex;
-    for (const uint32_t* limit =
-             image + ((numBytes + sizeof(uint32_t) - 1) / sizeof(uint32_t));
+    char fill = topStream.fill();
+    std::string line;
+    for (const Word* limit =
+             image + ((numBytes + sizeof(Word) - 1) / sizeof(Word));
          image < limit; image++) {
       if ((offset & 0x1f) == 0 && headerWidth != 0) {
-        topStream.width(headerWidth);
-        topStream << offset << ": ";
+        AppendHex(line, offset, headerWidth, fill);
+        line.append(": ");
       }
-      topStream.width(sizeof(uint32_t) * 2);
-      topStream << *image;
-      offset += sizeof(uint32_t);
+      AppendHex(line, *image, sizeof(Word) * 2, fill);
+      offset += sizeof(Word);
       if (offset & 0x1f) {
-        topStream << " ";
+        line.push_back(' ');
       } else {
         if (showTrailingAscii) {
-          ShowTrailingAscii(topStream, 3, ((const char*)(image + 1)) - 0x20,
-                            0x20);
+          AppendTrailingAscii(line, 3, ((const char*)(image + 1)) - 0x20,
+                              0x20);
         }
-        topStream << std::endl;
+        line.push_back('\n');
+        topStream.write(line.data(), line.size());
+        line.clear();
       }
     }
     size_t trailing = offset & 0x1f;
     if (trailing != 0) {
       if (showTrailingAscii) {
         size_t missing =
-            (0x20 - trailing) / sizeof(uint32_t) * (2 * sizeof(uint32_t) + 1) +
-            2;
-        ShowTrailingAscii(topStream, missing, ((const char*)(image)) - trailing,
-                          trailing);
-      }
-      topStream << std::endl;
-    }
-  }
-
-  /*
-   * The goal here is not to escape things in some reversable way but only
-   * to make it so the output is all printable ascii.
-   */
-  void ShowEscapedAscii(const char* chars, size_t numBytes) {
-    std::ostream& topStream = *_outputStack.top();
-    const char* limit = chars + numBytes;
-    while (chars < limit) {
-      char c = *(chars++);
-      if ((c < ' ' || c > '~') && (c != '\t') && (c != '\r') && (c != '\n')) {
-        topStream << "\\x";
-        topStream << std::hex << (((int)(c >> 4)) & 0xf);
-        topStream << std::hex << (((int)(c)) & 0xf);
-      } else {
-        topStream << c;
+            (0x20 - trailing) / sizeof(Word) * (2 * sizeof(Word) + 1) + 2;
+        AppendTrailingAscii(line, missing, ((const char*)(image)) - trailing,
+                            trailing);
       }
+      line.push_back('\n');
+      topStream.write(line.data(), line.size());
     }
   }
 
- private:
   std::stack<std::ostream*> _outputStack;
-  void ShowTrailingAscii(std::ostream& topStream, size_t numBlanks,
-                         const char* chars, size_t numBytes) {
-    for (size_t i = 0; i < numBlanks; i++) {
-      topStream << ' ';
-    }
+  void AppendTrailingAscii(std::string& line, size_t numBlanks,
+                           const char* chars, size_t numBytes) {
+    line.append(numBlanks, ' ');
     const char* limit = chars + numBytes;
     while (chars < limit) {
       char c = *(chars++);
       if (c < ' ' || c > '~') {
         c = '.';
       }
-      topStream << c;
+      line.push_back(c);
     }
   }
 };
@@ -307,10 +432,31 @@ Output& operator<<(Output& output, T v) {
   return output;
 }
 
+inline Output& operator<<(Output& output, unsigned int v) {
+  output.WriteUnsigned(v);
+  return output;
+}
+
+inline Output& operator<<(Output& output, unsigned long v) {
+  output.WriteUnsigned(v);
+  return output;
+}
+
+inline Output& operator<<(Output& output, unsigned long long v) {
+  output.WriteUnsigned(v);
+  return output;
+}
+
 class Error {
  public:
   Error(const ScriptContext& scriptContext)
-      : _scriptContext(scriptContext), _contextWritePending(false) {}
+      : _scriptContext(scriptContext),
+        _stream(std::cerr),
+        _contextWritePending(false) {}
+  Error(const ScriptContext& scriptContext, std::ostream& stream)
+      : _scriptContext(scriptContext),
+        _stream(stream),
+        _contextWritePending(false) {}
   ~Error() {}
   void SetContextWritePending() { _contextWritePending = true; }
   void FlushPendingErrorContext() {
@@ -318,20 +464,22 @@ class Error {
       if (!_scriptContext.empty()) {
         ScriptContext::const_reverse_iterator itEnd = _scriptContext.rend();
         ScriptContext::const_reverse_iterator it = _scriptContext.rbegin();
-        std::cerr << "Error at line " << std::dec << it->_line << " of "
-                  << it->_path;
+        _stream << "Error at line " << std::dec << it->_line << " of "
+                << it->_path;
         for (++it; it != itEnd; ++it) {
-          std::cerr << "\n called from line " << it->_line << " of "
-                    << it->_path;
+          _stream << "\n called from line " << it->_line << " of "
+                  << it->_path;
         }
-        std::cerr << "\n";
+        _stream << "\n";
       }
       _contextWritePending = false;
     }
   }
+  std::ostream& GetStream() { return _stream; }
 
  private:
   const ScriptContext& _scriptContext;
+  std::ostream& _stream;
   bool _contextWritePending;
 };
 
@@ -342,7 +490,7 @@ class Error {
 template <typename T>
 Error& operator<<(Error& error, T v) {
   error.FlushPendingErrorContext();
-  std::cerr << v;
+  error.GetStream() << v;
   return error;
 }
 
@@ -350,12 +498,15 @@ class Context {
  public:
   Context(Input& input, Output& output, Error& error,
           const std::string& redirectPrefix)
-      : _input(input),
-        _output(output),
+      : Context(ReadTokens(input), output, error, redirectPrefix) {}
+
+  Context(const Tokens& tokens, Output& output, Error& error,
+          const std::string& redirectPrefix)
+      : _output(output),
         _error(error),
         _redirectPrefix(redirectPrefix),
-        _hasIllFormedSwitch(false) {
-    _input.GetTokens(_tokens);
+        _hasIllFormedSwitch(false),
+        _tokens(tokens) {
     _error.SetContextWritePending();
     std::string switchName;
     size_t argNum = 0;
@@ -410,58 +561,66 @@ class Context {
     }
   }
 
-  bool SetRedirectPathBySuffix() {
+  bool SetRedirectPathBySuffix(std::string& redirectPath) const {
     const std::string& suffix = Argument("redirectSuffix", 0);
     if (!suffix.empty()) {
-      _redirectPath.append(".");
-      _redirectPath.append(suffix);
+      redirectPath.append(".");
+      redirectPath.append(suffix);
       return true;
     }
     return false;
   }
 
-  void SetRedirectPathByArguments() {
+  void SetRedirectPathByArguments(std::string& redirectPath) const {
     for (size_t i = 0; i < _positionalArguments.size(); i++) {
-      _redirectPath.append((i == 0) ? "." : "_");
-      _redirectPath.append(_positionalArguments[i]);
+      redirectPath.append((i == 0) ? "." : "_");
+      redirectPath.append(_positionalArguments[i]);
     }
 
     for (std::map<std::string, std::vector<std::string> >::const_iterator it =
              _switchedArguments.begin();
          it != _switchedArguments.end(); ++it) {
-      _redirectPath.append("::");
-      _redirectPath.append(it->first);
+      redirectPath.append("::");
+      redirectPath.append(it->first);
       for (std::vector<std::string>::const_iterator itVector =
                it->second.begin();
            itVector != it->second.end(); ++itVector) {
-        _redirectPath.append(":");
-        _redirectPath.append(*itVector);
+        redirectPath.append(":");
+        redirectPath.append(*itVector);
       }
     }
   }
 
-  void StartRedirect() {
-    if (_redirectPath.empty()) {
-      _redirectPath = _redirectPrefix;
-      if (!SetRedirectPathBySuffix()) {
-        SetRedirectPathByArguments();
-      }
+  /*
+   * Return the path of the file to which StartRedirect() would send the
+   * output of the command.
+   */
+  std::string RedirectPath() const {
+    std::string redirectPath = _redirectPrefix;
+    if (!SetRedirectPathBySuffix(redirectPath)) {
+      SetRedirectPathByArguments(redirectPath);
+    }
 
-      if (_redirectPath.size() > 255) {
-        /*
-         * Paths that are too long cause an error in the attempt to open them.
-         * This is typically exposed using large numbers of switches, as might
-         * happen with use of the /extend switch.  For now, just handle this
-         * by truncation.
-         */
-        _redirectPath.resize(255);
-      }
+    if (redirectPath.size() > 255) {
+      /*
+       * Paths that are too long cause an error in the attempt to open them.
+       * This is typically exposed using large numbers of switches, as might
+       * happen with use of the /extend switch.  For now, just handle this
+       * by truncation.
+       */
+      redirectPath.resize(255);
+    }
+    return redirectPath;
+  }
 
+  void StartRedirect() {
+    if (_redirectPath.empty()) {
+      _redirectPath = RedirectPath();
       if (!_output.PushTarget(_redirectPath)) {
         _error << "Failed to open " << _redirectPath << " for writing.\n";
         char* openFailCause = strerror(errno);
         if (openFailCause) {
-          std::cerr << openFailCause << "\n";
+          _error.GetStream() << openFailCause << "\n";
         }
         _redirectPath.clear();
       }
@@ -646,8 +805,6 @@ class Context {
   bool HasIllFormedSwitch() const { return _hasIllFormedSwitch; }
 
  private:
-  ScriptContext _scriptContext;
-  Input& _input;
   Output& _output;
   Error& _error;
   const std::string& _redirectPrefix;
@@ -658,6 +815,12 @@ class Context {
   std::vector<std::string> _commandSource;
   const std::string emptyToken;
   std::string _redirectPath;
+
+  static Tokens ReadTokens(Input& input) {
+    Tokens tokens;
+    input.GetTokens(tokens);
+    return tokens;
+  }
 };
 
 class Command {
@@ -746,42 +909,43 @@ class Runner {
     }
   }
 
-  void ShowHelpMessage() {
-    _output << "Supported commands are:\nhelp\nredirect\nsource\n";
+  void ShowHelpMessage(Output& output) {
+    output << "Supported commands are:\nhelp\nredirect\nsource\n";
     for (std::map<std::string, Command*>::iterator it = _commands.begin();
          it != _commands.end(); ++it) {
-      _output << it->first << "\n";
+      output << it->first << "\n";
     }
-    _output << "Use \"help <command-name>\" for help on a specific"
-               " command.\n";
+    output << "Use \"help <command-name>\" for help on a specific"
+              " command.\n";
   }
 
   void HandleHelpCommand(Context& context) {
+    Output& output = context.GetOutput();
     size_t numTokens = context.GetNumTokens();
     if (numTokens == 1) {
-      ShowHelpMessage();
+      ShowHelpMessage(output);
     } else {
       const std::string& topic = context.TokenAt(1);
       if (topic == "redirect") {
-        _output << "Use \"redirect on\" to enable redirection"
-                   " of output to separate files per command.\n";
-        _output << "Use \"redirect off\" to disable redirection"
-                   " of output to separate files per\ncommand.\n";
+        output << "Use \"redirect on\" to enable redirection"
+                  " of output to separate files per command.\n";
+        output << "Use \"redirect off\" to disable redirection"
+                  " of output to separate files per\ncommand.\n";
       } else if (topic == "source") {
-        _output << "Use \"source <path>\" to run commands"
-                   " from the specified file.\n";
+        output << "Use \"source <path>\" to run commands"
+                  " from the specified file.\n";
       } else if (topic == "help") {
-        _output << "Use \"help <command-name>\" for help on"
-                   " the specified command.\n";
-        _output << "Use \"help\" with no arguments to see"
-                   " the following:\n";
-        ShowHelpMessage();
+        output << "Use \"help <command-name>\" for help on"
+                  " the specified command.\n";
+        output << "Use \"help\" with no arguments to see"
+                  " the following:\n";
+        ShowHelpMessage(output);
       } else {
         std::map<std::string, Command*>::iterator itCommands =
             _commands.find(topic);
         if (itCommands == _commands.end()) {
-          _output << "\"" << topic << "\" is not a valid command name.\n";
-          ShowHelpMessage();
+          output << "\"" << topic << "\" is not a valid command name.\n";
+          ShowHelpMessage(output);
         } else {
           itCommands->second->ShowHelpMessage(context);
         }
@@ -795,7 +959,7 @@ class Runner {
     // empty std::string;
     const std::string& argument = context.TokenAt(1);
     if (numTokens != 2 || !(argument == "on" || argument == "off")) {
-      _error << "usage:  redirect on|off\n";
+      context.GetError() << "usage:  redirect on|off\n";
     } else {
       _redirect = (argument == "on");
     }
@@ -804,9 +968,9 @@ class Runner {
   void HandleSourceCommand(Context& context) {
     size_t numTokens = context.GetNumTokens();
     if (numTokens != 2) {
-      _error << "usage:  source <chap-command-file-path>\n";
+      context.GetError() << "usage:  source <chap-command-file-path>\n";
     } else {
-      _input.StartScript(context.TokenAt(1));
+      _input.StartScript(context.TokenAt(1), context.GetError().GetStream());
     }
   }
 
@@ -814,6 +978,90 @@ class Runner {
     _preCommandCallback = callback;
   }
 
+  /*
+   * Run the command already parsed into the given context, redirecting the
+   * output if requested.  Return false if the command was not recognized
+   * in a way that should terminate any scripts that are being run.
+   */
+  bool RunCommand(Context& context, bool redirect,
+                  bool runPreCommandCallback) {
+    Error& error = context.GetError();
+    if (context.HasIllFormedSwitch() && context.TokenAt(0).find('/') == 0) {
+      return true;
+    }
+    const std::string& command = context.TokenAt(0);
+    size_t numTokens = context.GetNumTokens();
+    if (command == "help") {
+      HandleHelpCommand(context);
+      return true;
+    }
+    if (command == "redirect") {
+      HandleRedirectCommand(context);
+      return true;
+    }
+    if (command == "source") {
+      HandleSourceCommand(context);
+      return true;
+    }
+    bool recognized = true;
+    bool redirectStarted = false;
+    std::map<std::string, std::list<CommandCallback> >::iterator it =
+        _commandCallbacks.find(command);
+    if (it != _commandCallbacks.end()) {
+      size_t mostTokensAccepted = 0;
+      std::list<CommandCallback>::iterator itBest = it->second.end();
+      for (std::list<CommandCallback>::iterator itCheck = it->second.begin();
+           itCheck != it->second.end(); ++itCheck) {
+        size_t numTokensAccepted = (*itCheck)(context, true);
+        if (numTokensAccepted > mostTokensAccepted) {
+          mostTokensAccepted = numTokensAccepted;
+          itBest = itCheck;
+        }
+      }
+      if (mostTokensAccepted == 0) {
+        error << "unknown command " << command << "\n";
+        recognized = false;
+      } else {
+        if (redirect) {
+          /*
+           * Redirect for the duration of the command context.  Note
+           * that we don't bother supporting /redirectSuffix for the
+           * old style command callbacks because they are deprecated
+           * and typically were written before switched arguments were
+           * handled separately, so they generally not work as
+           * currently
+           * written if the switch were supplied.
+           */
+          redirectStarted = true;
+          context.StartRedirect();
+        }
+        if (mostTokensAccepted == numTokens || mostTokensAccepted >= 2) {
+          (*itBest)(context, false);
+          return true;
+        }
+      }
+    }
+    Command* c = FindCommand(command);
+    if (c == (Command*)(0)) {
+      error << "Command " << command << " is not recognized\n";
+      error << "Type \"help\" to get help.\n";
+    } else {
+      if ((redirect || !context.Argument("redirectSuffix", 0).empty()) &&
+          !redirectStarted) {
+        // Redirect for the duration of the command context.
+        redirectStarted = true;
+        context.StartRedirect();
+      }
+      if (!context.HasIllFormedSwitch()) {
+        if (runPreCommandCallback && _preCommandCallback != nullptr) {
+          _preCommandCallback();
+        }
+        c->Run(context);
+      }
+    }
+    return recognized;
+  }
+
   void RunCommands() {
     replxx_install_window_change_handler();
     replxx_set_completion_callback(
@@ -824,14 +1072,7 @@ class Runner {
     while (true) {
       try {
         Context context(_input, _output, _error, _redirectPrefix);
-        bool hasIllFormedSwitch = context.HasIllFormedSwitch();
-        if (context.HasIllFormedSwitch()) {
-          if (context.TokenAt(0).find('/') == 0) {
-            continue;
-          }
-        }
-        std::string command = context.TokenAt(0);
-        if (command.empty()) {
+        if (context.TokenAt(0).empty()) {
           // There are no more commands to execute, but perhaps only in
           // the current script.
           if (_input.IsDone()) {
@@ -844,70 +1085,8 @@ class Runner {
             continue;
           }
         }
-        size_t numTokens = context.GetNumTokens();
-        if (command == "help") {
-          HandleHelpCommand(context);
-        } else if (command == "redirect") {
-          HandleRedirectCommand(context);
-        } else if (command == "source") {
-          HandleSourceCommand(context);
-        } else {
-          bool redirectStarted = false;
-          std::map<std::string, std::list<CommandCallback> >::iterator it =
-              _commandCallbacks.find(command);
-          if (it != _commandCallbacks.end()) {
-            size_t mostTokensAccepted = 0;
-            std::list<CommandCallback>::iterator itBest = it->second.end();
-            for (std::list<CommandCallback>::iterator itCheck =
-                     it->second.begin();
-                 itCheck != it->second.end(); ++itCheck) {
-              size_t numTokensAccepted = (*itCheck)(context, true);
-              if (numTokensAccepted > mostTokensAccepted) {
-                mostTokensAccepted = numTokensAccepted;
-                itBest = itCheck;
-              }
-            }
-            if (mostTokensAccepted == 0) {
-              _error << "unknown command " << command << "\n";
-              _input.TerminateAllScripts();
-            } else {
-              if (_redirect) {
-                /*
-                 * Redirect for the duration of the command context.  Note
-                 * that we don't bother supporting /redirectSuffix for the
-                 * old style command callbacks because they are deprecated
-                 * and typically were written before switched arguments were
-                 * handled separately, so they generally not work as
-                 * currently
-                 * written if the switch were supplied.
-                 */
-                redirectStarted = true;
-                context.StartRedirect();
-              }
-              if (mostTokensAccepted == numTokens || mostTokensAccepted >= 2) {
-                (*itBest)(context, false);
-                continue;
-              }
-            }
-          }
-          Command* c = FindCommand(command);
-          if (c == (Command*)(0)) {
-            _error << "Command " << command << " is not recognized\n";
-            _error << "Type \"help\" to get help.\n";
-          } else {
-            if ((_redirect || !context.Argument("redirectSuffix", 0).empty()) &&
-                !redirectStarted) {
-              // Redirect for the duration of the command context.
-              redirectStarted = true;
-              context.StartRedirect();
-            }
-            if (!hasIllFormedSwitch) {
-              if (_preCommandCallback != nullptr) {
-                _preCommandCallback();
-              }
-              c->Run(context);
-            }
-          }
+        if (!RunCommand(context, _redirect, true)) {
+          _input.TerminateAllScripts();
         }
       } catch (CommandInterruptedException& e) {
         // TODO: support SIG_INT to interrupt long running commands
@@ -918,6 +1097,65 @@ class Runner {
     replxx_history_free();
   }
 
+  /*
+   * Run the commands from the given script, as "source" would, then return
+   * without reading standard input.  The whole script, including any
+   * scripts it sources, is read before any command is run.  Consecutive
+   * commands that write their results to separate files, by "redirect on"
+   * or by /redirectSuffix, are independent of each other and so are run
+   * at the same time, on as many threads as were requested by -j.  What
+   * such commands write to standard output and standard error is held
+   * until they finish and then written in the order of the script, so the
+   * results are the same as if the commands had been run one at a time.
+   * All other commands, and any that use or change the derived set, run
+   * alone, after everything before them in the script has finished.
+   */
+  void RunBatch(const std::string& scriptPath) {
+    std::vector<std::unique_ptr<BatchCommand> > batch;
+    ReadBatch(scriptPath, batch);
+    size_t numCommands = batch.size();
+    size_t first = 0;
+    while (first < numCommands) {
+      BatchCommand& firstCommand = *(batch[first]);
+      if (firstCommand._alreadyRun) {
+        firstCommand.Flush();
+        first++;
+        continue;
+      }
+      if (!firstCommand._concurrent) {
+        Error error(firstCommand._scriptContext);
+        if (!RunBatchCommand(firstCommand, _output, error, true)) {
+          return;
+        }
+        first++;
+        continue;
+      }
+      /*
+       * Commands that would write the same file are kept apart so that the
+       * last one still determines the contents.
+       */
+      std::set<std::string> redirectPaths;
+      redirectPaths.insert(firstCommand._redirectPath);
+      size_t limit = first + 1;
+      while (limit < numCommands && batch[limit]->_concurrent &&
+             redirectPaths.insert(batch[limit]->_redirectPath).second) {
+        limit++;
+      }
+      if (_preCommandCallback != nullptr) {
+        _preCommandCallback();
+      }
+      WorkerThreads::Run(limit - first, [&](size_t taskIndex, size_t) {
+        BatchCommand& batchCommand = *(batch[first + taskIndex]);
+        Output output(batchCommand._output);
+        Error error(batchCommand._scriptContext, batchCommand._errors);
+        RunBatchCommand(batchCommand, output, error, false);
+      });
+      for (; first < limit; first++) {
+        batch[first]->Flush();
+      }
+    }
+  }
+
   ScriptContext _scriptContext;
   const std::string _redirectPrefix;
   bool _redirect;
@@ -927,6 +1165,115 @@ class Runner {
   std::map<std::string, std::list<CommandCallback> > _commandCallbacks;
   std::map<std::string, Command*> _commands;
   std::function<void()> _preCommandCallback;
+
+ private:
+  /*
+   * A command read by RunBatch(), with what is needed to run it later: the
+   * script context at the point it was read, which is used in reporting
+   * errors, whether output was being redirected at that point and, for a
+   * command that is run at the same time as others, what it writes to
+   * standard output and standard error.
+   */
+  struct BatchCommand {
+    BatchCommand(const Tokens& tokens, const ScriptContext& scriptContext,
+                 bool redirect)
+        : _tokens(tokens),
+          _scriptContext(scriptContext),
+          _redirect(redirect),
+          _concurrent(false),
+          _alreadyRun(false) {}
+    void Flush() {
+      std::cerr << _errors.str();
+      std::cout << _output.str();
+    }
+    Tokens _tokens;
+    ScriptContext _scriptContext;
+    bool _redirect;
+    bool _concurrent;
+    bool _alreadyRun;
+    std::string _redirectPath;
+    std::ostringstream _output;
+    std::ostringstream _errors;
+  };
+
+  /*
+   * Read all the commands of the given script, and of any scripts that it
+   * sources, handling "redirect" and "source" as they are read because
+   * they affect how the rest of the script is read and run.
+   */
+  void ReadBatch(const std::string& scriptPath,
+                 std::vector<std::unique_ptr<BatchCommand> >& batch) {
+    if (!_input.StartScript(scriptPath)) {
+      return;
+    }
+    while (_input.IsInScript()) {
+      Tokens tokens;
+      _input.GetTokens(tokens);
+      if (tokens.empty()) {
+        // A script just finished.
+        continue;
+      }
+      batch.emplace_back(new BatchCommand(tokens, _scriptContext, _redirect));
+      BatchCommand& batchCommand = *(batch.back());
+      Output output(batchCommand._output);
+      Error error(batchCommand._scriptContext, batchCommand._errors);
+      Context context(tokens, output, error, _redirectPrefix);
+      if (tokens[0] == "redirect" || tokens[0] == "source") {
+        RunCommand(context, _redirect, false);
+        batchCommand._alreadyRun = true;
+      } else if (CanRunConcurrently(context, _redirect)) {
+        batchCommand._concurrent = true;
+        batchCommand._redirectPath = context.RedirectPath();
+        /*
+         * Any complaints about the switches are made again when the
+         * command is run.
+         */
+        batchCommand._errors.str("");
+      } else {
+        batchCommand._errors.str("");
+      }
+    }
+  }
+
+  /*
+   * A command can run at the same time as its neighbors if it is one of
+   * the registered commands, as opposed to a deprecated command callback,
+   * if its results go to a file of their own and if it neither uses nor
+   * changes the derived set.
+   */
+  bool CanRunConcurrently(const Context& context, bool redirect) {
+    const std::string& command = context.TokenAt(0);
+    if (_commandCallbacks.find(command) != _commandCallbacks.end() ||
+        FindCommand(command) == (Command*)(0)) {
+      return false;
+    }
+    if (!redirect && context.Argument("redirectSuffix", 0).empty()) {
+      return false;
+    }
+    for (size_t i = 0; i < context.GetNumTokens(); i++) {
+      const std::string& token = context.TokenAt(i);
+      if (token == "derived" || token == "/setOperation") {
+        return false;
+      }
+    }
+    return true;
+  }
+
+  /*
+   * Run a command read by ReadBatch(), returning false if the rest of the
+   * batch should not be run.
+   */
+  bool RunBatchCommand(BatchCommand& batchCommand, Output& output,
+                       Error& error, bool runPreCommandCallback) {
+    try {
+      Context context(batchCommand._tokens, output, error, _redirectPrefix);
+      return RunCommand(context, batchCommand._redirect,
+                        runPreCommandCallback);
+    } catch (CommandInterruptedException& e) {
+      error << "\nThe command was interrupted.\n";
+      return false;
+    }
+  }
 };
 
 }  // namespace Commands
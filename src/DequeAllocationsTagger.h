@@ -18,6 +18,7 @@ class DequeAllocationsTagger : public Allocations::Tagger<Offset> {
   typedef typename Allocations::ContiguousImage<Offset> ContiguousImage;
   typedef typename Tagger::Phase Phase;
   typedef typename Directory::AllocationIndex AllocationIndex;
+  typedef typename Graph::Anchors Anchors;
   typedef typename Directory::Allocation Allocation;
   typedef typename VirtualAddressMap<Offset>::Reader Reader;
   typedef typename Allocations::TagHolder<Offset> TagHolder;
@@ -34,6 +35,23 @@ class DequeAllocationsTagger : public Allocations::Tagger<Offset> {
         _mapTagIndex(_tagHolder.RegisterTag("%DequeMap")),
         _blockTagIndex(_tagHolder.RegisterTag("%DequeBlock")) {}
 
+  DequeAllocationsTagger(const DequeAllocationsTagger& other,
+                         TagHolder& tagHolder)
+      : _graph(other._graph),
+        _tagHolder(tagHolder),
+        _directory(other._directory),
+        _numAllocations(other._numAllocations),
+        _addressMap(other._addressMap),
+        _mapReader(_addressMap),
+        _endIterator(_addressMap.end()),
+        _anchorIterator(_addressMap.end()),
+        _mapTagIndex(other._mapTagIndex),
+        _blockTagIndex(other._blockTagIndex) {}
+
+  Tagger* Copy(TagHolder& tagHolder) const {
+    return new DequeAllocationsTagger(*this, tagHolder);
+  }
+
   bool TagFromAllocation(const ContiguousImage& /* contiguousImage */,
                          Reader& reader, AllocationIndex index, Phase phase,
                          const Allocation& allocation, bool /* isUnsigned */) {
@@ -119,7 +137,7 @@ class DequeAllocationsTagger : public Allocations::Tagger<Offset> {
 
   bool CheckDequeMapAnchorIn(Reader& reader, AllocationIndex index,
                              const Allocation& allocation,
-                             const std::vector<Offset>* anchors) {
+                             const Anchors* anchors) {
     Offset address = allocation.Address();
     if (anchors != nullptr) {
       typename VirtualAddressMap<Offset>::Reader dequeReader(_addressMap);
@@ -14,6 +14,8 @@ class DequeMapDescriber : public Allocations::PatternDescriber<Offset> {
       typename Allocations::Directory<Offset>::AllocationIndex AllocationIndex;
   typedef typename Allocations::PatternDescriber<Offset> Base;
   typedef typename Allocations::Directory<Offset>::Allocation Allocation;
+  typedef typename Allocations::Graph<Offset>::Anchors Anchors;
+  typedef typename Allocations::Graph<Offset>::EdgeIterator EdgeIterator;
   DequeMapDescriber(const ProcessImage<Offset>& processImage)
       : Allocations::PatternDescriber<Offset>(processImage, "DequeMap") {}
 
@@ -30,9 +32,9 @@ class DequeMapDescriber : public Allocations::PatternDescriber<Offset> {
     Offset allocationAddress = allocation.Address();
     Offset allocationLimit = allocationAddress + allocationSize;
     FindDeques(InStaticMemory, allocationAddress, allocationLimit,
-               Base::_graph->GetStaticAnchors(index), deques);
+               Base::GetGraph().GetStaticAnchors(index), deques);
     FindDeques(OnStack, allocationAddress, allocationLimit,
-               Base::_graph->GetStackAnchors(index), deques);
+               Base::GetGraph().GetStackAnchors(index), deques);
     FindDeques(allocationAddress, allocationLimit, index, deques);
     if (deques.size() == 1) {
       const DequeInfo& dequeInfo = deques[0];
@@ -149,7 +151,7 @@ class DequeMapDescriber : public Allocations::PatternDescriber<Offset> {
   }
 
   void FindDeques(LocationType locationType, Offset mapAddress, Offset mapLimit,
-                  const std::vector<Offset>* anchors,
+                  const Anchors* anchors,
                   std::vector<DequeInfo>& deques) const {
     if (anchors != nullptr) {
       typename VirtualAddressMap<Offset>::Reader reader(Base::_addressMap);
@@ -171,11 +173,11 @@ class DequeMapDescriber : public Allocations::PatternDescriber<Offset> {
   }
   void FindDeques(Offset mapAddress, Offset mapLimit, AllocationIndex index,
                   std::vector<DequeInfo>& deques) const {
-    const AllocationIndex* pFirstIncoming;
-    const AllocationIndex* pPastIncoming;
-    Base::_graph->GetIncoming(index, &pFirstIncoming, &pPastIncoming);
+    EdgeIterator pFirstIncoming;
+    EdgeIterator pPastIncoming;
+    Base::GetGraph().GetIncoming(index, &pFirstIncoming, &pPastIncoming);
 
-    for (const AllocationIndex* pNextIncoming = pFirstIncoming;
+    for (EdgeIterator pNextIncoming = pFirstIncoming;
          pNextIncoming < pPastIncoming; pNextIncoming++) {
       const Allocation* incoming =
           Base::_directory.AllocationAt(*pNextIncoming);
@@ -11,10 +11,15 @@ extern "C" {
 #include <iostream>
 #include <memory>
 #include <regex>
+#include "Allocations/EdgeLists.h"
+#include "AnalysisCache.h"
 #include "Commands/Runner.h"
 #include "FileImage.h"
 #include "Linux/ELFCore32FileAnalyzerFactory.h"
 #include "Linux/ELFCore64FileAnalyzerFactory.h"
+#include "Linux/ElfSymbolTable.h"
+#include "PointerIndex.h"
+#include "WorkerThreads.h"
 
 namespace chap {
 using namespace std;
@@ -24,9 +29,30 @@ void FileAnalyzer::AddCommandCallbacks(Commands::Runner & /* r */) {}
 
 void PrintUsageAndExit(int exitCode,
                        const vector<string> supportedFileFormats) {
-  cerr << "Usage: chap [-t] <file>\n\n"
+  cerr << "Usage: chap [-t] [-c] [-j <num-threads>] [-compactGraph] "
+          "[-b <script>]\n"
+          "            [-pointerIndexLimit <mib>] [-debugDir <dir>] <file>\n\n"
           "-t means to just do truncation check then stop\n"
           "   0 exit code means no truncation was found\n\n"
+          "-c means to save the references between allocations and the\n"
+          "   allocation tags in <file>.chapcache and to reuse them if that\n"
+          "   file already exists and matches the core (the allocations and\n"
+          "   signatures are still found each time)\n\n"
+          "-j sets the number of threads used for the more expensive\n"
+          "   parts of the analysis (default is the number of cores)\n\n"
+          "-compactGraph means to keep the references between allocations\n"
+          "   in a compressed form, which is slower to use but takes much\n"
+          "   less memory for cores with very many references\n\n"
+          "-b means to run the commands in <script> and then exit, rather\n"
+          "   than reading commands from standard input, running commands\n"
+          "   that are redirected to files at the same time as each other\n\n"
+          "-pointerIndexLimit sets the most memory, in MiB, that may be used\n"
+          "   for the index that speeds up repeated use of \"enumerate\n"
+          "   pointers\" and \"describe pointers\" (default is 1024, and 0\n"
+          "   means never to build the index)\n\n"
+          "-debugDir sets the directory searched for separate debug files\n"
+          "   when naming signatures and static anchors from the symbol\n"
+          "   tables of the modules (default is /usr/lib/debug, as for gdb)\n\n"
           "Supported file types include the following:\n\n";
   for (vector<string>::const_iterator it = supportedFileFormats.begin();
        it != supportedFileFormats.end(); ++it) {
@@ -60,13 +86,45 @@ int main(int argc, char **argv, char ** /* envp */) {
     supportedFileFormats.push_back((*it)->GetSupportedFileFormat());
   }
 
-  string path(argv[argc - 1]);
-  if ((argc < 2) || (argc > 3) || ((argc == 3) && (strcmp(argv[1], "-t"))) ||
-      (path[0] == '-')) {
-    PrintUsageAndExit(1, supportedFileFormats);
+  bool truncationCheckOnly = false;
+  string batchScript;
+  int argIndex = 1;
+  for (; argIndex < argc - 1; argIndex++) {
+    if (!strcmp(argv[argIndex], "-t")) {
+      truncationCheckOnly = true;
+    } else if (!strcmp(argv[argIndex], "-c")) {
+      AnalysisCache::SetEnabled(true);
+    } else if (!strcmp(argv[argIndex], "-compactGraph")) {
+      Allocations::EdgeListsBase::SetCompactByDefault(true);
+    } else if (!strcmp(argv[argIndex], "-j") && argIndex + 1 < argc - 1) {
+      char *numThreadsEnd;
+      long numThreads = strtol(argv[++argIndex], &numThreadsEnd, 10);
+      if (*numThreadsEnd != '\000' || numThreads <= 0) {
+        PrintUsageAndExit(1, supportedFileFormats);
+      }
+      WorkerThreads::SetNumThreads(numThreads);
+    } else if (!strcmp(argv[argIndex], "-b") && argIndex + 1 < argc - 1) {
+      batchScript = argv[++argIndex];
+    } else if (!strcmp(argv[argIndex], "-pointerIndexLimit") &&
+               argIndex + 1 < argc - 1) {
+      char *maxMiBEnd;
+      long maxMiB = strtol(argv[++argIndex], &maxMiBEnd, 10);
+      if (*maxMiBEnd != '\000' || maxMiB < 0) {
+        PrintUsageAndExit(1, supportedFileFormats);
+      }
+      PointerIndexBase::SetMaxBytes(((uint64_t)(maxMiB)) << 20);
+    } else if (!strcmp(argv[argIndex], "-debugDir") &&
+               argIndex + 1 < argc - 1) {
+      Linux::ElfSymbolTableBase::SetDebugDirectory(argv[++argIndex]);
+    } else {
+      PrintUsageAndExit(1, supportedFileFormats);
+    }
   }
 
-  bool truncationCheckOnly = (argc == 3);
+  if (argIndex != argc - 1 || argv[argIndex][0] == '-') {
+    PrintUsageAndExit(1, supportedFileFormats);
+  }
+  string path(argv[argIndex]);
 
   try {
     FileImage fileImage(path.c_str());
@@ -106,7 +164,11 @@ int main(int argc, char **argv, char ** /* envp */) {
         // TODO - the call to AddCommandCallbacks will become obsolete
         analyzer->AddCommandCallbacks(commandsRunner);
 
-        commandsRunner.RunCommands();
+        if (batchScript.empty()) {
+          commandsRunner.RunCommands();
+        } else {
+          commandsRunner.RunBatch(batchScript);
+        }
       }
       delete analyzer;
       exit(0);
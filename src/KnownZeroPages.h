@@ -0,0 +1,187 @@
+// Copyright (c) 2021 VMware, Inc. All Rights Reserved.
+// SPDX-License-Identifier: GPL-2.0
+
+#pragma once
+#include <stdint.h>
+#include <string.h>
+#include <atomic>
+#include <memory>
+#if defined(__x86_64__)
+#include <emmintrin.h>
+#endif
+#include "FileImage.h"
+
+namespace chap {
+/*
+ * KnownZeroPages keeps track of which pages of a core file are known to be
+ * all zero, so that scans over large parts of the image can skip them.
+ * Production cores often have large such regions, either because the file
+ * is sparse or because many pages in the process were never touched.
+ *
+ * The pages are the page-sized pieces of the file starting at a given
+ * offset, which is normally 0 but is not for cores, such as those written by
+ * gdb, that place the images of the memory ranges right after the headers
+ * without padding.
+ *
+ * Holes in the file, found with SEEK_DATA and SEEK_HOLE where the file
+ * system supports them, are known to be zero as soon as the offset of the
+ * pages is set, without reading anything.  Any other page is checked the
+ * first time it is asked about, and the answer is remembered.  Asking is
+ * safe from multiple threads at once, so the checks are naturally spread
+ * over the threads that are scanning.
+ */
+class KnownZeroPages {
+ public:
+  static constexpr int LOG2_PAGE_SIZE = 12;
+  static constexpr uint64_t BYTES_PER_PAGE = ((uint64_t)1) << LOG2_PAGE_SIZE;
+
+  KnownZeroPages(const FileImage& fileImage)
+      : _fileImage(fileImage),
+        _image(fileImage.GetImage()),
+        _fileSize(fileImage.GetFileSize()),
+        _pageOffset(0),
+        _numPages(0) {}
+
+  /*
+   * Start tracking the pages that start at the given offset in the file,
+   * which must be less than BYTES_PER_PAGE.  Until this is called no page
+   * is known to be zero.
+   */
+  void SetPageOffset(uint64_t pageOffset) {
+    if (pageOffset >= _fileSize) {
+      return;
+    }
+    _pageOffset = pageOffset;
+    _numPages = (_fileSize - pageOffset + BYTES_PER_PAGE - 1) >> LOG2_PAGE_SIZE;
+    _states.reset(new std::atomic<uint64_t>[(_numPages + PAGES_PER_WORD - 1) /
+                                            PAGES_PER_WORD]());
+    MarkHoles();
+  }
+
+  /*
+   * Return the offset in the file of the first page.
+   */
+  uint64_t GetPageOffset() const { return _pageOffset; }
+
+  /*
+   * Return true if the page that starts at the given offset in the file is
+   * all zero.
+   */
+  bool IsZeroPage(uint64_t fileOffset) const {
+    uint64_t page = (fileOffset - _pageOffset) >> LOG2_PAGE_SIZE;
+    if (fileOffset < _pageOffset || page >= _numPages) {
+      return false;
+    }
+    std::atomic<uint64_t>& word = _states[page / PAGES_PER_WORD];
+    int shift = (int)(page % PAGES_PER_WORD) * BITS_PER_STATE;
+    uint64_t state = (word.load(std::memory_order_relaxed) >> shift) & 3;
+    if (state == UNKNOWN) {
+      uint64_t pageOffset = _pageOffset + (page << LOG2_PAGE_SIZE);
+      uint64_t size = _fileSize - pageOffset;
+      if (size > BYTES_PER_PAGE) {
+        size = BYTES_PER_PAGE;
+      }
+      state = IsAllZero(_image + pageOffset, size) ? ZERO : NOT_ZERO;
+      /*
+       * Any other thread checking the same page gets the same answer, so
+       * the order of the updates does not matter.
+       */
+      word.fetch_or(state << shift, std::memory_order_relaxed);
+    }
+    return state == ZERO;
+  }
+
+ private:
+  static constexpr uint64_t UNKNOWN = 0;
+  static constexpr uint64_t ZERO = 1;
+  static constexpr uint64_t NOT_ZERO = 2;
+  static constexpr int BITS_PER_STATE = 2;
+  static constexpr uint64_t PAGES_PER_WORD = 64 / BITS_PER_STATE;
+
+  const FileImage& _fileImage;
+  const char* _image;
+  const uint64_t _fileSize;
+  uint64_t _pageOffset;
+  uint64_t _numPages;
+  std::unique_ptr<std::atomic<uint64_t>[]> _states;
+
+  void MarkHoles() {
+#if defined(SEEK_DATA) && defined(SEEK_HOLE)
+    int fd = _fileImage._fd;
+    off64_t fileSize = (off64_t)_fileSize;
+    off64_t hole = (off64_t)_pageOffset;
+    while (hole < fileSize) {
+      hole = lseek64(fd, hole, SEEK_HOLE);
+      if (hole < 0 || hole >= fileSize) {
+        /*
+         * Either there are no more holes, other than the implicit one at
+         * the end of the file, or the file system does not support the
+         * query.  Any remaining pages will be checked as needed.
+         */
+        break;
+      }
+      off64_t data = lseek64(fd, hole, SEEK_DATA);
+      if (data < 0 || data > fileSize) {
+        data = fileSize;
+      }
+      /*
+       * Only pages entirely in the hole are known to be zero, except that
+       * the last page of the file is known to be zero if the hole extends
+       * to the end of the file.
+       */
+      uint64_t firstPage =
+          ((uint64_t)hole - _pageOffset + BYTES_PER_PAGE - 1) >> LOG2_PAGE_SIZE;
+      uint64_t pageLimit = _numPages;
+      if (data != fileSize) {
+        pageLimit = ((uint64_t)data - _pageOffset) >> LOG2_PAGE_SIZE;
+      }
+      for (uint64_t page = firstPage; page < pageLimit; page++) {
+        _states[page / PAGES_PER_WORD].fetch_or(
+            ZERO << ((page % PAGES_PER_WORD) * BITS_PER_STATE),
+            std::memory_order_relaxed);
+      }
+      hole = data;
+    }
+    (void)lseek64(fd, 0, SEEK_SET);
+#endif
+  }
+
+  /*
+   * Return true if the given image is all zero.  The check is done 64 bytes
+   * at a time, so that most pages that are not zero are rejected after
+   * reading just the start of the page.
+   */
+  static bool IsAllZero(const char* image, uint64_t size) {
+    uint64_t checked = 0;
+#if defined(__x86_64__)
+    /*
+     * SSE2 is always available on x86-64.
+     */
+    const __m128i zero = _mm_setzero_si128();
+    for (; size - checked >= 64; checked += 64) {
+      const __m128i* block = (const __m128i*)(image + checked);
+      __m128i any = _mm_or_si128(
+          _mm_or_si128(_mm_loadu_si128(block), _mm_loadu_si128(block + 1)),
+          _mm_or_si128(_mm_loadu_si128(block + 2),
+                       _mm_loadu_si128(block + 3)));
+      if (_mm_movemask_epi8(_mm_cmpeq_epi8(any, zero)) != 0xffff) {
+        return false;
+      }
+    }
+#endif
+    for (; size - checked >= sizeof(uint64_t); checked += sizeof(uint64_t)) {
+      uint64_t word;
+      memcpy(&word, image + checked, sizeof(word));
+      if (word != 0) {
+        return false;
+      }
+    }
+    for (; checked < size; checked++) {
+      if (image[checked] != 0) {
+        return false;
+      }
+    }
+    return true;
+  }
+};
+}  // namespace chap
@@ -6,6 +6,7 @@
 #include "../VirtualAddressMap.h"
 #include "CorruptionSkipper.h"
 #include "InfrastructureFinder.h"
+#include "RunBatchScanner.h"
 
 namespace chap {
 namespace LibcMalloc {
@@ -16,6 +17,11 @@ class HeapAllocationFinder : public Allocations::Directory<Offset>::Finder {
   typedef typename VirtualAddressMap<Offset>::NotMapped NotMapped;
   typedef typename VirtualAddressMap<Offset>::RangeAttributes RangeAttributes;
   typedef typename std::set<Offset> OffsetSet;
+  typedef typename Allocations::Directory<Offset>::FoundAllocation
+      FoundAllocation;
+
+  typedef typename InfrastructureFinder<Offset>::Heap Heap;
+  typedef typename InfrastructureFinder<Offset>::HeapMap HeapMap;
 
   HeapAllocationFinder(const VirtualAddressMap<Offset>& addressMap,
                        const InfrastructureFinder<Offset>& infrastructureFinder,
@@ -25,20 +31,24 @@ class HeapAllocationFinder : public Allocations::Directory<Offset>::Finder {
                            doublyLinkedListCorruptionChecker,
                        Allocations::Directory<Offset>& allocationDirectory)
       : _addressMap(addressMap),
-        _reader(addressMap),
         _infrastructureFinder(infrastructureFinder),
         _arenas(_infrastructureFinder.GetArenas()),
         _mainArenaAddress(_infrastructureFinder.GetMainArenaAddress()),
         _arenaStructSize(_infrastructureFinder.GetArenaStructSize()),
         _maxHeapSize(_infrastructureFinder.GetMaxHeapSize()),
         _heapMap(_infrastructureFinder.GetHeaps()),
-        _heapMapIterator(_heapMap.begin()),
+        _heaps(HeapsInOrder(_heapMap)),
         _corruptionSkipper(corruptionSkipper),
         _fastBinFreeStatusFixer(fastBinFreeStatusFixer),
-        _doublyLinkedListCorruptionChecker(doublyLinkedListCorruptionChecker) {
-    if (_heapMapIterator != _heapMap.end()) {
-      SkipHeaders();
-      Advance();
+        _doublyLinkedListCorruptionChecker(doublyLinkedListCorruptionChecker),
+        _scanner(_heaps.size(),
+                 [this](size_t heapIndex,
+                        std::vector<FoundAllocation>& allocations,
+                        std::ostream& warnings) {
+                   ScanHeap(heapIndex, allocations, warnings);
+                 }) {
+    if (!_heaps.empty() && _scanner.Finished()) {
+      CheckNonMainArenas();
     }
     _finderIndex = allocationDirectory.AddFinder(this);
   }
@@ -48,7 +58,7 @@ class HeapAllocationFinder : public Allocations::Directory<Offset>::Finder {
   /*
    * Return true if there are no more allocations available.
    */
-  virtual bool Finished() { return _heapMapIterator == _heapMap.end(); }
+  virtual bool Finished() { return _scanner.Finished(); }
 
   /*
    * Return the address of the next allocation (in increasing order of
@@ -58,44 +68,38 @@ class HeapAllocationFinder : public Allocations::Directory<Offset>::Finder {
    * any allocations already reported by this allocation finder have already
    * been assigned allocation indices in the Directory.
    */
-  virtual Offset NextAddress() { return _allocationAddress; }
+  virtual Offset NextAddress() { return _scanner.Next()._address; }
   /*
    * Return the size of the next allocation (in increasing order of
    * address) to be reported by this finder, without advancing to the next
    * allocation.  The return value is undefined if there are no more
    * allocations available.
    */
-  virtual Offset NextSize() { return _allocationSize; }
+  virtual Offset NextSize() { return _scanner.Next()._size; }
   /*
    * Return true if the next allocation (in increasing order of address) to
    * address) to be reported by this finder is considered used, without
    * advancing to the next allocation.
    */
-  virtual bool NextIsUsed() { return _allocationIsUsed; }
+  virtual bool NextIsUsed() { return _scanner.Next()._isUsed; }
   /*
    * Advance to the next allocation.
    */
   virtual void Advance() {
-    if (_heapMapIterator != _heapMap.end()) {
-      while (!AdvanceToNextAllocationOfHeap()) {
-        if (++_heapMapIterator == _heapMap.end()) {
-          for (auto keyAndValue : _arenas) {
-            if (keyAndValue.first != _mainArenaAddress) {
-              const typename InfrastructureFinder<Offset>::Arena& arena =
-                  keyAndValue.second;
-              _fastBinFreeStatusFixer.MarkFastBinItemsAsFree(arena, false,
-                                                             _finderIndex);
-              _doublyLinkedListCorruptionChecker
-                  .CheckDoublyLinkedListCorruption(arena);
-            }
-          }
-          return;
-        } else {
-          SkipHeaders();
-        }
+    if (!_scanner.Finished()) {
+      _scanner.Advance();
+      if (_scanner.Finished()) {
+        CheckNonMainArenas();
       }
     }
   }
+  /*
+   * Copy the next allocation and as many of the allocations that follow it
+   * in the same heap as fit.
+   */
+  virtual size_t NextSpan(FoundAllocation* records, size_t maxRecords) {
+    return _scanner.CopySpan(records, maxRecords);
+  }
   /*
    * Return the smallest request size that might reasonably have resulted
    * in an allocation of the given size.
@@ -106,155 +110,165 @@ class HeapAllocationFinder : public Allocations::Directory<Offset>::Finder {
 
  private:
   const VirtualAddressMap<Offset>& _addressMap;
-  typename VirtualAddressMap<Offset>::Reader _reader;
   const InfrastructureFinder<Offset>& _infrastructureFinder;
   const typename InfrastructureFinder<Offset>::ArenaMap& _arenas;
   const Offset _mainArenaAddress;
   const Offset _arenaStructSize;
   const Offset _maxHeapSize;
-  const typename InfrastructureFinder<Offset>::HeapMap& _heapMap;
-  typename InfrastructureFinder<Offset>::HeapMap::const_iterator
-      _heapMapIterator;
-  Offset _allocationAddress;
-  Offset _allocationSize;
-  bool _allocationIsUsed;
-  Offset _base;
-  Offset _limit;
-  Offset _chunkSize;
-  Offset _prevCheck;
-  Offset _check;
-  Offset _checkLimit;
-  Offset _sizeAndFlags;
-  Offset _top;
+  const HeapMap& _heapMap;
+  const std::vector<typename HeapMap::const_iterator> _heaps;
   CorruptionSkipper<Offset>& _corruptionSkipper;
   FastBinFreeStatusFixer<Offset>& _fastBinFreeStatusFixer;
   DoublyLinkedListCorruptionChecker<Offset>& _doublyLinkedListCorruptionChecker;
   size_t _finderIndex;
+  RunBatchScanner<Offset> _scanner;
+
+  static std::vector<typename HeapMap::const_iterator> HeapsInOrder(
+      const HeapMap& heapMap) {
+    std::vector<typename HeapMap::const_iterator> heaps;
+    heaps.reserve(heapMap.size());
+    for (auto it = heapMap.begin(); it != heapMap.end(); ++it) {
+      heaps.push_back(it);
+    }
+    return heaps;
+  }
+
+  /*
+   * This is done once all the allocations for the heaps have been added to
+   * the directory.
+   */
+  void CheckNonMainArenas() {
+    for (auto keyAndValue : _arenas) {
+      if (keyAndValue.first != _mainArenaAddress) {
+        const typename InfrastructureFinder<Offset>::Arena& arena =
+            keyAndValue.second;
+        _fastBinFreeStatusFixer.MarkFastBinItemsAsFree(arena, false,
+                                                       _finderIndex);
+        _doublyLinkedListCorruptionChecker.CheckDoublyLinkedListCorruption(
+            arena);
+      }
+    }
+  }
 
-  void SkipHeaders() {
-    const typename InfrastructureFinder<Offset>::Heap& heap =
-        _heapMapIterator->second;
-    _base = heap._address;
+  /*
+   * Append the allocations of the given heap to the given vector.  This may
+   * be called for different heaps at the same time, so it has its own
+   * reader and writes warnings to the given stream.
+   */
+  void ScanHeap(size_t heapIndex, std::vector<FoundAllocation>& allocations,
+                std::ostream& warnings) const {
+    Reader reader(_addressMap);
+    typename HeapMap::const_iterator itHeap = _heaps[heapIndex];
+    const Heap& heap = itHeap->second;
+    Offset base = heap._address;
     Offset size = heap._size;
     const char* heapImage;
-    Offset numBytesFound = _addressMap.FindMappedMemoryImage(_base, &heapImage);
+    Offset numBytesFound = _addressMap.FindMappedMemoryImage(base, &heapImage);
     if (numBytesFound < size) {
-      std::cerr << "Heap at 0x" << std::hex << _base
-                << " is not fully mapped in the core.\n";
+      warnings << "Heap at 0x" << std::hex << base
+               << " is not fully mapped in the core.\n";
       size = numBytesFound;
     }
-    _limit = _base + size;
+    Offset limit = base + size;
 
-    if ((heap._arenaAddress & ~(_maxHeapSize - 1)) == _base) {
-      _base += 4 * sizeof(Offset) + _arenaStructSize;
+    if ((heap._arenaAddress & ~(_maxHeapSize - 1)) == base) {
+      base += 4 * sizeof(Offset) + _arenaStructSize;
     } else {
-      _base += 4 * sizeof(Offset);
+      base += 4 * sizeof(Offset);
     }
 
-    _top = 0;
     typename InfrastructureFinder<Offset>::ArenaMap::const_iterator itArena =
         _arenas.find(heap._arenaAddress);
     if (itArena == _arenas.end()) {
       abort();
     }
-    _top = itArena->second._top;
+    Offset top = itArena->second._top;
 
-    _sizeAndFlags = _reader.ReadOffset(_base + sizeof(Offset));
-    _chunkSize = 0;
-    _prevCheck = _base;
-    _check = _base;
-    _checkLimit = _limit - 4 * sizeof(Offset);
-  }
+    Offset sizeAndFlags = reader.ReadOffset(base + sizeof(Offset));
+    Offset chunkSize = 0;
+    Offset prevCheck = base;
+    Offset check = base;
+    Offset checkLimit = limit - 4 * sizeof(Offset);
 
-  bool AdvanceToNextAllocationOfHeap() {
-    const typename InfrastructureFinder<Offset>::Heap& heap =
-        _heapMapIterator->second;
-    while (_check < _checkLimit) {
-      if (((_sizeAndFlags & 2) != 0) ||
-          ((sizeof(Offset) == 8) && ((_sizeAndFlags & sizeof(Offset)) != 0))) {
-        _check = HandleNonMainArenaCorruption(heap, _prevCheck);
-        if (_check != 0) {
-          _chunkSize = 0;
-          _sizeAndFlags = _reader.ReadOffset(_check + sizeof(Offset), 0xbadbad);
-          if (_sizeAndFlags != 0xbadbad) {
-            _prevCheck = _check;
+    while (check < checkLimit) {
+      if (((sizeAndFlags & 2) != 0) ||
+          ((sizeof(Offset) == 8) && ((sizeAndFlags & sizeof(Offset)) != 0))) {
+        check = HandleNonMainArenaCorruption(heap, prevCheck, warnings);
+        if (check != 0) {
+          chunkSize = 0;
+          sizeAndFlags = reader.ReadOffset(check + sizeof(Offset), 0xbadbad);
+          if (sizeAndFlags != 0xbadbad) {
+            prevCheck = check;
             continue;
           }
         }
-        return false;
+        break;
       }
-      _chunkSize = _sizeAndFlags & ~7;
-      if ((_chunkSize == 0) || (_chunkSize >= 0x10000000) ||
-          (_chunkSize > (_limit - _check))) {
-        _check = HandleNonMainArenaCorruption(heap, _prevCheck);
-        if (_check != 0) {
-          _chunkSize = 0;
-          _sizeAndFlags = _reader.ReadOffset(_check + sizeof(Offset), 0xbadbad);
-          if (_sizeAndFlags != 0xbadbad) {
-            _prevCheck = _check;
+      chunkSize = sizeAndFlags & ~7;
+      if ((chunkSize == 0) || (chunkSize >= 0x10000000) ||
+          (chunkSize > (limit - check))) {
+        check = HandleNonMainArenaCorruption(heap, prevCheck, warnings);
+        if (check != 0) {
+          chunkSize = 0;
+          sizeAndFlags = reader.ReadOffset(check + sizeof(Offset), 0xbadbad);
+          if (sizeAndFlags != 0xbadbad) {
+            prevCheck = check;
             continue;
           }
         }
-        return false;
+        break;
       }
-      _allocationSize = _chunkSize - sizeof(Offset);
+      Offset allocationSize = chunkSize - sizeof(Offset);
       bool isFree = true;
-      if (_check + _chunkSize == _limit) {
-        _allocationSize -= sizeof(Offset);
+      if (check + chunkSize == limit) {
+        allocationSize -= sizeof(Offset);
       } else {
-        _sizeAndFlags =
-            _reader.ReadOffset(_check + sizeof(Offset) + _chunkSize, 0xbadbad);
-        if (_sizeAndFlags == 0xbadbad) {
-          return false;
+        sizeAndFlags =
+            reader.ReadOffset(check + sizeof(Offset) + chunkSize, 0xbadbad);
+        if (sizeAndFlags == 0xbadbad) {
+          break;
         }
-        isFree = ((_sizeAndFlags & 1) == 0) ||
-                 (_allocationSize < 3 * sizeof(Offset));
+        isFree = ((sizeAndFlags & 1) == 0) ||
+                 (allocationSize < 3 * sizeof(Offset));
       }
-      if ((_check + _allocationSize + 3 * sizeof(Offset) == _limit) &&
-          ((_sizeAndFlags & ~7) == 0)) {
+      if ((check + allocationSize + 3 * sizeof(Offset) == limit) &&
+          ((sizeAndFlags & ~7) == 0)) {
         break;
       }
-      _allocationAddress = _check + 2 * sizeof(Offset);
-      if (isFree) {
-        if (_check == _top) {
-          /*
-           * If the entry is the top value for an arena, we want the size of the
-           * allocation to include any writable bytes in the heap that follow
-           * the top allocation so that the results of "count free" reflect
-           * the bytes that are actually available for allocation.  Otherwise,
-           * if the end of the top allocation has shifted to a lower address
-           * without a corresponding shift in the end of the writable region for
-           * the heap, the total free count will be misleading.
-           */
-          typename VirtualAddressMap<Offset>::const_iterator itMap =
-              _addressMap.find(_top);
-          Offset endWritableInHeap = itMap.Limit();
-          Offset endHeapRange = _heapMapIterator->first + _maxHeapSize;
-          if (endWritableInHeap > endHeapRange) {
-            endWritableInHeap = endHeapRange;
-          }
-          _allocationSize = endWritableInHeap - _allocationAddress;
+      Offset allocationAddress = check + 2 * sizeof(Offset);
+      if (isFree && check == top) {
+        /*
+         * If the entry is the top value for an arena, we want the size of the
+         * allocation to include any writable bytes in the heap that follow
+         * the top allocation so that the results of "count free" reflect
+         * the bytes that are actually available for allocation.  Otherwise,
+         * if the end of the top allocation has shifted to a lower address
+         * without a corresponding shift in the end of the writable region for
+         * the heap, the total free count will be misleading.
+         */
+        typename VirtualAddressMap<Offset>::const_iterator itMap =
+            _addressMap.find(top);
+        Offset endWritableInHeap = itMap.Limit();
+        Offset endHeapRange = itHeap->first + _maxHeapSize;
+        if (endWritableInHeap > endHeapRange) {
+          endWritableInHeap = endHeapRange;
         }
-        _allocationIsUsed = false;
-      } else {
-        _allocationIsUsed = true;
+        allocationSize = endWritableInHeap - allocationAddress;
       }
-      _prevCheck = _check;
-      _check += _chunkSize;
-      return true;
+      allocations.push_back({allocationAddress, allocationSize, !isFree});
+      prevCheck = check;
+      check += chunkSize;
     }
-    return false;
   }
 
-  Offset HandleNonMainArenaCorruption(
-      const typename InfrastructureFinder<Offset>::Heap& heap,
-      Offset corruptionPoint) {
-    std::cerr << "Corruption was found in non-main arena run near 0x"
-              << std::hex << corruptionPoint << "\n";
+  Offset HandleNonMainArenaCorruption(const Heap& heap, Offset corruptionPoint,
+                                      std::ostream& warnings) const {
+    warnings << "Corruption was found in non-main arena run near 0x"
+             << std::hex << corruptionPoint << "\n";
     Offset arenaAddress = heap._arenaAddress;
     Offset heapAddress = heap._address;
-    std::cerr << "Corrupt heap is at 0x" << std::hex << heapAddress << "\n";
-    std::cerr << "Corrupt arena is at 0x" << std::hex << arenaAddress << "\n";
+    warnings << "Corrupt heap is at 0x" << std::hex << heapAddress << "\n";
+    warnings << "Corrupt arena is at 0x" << std::hex << arenaAddress << "\n";
     Offset heapLimit = heapAddress + heap._size;
     return _corruptionSkipper.SkipArenaCorruption(arenaAddress, corruptionPoint,
                                                   heapLimit);
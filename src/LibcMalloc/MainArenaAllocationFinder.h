@@ -6,6 +6,7 @@
 #include "../VirtualAddressMap.h"
 #include "CorruptionSkipper.h"
 #include "InfrastructureFinder.h"
+#include "RunBatchScanner.h"
 
 namespace chap {
 namespace LibcMalloc {
@@ -17,6 +18,10 @@ class MainArenaAllocationFinder
   typedef typename VirtualAddressMap<Offset>::NotMapped NotMapped;
   typedef typename VirtualAddressMap<Offset>::RangeAttributes RangeAttributes;
   typedef typename std::set<Offset> OffsetSet;
+  typedef typename Allocations::Directory<Offset>::FoundAllocation
+      FoundAllocation;
+
+  typedef typename InfrastructureFinder<Offset>::MainArenaRuns MainArenaRuns;
 
   MainArenaAllocationFinder(
       const VirtualAddressMap<Offset>& addressMap,
@@ -27,19 +32,23 @@ class MainArenaAllocationFinder
           doublyLinkedListCorruptionChecker,
       Allocations::Directory<Offset>& allocationDirectory)
       : _addressMap(addressMap),
-        _reader(addressMap),
         _infrastructureFinder(infrastructureFinder),
         _mainArenaAddress(_infrastructureFinder.GetMainArenaAddress()),
         _mainArena(
             _infrastructureFinder.GetArenas().find(_mainArenaAddress)->second),
         _mainArenaRuns(_infrastructureFinder.GetMainArenaRuns()),
-        _mainArenaRunsIterator(_mainArenaRuns.begin()),
+        _runs(_mainArenaRuns.begin(), _mainArenaRuns.end()),
         _corruptionSkipper(corruptionSkipper),
         _fastBinFreeStatusFixer(fastBinFreeStatusFixer),
-        _doublyLinkedListCorruptionChecker(doublyLinkedListCorruptionChecker) {
-    if (_mainArenaRunsIterator != _mainArenaRuns.end()) {
-      StartMainArenaRun();
-      Advance();
+        _doublyLinkedListCorruptionChecker(doublyLinkedListCorruptionChecker),
+        _scanner(_runs.size(),
+                 [this](size_t runIndex,
+                        std::vector<FoundAllocation>& allocations,
+                        std::ostream& warnings) {
+                   ScanMainArenaRun(runIndex, allocations, warnings);
+                 }) {
+    if (!_runs.empty() && _scanner.Finished()) {
+      CheckMainArena();
     }
     _finderIndex = allocationDirectory.AddFinder(this);
   }
@@ -49,9 +58,7 @@ class MainArenaAllocationFinder
   /*
    * Return true if there are no more allocations available.
    */
-  virtual bool Finished() {
-    return _mainArenaRunsIterator == _mainArenaRuns.end();
-  }
+  virtual bool Finished() { return _scanner.Finished(); }
 
   /*
    * Return the address of the next allocation (in increasing order of
@@ -61,38 +68,38 @@ class MainArenaAllocationFinder
    * any allocations already reported by this allocation finder have already
    * been assigned allocation indices in the Directory.
    */
-  virtual Offset NextAddress() { return _allocationAddress; }
+  virtual Offset NextAddress() { return _scanner.Next()._address; }
   /*
    * Return the size of the next allocation (in increasing order of
    * address) to be reported by this finder, without advancing to the next
    * allocation.  The return value is undefined if there are no more
    * allocations available.
    */
-  virtual Offset NextSize() { return _allocationSize; }
+  virtual Offset NextSize() { return _scanner.Next()._size; }
   /*
    * Return true if the next allocation (in increasing order of address) to
    * address) to be reported by this finder is considered used, without
    * advancing to the next allocation.
    */
-  virtual bool NextIsUsed() { return _allocationIsUsed; }
+  virtual bool NextIsUsed() { return _scanner.Next()._isUsed; }
   /*
    * Advance to the next allocation.
    */
   virtual void Advance() {
-    if (_mainArenaRunsIterator != _mainArenaRuns.end()) {
-      while (!AdvanceToNextAllocationOfRun()) {
-        if (++_mainArenaRunsIterator == _mainArenaRuns.end()) {
-          _fastBinFreeStatusFixer.MarkFastBinItemsAsFree(_mainArena, true,
-                                                         _finderIndex);
-          _doublyLinkedListCorruptionChecker.CheckDoublyLinkedListCorruption(
-              _mainArena);
-          return;
-        } else {
-          StartMainArenaRun();
-        }
+    if (!_scanner.Finished()) {
+      _scanner.Advance();
+      if (_scanner.Finished()) {
+        CheckMainArena();
       }
     }
   }
+  /*
+   * Copy the next allocation and as many of the allocations that follow it
+   * in the same main arena run as fit.
+   */
+  virtual size_t NextSpan(FoundAllocation* records, size_t maxRecords) {
+    return _scanner.CopySpan(records, maxRecords);
+  }
   /*
    * Return the smallest request size that might reasonably have resulted
    * in an allocation of the given size.
@@ -103,84 +110,88 @@ class MainArenaAllocationFinder
 
  private:
   const VirtualAddressMap<Offset>& _addressMap;
-  typename VirtualAddressMap<Offset>::Reader _reader;
   const InfrastructureFinder<Offset>& _infrastructureFinder;
   const Offset _mainArenaAddress;
   const typename InfrastructureFinder<Offset>::Arena& _mainArena;
-  const typename InfrastructureFinder<Offset>::MainArenaRuns& _mainArenaRuns;
-  typename InfrastructureFinder<Offset>::MainArenaRuns::const_iterator
-      _mainArenaRunsIterator;
-  Offset _allocationAddress;
-  Offset _allocationSize;
-  bool _allocationIsUsed;
-  Offset _base;
-  Offset _size;
-  Offset _limit;
-  Offset _chunkSize;
-  Offset _prevCheck;
-  Offset _check;
-  Offset _checkLimit;
-  Offset _sizeAndFlags;
+  const MainArenaRuns& _mainArenaRuns;
+  const std::vector<std::pair<Offset, Offset> > _runs;  // base, size
   CorruptionSkipper<Offset>& _corruptionSkipper;
   FastBinFreeStatusFixer<Offset>& _fastBinFreeStatusFixer;
   DoublyLinkedListCorruptionChecker<Offset>& _doublyLinkedListCorruptionChecker;
   size_t _finderIndex;
-  void StartMainArenaRun() {
-    _base = _mainArenaRunsIterator->first;
-    _size = _mainArenaRunsIterator->second;
-    _limit = _base + _size;
-    _sizeAndFlags = _reader.ReadOffset(_base + sizeof(Offset));
-    _chunkSize = 0;
-    _prevCheck = _base;
-    _check = _base;
+  RunBatchScanner<Offset> _scanner;
+
+  /*
+   * This is done once all the allocations for the main arena runs have been
+   * added to the directory.
+   */
+  void CheckMainArena() {
+    _fastBinFreeStatusFixer.MarkFastBinItemsAsFree(_mainArena, true,
+                                                   _finderIndex);
+    _doublyLinkedListCorruptionChecker.CheckDoublyLinkedListCorruption(
+        _mainArena);
   }
 
-  bool AdvanceToNextAllocationOfRun() {
-    while (_check < _limit) {
-      if ((_sizeAndFlags & (sizeof(Offset) | 6)) != 0) {
-        _check = HandleMainArenaCorruption(_prevCheck, _limit);
-        if (_check != 0) {
-          _chunkSize = 0;
-          _prevCheck = _check;
-          _sizeAndFlags = _reader.ReadOffset(_check + sizeof(Offset));
+  /*
+   * Append the allocations of the given main arena run to the given vector.
+   * This may be called for different runs at the same time, so it has its
+   * own reader and writes warnings to the given stream.
+   */
+  void ScanMainArenaRun(size_t runIndex,
+                        std::vector<FoundAllocation>& allocations,
+                        std::ostream& warnings) const {
+    Reader reader(_addressMap);
+    Offset base = _runs[runIndex].first;
+    Offset limit = base + _runs[runIndex].second;
+    Offset sizeAndFlags = reader.ReadOffset(base + sizeof(Offset));
+    Offset chunkSize = 0;
+    Offset prevCheck = base;
+    Offset check = base;
+    while (check < limit) {
+      if ((sizeAndFlags & (sizeof(Offset) | 6)) != 0) {
+        check = HandleMainArenaCorruption(prevCheck, limit, warnings);
+        if (check != 0) {
+          chunkSize = 0;
+          prevCheck = check;
+          sizeAndFlags = reader.ReadOffset(check + sizeof(Offset));
           continue;
         }
         break;
       }
-      _chunkSize = _sizeAndFlags & ~7;
+      chunkSize = sizeAndFlags & ~7;
 
-      if ((_chunkSize == 0) || (_chunkSize > (_limit - _check))) {
-        _check = HandleMainArenaCorruption(_prevCheck, _limit);
-        if (_check != 0) {
-          _chunkSize = 0;
-          _prevCheck = _check;
-          _sizeAndFlags = _reader.ReadOffset(_check + sizeof(Offset));
+      if ((chunkSize == 0) || (chunkSize > (limit - check))) {
+        check = HandleMainArenaCorruption(prevCheck, limit, warnings);
+        if (check != 0) {
+          chunkSize = 0;
+          prevCheck = check;
+          sizeAndFlags = reader.ReadOffset(check + sizeof(Offset));
           continue;
         }
         break;
       }
-      _allocationAddress = _check + 2 * sizeof(Offset);
-      _allocationSize = _chunkSize - sizeof(Offset);
-      _allocationIsUsed = false;
-      if (_check + _chunkSize == _limit) {
-        _allocationSize -= sizeof(Offset);
+      Offset allocationAddress = check + 2 * sizeof(Offset);
+      Offset allocationSize = chunkSize - sizeof(Offset);
+      bool allocationIsUsed = false;
+      if (check + chunkSize == limit) {
+        allocationSize -= sizeof(Offset);
       } else {
-        _sizeAndFlags =
-            _reader.ReadOffset(_check + sizeof(Offset) + _chunkSize);
-        _allocationIsUsed = ((_sizeAndFlags & 1) != 0);
+        sizeAndFlags = reader.ReadOffset(check + sizeof(Offset) + chunkSize);
+        allocationIsUsed = ((sizeAndFlags & 1) != 0);
       }
-      _prevCheck = _check;
-      _check += _chunkSize;
-      return true;
+      allocations.push_back(
+          {allocationAddress, allocationSize, allocationIsUsed});
+      prevCheck = check;
+      check += chunkSize;
     }
-    return false;
   }
 
-  Offset HandleMainArenaCorruption(Offset corruptionPoint, Offset limit) {
-    std::cerr << "Corruption was found in main arena run near 0x" << std::hex
-              << corruptionPoint << "\n";
-    std::cerr << "The main arena is at 0x" << std::hex << _mainArenaAddress
-              << "\n";
+  Offset HandleMainArenaCorruption(Offset corruptionPoint, Offset limit,
+                                   std::ostream& warnings) const {
+    warnings << "Corruption was found in main arena run near 0x" << std::hex
+             << corruptionPoint << "\n";
+    warnings << "The main arena is at 0x" << std::hex << _mainArenaAddress
+             << "\n";
     return _corruptionSkipper.SkipArenaCorruption(_mainArenaAddress,
                                                   corruptionPoint, limit);
   }
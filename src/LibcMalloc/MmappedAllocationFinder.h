@@ -9,6 +9,8 @@ namespace LibcMalloc {
 template <class Offset>
 class MmappedAllocationFinder : public Allocations::Directory<Offset>::Finder {
  public:
+  typedef typename Allocations::Directory<Offset>::FoundAllocation
+      FoundAllocation;
   MmappedAllocationFinder(
       VirtualMemoryPartition<Offset>& virtualMemoryPartition)
       : LIBC_MALLOC_MMAPPED_ALLOCATION("libc malloc mmapped allocation"),
@@ -52,6 +54,23 @@ class MmappedAllocationFinder : public Allocations::Directory<Offset>::Finder {
       ++_itNext;
     }
   }
+  /*
+   * Copy the next allocation and as many of the following ones as fit,
+   * leaving the finder at the last one copied.
+   */
+  virtual size_t NextSpan(FoundAllocation* records, size_t maxRecords) {
+    size_t numRecords = 0;
+    for (; _itNext != _mmappedChunks.end() && numRecords < maxRecords;
+         ++_itNext) {
+      Offset address = _itNext->first + 2 * sizeof(Offset);
+      Offset size = _itNext->second - 2 * sizeof(Offset);
+      records[numRecords++] = {address, size, true};
+    }
+    if (numRecords != 0) {
+      --_itNext;
+    }
+    return numRecords;
+  }
   /*
    * Return the smallest request size that might reasonably have resulted
    * in an allocation of the given size.
@@ -72,25 +91,35 @@ class MmappedAllocationFinder : public Allocations::Directory<Offset>::Finder {
   void ScanForMmappedChunksInRange(Offset base, Offset limit) {
     typename VirtualAddressMap<Offset>::Reader reader(_addressMap);
     Offset candidate = (base + 0xFFF) & ~0xFFF;
-    while (candidate <= limit - 0x1000) {
-      Offset expect0 = reader.ReadOffset(candidate, 0xbadbad);
-      Offset chunkSizeAndFlags =
-          reader.ReadOffset(candidate + sizeof(Offset), 0xbadbad);
-      bool foundMmappedAlloc =
-          (expect0 == 0) &&
-          ((chunkSizeAndFlags & ((Offset)0xFFF)) == ((Offset)2)) &&
-          (chunkSizeAndFlags >= ((Offset)0x1000)) &&
-          (candidate + chunkSizeAndFlags - 2) > candidate &&
-          (candidate + chunkSizeAndFlags - 2) <= limit;
-      if (!foundMmappedAlloc) {
-        candidate += 0x1000;
-      } else {
-        Offset chunkSize = chunkSizeAndFlags - 2;
+    /*
+     * A chunk can't start on a page that is all zero, because the size
+     * would be 0, so such pages are skipped without being read.
+     */
+    _addressMap.VisitSpansNotKnownZero(
+        base, limit, [&](Offset spanBase, Offset spanLimit) {
+          if (candidate < spanBase) {
+            candidate = (spanBase + 0xFFF) & ~0xFFF;
+          }
+          while (candidate < spanLimit && candidate <= limit - 0x1000) {
+            Offset expect0 = reader.ReadOffset(candidate, 0xbadbad);
+            Offset chunkSizeAndFlags =
+                reader.ReadOffset(candidate + sizeof(Offset), 0xbadbad);
+            bool foundMmappedAlloc =
+                (expect0 == 0) &&
+                ((chunkSizeAndFlags & ((Offset)0xFFF)) == ((Offset)2)) &&
+                (chunkSizeAndFlags >= ((Offset)0x1000)) &&
+                (candidate + chunkSizeAndFlags - 2) > candidate &&
+                (candidate + chunkSizeAndFlags - 2) <= limit;
+            if (!foundMmappedAlloc) {
+              candidate += 0x1000;
+            } else {
+              Offset chunkSize = chunkSizeAndFlags - 2;
 
-        _mmappedChunks[candidate] = chunkSize;
-        candidate += chunkSize;
-      }
-    }
+              _mmappedChunks[candidate] = chunkSize;
+              candidate += chunkSize;
+            }
+          }
+        });
   }
 
   void ScanForMmappedChunks() {
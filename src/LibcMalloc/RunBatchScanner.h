@@ -0,0 +1,155 @@
+// Copyright (c) 2021 VMware, Inc. All Rights Reserved.
+// SPDX-License-Identifier: GPL-2.0
+
+#pragma once
+#include <algorithm>
+#include <functional>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include "../Allocations/Directory.h"
+#include "../WorkerThreads.h"
+
+namespace chap {
+namespace LibcMalloc {
+/*
+ * A RunBatchScanner reports, in order, the allocations of a sequence of
+ * runs of chunks that can be scanned independently of each other, such as
+ * the non-main heaps or the main arena runs.  The runs are scanned a batch
+ * at a time, with each run of the batch scanned as a separate task on the
+ * worker threads into its own buffer.  Any warnings from scanning a run are
+ * held until the scanner reaches that run, so the allocations and warnings
+ * come out in the same order as for a serial scan.
+ */
+template <class Offset>
+class RunBatchScanner {
+ public:
+  typedef typename Allocations::Directory<Offset>::FoundAllocation
+      FoundAllocation;
+  /*
+   * A ScanRun appends the allocations of the run with the given index to
+   * the given vector, in increasing order of address, and writes any
+   * warnings to the given stream.  It must be safe to call for different
+   * runs at the same time.
+   */
+  typedef std::function<void(size_t,  // run index
+                             std::vector<FoundAllocation>&, std::ostream&)>
+      ScanRun;
+
+  RunBatchScanner(size_t numRuns, ScanRun scanRun)
+      : _numRuns(numRuns),
+        _scanRun(scanRun),
+        _runsPerBatch(2 * WorkerThreads::GetNumThreads()),
+        _runIndex(0),
+        _batchBase(0),
+        _next(0) {
+    EnterRun();
+  }
+
+  /*
+   * Return true if there are no more allocations available.
+   */
+  bool Finished() const { return _runIndex == _numRuns; }
+
+  /*
+   * Return the next allocation.  The return value is undefined if there
+   * are no more allocations available.
+   */
+  const FoundAllocation& Next() const {
+    return _batch[_runIndex - _batchBase]._allocations[_next];
+  }
+
+  /*
+   * Advance to the next allocation.
+   */
+  void Advance() {
+    if (_runIndex == _numRuns) {
+      return;
+    }
+    std::vector<FoundAllocation>& allocations =
+        _batch[_runIndex - _batchBase]._allocations;
+    if (++_next < allocations.size()) {
+      return;
+    }
+    std::vector<FoundAllocation>().swap(allocations);
+    _next = 0;
+    _runIndex++;
+    EnterRun();
+  }
+
+  /*
+   * Copy the next allocation and as many of the allocations that follow it
+   * in the same run as fit, leaving the scanner at the last one copied, and
+   * return the number copied.
+   */
+  size_t CopySpan(FoundAllocation* records, size_t maxRecords) {
+    if (_runIndex == _numRuns || maxRecords == 0) {
+      return 0;
+    }
+    const std::vector<FoundAllocation>& allocations =
+        _batch[_runIndex - _batchBase]._allocations;
+    size_t numRecords = std::min(maxRecords, allocations.size() - _next);
+    std::copy(allocations.begin() + _next,
+              allocations.begin() + _next + numRecords, records);
+    _next += numRecords - 1;
+    return numRecords;
+  }
+
+ private:
+  struct ScannedRun {
+    std::vector<FoundAllocation> _allocations;
+    std::string _warnings;
+    std::ios_base::fmtflags _warningFlags;
+  };
+  const size_t _numRuns;
+  ScanRun _scanRun;
+  const size_t _runsPerBatch;
+  size_t _runIndex;
+  size_t _batchBase;
+  size_t _next;
+  std::vector<ScannedRun> _batch;
+
+  /*
+   * Move to the first allocation of the first run, starting at the current
+   * one, that has any allocations, scanning more batches as needed and
+   * writing the warnings for each run reached.
+   */
+  void EnterRun() {
+    for (; _runIndex < _numRuns; _runIndex++) {
+      if (_runIndex - _batchBase >= _batch.size()) {
+        ScanBatch();
+      }
+      ScannedRun& run = _batch[_runIndex - _batchBase];
+      if (!run._warnings.empty()) {
+        /*
+         * The stream is left formatted as a serial scan would leave it,
+         * because later messages may depend on that.
+         */
+        std::cerr << run._warnings;
+        std::cerr.flags(run._warningFlags);
+      }
+      if (!run._allocations.empty()) {
+        return;
+      }
+    }
+    _batch.clear();
+  }
+
+  void ScanBatch() {
+    _batchBase = _runIndex;
+    size_t numRunsInBatch = std::min(_runsPerBatch, _numRuns - _batchBase);
+    _batch.clear();
+    _batch.resize(numRunsInBatch);
+    WorkerThreads::Run(numRunsInBatch, [this](size_t taskIndex, size_t) {
+      ScannedRun& run = _batch[taskIndex];
+      std::ostringstream warnings;
+      warnings.flags(std::cerr.flags());
+      _scanRun(_batchBase + taskIndex, run._allocations, warnings);
+      run._warnings = warnings.str();
+      run._warningFlags = warnings.flags();
+    });
+  }
+};
+}  // namespace LibcMalloc
+}  // namespace chap
@@ -35,7 +35,7 @@ class DescribeArenas : public Commands::Subcommand {
       const typename InfrastructureFinder<Offset>::Arena arena =
           addressAndInfo.second;
       tally.AdjustTally(arena._maxSize);
-      ArenaTally& arenaTally = _arenaTallies[address];
+      const ArenaTally& arenaTally = _arenaTallies.find(address)->second;
       output << "Arena at 0x" << std::hex << address << " has size 0x"
              << arena._size << " (" << std::dec << arena._size
              << "),\nmaximum size 0x" << std::hex << arena._maxSize << " ("
@@ -63,6 +63,13 @@ class DescribeArenas : public Commands::Subcommand {
   };
   std::map<Offset, ArenaTally> _arenaTallies;
   void SetArenaTallies() {
+    /*
+     * Every arena gets a tally up front, even if it has no allocations, so
+     * that Run() need not change the map and can safely run concurrently.
+     */
+    for (const auto& addressAndInfo : _arenas) {
+      _arenaTallies[addressAndInfo.first];
+    }
     typename Allocations::Directory<Offset>::AllocationIndex numAllocations =
         _directory.NumAllocations();
     for (typename Allocations::Directory<Offset>::AllocationIndex i = 0;
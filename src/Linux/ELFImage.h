@@ -188,6 +188,11 @@ class ELFImage {
     // _expectedMinimumFileSize.
     _isTruncated = (_fileSize < _minimumExpectedFileSize);
 
+    /*
+     * The virtual address map does not change after this point.
+     */
+    _virtualAddressMap.Freeze();
+
     if (_elfHeader->e_type == ET_CORE) {
       VisitNotes(
           std::bind(&ELFImage<Ehdr, Phdr, Shdr, Nhdr, Off, Word, elfClass,
@@ -0,0 +1,436 @@
+// Copyright (c) 2021 VMware, Inc. All Rights Reserved.
+// SPDX-License-Identifier: GPL-2.0
+
+#pragma once
+extern "C" {
+#include <elf.h>
+#include <stdlib.h>
+#include <string.h>
+};
+#include <cxxabi.h>
+#include <stdint.h>
+#include <algorithm>
+#include <string>
+#include <type_traits>
+#include <vector>
+#include "../FileImage.h"
+
+namespace chap {
+namespace Linux {
+class ElfSymbolTableBase {
+ public:
+  /*
+   * Set the directory searched for separate debug files for modules that
+   * have no .symtab section.  An empty path means that only the directory
+   * of the module itself is searched.
+   */
+  static void SetDebugDirectory(const std::string& debugDirectory) {
+    DebugDirectory() = debugDirectory;
+  }
+  static const std::string& GetDebugDirectory() { return DebugDirectory(); }
+
+  /*
+   * Return the demangled form of the given symbol name, or the name itself
+   * if it is not a mangled C++ name.
+   */
+  static std::string Demangle(const std::string& mangled) {
+    int status = 0;
+    char* demangled = abi::__cxa_demangle(mangled.c_str(), nullptr, nullptr,
+                                          &status);
+    if (demangled == nullptr) {
+      return mangled;
+    }
+    std::string name(demangled);
+    free(demangled);
+    return name;
+  }
+
+ private:
+  static std::string& DebugDirectory() {
+    static std::string debugDirectory("/usr/lib/debug");
+    return debugDirectory;
+  }
+};
+
+/*
+ * An ElfSymbolTable holds the function and object symbols of a module, sorted
+ * by link-time address, so that the symbol that contains a given address can
+ * be found by binary search.  The symbols are taken from the .symtab section
+ * of the module if there is one.  Otherwise they are taken from the .symtab
+ * section of a separate debug file, found by build ID as
+ * <debug-dir>/.build-id/xx/yyyy.debug or by the name in the .gnu_debuglink
+ * section, in the places gdb looks and directly under the debug directory,
+ * or, failing that, from the .dynsym section of the module.  A debug file is
+ * used only if it has the same build ID as the module.
+ *
+ * The table does not keep the files open.
+ */
+template <class ElfImage>
+class ElfSymbolTable : public ElfSymbolTableBase {
+ public:
+  typedef typename ElfImage::Offset Offset;
+  typedef typename ElfImage::ElfHeader ElfHeader;
+  typedef typename ElfImage::ProgramHeader ProgramHeader;
+  typedef typename ElfImage::SectionHeader SectionHeader;
+  typedef typename ElfImage::NoteHeader NoteHeader;
+  typedef typename std::conditional<sizeof(Offset) == 8, Elf64_Sym,
+                                    Elf32_Sym>::type ElfSymbol;
+
+  ElfSymbolTable(const std::string& modulePath) : _linkBase(0) {
+    ParsedFile module;
+    try {
+      FileImage fileImage(modulePath.c_str(), false);
+      if (!Parse(fileImage, module)) {
+        return;
+      }
+      _linkBase = module._linkBase;
+      _buildId = module._buildId;
+      if (module._symtab != nullptr) {
+        AddSymbols(fileImage, module, module._symtab);
+      } else if (!ReadDebugFile(modulePath, module) &&
+                 module._dynsym != nullptr) {
+        AddSymbols(fileImage, module, module._dynsym);
+      }
+    } catch (...) {
+      return;
+    }
+    std::sort(_symbols.begin(), _symbols.end());
+    /*
+     * Where several symbols start at the same address, keep just the one
+     * that sorted first.
+     */
+    _symbols.erase(std::unique(_symbols.begin(), _symbols.end(),
+                               [](const Symbol& left, const Symbol& right) {
+                                 return left._address == right._address;
+                               }),
+                   _symbols.end());
+  }
+
+  bool IsEmpty() const { return _symbols.empty(); }
+
+  /*
+   * Return the lowest link-time address of the module, rounded down to a
+   * page boundary, which corresponds to the start of the first range of the
+   * module in the process.
+   */
+  Offset GetLinkBase() const { return _linkBase; }
+
+  /*
+   * Return the build ID of the module, as a hexadecimal string, or an empty
+   * string if it has none.
+   */
+  const std::string& GetBuildId() const { return _buildId; }
+
+  /*
+   * Find the symbol that contains the given link-time address, returning
+   * false if there is none.  A symbol of size 0 contains only its own
+   * address.
+   */
+  bool Find(Offset address, std::string& mangledName,
+            Offset& offsetInSymbol) const {
+    typename std::vector<Symbol>::const_iterator it = std::upper_bound(
+        _symbols.begin(), _symbols.end(), address,
+        [](Offset value, const Symbol& symbol) {
+          return value < symbol._address;
+        });
+    if (it == _symbols.begin()) {
+      return false;
+    }
+    --it;
+    offsetInSymbol = address - it->_address;
+    if (offsetInSymbol != 0 && offsetInSymbol >= it->_size) {
+      return false;
+    }
+    mangledName.assign(_names.data() + it->_nameOffset);
+    return true;
+  }
+
+  /*
+   * Return the build ID from the image of a loaded module that starts with
+   * its ELF header, or an empty string if the image is too short to hold the
+   * note or the module has no build ID.
+   */
+  static std::string FindBuildIdInLoadedImage(const char* image,
+                                              uint64_t imageSize) {
+    const ElfHeader* elfHeader = (const ElfHeader*)(image);
+    if (!IsUsableHeader(image, imageSize) ||
+        elfHeader->e_phentsize != sizeof(ProgramHeader) ||
+        elfHeader->e_phoff + elfHeader->e_phnum * sizeof(ProgramHeader) >
+            imageSize) {
+      return "";
+    }
+    const ProgramHeader* programHeaders =
+        (const ProgramHeader*)(image + elfHeader->e_phoff);
+    Offset linkBase = FindLinkBase(programHeaders, elfHeader->e_phnum);
+    for (size_t i = 0; i < elfHeader->e_phnum; i++) {
+      const ProgramHeader& header = programHeaders[i];
+      if (header.p_type != PT_NOTE) {
+        continue;
+      }
+      uint64_t notesOffset = header.p_vaddr - linkBase;
+      if (notesOffset > imageSize ||
+          header.p_filesz > imageSize - notesOffset) {
+        continue;
+      }
+      std::string buildId = FindBuildIdInNotes(image + notesOffset,
+                                               header.p_filesz, header.p_align);
+      if (!buildId.empty()) {
+        return buildId;
+      }
+    }
+    return "";
+  }
+
+ private:
+  struct Symbol {
+    Offset _address;
+    Offset _size;
+    size_t _nameOffset;
+    bool _isGlobal;
+    /*
+     * Symbols are sorted by address, with a global symbol preferred over
+     * any local or weak one at the same address and, after that, a larger
+     * symbol preferred over a smaller one.
+     */
+    bool operator<(const Symbol& other) const {
+      if (_address != other._address) {
+        return _address < other._address;
+      }
+      if (_isGlobal != other._isGlobal) {
+        return _isGlobal;
+      }
+      return _size > other._size;
+    }
+  };
+
+  struct ParsedFile {
+    ParsedFile()
+        : _sectionHeaders(nullptr),
+          _numSections(0),
+          _symtab(nullptr),
+          _dynsym(nullptr),
+          _linkBase(0) {}
+    const SectionHeader* _sectionHeaders;
+    size_t _numSections;
+    const SectionHeader* _symtab;
+    const SectionHeader* _dynsym;
+    Offset _linkBase;
+    std::string _buildId;
+    std::string _debugLink;
+  };
+
+  Offset _linkBase;
+  std::string _buildId;
+  std::vector<Symbol> _symbols;
+  std::string _names;
+
+  static bool IsUsableHeader(const char* image, uint64_t size) {
+    const ElfHeader* elfHeader = (const ElfHeader*)(image);
+    return size >= sizeof(ElfHeader) && !strncmp(image, ELFMAG, SELFMAG) &&
+           elfHeader->e_ident[EI_CLASS] ==
+               (sizeof(Offset) == 8 ? ELFCLASS64 : ELFCLASS32) &&
+           elfHeader->e_ident[EI_DATA] == ELFDATA2LSB;
+  }
+
+  static Offset FindLinkBase(const ProgramHeader* programHeaders,
+                             size_t numProgramHeaders) {
+    Offset linkBase = ~((Offset)0);
+    for (size_t i = 0; i < numProgramHeaders; i++) {
+      const ProgramHeader& header = programHeaders[i];
+      if (header.p_type == PT_LOAD && header.p_vaddr < linkBase) {
+        linkBase = header.p_vaddr;
+      }
+    }
+    return (linkBase == ~((Offset)0)) ? 0 : (linkBase & ~((Offset)0xfff));
+  }
+
+  static std::string FindBuildIdInNotes(const char* notes, uint64_t size,
+                                        uint64_t align) {
+    static const char HEX_DIGITS[] = "0123456789abcdef";
+    uint64_t mask = (align == 8) ? 7 : 3;
+    uint64_t offset = 0;
+    while (size - offset >= sizeof(NoteHeader)) {
+      const NoteHeader* noteHeader = (const NoteHeader*)(notes + offset);
+      uint64_t nameOffset = offset + sizeof(NoteHeader);
+      uint64_t descOffset = (nameOffset + noteHeader->n_namesz + mask) & ~mask;
+      uint64_t descLimit = descOffset + noteHeader->n_descsz;
+      if (descLimit > size) {
+        break;
+      }
+      if (noteHeader->n_type == NT_GNU_BUILD_ID &&
+          noteHeader->n_namesz == 4 &&
+          !memcmp(notes + nameOffset, "GNU", 4)) {
+        std::string buildId;
+        for (uint64_t i = descOffset; i < descLimit; i++) {
+          unsigned char c = (unsigned char)(notes[i]);
+          buildId.push_back(HEX_DIGITS[c >> 4]);
+          buildId.push_back(HEX_DIGITS[c & 0xf]);
+        }
+        return buildId;
+      }
+      offset = (descLimit + mask) & ~mask;
+    }
+    return "";
+  }
+
+  static bool IsInFile(const FileImage& fileImage,
+                       const SectionHeader& header) {
+    uint64_t fileSize = fileImage.GetFileSize();
+    return header.sh_type != SHT_NOBITS && header.sh_offset <= fileSize &&
+           header.sh_size <= fileSize - header.sh_offset;
+  }
+
+  /*
+   * Find the parts of the given ELF file that are needed for the symbols,
+   * returning false if it is not an ELF file of the right class.
+   */
+  static bool Parse(const FileImage& fileImage, ParsedFile& parsed) {
+    const char* image = fileImage.GetImage();
+    uint64_t fileSize = fileImage.GetFileSize();
+    if (!IsUsableHeader(image, fileSize)) {
+      return false;
+    }
+    const ElfHeader* elfHeader = (const ElfHeader*)(image);
+    if (elfHeader->e_phentsize == sizeof(ProgramHeader) &&
+        elfHeader->e_phoff + elfHeader->e_phnum * sizeof(ProgramHeader) <=
+            fileSize) {
+      parsed._linkBase =
+          FindLinkBase((const ProgramHeader*)(image + elfHeader->e_phoff),
+                       elfHeader->e_phnum);
+    }
+    if (elfHeader->e_shentsize != sizeof(SectionHeader) ||
+        elfHeader->e_shoff + elfHeader->e_shnum * sizeof(SectionHeader) >
+            fileSize) {
+      return true;
+    }
+    parsed._sectionHeaders =
+        (const SectionHeader*)(image + elfHeader->e_shoff);
+    parsed._numSections = elfHeader->e_shnum;
+    const SectionHeader* sectionNames = nullptr;
+    if (elfHeader->e_shstrndx < parsed._numSections &&
+        IsInFile(fileImage, parsed._sectionHeaders[elfHeader->e_shstrndx])) {
+      sectionNames = parsed._sectionHeaders + elfHeader->e_shstrndx;
+    }
+    for (size_t i = 0; i < parsed._numSections; i++) {
+      const SectionHeader& header = parsed._sectionHeaders[i];
+      if (!IsInFile(fileImage, header)) {
+        continue;
+      }
+      switch (header.sh_type) {
+        case SHT_SYMTAB:
+          parsed._symtab = &header;
+          break;
+        case SHT_DYNSYM:
+          parsed._dynsym = &header;
+          break;
+        case SHT_NOTE:
+          if (parsed._buildId.empty()) {
+            parsed._buildId = FindBuildIdInNotes(
+                image + header.sh_offset, header.sh_size, header.sh_addralign);
+          }
+          break;
+        case SHT_PROGBITS:
+          if (sectionNames != nullptr &&
+              header.sh_name < sectionNames->sh_size &&
+              !strncmp(image + sectionNames->sh_offset + header.sh_name,
+                       ".gnu_debuglink", sectionNames->sh_size -
+                                            header.sh_name)) {
+            parsed._debugLink.assign(
+                image + header.sh_offset,
+                strnlen(image + header.sh_offset, header.sh_size));
+          }
+          break;
+      }
+    }
+    return true;
+  }
+
+  /*
+   * Add the function and object symbols that are defined in the given
+   * symbol table section.
+   */
+  void AddSymbols(const FileImage& fileImage, const ParsedFile& parsed,
+                  const SectionHeader* symbolSection) {
+    if (symbolSection->sh_link >= parsed._numSections ||
+        symbolSection->sh_entsize != sizeof(ElfSymbol)) {
+      return;
+    }
+    const SectionHeader& stringSection =
+        parsed._sectionHeaders[symbolSection->sh_link];
+    if (!IsInFile(fileImage, stringSection) || stringSection.sh_size == 0) {
+      return;
+    }
+    const char* image = fileImage.GetImage();
+    size_t namesBase = _names.size();
+    _names.append(image + stringSection.sh_offset, stringSection.sh_size);
+    _names.push_back('\000');
+    const ElfSymbol* elfSymbols =
+        (const ElfSymbol*)(image + symbolSection->sh_offset);
+    size_t numSymbols = symbolSection->sh_size / sizeof(ElfSymbol);
+    for (size_t i = 0; i < numSymbols; i++) {
+      const ElfSymbol& elfSymbol = elfSymbols[i];
+      unsigned char type = ELF64_ST_TYPE(elfSymbol.st_info);
+      if ((type != STT_OBJECT && type != STT_FUNC && type != STT_GNU_IFUNC) ||
+          elfSymbol.st_shndx == SHN_UNDEF ||
+          elfSymbol.st_shndx >= SHN_LORESERVE || elfSymbol.st_value == 0 ||
+          elfSymbol.st_name == 0 ||
+          elfSymbol.st_name >= stringSection.sh_size) {
+        continue;
+      }
+      Symbol symbol;
+      symbol._address = elfSymbol.st_value;
+      symbol._size = elfSymbol.st_size;
+      symbol._nameOffset = namesBase + elfSymbol.st_name;
+      symbol._isGlobal = (ELF64_ST_BIND(elfSymbol.st_info) == STB_GLOBAL);
+      _symbols.push_back(symbol);
+    }
+  }
+
+  /*
+   * Try the possible separate debug files for the given module, adding the
+   * symbols from the first one that matches the module, and return true if
+   * one was found.
+   */
+  bool ReadDebugFile(const std::string& modulePath, const ParsedFile& module) {
+    const std::string& debugDirectory = GetDebugDirectory();
+    std::string moduleDirectory;
+    size_t lastSlash = modulePath.rfind('/');
+    if (lastSlash != std::string::npos) {
+      moduleDirectory = modulePath.substr(0, lastSlash);
+    }
+    std::vector<std::string> candidates;
+    if (!debugDirectory.empty() && module._buildId.size() > 2) {
+      candidates.push_back(debugDirectory + "/.build-id/" +
+                           module._buildId.substr(0, 2) + "/" +
+                           module._buildId.substr(2) + ".debug");
+    }
+    if (!module._debugLink.empty()) {
+      candidates.push_back(moduleDirectory + "/" + module._debugLink);
+      candidates.push_back(moduleDirectory + "/.debug/" + module._debugLink);
+      if (!debugDirectory.empty()) {
+        candidates.push_back(debugDirectory + moduleDirectory + "/" +
+                             module._debugLink);
+        candidates.push_back(debugDirectory + "/" + module._debugLink);
+      }
+    }
+    for (const auto& candidate : candidates) {
+      if (candidate == modulePath) {
+        continue;
+      }
+      try {
+        FileImage fileImage(candidate.c_str(), false);
+        ParsedFile debugFile;
+        if (!Parse(fileImage, debugFile) || debugFile._symtab == nullptr ||
+            debugFile._buildId != module._buildId) {
+          continue;
+        }
+        AddSymbols(fileImage, debugFile, debugFile._symtab);
+        return true;
+      } catch (...) {
+      }
+    }
+    return false;
+  }
+};
+}  // namespace Linux
+}  // namespace chap
@@ -6,11 +6,13 @@
 #include <map>
 #include <regex>
 #include "../Allocations/TaggerRunner.h"
+#include "../AnalysisCache.h"
 #include "../LibcMalloc/FinderGroup.h"
 #include "../ProcessImage.h"
 #include "../RangeMapper.h"
 #include "../Unmangler.h"
 #include "ELFImage.h"
+#include "ElfSymbolTable.h"
 
 namespace chap {
 namespace Linux {
@@ -28,7 +30,9 @@ class LinuxProcessImage : public ProcessImage<typename ElfImage::Offset> {
                              elfImage.GetThreadMap()),
         _elfImage(elfImage),
         _firstReadableStackGuardFound(false),
-        _symdefsRead(false) {
+        _symdefsRead(false),
+        _symreqsWritten(false),
+        _allocationsResolved(false) {
     if (_elfImage.GetELFType() != ET_CORE) {
       /*
        * It is the responsibilty of the caller to avoid passing in an ELFImage
@@ -146,6 +150,8 @@ class LinuxProcessImage : public ProcessImage<typename ElfImage::Offset> {
         }
       }
 
+      Base::_stackRegistry.Freeze();
+
       /*
        * Now that any allocation finders have been registered with the
        * allocaion directory, find out where all the allocations are.
@@ -166,10 +172,12 @@ class LinuxProcessImage : public ProcessImage<typename ElfImage::Offset> {
        */
       FindStaticAnchorRanges();
 
-      Base::_allocationGraph = new Allocations::Graph<Offset>(
-          Base::_virtualAddressMap, Base::_allocationDirectory,
-          Base::_threadMap, Base::_stackRegistry, _staticAnchorLimits, nullptr,
-          nullptr);
+      /*
+       * The graph could be calculated from this point on, but it and the
+       * tags are calculated only when first used, which for the tags is
+       * after the constructor has finished.
+       */
+      _allocationsResolved = true;
 
       /*
        * In Linux processes the current approach is to wait until the
@@ -183,6 +191,8 @@ class LinuxProcessImage : public ProcessImage<typename ElfImage::Offset> {
 
       FindSignatureNamesFromBinaries();
 
+      FindSignatureNamesFromSymbolTables();
+
       WriteSymreqsFileIfNeeded();
 
       /*
@@ -191,8 +201,6 @@ class LinuxProcessImage : public ProcessImage<typename ElfImage::Offset> {
        */
       Base::_virtualMemoryPartition.ClaimUnclaimedRangesAsUnknown();
 
-      Base::TagAllocations();
-
       WarnForModulesWithNoWritableRanges();
     }
   }
@@ -203,6 +211,7 @@ class LinuxProcessImage : public ProcessImage<typename ElfImage::Offset> {
 
   void RefreshSignaturesAndAnchors() {
     if (!_symdefsRead) {
+      Base::PreserveSignaturesForTagging();
       ReadSymdefsFile();
     }
   }
@@ -216,6 +225,43 @@ class LinuxProcessImage : public ProcessImage<typename ElfImage::Offset> {
 
  private:
   std::unique_ptr<LibcMalloc::FinderGroup<Offset> > _libcMallocFinderGroup;
+  /*
+   * Results from a previous analysis of the same core, kept between the
+   * calculation of the graph and the calculation of the tags.
+   */
+  std::unique_ptr<AnalysisCache::Reader> _cachedAnalysis;
+
+  virtual void BuildAllocationGraph() {
+    if (!_allocationsResolved) {
+      return;
+    }
+    if (AnalysisCache::IsEnabled()) {
+      _cachedAnalysis.reset(new AnalysisCache::Reader(GetAnalysisCachePath(),
+                                                      GetAnalysisCacheKey()));
+      if (!_cachedAnalysis->IsValid()) {
+        _cachedAnalysis.reset();
+      }
+    }
+    Base::_allocationGraph = new Allocations::Graph<Offset>(
+        Base::_virtualAddressMap, Base::_allocationDirectory, Base::_threadMap,
+        Base::_stackRegistry, _staticAnchorLimits, nullptr, nullptr,
+        _cachedAnalysis.get());
+    FindAnchorNamesFromSymbolTables();
+    if (_symreqsWritten) {
+      WriteSymreqsFile(true);
+    }
+  }
+
+  virtual void BuildAllocationTags() {
+    Base::TagAllocations(_cachedAnalysis.get());
+    if (_cachedAnalysis != nullptr && _cachedAnalysis->Finished()) {
+      std::cerr << "Reused analysis results from " << GetAnalysisCachePath()
+                << ".\n";
+    } else if (AnalysisCache::IsEnabled()) {
+      SaveAnalysis();
+    }
+    _cachedAnalysis.reset();
+  }
 
   void WarnIfFirstReadableStackGuardFound() {
     if (!_firstReadableStackGuardFound) {
@@ -563,14 +609,20 @@ class LinuxProcessImage : public ProcessImage<typename ElfImage::Offset> {
         if (moduleNameAndRanges.first.find("/ld") == std::string::npos) {
           continue;
         }
-        auto itEnd = moduleNameAndRanges.second.end();
-        auto it = moduleNameAndRanges.second.begin();
-        if (it == itEnd) {
+        /*
+         * Patching the chain can replace ranges of any module in the chain,
+         * including this one, so work from a copy of the range bases.
+         */
+        std::vector<Offset> rangeBases;
+        for (const auto& range : moduleNameAndRanges.second) {
+          rangeBases.push_back(range._base);
+        }
+        if (rangeBases.empty()) {
           continue;
         }
-        Offset loaderBase = it->_base;
-        while (++it != itEnd) {
-          auto itMap = Base::_virtualAddressMap.find(it->_base);
+        Offset loaderBase = rangeBases[0];
+        for (size_t i = 1; i < rangeBases.size(); i++) {
+          auto itMap = Base::_virtualAddressMap.find(rangeBases[i]);
           if (itMap == Base::_virtualAddressMap.end()) {
             continue;
           }
@@ -1148,7 +1200,24 @@ class LinuxProcessImage : public ProcessImage<typename ElfImage::Offset> {
   ElfImage& _elfImage;
   bool _firstReadableStackGuardFound;
   bool _symdefsRead;
+  /*
+   * True if this run wrote the .symreqs file, which then still lacks the
+   * requests for static anchors, and the marker that says they are present,
+   * until the graph has been built.
+   */
+  bool _symreqsWritten;
+  /*
+   * Signatures requested in the .symreqs file written by this run.
+   */
+  std::vector<Offset> _requestedSignatures;
+  bool _allocationsResolved;
   std::map<Offset, Offset> _staticAnchorLimits;
+  /*
+   * Symbol tables of modules, by path, read on first use.  A null entry
+   * means that no usable symbols were found for the module.
+   */
+  std::map<std::string, std::unique_ptr<ElfSymbolTable<ElfImage> > >
+      _moduleSymbols;
 
   bool ParseOffset(const std::string& s, Offset& value) const {
     if (!s.empty()) {
@@ -1503,21 +1572,182 @@ class LinuxProcessImage : public ProcessImage<typename ElfImage::Offset> {
     }
   }
 
-  void AddSignatureRequestsToSymReqs(std::ofstream& gdbScriptFile) {
+  /*
+   * Return the build ID found in the image of the given module in the core,
+   * or an empty string if it is not known.
+   */
+  std::string FindBuildIdInCore(const std::string& modulePath) const {
+    const typename ModuleDirectory<Offset>::RangeToFlags* ranges =
+        Base::_moduleDirectory.Find(modulePath);
+    if (ranges == nullptr || ranges->begin() == ranges->end()) {
+      return "";
+    }
+    Offset moduleBase = ranges->begin()->_base;
+    typename VirtualAddressMap<Offset>::const_iterator itRange =
+        Base::_virtualAddressMap.find(moduleBase);
+    if (itRange == Base::_virtualAddressMap.end() ||
+        itRange.GetImage() == nullptr) {
+      return "";
+    }
+    return ElfSymbolTable<ElfImage>::FindBuildIdInLoadedImage(
+        itRange.GetImage() + (moduleBase - itRange.Base()),
+        itRange.Limit() - moduleBase);
+  }
+
+  /*
+   * Return the symbol table for the module with the given path, reading it
+   * on first use, or null if no usable symbols were found.  The symbols are
+   * not used if the build ID in the image of the module in the core is known
+   * and differs from that of the module.  If the module cannot be read at
+   * that path, as when the core was copied from another host, a module of
+   * the same name in the directory of the core is used instead, but only if
+   * its build ID is the one in the core.
+   */
+  const ElfSymbolTable<ElfImage>* GetModuleSymbols(
+      const std::string& modulePath) {
+    typename std::map<std::string,
+                      std::unique_ptr<ElfSymbolTable<ElfImage> > >::iterator
+        it = _moduleSymbols.find(modulePath);
+    if (it != _moduleSymbols.end()) {
+      return it->second.get();
+    }
+    std::unique_ptr<ElfSymbolTable<ElfImage> >& symbols =
+        _moduleSymbols[modulePath];
+    symbols.reset(new ElfSymbolTable<ElfImage>(modulePath));
+    if (!symbols->IsEmpty()) {
+      if (!symbols->GetBuildId().empty()) {
+        std::string buildIdInCore = FindBuildIdInCore(modulePath);
+        if (!buildIdInCore.empty() && buildIdInCore != symbols->GetBuildId()) {
+          symbols.reset();
+        }
+      }
+      return symbols.get();
+    }
+    symbols.reset();
+    std::string besideCore(
+        Base::_virtualAddressMap.GetFileImage().GetFileName());
+    besideCore.erase(besideCore.rfind('/') + 1);
+    besideCore.append(modulePath, modulePath.rfind('/') + 1,
+                      std::string::npos);
+    if (besideCore == modulePath) {
+      return nullptr;
+    }
+    symbols.reset(new ElfSymbolTable<ElfImage>(besideCore));
+    if (symbols->IsEmpty() || symbols->GetBuildId().empty() ||
+        symbols->GetBuildId() != FindBuildIdInCore(modulePath)) {
+      symbols.reset();
+    }
+    return symbols.get();
+  }
+
+  /*
+   * Find the symbol that contains the given address, using the symbol table
+   * of the module that contains the address.
+   */
+  bool FindModuleSymbol(Offset address, std::string& mangledName,
+                        Offset& offsetInSymbol) {
+    std::string modulePath;
+    Offset rangeBase = 0;
+    Offset rangeSize = 0;
+    Offset relativeAddress;
+    if (!Base::_moduleDirectory.Find(address, modulePath, rangeBase, rangeSize,
+                                     relativeAddress)) {
+      return false;
+    }
+    const ElfSymbolTable<ElfImage>* symbols = GetModuleSymbols(modulePath);
+    return symbols != nullptr &&
+           symbols->Find(symbols->GetLinkBase() + relativeAddress, mangledName,
+                         offsetInSymbol);
+  }
+
+  /*
+   * Name any signatures that are still pending from the symbol tables of the
+   * modules, so that only the ones not found there need to be resolved by
+   * gdb using the .symreqs file.  As with names from the .symdefs file, the
+   * name of a vtable is the name of the class.
+   */
+  void FindSignatureNamesFromSymbolTables() {
     typename SignatureDirectory::SignatureNameAndStatusConstIterator itEnd =
         Base::_signatureDirectory.EndSignatures();
     for (typename SignatureDirectory::SignatureNameAndStatusConstIterator it =
              Base::_signatureDirectory.BeginSignatures();
          it != itEnd; ++it) {
-      Offset signature = it->first;
       typename SignatureDirectory::Status status = it->second.second;
-      if (status == SignatureDirectory::UNWRITABLE_PENDING_SYMDEFS ||
-          status == SignatureDirectory::WRITABLE_MODULE_REFERENCE) {
-        gdbScriptFile << "printf \"SIGNATURE " << std::hex << signature
-                      << "\\n\"" << '\n'
-                      << "info symbol 0x" << signature << '\n';
+      if (status != SignatureDirectory::UNWRITABLE_PENDING_SYMDEFS &&
+          status != SignatureDirectory::WRITABLE_MODULE_REFERENCE) {
+        continue;
+      }
+      Offset signature = it->first;
+      std::string mangledName;
+      Offset offsetInSymbol = 0;
+      if (!FindModuleSymbol(signature, mangledName, offsetInSymbol)) {
+        continue;
+      }
+      if (mangledName.compare(0, 4, "_ZTV") == 0) {
+        Unmangler<Offset> unmangler(mangledName.c_str() + 4, false);
+        if (!unmangler.Unmangled().empty()) {
+          Base::_signatureDirectory.MapSignatureNameAndStatus(
+              signature, unmangler.Unmangled(),
+              SignatureDirectory::VTABLE_WITH_NAME_FROM_BINARY);
+        }
+      } else {
+        Base::_signatureDirectory.MapSignatureNameAndStatus(
+            signature, ElfSymbolTableBase::Demangle(mangledName),
+            SignatureDirectory::UNWRITABLE_WITH_NAME_FROM_BINARY);
+      }
+    }
+  }
+
+  /*
+   * Name the static anchors from the symbol tables of the modules, in the
+   * form gdb uses, with any offset in the symbol given in decimal.  This is
+   * done once the graph is available, after which the symbol tables are no
+   * longer needed.
+   */
+  void FindAnchorNamesFromSymbolTables() {
+    const Allocations::Graph<Offset>& graph = *(Base::_allocationGraph);
+    const Allocations::Directory<Offset>& directory =
+        Base::_allocationDirectory;
+    typename Allocations::Directory<Offset>::AllocationIndex numAllocations =
+        directory.NumAllocations();
+    for (typename Allocations::Directory<Offset>::AllocationIndex i = 0;
+         i < numAllocations; ++i) {
+      if (!graph.IsStaticAnchorPoint(i)) {
+        continue;
+      }
+      const typename Allocations::Graph<Offset>::Anchors* anchors =
+          graph.GetStaticAnchors(i);
+      const Offset* itAnchorsEnd = anchors->end();
+      for (const Offset* itAnchors = anchors->begin();
+           itAnchors != itAnchorsEnd; ++itAnchors) {
+        Offset anchor = *itAnchors;
+        std::string mangledName;
+        Offset offsetInSymbol = 0;
+        if (!Base::_anchorDirectory.Name(anchor).empty() ||
+            !FindModuleSymbol(anchor, mangledName, offsetInSymbol)) {
+          continue;
+        }
+        std::ostringstream name;
+        name << ElfSymbolTableBase::Demangle(mangledName);
+        if (offsetInSymbol != 0) {
+          name << " + " << std::dec << offsetInSymbol;
+        }
+        Base::_anchorDirectory.MapAnchorToName(anchor, name.str());
       }
     }
+    _moduleSymbols.clear();
+  }
+
+  void AddSignatureRequestsToSymReqs(std::ofstream& gdbScriptFile) {
+    typename std::vector<Offset>::const_iterator itEnd =
+        _requestedSignatures.end();
+    for (typename std::vector<Offset>::const_iterator it =
+             _requestedSignatures.begin();
+         it != itEnd; ++it) {
+      gdbScriptFile << "printf \"SIGNATURE " << std::hex << *it << "\\n\""
+                    << '\n'
+                    << "info symbol 0x" << *it << '\n';
+    }
   }
 
   void AddAnchorRequestsToSymReqs(std::ofstream& gdbScriptFile) {
@@ -1533,18 +1763,42 @@ class LinuxProcessImage : public ProcessImage<typename ElfImage::Offset> {
       if (!allocation->IsUsed() || !graph.IsStaticAnchorPoint(i)) {
         continue;
       }
-      const std::vector<Offset>* anchors = graph.GetStaticAnchors(i);
-      typename std::vector<Offset>::const_iterator itAnchorsEnd =
-          anchors->end();
-      for (typename std::vector<Offset>::const_iterator itAnchors =
-               anchors->begin();
+      const typename Allocations::Graph<Offset>::Anchors* anchors =
+          graph.GetStaticAnchors(i);
+      const Offset* itAnchorsEnd = anchors->end();
+      for (const Offset* itAnchors = anchors->begin();
            itAnchors != itAnchorsEnd; ++itAnchors) {
+        if (!Base::_anchorDirectory.Name(*itAnchors).empty()) {
+          /*
+           * The anchor was already named from the symbol table of its
+           * module.
+           */
+          continue;
+        }
         gdbScriptFile << "printf \"ANCHOR " << std::hex << *itAnchors << "\\n\""
                       << '\n'
                       << "info symbol 0x" << std::hex << *itAnchors << '\n';
       }
     }
   }
+
+  /*
+   * The last line of a .symreqs file that has the requests for the static
+   * anchors.
+   */
+  static const char* AnchorRequestsMarker() {
+    return "# This file includes the requests for static anchors.";
+  }
+
+  /*
+   * Write a .symreqs file with a gdb request for each signature that could
+   * not be named from the core or the modules, unless there is already such
+   * a file that is complete.  The requests for static anchors are added once
+   * the graph has been built, so that a .symreqs file does not require
+   * building the graph before the first command.  A file that lacks them,
+   * because the run that wrote it ended before the graph was built, is
+   * written again.
+   */
   void WriteSymreqsFileIfNeeded() {
     std::string symReqsPath(
         Base::_virtualAddressMap.GetFileImage().GetFileName());
@@ -1552,14 +1806,42 @@ class LinuxProcessImage : public ProcessImage<typename ElfImage::Offset> {
     std::ifstream symReqs;
     symReqs.open(symReqsPath.c_str());
     if (!symReqs.fail()) {
-      return;
+      std::string line;
+      while (getline(symReqs, line, '\n')) {
+        if (line == AnchorRequestsMarker()) {
+          return;
+        }
+      }
+      symReqs.close();
+    }
+    typename SignatureDirectory::SignatureNameAndStatusConstIterator itEnd =
+        Base::_signatureDirectory.EndSignatures();
+    for (typename SignatureDirectory::SignatureNameAndStatusConstIterator it =
+             Base::_signatureDirectory.BeginSignatures();
+         it != itEnd; ++it) {
+      typename SignatureDirectory::Status status = it->second.second;
+      if (status == SignatureDirectory::UNWRITABLE_PENDING_SYMDEFS ||
+          status == SignatureDirectory::WRITABLE_MODULE_REFERENCE) {
+        _requestedSignatures.push_back(it->first);
+      }
     }
+    _symreqsWritten = WriteSymreqsFile(false);
+  }
 
+  /*
+   * Write the .symreqs file with the requests for the signatures found when
+   * the file was first written and, if requested, for the static anchors
+   * that could not be named from the modules.
+   */
+  bool WriteSymreqsFile(bool withAnchors) {
+    std::string symReqsPath(
+        Base::_virtualAddressMap.GetFileImage().GetFileName());
+    symReqsPath.append(".symreqs");
     std::ofstream gdbScriptFile;
     gdbScriptFile.open(symReqsPath.c_str());
     if (gdbScriptFile.fail()) {
       std::cerr << "Unable to open " << symReqsPath << " for writing.\n";
-      return;
+      return false;
     }
 
     std::string symDefsPath(
@@ -1572,13 +1854,70 @@ class LinuxProcessImage : public ProcessImage<typename ElfImage::Offset> {
     gdbScriptFile << "set logging on\n";
     gdbScriptFile << "set height 0\n";
     AddSignatureRequestsToSymReqs(gdbScriptFile);
-    AddAnchorRequestsToSymReqs(gdbScriptFile);
+    if (withAnchors) {
+      AddAnchorRequestsToSymReqs(gdbScriptFile);
+    }
     gdbScriptFile << "set logging off\n";
     gdbScriptFile << "set logging overwrite 0\n";
     gdbScriptFile << "set logging redirect 0\n";
     gdbScriptFile << "printf \"output written to " << symDefsPath << "\\n\""
                   << '\n';
+    if (withAnchors) {
+      gdbScriptFile << AnchorRequestsMarker() << '\n';
+    }
     gdbScriptFile.close();
+    return true;
+  }
+
+  std::string GetAnalysisCachePath() const {
+    return AnalysisCache::PathFor(
+        Base::_virtualAddressMap.GetFileImage().GetFileName());
+  }
+
+  /*
+   * The cached results are considered to apply to the core if the core has
+   * the same size, modification time and ELF headers as when the results
+   * were saved, and the allocations found this time are the same.
+   */
+  AnalysisCache::Key GetAnalysisCacheKey() const {
+    const FileImage& fileImage = Base::_virtualAddressMap.GetFileImage();
+    const char* image = fileImage.GetImage();
+    uint64_t fileSize = fileImage.GetFileSize();
+    const typename ElfImage::ElfHeader* elfHeader =
+        (const typename ElfImage::ElfHeader*)(image);
+    uint64_t headersHash = AnalysisCache::Hash(image, sizeof(*elfHeader));
+    uint64_t headersLimit = elfHeader->e_phoff +
+                            (uint64_t)(elfHeader->e_phnum) *
+                                elfHeader->e_phentsize;
+    if (elfHeader->e_phoff < fileSize) {
+      headersHash = AnalysisCache::Hash(
+          image + elfHeader->e_phoff,
+          ((headersLimit < fileSize) ? headersLimit : fileSize) -
+              elfHeader->e_phoff,
+          headersHash);
+    }
+    size_t numAllocations = Base::_allocationDirectory.NumAllocations();
+    uint64_t allocationsHash =
+        (numAllocations == 0)
+            ? 0
+            : AnalysisCache::Hash(
+                  Base::_allocationDirectory.AllocationAt(0),
+                  numAllocations *
+                      sizeof(typename Allocations::Directory<
+                             Offset>::Allocation));
+    return AnalysisCache::MakeKey(fileImage._fd, sizeof(Offset), headersHash,
+                                  allocationsHash, numAllocations);
+  }
+
+  void SaveAnalysis() {
+    std::string path = GetAnalysisCachePath();
+    AnalysisCache::Writer writer(path, GetAnalysisCacheKey());
+    Base::_allocationGraph->SaveTo(writer);
+    Base::_allocationTagHolder->SaveTo(writer);
+    if (!writer.Commit()) {
+      std::cerr << "Warning: Unable to save analysis results to " << path
+                << ".\n";
+    }
   }
 
   void FindStaticAnchorRanges() {
@@ -18,6 +18,8 @@ class ListAllocationsTagger : public Allocations::Tagger<Offset> {
   typedef typename Allocations::ContiguousImage<Offset> ContiguousImage;
   typedef typename Tagger::Phase Phase;
   typedef typename Directory::AllocationIndex AllocationIndex;
+  typedef typename Graph::Anchors Anchors;
+  typedef typename Graph::EdgeIterator EdgeIterator;
   typedef typename Directory::Allocation Allocation;
   typedef typename VirtualAddressMap<Offset>::Reader Reader;
   typedef typename Allocations::TagHolder<Offset> TagHolder;
@@ -32,6 +34,21 @@ class ListAllocationsTagger : public Allocations::Tagger<Offset> {
         _nodeTagIndex(_tagHolder.RegisterTag("%ListNode")),
         _unknownHeadNodeTagIndex(_tagHolder.RegisterTag("%ListNode")) {}
 
+  ListAllocationsTagger(const ListAllocationsTagger& other,
+                        TagHolder& tagHolder)
+      : _graph(other._graph),
+        _tagHolder(tagHolder),
+        _directory(other._directory),
+        _numAllocations(other._numAllocations),
+        _addressMap(other._addressMap),
+        _nodeReader(_addressMap),
+        _nodeTagIndex(other._nodeTagIndex),
+        _unknownHeadNodeTagIndex(other._unknownHeadNodeTagIndex) {}
+
+  Tagger* Copy(TagHolder& tagHolder) const {
+    return new ListAllocationsTagger(*this, tagHolder);
+  }
+
   bool TagFromAllocation(const ContiguousImage& contiguousImage,
                          Reader& /* reader */, AllocationIndex index,
                          Phase phase, const Allocation& allocation,
@@ -305,7 +322,7 @@ class ListAllocationsTagger : public Allocations::Tagger<Offset> {
     return listHead;
   }
 
-  bool HasAnchorToStart(const std::vector<Offset>* anchors, Offset node,
+  bool HasAnchorToStart(const Anchors* anchors, Offset node,
                         Reader& refReader) {
     if (anchors != nullptr) {
       for (auto anchor : (*anchors)) {
@@ -320,10 +337,10 @@ class ListAllocationsTagger : public Allocations::Tagger<Offset> {
   bool HasExtraPointerToStartFromAllocation(AllocationIndex index, Offset node,
                                             Offset next, Offset prev,
                                             Reader& refReader) {
-    const AllocationIndex* pFirstIncoming;
-    const AllocationIndex* pPastIncoming;
+    EdgeIterator pFirstIncoming;
+    EdgeIterator pPastIncoming;
     _graph.GetIncoming(index, &pFirstIncoming, &pPastIncoming);
-    for (const AllocationIndex* pNextIncoming = pFirstIncoming;
+    for (EdgeIterator pNextIncoming = pFirstIncoming;
          pNextIncoming != pPastIncoming; ++pNextIncoming) {
       const Allocation* incomingAllocation =
           _directory.AllocationAt(*pNextIncoming);
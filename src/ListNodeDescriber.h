@@ -29,7 +29,7 @@ class ListNodeDescriber : public Allocations::PatternDescriber<Offset> {
       size_t numEntries = 1;
       Offset address = allocation.Address();
       typename Allocations::TagHolder<Offset>::TagIndex tagIndex =
-          Base::_tagHolder.GetTagIndex(index);
+          Base::GetTagHolder().GetTagIndex(index);
       typename VirtualAddressMap<Offset>::Reader reader(Base::_addressMap);
       AllocationIndex numAllocations = Base::_directory.NumAllocations();
 
@@ -44,9 +44,9 @@ class ListNodeDescriber : public Allocations::PatternDescriber<Offset> {
        */
       Offset prev = reader.ReadOffset(address + sizeof(Offset), 0xbad);
       AllocationIndex prevIndex =
-          Base::_graph->TargetAllocationIndex(index, prev);
+          Base::GetGraph().TargetAllocationIndex(index, prev);
       while (prevIndex != numAllocations &&
-             Base::_tagHolder.GetTagIndex(prevIndex) == tagIndex &&
+             Base::GetTagHolder().GetTagIndex(prevIndex) == tagIndex &&
              Base::_directory.AllocationAt(prevIndex)->Address() == prev) {
         if (prev == address) {
           output << "This allocation belongs to an std::list but the header "
@@ -57,7 +57,7 @@ class ListNodeDescriber : public Allocations::PatternDescriber<Offset> {
         address = prev;
         index = prevIndex;
         prev = reader.ReadOffset(address + sizeof(Offset), 0xbad);
-        prevIndex = Base::_graph->TargetAllocationIndex(index, prev);
+        prevIndex = Base::GetGraph().TargetAllocationIndex(index, prev);
       }
       Offset header = prev;
 
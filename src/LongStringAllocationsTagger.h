@@ -19,6 +19,7 @@ class LongStringAllocationsTagger : public Allocations::Tagger<Offset> {
   typedef typename Allocations::ContiguousImage<Offset> ContiguousImage;
   typedef typename Tagger::Phase Phase;
   typedef typename Directory::AllocationIndex AllocationIndex;
+  typedef typename Graph::Anchors Anchors;
   typedef typename Directory::Allocation Allocation;
   typedef typename VirtualAddressMap<Offset>::Reader Reader;
   typedef typename Allocations::TagHolder<Offset> TagHolder;
@@ -89,6 +90,23 @@ class LongStringAllocationsTagger : public Allocations::Tagger<Offset> {
     }
   }
 
+  LongStringAllocationsTagger(const LongStringAllocationsTagger& other,
+                              TagHolder& tagHolder)
+      : _graph(other._graph),
+        _tagHolder(tagHolder),
+        _directory(other._directory),
+        _numAllocations(other._numAllocations),
+        _addressMap(other._addressMap),
+        _charsImage(_addressMap, _directory),
+        _staticAnchorReader(_addressMap),
+        _stackAnchorReader(_addressMap),
+        _enabled(other._enabled),
+        _tagIndex(other._tagIndex) {}
+
+  Tagger* Copy(TagHolder& tagHolder) const {
+    return new LongStringAllocationsTagger(*this, tagHolder);
+  }
+
   bool TagFromAllocation(const ContiguousImage& contiguousImage,
                          Reader& /* reader */, AllocationIndex index,
                          Phase phase, const Allocation& allocation,
@@ -173,8 +191,8 @@ class LongStringAllocationsTagger : public Allocations::Tagger<Offset> {
   void TagIfLongStringCharsAnchorPoint(const ContiguousImage& contiguousImage,
                                        AllocationIndex index,
                                        const Allocation& allocation) {
-    const std::vector<Offset>* staticAnchors = _graph.GetStaticAnchors(index);
-    const std::vector<Offset>* stackAnchors = _graph.GetStackAnchors(index);
+    const Anchors* staticAnchors = _graph.GetStaticAnchors(index);
+    const Anchors* stackAnchors = _graph.GetStackAnchors(index);
     if (staticAnchors == nullptr && stackAnchors == nullptr) {
       return;
     }
@@ -206,8 +224,7 @@ class LongStringAllocationsTagger : public Allocations::Tagger<Offset> {
   }
   bool CheckLongStringAnchorIn(AllocationIndex charsIndex, Offset charsAddress,
                                Offset stringLength, Offset minCapacity,
-                               Offset maxCapacity,
-                               const std::vector<Offset>* anchors,
+                               Offset maxCapacity, const Anchors* anchors,
                                Reader& anchorReader) {
     if (anchors != nullptr) {
       for (Offset anchor : *anchors) {
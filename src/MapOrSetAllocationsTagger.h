@@ -31,6 +31,20 @@ class MapOrSetAllocationsTagger : public Allocations::Tagger<Offset> {
         _nodeReader(_addressMap),
         _nodeTagIndex(_tagHolder.RegisterTag("%MapOrSetNode")) {}
 
+  MapOrSetAllocationsTagger(const MapOrSetAllocationsTagger& other,
+                            TagHolder& tagHolder)
+      : _graph(other._graph),
+        _tagHolder(tagHolder),
+        _directory(other._directory),
+        _numAllocations(other._numAllocations),
+        _addressMap(other._addressMap),
+        _nodeReader(_addressMap),
+        _nodeTagIndex(other._nodeTagIndex) {}
+
+  Tagger* Copy(TagHolder& tagHolder) const {
+    return new MapOrSetAllocationsTagger(*this, tagHolder);
+  }
+
   bool TagFromAllocation(const ContiguousImage& contiguousImage,
                          Reader& /* reader */, AllocationIndex index,
                          Phase phase, const Allocation& allocation,
@@ -28,20 +28,20 @@ class MapOrSetNodeDescriber : public Allocations::PatternDescriber<Offset> {
     if (explain) {
       Offset address = allocation.Address();
       typename Allocations::TagHolder<Offset>::TagIndex tagIndex =
-          Base::_tagHolder.GetTagIndex(index);
+          Base::GetTagHolder().GetTagIndex(index);
       typename VirtualAddressMap<Offset>::Reader reader(Base::_addressMap);
       AllocationIndex numAllocations = Base::_directory.NumAllocations();
 
       Offset parent = reader.ReadOffset(address + sizeof(Offset), 0xbad);
       AllocationIndex parentIndex =
-          Base::_graph->TargetAllocationIndex(index, parent);
+          Base::GetGraph().TargetAllocationIndex(index, parent);
       while (parentIndex != numAllocations &&
-             Base::_tagHolder.GetTagIndex(parentIndex) == tagIndex &&
+             Base::GetTagHolder().GetTagIndex(parentIndex) == tagIndex &&
              Base::_directory.AllocationAt(parentIndex)->Address() == parent) {
         address = parent;
         index = parentIndex;
         parent = reader.ReadOffset(address + sizeof(Offset), 0xbad);
-        parentIndex = Base::_graph->TargetAllocationIndex(index, parent);
+        parentIndex = Base::GetGraph().TargetAllocationIndex(index, parent);
       }
       output << "This allocation belongs to an std::map or std::set at 0x"
              << std::hex << (parent - sizeof(Offset)) << "\nthat has "
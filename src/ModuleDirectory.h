@@ -133,7 +133,13 @@ class ModuleDirectory {
     }
     return false;
   }
-  void Resolve() { _isResolved = true; }
+  void Resolve() {
+    _isResolved = true;
+    _rangeMapper.Freeze();
+    for (auto& nameAndRanges : _rangesByName) {
+      nameAndRanges.second.Freeze();
+    }
+  }
   bool IsResolved() const { return _isResolved; }
   const_iterator begin() const { return _rangesByName.begin(); }
   const_iterator end() const { return _rangesByName.end(); }
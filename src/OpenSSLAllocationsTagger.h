@@ -47,6 +47,21 @@ class OpenSSLAllocationsTagger : public Allocations::Tagger<Offset> {
     }
   }
 
+  OpenSSLAllocationsTagger(const OpenSSLAllocationsTagger& other,
+                           TagHolder& tagHolder)
+      : _tagHolder(tagHolder),
+        _SSLTagIndex(other._SSLTagIndex),
+        _SSL_CTXTagIndex(other._SSL_CTXTagIndex),
+        _rangeToFlags(other._rangeToFlags),
+        _candidateBase(other._candidateBase),
+        _candidateLimit(other._candidateLimit),
+        _enabled(other._enabled),
+        _reader(other._reader) {}
+
+  Tagger* Copy(TagHolder& tagHolder) const {
+    return new OpenSSLAllocationsTagger(*this, tagHolder);
+  }
+
   bool TagFromAllocation(const ContiguousImage& contiguousImage,
                          Reader& /* reader */, AllocationIndex index,
                          Phase phase, const Allocation& /* allocation */,
@@ -0,0 +1,256 @@
+// Copyright (c) 2021 VMware, Inc. All Rights Reserved.
+// SPDX-License-Identifier: GPL-2.0
+
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+#include <algorithm>
+#include <iostream>
+#include <memory>
+#include <utility>
+#include <vector>
+#include "CandidateFilter.h"
+#include "Commands/Runner.h"
+#include "VirtualAddressMap.h"
+#include "WorkerThreads.h"
+
+namespace chap {
+class PointerIndexBase {
+ public:
+  /*
+   * Set the largest number of bytes that any pointer index may take.  An
+   * index that would take more is not built, and 0 means that no index is
+   * ever built.
+   */
+  static void SetMaxBytes(uint64_t maxBytes) { MaxBytes() = maxBytes; }
+  static uint64_t GetMaxBytes() { return MaxBytes(); }
+
+ private:
+  static uint64_t& MaxBytes() {
+    static uint64_t maxBytes = ((uint64_t)(1)) << 30;
+    return maxBytes;
+  }
+};
+
+/*
+ * A PointerIndex holds, for each value that points into mapped memory and
+ * appears in some pointer-aligned word of the imaged memory, the addresses
+ * of all the words that hold that value.  Finding the words that hold a
+ * given value is then a binary search rather than a scan of every imaged
+ * byte of the process image.
+ *
+ * The index is built in parallel in three passes.  The imaged memory is
+ * split into tasks of consecutive words.  The first pass counts, for each
+ * task, the matching words in each of NUM_PARTITIONS partitions, where
+ * each partition covers an equal share of the mapped bytes, so that the
+ * partitions are in increasing order of value.  The second pass stores the
+ * value and address of each matching word at a position determined by
+ * those counts, and the third pass sorts each partition.
+ */
+template <class Offset>
+class PointerIndex : public PointerIndexBase {
+ public:
+  typedef VirtualAddressMap<Offset> AddressMap;
+  typedef std::pair<Offset, Offset> Entry;  // value, address of word
+  static constexpr size_t NUM_PARTITIONS = 256;
+  static constexpr ptrdiff_t WORDS_PER_TASK = 1 << 22;
+
+  /*
+   * Return a new index for the imaged memory of the given map, or nullptr
+   * if the index would take more than GetMaxBytes(), in which case that is
+   * reported to the given error stream unless the limit is 0.
+   */
+  static PointerIndex* Build(const AddressMap& addressMap,
+                             Commands::Error& error) {
+    if (GetMaxBytes() == 0) {
+      return nullptr;
+    }
+    std::unique_ptr<PointerIndex> index(new PointerIndex(addressMap));
+    return index->Fill(error) ? index.release() : nullptr;
+  }
+
+  /*
+   * Return true if the index can answer for the given value, setting the
+   * range of entries for words that hold that value, in increasing order of
+   * address.  Values that do not point into mapped memory are not indexed.
+   */
+  bool Find(Offset value, const Entry** first, const Entry** limit) const {
+    if (RangeIndexFor(value) == _bases.size()) {
+      return false;
+    }
+    auto bounds = std::equal_range(
+        _entries.begin(), _entries.end(), Entry(value, 0),
+        [](const Entry& left, const Entry& right) {
+          return left.first < right.first;
+        });
+    *first = _entries.data() + (bounds.first - _entries.begin());
+    *limit = _entries.data() + (bounds.second - _entries.begin());
+    return true;
+  }
+
+  size_t NumEntries() const { return _entries.size(); }
+
+  uint64_t NumBytes() const {
+    return _entries.capacity() * sizeof(Entry) +
+           _bases.capacity() * 3 * sizeof(Offset);
+  }
+
+ private:
+  struct Task {
+    Task(Offset base, const Offset* first, const Offset* limit)
+        : _base(base), _first(first), _limit(limit) {}
+    Offset _base;
+    const Offset* _first;
+    const Offset* _limit;
+  };
+
+  PointerIndex(const AddressMap& addressMap) : _addressMap(addressMap) {}
+
+  const AddressMap& _addressMap;
+  /*
+   * The mapped ranges, in increasing order, with the number of mapped bytes
+   * before each one.
+   */
+  std::vector<Offset> _bases;
+  std::vector<Offset> _limits;
+  std::vector<Offset> _mappedBefore;
+  std::vector<Entry> _entries;
+
+  /*
+   * Return the index of the mapped range that contains the given value, or
+   * the number of ranges if there is none.
+   */
+  size_t RangeIndexFor(Offset value) const {
+    size_t numRanges = _bases.size();
+    size_t rangeIndex =
+        std::upper_bound(_bases.begin(), _bases.end(), value) - _bases.begin();
+    if (rangeIndex == 0 || value >= _limits[rangeIndex - 1]) {
+      return numRanges;
+    }
+    return rangeIndex - 1;
+  }
+
+  /*
+   * Visit every word of the given task that points into mapped memory,
+   * with the address of the word and the partition for its value.
+   */
+  template <typename WordVisitor>
+  void VisitTask(const Task& task, const CandidateFilter<Offset>& filter,
+                 Offset bytesPerPartition, WordVisitor visit) const {
+    size_t numRanges = _bases.size();
+    auto visitWords = [&](const Offset* first, const Offset* limit) {
+      filter.Visit(first, limit, [&](const Offset* word) {
+        Offset value = *word;
+        size_t rangeIndex = RangeIndexFor(value);
+        if (rangeIndex != numRanges) {
+          Offset position =
+              _mappedBefore[rangeIndex] + (value - _bases[rangeIndex]);
+          visit(task._base + (Offset)((const char*)word -
+                                      (const char*)task._first),
+                value, (size_t)(position / bytesPerPartition));
+        }
+      });
+    };
+    if (filter.Accepts(0)) {
+      visitWords(task._first, task._limit);
+    } else {
+      _addressMap.VisitWordsNotKnownZero(task._base, task._first, task._limit,
+                                         visitWords);
+    }
+  }
+
+  bool Fill(Commands::Error& error) {
+    std::vector<Task> tasks;
+    Offset mappedBytes = 0;
+    typename AddressMap::const_iterator itEnd = _addressMap.end();
+    for (typename AddressMap::const_iterator it = _addressMap.begin();
+         it != itEnd; ++it) {
+      Offset base = it.Base();
+      _bases.push_back(base);
+      _limits.push_back(it.Limit());
+      _mappedBefore.push_back(mappedBytes);
+      mappedBytes += it.Size();
+      const char* image = it.GetImage();
+      if (image == (const char*)0) {
+        continue;
+      }
+      const Offset* first = (const Offset*)(image);
+      const Offset* limit = first + it.Size() / sizeof(Offset);
+      while (first < limit) {
+        const Offset* taskLimit =
+            (limit - first > WORDS_PER_TASK) ? first + WORDS_PER_TASK : limit;
+        tasks.emplace_back(base, first, taskLimit);
+        base += (taskLimit - first) * sizeof(Offset);
+        first = taskLimit;
+      }
+    }
+    if (_bases.empty()) {
+      return true;
+    }
+    CandidateFilter<Offset> filter(_bases.front(),
+                                   _limits.back() - _bases.front());
+    Offset bytesPerPartition = (mappedBytes + NUM_PARTITIONS - 1) /
+                               NUM_PARTITIONS;
+    size_t numTasks = tasks.size();
+
+    std::vector<uint64_t> counts(numTasks * NUM_PARTITIONS, 0);
+    WorkerThreads::Run(numTasks, [&](size_t taskIndex, size_t) {
+      uint64_t* taskCounts = counts.data() + taskIndex * NUM_PARTITIONS;
+      VisitTask(tasks[taskIndex], filter, bytesPerPartition,
+                [&](Offset, Offset, size_t partition) {
+                  taskCounts[partition]++;
+                });
+    });
+
+    /*
+     * Turn the counts into the position of the first entry for each task in
+     * each partition, with partitions in order and, within each partition,
+     * tasks in order.
+     */
+    std::vector<uint64_t> partitionStarts(NUM_PARTITIONS + 1, 0);
+    uint64_t numEntries = 0;
+    for (size_t partition = 0; partition < NUM_PARTITIONS; partition++) {
+      partitionStarts[partition] = numEntries;
+      for (size_t taskIndex = 0; taskIndex < numTasks; taskIndex++) {
+        uint64_t& count = counts[taskIndex * NUM_PARTITIONS + partition];
+        uint64_t numInTask = count;
+        count = numEntries;
+        numEntries += numInTask;
+      }
+    }
+    partitionStarts[NUM_PARTITIONS] = numEntries;
+
+    uint64_t numBytes = numEntries * sizeof(Entry);
+    if (numBytes > GetMaxBytes()) {
+      error << "The pointer index would take 0x" << std::hex << numBytes
+            << " bytes, more than the limit of 0x" << GetMaxBytes()
+            << ", so pointers will be found by scanning.\n";
+      return false;
+    }
+
+    _entries.resize(numEntries);
+    Entry* entries = _entries.data();
+    WorkerThreads::Run(numTasks, [&](size_t taskIndex, size_t) {
+      uint64_t* nextPositions = counts.data() + taskIndex * NUM_PARTITIONS;
+      VisitTask(tasks[taskIndex], filter, bytesPerPartition,
+                [&](Offset address, Offset value, size_t partition) {
+                  entries[nextPositions[partition]++] = Entry(value, address);
+                });
+    });
+
+    /*
+     * The entries of each partition are already in increasing order of
+     * address, so a stable sort by value leaves the addresses for each
+     * value in increasing order.
+     */
+    WorkerThreads::Run(NUM_PARTITIONS, [&](size_t partition, size_t) {
+      std::stable_sort(entries + partitionStarts[partition],
+                       entries + partitionStarts[partition + 1],
+                       [](const Entry& left, const Entry& right) {
+                         return left.first < right.first;
+                       });
+    });
+    return true;
+  }
+};
+}  // namespace chap
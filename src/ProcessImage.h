@@ -2,11 +2,15 @@
 // SPDX-License-Identifier: GPL-2.0
 
 #pragma once
+#include <memory>
+#include <mutex>
 #include "Allocations/AnchorDirectory.h"
 #include "Allocations/Directory.h"
 #include "Allocations/Graph.h"
+#include "Allocations/SignatureColumn.h"
 #include "Allocations/SignatureDirectory.h"
 #include "Allocations/TagHolder.h"
+#include "AnalysisCache.h"
 #include "COWStringAllocationsTagger.h"
 #include "DequeAllocationsTagger.h"
 #include "GoLang/FinderGroup.h"
@@ -16,6 +20,7 @@
 #include "ModuleDirectory.h"
 #include "OpenSSLAllocationsTagger.h"
 #include "PThread/InfrastructureFinder.h"
+#include "PointerIndex.h"
 #include "Python/AllocationsTagger.h"
 #include "Python/FinderGroup.h"
 #include "Python/InfrastructureFinder.h"
@@ -99,18 +104,61 @@ class ProcessImage {
     return _allocationDirectory;
   }
 
+  /*
+   * The signature column is filled on first use and filled again if the
+   * signature directory has gained signatures since then, which can happen
+   * only between commands.
+   */
+  const Allocations::SignatureColumn<Offset> &GetSignatureColumn() const {
+    std::lock_guard<std::mutex> lock(_signatureColumnMutex);
+    if (!_signatureColumn.IsCurrent(_allocationDirectory,
+                                    _signatureDirectory)) {
+      _signatureColumn.Fill(_allocationDirectory, _virtualAddressMap,
+                            _signatureDirectory);
+    }
+    return _signatureColumn;
+  }
+
+  /*
+   * The allocation graph and the allocation tags are expensive to calculate
+   * and many commands need neither, so each is calculated the first time it
+   * is requested.  Either may be null if it cannot be calculated.
+   */
   const Allocations::TagHolder<Offset> *GetAllocationTagHolder() const {
+    std::call_once(_allocationTagsOnce, [this]() {
+      if (GetAllocationGraph() != nullptr) {
+        const_cast<ProcessImage *>(this)->BuildAllocationTags();
+      }
+    });
     return _allocationTagHolder;
   }
 
   Allocations::TagHolder<Offset> *GetAllocationTagHolder() {
-    return _allocationTagHolder;
+    return const_cast<Allocations::TagHolder<Offset> *>(
+        ((const ProcessImage *)(this))->GetAllocationTagHolder());
   }
 
   const Allocations::Graph<Offset> *GetAllocationGraph() const {
+    std::call_once(_allocationGraphOnce, [this]() {
+      const_cast<ProcessImage *>(this)->BuildAllocationGraph();
+    });
     return _allocationGraph;
   }
 
+  /*
+   * The pointer index is built the first time it is requested, and only
+   * commands that look for references to arbitrary addresses use it.  It
+   * is null if it would take more than PointerIndexBase::GetMaxBytes(),
+   * which is reported to the error stream of the command that first asked.
+   */
+  const PointerIndex<Offset> *GetPointerIndex(Commands::Error &error) const {
+    std::call_once(_pointerIndexOnce, [this, &error]() {
+      _pointerIndex.reset(
+          PointerIndex<Offset>::Build(_virtualAddressMap, error));
+    });
+    return _pointerIndex.get();
+  }
+
   const PThread::InfrastructureFinder<Offset> &GetPThreadInfrastructureFinder()
       const {
     return _pThreadInfrastructureFinder;
@@ -145,15 +193,48 @@ class ProcessImage {
   PThread::InfrastructureFinder<Offset> _pThreadInfrastructureFinder;
 
   /*
-   * Pre-tag all allocations.  This should be done just once, at the end
-   * of the constructor for the derived class.
+   * Calculate the allocation graph, leaving _allocationGraph null if this
+   * is not possible.  This is called at most once, on first use of the
+   * graph, and only after the constructor for the derived class has found
+   * the allocations and anything else needed to calculate the graph.
+   */
+  virtual void BuildAllocationGraph() {}
+
+  /*
+   * Calculate the allocation tags.  This is called at most once, on first
+   * use of the tags, and only if the graph is available.
    */
-  void TagAllocations() {
+  virtual void BuildAllocationTags() { TagAllocations(); }
+
+  /*
+   * Some tags depend on which signatures are known to be vtable pointers,
+   * so the signatures are preserved as they were before any change to the
+   * signature directory that should not affect the tags, such as reading
+   * the symdefs file.  This keeps the tags the same regardless of when they
+   * are first needed.
+   */
+  void PreserveSignaturesForTagging() {
+    if (_allocationTagHolder == nullptr && _signaturesForTagging == nullptr) {
+      _signaturesForTagging.reset(
+          new Allocations::SignatureDirectory<Offset>(_signatureDirectory));
+    }
+  }
+
+  /*
+   * Pre-tag all allocations.  If cached results of a previous analysis of
+   * the same core are provided, the tags are taken from there if possible.
+   */
+  void TagAllocations(AnalysisCache::Reader *cachedAnalysis = nullptr) {
     _allocationTagHolder = new Allocations::TagHolder<Offset>(
         _allocationDirectory.NumAllocations());
 
+    const Allocations::SignatureDirectory<Offset> &signatureDirectory =
+        (_signaturesForTagging != nullptr) ? *_signaturesForTagging
+                                           : _signatureDirectory;
+
     Allocations::TaggerRunner<Offset> runner(
-        *_allocationGraph, *_allocationTagHolder, _signatureDirectory);
+        *_allocationGraph, *_allocationTagHolder, signatureDirectory,
+        GetSignatureColumn());
 
     runner.RegisterTagger(new UnorderedMapOrSetAllocationsTagger<Offset>(
         *(_allocationGraph), *(_allocationTagHolder)));
@@ -171,7 +252,7 @@ class ProcessImage {
         *(_allocationGraph), *(_allocationTagHolder), _moduleDirectory));
 
     runner.RegisterTagger(new VectorAllocationsTagger<Offset>(
-        *(_allocationGraph), *(_allocationTagHolder), _signatureDirectory));
+        *(_allocationGraph), *(_allocationTagHolder), signatureDirectory));
 
     runner.RegisterTagger(new COWStringAllocationsTagger<Offset>(
         *(_allocationGraph), *(_allocationTagHolder), _moduleDirectory));
@@ -183,7 +264,21 @@ class ProcessImage {
         *(_allocationGraph), *(_allocationTagHolder),
         _pythonFinderGroup.GetInfrastructureFinder(), _virtualAddressMap));
 
-    runner.ResolveAllAllocationTags();
+    if (cachedAnalysis == nullptr ||
+        !_allocationTagHolder->RestoreFrom(*cachedAnalysis)) {
+      runner.ResolveAllAllocationTags();
+    }
+    _signaturesForTagging.reset();
   }
+
+ private:
+  mutable std::once_flag _allocationGraphOnce;
+  mutable std::once_flag _allocationTagsOnce;
+  mutable std::once_flag _pointerIndexOnce;
+  mutable std::unique_ptr<PointerIndex<Offset> > _pointerIndex;
+  mutable std::mutex _signatureColumnMutex;
+  mutable Allocations::SignatureColumn<Offset> _signatureColumn;
+  std::unique_ptr<Allocations::SignatureDirectory<Offset> >
+      _signaturesForTagging;
 };
 }  // namespace chap
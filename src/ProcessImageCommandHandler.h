@@ -180,9 +180,8 @@ class ProcessImageCommandHandler {
             "writable ranges",
             _virtualMemoryPartition.GetClaimedWritableRanges(),
             _compoundDescriber, _virtualMemoryPartition.UNKNOWN),
-        _describePointersSubcommand(processImage.GetVirtualAddressMap(),
-                                    _compoundDescriber),
-        _enumeratePointersSubcommand(processImage.GetVirtualAddressMap()),
+        _describePointersSubcommand(processImage, _compoundDescriber),
+        _enumeratePointersSubcommand(processImage),
         _describeRelRefsSubcommand(processImage.GetVirtualAddressMap(),
                                    _compoundDescriber),
         _enumerateRelRefsSubcommand(processImage.GetVirtualAddressMap()),
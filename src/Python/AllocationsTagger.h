@@ -19,6 +19,7 @@ class AllocationsTagger : public Allocations::Tagger<Offset> {
   typedef typename Allocations::Tagger<Offset> Tagger;
   typedef typename Tagger::Phase Phase;
   typedef typename Directory::AllocationIndex AllocationIndex;
+  typedef typename Allocations::Graph<Offset>::EdgeIterator EdgeIterator;
   typedef typename Directory::Allocation Allocation;
   typedef typename VirtualAddressMap<Offset>::Reader Reader;
   typedef typename VirtualAddressMap<Offset>::RangeAttributes RangeAttributes;
@@ -70,6 +71,47 @@ class AllocationsTagger : public Allocations::Tagger<Offset> {
     TagListedContainerPythonObjects();
   }
 
+  /*
+   * Note that a copy does not repeat the tagging done by the constructor.
+   */
+  AllocationsTagger(const AllocationsTagger& other, TagHolder& tagHolder)
+      : _graph(other._graph),
+        _directory(other._directory),
+        _numAllocations(other._numAllocations),
+        _tagHolder(tagHolder),
+        _infrastructureFinder(other._infrastructureFinder),
+        _arenaStructArray(other._arenaStructArray),
+        _arenaSize(other._arenaSize),
+        _poolSize(other._poolSize),
+        _typeType(other._typeType),
+        _dictType(other._dictType),
+        _keysInDict(other._keysInDict),
+        _valuesInDict(other._valuesInDict),
+        _listType(other._listType),
+        _itemsInList(other._itemsInList),
+        _dequeType(other._dequeType),
+        _firstBlockInDeque(other._firstBlockInDeque),
+        _lastBlockInDeque(other._lastBlockInDeque),
+        _forwardInDequeBlock(other._forwardInDequeBlock),
+        _nonEmptyGarbageCollectionLists(other._nonEmptyGarbageCollectionLists),
+        _garbageCollectionHeaderSize(other._garbageCollectionHeaderSize),
+        _cachedKeysInHeapTypeObject(other._cachedKeysInHeapTypeObject),
+        _virtualAddressMap(other._virtualAddressMap),
+        _reader(_virtualAddressMap),
+        _simplePythonObjectTagIndex(other._simplePythonObjectTagIndex),
+        _containerPythonObjectTagIndex(other._containerPythonObjectTagIndex),
+        _dictKeysObjectTagIndex(other._dictKeysObjectTagIndex),
+        _dictValuesArrayTagIndex(other._dictValuesArrayTagIndex),
+        _listItemsTagIndex(other._listItemsTagIndex),
+        _dequeBlockTagIndex(other._dequeBlockTagIndex),
+        _arenaStructArrayTagIndex(other._arenaStructArrayTagIndex),
+        _mallocedArenaTagIndex(other._mallocedArenaTagIndex),
+        _enabled(other._enabled) {}
+
+  Tagger* Copy(TagHolder& tagHolder) const {
+    return new AllocationsTagger(*this, tagHolder);
+  }
+
   bool TagFromAllocation(const ContiguousImage& contiguousImage,
                          Reader& /* reader */, AllocationIndex index,
                          Phase phase, const Allocation& allocation,
@@ -155,10 +197,10 @@ class AllocationsTagger : public Allocations::Tagger<Offset> {
                              const Allocation& allocation) {
     if (allocation.Address() == _arenaStructArray) {
       _tagHolder.TagAllocation(index, _arenaStructArrayTagIndex);
-      const AllocationIndex* pFirstOutgoing;
-      const AllocationIndex* pPastOutgoing;
+      EdgeIterator pFirstOutgoing;
+      EdgeIterator pPastOutgoing;
       _graph.GetOutgoing(index, &pFirstOutgoing, &pPastOutgoing);
-      for (const AllocationIndex* pNextOutgoing = pFirstOutgoing;
+      for (EdgeIterator pNextOutgoing = pFirstOutgoing;
            pNextOutgoing != pPastOutgoing; pNextOutgoing++) {
         /*
          * References between allocations are always to the inner-most
@@ -203,6 +245,9 @@ class AllocationsTagger : public Allocations::Tagger<Offset> {
     Offset firstDequeBlock =
         reader.ReadOffset(dequeStart + _firstBlockInDeque, 0xbad);
     if (firstDequeBlock == 0xbad) {
+      if (_tagHolder.DeferToOrderedRun()) {
+        return;
+      }
       std::cerr << "Warning: unable to get first block address for deque at 0x"
                 << std::hex << dequeAllocation << "\n";
       return;
@@ -210,6 +255,9 @@ class AllocationsTagger : public Allocations::Tagger<Offset> {
     Offset lastDequeBlock =
         reader.ReadOffset(dequeStart + _lastBlockInDeque, 0xbad);
     if (lastDequeBlock == 0xbad) {
+      if (_tagHolder.DeferToOrderedRun()) {
+        return;
+      }
       std::cerr << "Warning: unable to get last block address for deque at 0x"
                 << std::hex << dequeAllocation << "\n";
       return;
@@ -231,6 +279,9 @@ class AllocationsTagger : public Allocations::Tagger<Offset> {
         break;
       }
       if (dequeBlock == 0xbad) {
+        if (_tagHolder.DeferToOrderedRun()) {
+          break;
+        }
         std::cerr
             << "Warning: unable to access full chain of blocks for deque at 0x"
             << std::hex << dequeAllocation << "\n";
@@ -3,6 +3,7 @@
 
 #pragma once
 #include <string.h>
+#include <mutex>
 #include "../Allocations/PatternDescriber.h"
 #include "../ProcessImage.h"
 #include "InfrastructureFinder.h"
@@ -39,6 +40,7 @@ class ArenaStructArrayDescriber : public Allocations::PatternDescriber<Offset> {
     output << std::dec << _infrastructureFinder.NumArenas()
            << " entries in the array"
            << " have corresponding python arenas.\n";
+    std::lock_guard<std::mutex> lock(_contiguousImageMutex);
     _contiguousImage.SetIndex(index);
     // TODO: Possibly dump the array as part of the description.
     if (explain) {
@@ -47,6 +49,7 @@ class ArenaStructArrayDescriber : public Allocations::PatternDescriber<Offset> {
 
  private:
   const InfrastructureFinder<Offset>& _infrastructureFinder;
+  mutable std::mutex _contiguousImageMutex;
   mutable Allocations::ContiguousImage<Offset> _contiguousImage;
 };
 }  // namespace Python
@@ -15,6 +15,8 @@ class BlockAllocationFinder : public Allocations::Directory<Offset>::Finder {
   typedef typename VirtualAddressMap<Offset>::NotMapped NotMapped;
   typedef typename VirtualAddressMap<Offset>::RangeAttributes RangeAttributes;
   typedef typename std::set<Offset> OffsetSet;
+  typedef typename Allocations::Directory<Offset>::FoundAllocation
+      FoundAllocation;
 
   BlockAllocationFinder(
       const VirtualAddressMap<Offset>& addressMap,
@@ -97,6 +99,29 @@ class BlockAllocationFinder : public Allocations::Directory<Offset>::Finder {
       }
     }
   }
+  /*
+   * Copy the next allocation and as many of the blocks that follow it in
+   * the same pool as fit, leaving the finder at the last one copied.
+   */
+  virtual size_t NextSpan(FoundAllocation* records, size_t maxRecords) {
+    if (_itActiveIndices == _activeIndices.end() || maxRecords == 0) {
+      return 0;
+    }
+    records[0] = {_allocationAddress, _allocationSize, _allocationIsUsed};
+    size_t numRecords = 1;
+    if (_allocationSize != _poolSize) {
+      for (; numRecords < maxRecords && _block + _blockSize < _blocksLimit;
+           numRecords++) {
+        _block += _blockSize;
+        ++_blockIndex;
+        records[numRecords] = {_block, _blockSize,
+                               (bool)(_blockUsedInPool[_blockIndex])};
+      }
+      _allocationAddress = _block;
+      _allocationIsUsed = _blockUsedInPool[_blockIndex];
+    }
+    return numRecords;
+  }
   /*
    * Return the smallest request size that might reasonably have resulted
    * in an allocation of the given size.
@@ -3,6 +3,7 @@
 
 #pragma once
 #include <string.h>
+#include <mutex>
 #include "../Allocations/PatternDescriber.h"
 #include "../ProcessImage.h"
 
@@ -38,6 +39,7 @@ class ContainerPythonObjectDescriber
                         bool /* explain */) const {
     Commands::Output& output = context.GetOutput();
     output << "This allocation matches pattern ContainerPythonObject.\n";
+    std::lock_guard<std::mutex> lock(_contiguousImageMutex);
     _contiguousImage.SetIndex(index);
     const char* firstChar = _contiguousImage.FirstChar();
     long long gcRefcnt =
@@ -81,6 +83,7 @@ class ContainerPythonObjectDescriber
   const Offset _garbageCollectionHeaderSize;
   const Offset _garbageCollectionRefcntShift;
   const Offset _refcntInGarbageCollectionHeader;
+  mutable std::mutex _contiguousImageMutex;
   mutable Allocations::ContiguousImage<Offset> _contiguousImage;
 };
 }  // namespace Python
@@ -3,6 +3,7 @@
 
 #pragma once
 #include <string.h>
+#include <mutex>
 #include "../Allocations/PatternDescriber.h"
 #include "../ProcessImage.h"
 #include "InfrastructureFinder.h"
@@ -32,6 +33,7 @@ class ListItemsDescriber : public Allocations::PatternDescriber<Offset> {
                         bool explain) const {
     Commands::Output& output = context.GetOutput();
     output << "This allocation matches pattern PythonListItems.\n";
+    std::lock_guard<std::mutex> lock(_contiguousImageMutex);
     _contiguousImage.SetIndex(index);
     if (explain) {
     }
@@ -39,6 +41,7 @@ class ListItemsDescriber : public Allocations::PatternDescriber<Offset> {
 
  private:
   const InfrastructureFinder<Offset>& _infrastructureFinder;
+  mutable std::mutex _contiguousImageMutex;
   mutable Allocations::ContiguousImage<Offset> _contiguousImage;
 };
 }  // namespace Python
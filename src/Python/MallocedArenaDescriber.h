@@ -3,6 +3,7 @@
 
 #pragma once
 #include <string.h>
+#include <mutex>
 #include "../Allocations/PatternDescriber.h"
 #include "../ProcessImage.h"
 #include "InfrastructureFinder.h"
@@ -35,6 +36,7 @@ class MallocedArenaDescriber : public Allocations::PatternDescriber<Offset> {
     output << "Only the first 0x" << std::hex
            << _infrastructureFinder.ArenaSize()
            << " bytes contain the arena.\n";
+    std::lock_guard<std::mutex> lock(_contiguousImageMutex);
     _contiguousImage.SetIndex(index);
     if (explain) {
     }
@@ -42,6 +44,7 @@ class MallocedArenaDescriber : public Allocations::PatternDescriber<Offset> {
 
  private:
   const InfrastructureFinder<Offset>& _infrastructureFinder;
+  mutable std::mutex _contiguousImageMutex;
   mutable Allocations::ContiguousImage<Offset> _contiguousImage;
 };
 }  // namespace Python
@@ -3,6 +3,7 @@
 
 #pragma once
 #include <string.h>
+#include <mutex>
 #include "../Allocations/Graph.h"
 #include "../Allocations/PatternDescriber.h"
 #include "../ProcessImage.h"
@@ -16,10 +17,10 @@ class PyDictKeysObjectDescriber : public Allocations::PatternDescriber<Offset> {
       typename Allocations::Directory<Offset>::AllocationIndex AllocationIndex;
   typedef typename Allocations::PatternDescriber<Offset> Base;
   typedef typename Allocations::Directory<Offset>::Allocation Allocation;
+  typedef typename Allocations::Graph<Offset>::EdgeIterator EdgeIterator;
   PyDictKeysObjectDescriber(const ProcessImage<Offset>& processImage)
       : Allocations::PatternDescriber<Offset>(processImage, "PyDictKeysObject"),
-        _graph(*(processImage.GetAllocationGraph())),
-        _directory(_graph.GetAllocationDirectory()),
+        _directory(processImage.GetAllocationDirectory()),
         _infrastructureFinder(processImage.GetPythonInfrastructureFinder()),
         _strType(_infrastructureFinder.StrType()),
         _cstringInStr(_infrastructureFinder.CstringInStr()),
@@ -38,6 +39,7 @@ class PyDictKeysObjectDescriber : public Allocations::PatternDescriber<Offset> {
                         const Allocation& allocation, bool explain) const {
     Commands::Output& output = context.GetOutput();
     output << "This allocation matches pattern PyDictKeysObject.\n";
+    std::lock_guard<std::mutex> lock(_contiguousImageMutex);
     _contiguousImage.SetIndex(index);
 
     Offset keysAddress = allocation.Address();
@@ -65,12 +67,12 @@ class PyDictKeysObjectDescriber : public Allocations::PatternDescriber<Offset> {
     } else {
       // For older python, we need to obtain the capacity from the dict.
 
-      const AllocationIndex* pFirstIncoming;
-      const AllocationIndex* pPastIncoming;
-      _graph.GetIncoming(index, &pFirstIncoming, &pPastIncoming);
+      EdgeIterator pFirstIncoming;
+      EdgeIterator pPastIncoming;
+      Base::GetGraph().GetIncoming(index, &pFirstIncoming, &pPastIncoming);
       Offset minDictSizeWithGCH =
           _garbageCollectionHeaderSize + _keysInDict + sizeof(Offset);
-      for (const AllocationIndex* pNextIncoming = pFirstIncoming;
+      for (EdgeIterator pNextIncoming = pFirstIncoming;
            pNextIncoming != pPastIncoming; pNextIncoming++) {
         AllocationIndex incomingIndex = *pNextIncoming;
         const Allocation* incomingAllocation =
@@ -149,7 +151,6 @@ class PyDictKeysObjectDescriber : public Allocations::PatternDescriber<Offset> {
   }
 
  private:
-  const Allocations::Graph<Offset>& _graph;
   const Allocations::Directory<Offset>& _directory;
   const InfrastructureFinder<Offset>& _infrastructureFinder;
   const Offset _strType;
@@ -157,6 +158,7 @@ class PyDictKeysObjectDescriber : public Allocations::PatternDescriber<Offset> {
   const Offset _garbageCollectionHeaderSize;
   const Offset _keysInDict;
   const Offset _dictKeysHeaderSize;
+  mutable std::mutex _contiguousImageMutex;
   mutable Allocations::ContiguousImage<Offset> _contiguousImage;
 };
 }  // namespace Python
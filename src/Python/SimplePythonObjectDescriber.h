@@ -3,6 +3,7 @@
 
 #pragma once
 #include <string.h>
+#include <mutex>
 #include "../Allocations/PatternDescriber.h"
 #include "../ProcessImage.h"
 
@@ -34,6 +35,7 @@ class SimplePythonObjectDescriber
                         bool explain) const {
     Commands::Output& output = context.GetOutput();
     output << "This allocation matches pattern SimplePythonObject.\n";
+    std::lock_guard<std::mutex> lock(_contiguousImageMutex);
     _contiguousImage.SetIndex(index);
     const Offset* asOffsets = _contiguousImage.FirstOffset();
     Offset referenceCount = asOffsets[0];
@@ -65,6 +67,7 @@ class SimplePythonObjectDescriber
   const InfrastructureFinder<Offset>& _infrastructureFinder;
   const Offset _strType;
   const Offset _cstringInStr;
+  mutable std::mutex _contiguousImageMutex;
   mutable Allocations::ContiguousImage<Offset> _contiguousImage;
 };
 }  // namespace Python
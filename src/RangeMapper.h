@@ -4,6 +4,7 @@
 #pragma once
 #include <functional>
 #include <map>
+#include <vector>
 namespace chap {
 template <class Off, class T>
 class RangeMapper {
@@ -17,7 +18,25 @@ class RangeMapper {
   typedef typename Map::const_reverse_iterator MapConstReverseIterator;
 
   RangeMapper(bool coallesceMatchingValues = true)
-      : _coallesceMatchingValues(coallesceMatchingValues) {}
+      : _coallesceMatchingValues(coallesceMatchingValues), _isFrozen(false) {}
+
+  /*
+   * A copy is never frozen, because the frozen form of the original refers
+   * to the map of the original.
+   */
+  RangeMapper(const RangeMapper& other)
+      : _map(other._map),
+        _coallesceMatchingValues(other._coallesceMatchingValues),
+        _isFrozen(false) {}
+
+  RangeMapper& operator=(const RangeMapper& other) {
+    if (this != &other) {
+      Thaw();
+      _map = other._map;
+      _coallesceMatchingValues = other._coallesceMatchingValues;
+    }
+    return *this;
+  }
   struct Range {
     Range() : _limit(0), _size(0), _base(0) {}
     void Set(Offset limit, Offset size, ValueType value) {
@@ -107,6 +126,7 @@ class RangeMapper {
     if (rangeSize == 0) {
       return true;
     }
+    Thaw();
     Offset rangeLimit = rangeBase + rangeSize;
 
     MapIterator it = _map.lower_bound(rangeBase);
@@ -163,6 +183,7 @@ class RangeMapper {
     if (rangeSize == 0) {
       return;
     }
+    Thaw();
     Offset rangeLimit = rangeBase + rangeSize;
 
     MapIterator it = _map.lower_bound(rangeBase);
@@ -210,7 +231,43 @@ class RangeMapper {
     }
   }
 
+  /*
+   * Build a flat copy of the ranges, used by find(), lower_bound(),
+   * upper_bound() and FindRange() until the next change to the ranges.
+   * This is intended for ranges that are not expected to change after
+   * some point, and must not be called while any other thread is using
+   * this RangeMapper.
+   *
+   * The limits, bases and values are kept in separate arrays in the
+   * Eytzinger (breadth first) order of a complete binary search tree on the
+   * limits, so a search touches few cache lines and has no branches that
+   * depend on the comparisons.
+   */
+  void Freeze() {
+    Thaw();
+    size_t numRanges = _map.size();
+    _frozenIterators.reserve(numRanges);
+    for (MapConstIterator it = _map.begin(); it != _map.end(); ++it) {
+      _frozenIterators.push_back(it);
+    }
+    _frozenLimits.resize(numRanges + 1);
+    _frozenBases.resize(numRanges + 1);
+    _frozenValues.resize(numRanges + 1);
+    _frozenIndices.resize(numRanges + 1);
+    FreezeSubtree(0, 1);
+    _isFrozen = true;
+  }
+
+  bool IsFrozen() const { return _isFrozen; }
+
   const_iterator find(Offset member) const {
+    if (_isFrozen) {
+      size_t slot = FrozenUpperBound(member);
+      if (slot == 0 || member < _frozenBases[slot]) {
+        return const_iterator(_map.end());
+      }
+      return const_iterator(_frozenIterators[_frozenIndices[slot]]);
+    }
     MapConstIterator it = _map.upper_bound(member);
     if (it != _map.end()) {
       if (member < it->first - it->second.first) {
@@ -226,7 +283,7 @@ class RangeMapper {
    * given member, or an iterator to the end if no such range exists.
    */
   const_iterator lower_bound(Offset member) const {
-    return const_iterator(_map.upper_bound(member));
+    return upper_bound(member);
   }
 
   /*
@@ -234,13 +291,22 @@ class RangeMapper {
    * member, or an iterator to the end if no such range exists.
    */
   const_iterator upper_bound(Offset member) const {
+    if (_isFrozen) {
+      size_t slot = FrozenUpperBound(member);
+      return const_iterator((slot == 0)
+                                ? _map.end()
+                                : _frozenIterators[_frozenIndices[slot]]);
+    }
     return const_iterator(_map.upper_bound(member));
   }
 
   /*
    * Clear the map.
    */
-  void clear() { _map.clear(); }
+  void clear() {
+    Thaw();
+    _map.clear();
+  }
 
   /*
    * If a range containing the given member exists, return true and
@@ -250,6 +316,16 @@ class RangeMapper {
 
   bool FindRange(Offset member, Offset& rangeBase, Offset& rangeSize,
                  ValueType& value) const {
+    if (_isFrozen) {
+      size_t slot = FrozenUpperBound(member);
+      if (slot == 0 || member < _frozenBases[slot]) {
+        return false;
+      }
+      rangeBase = _frozenBases[slot];
+      rangeSize = _frozenLimits[slot] - rangeBase;
+      value = _frozenValues[slot];
+      return true;
+    }
     MapConstIterator it = _map.upper_bound(member);
     if (it != _map.end()) {
       Offset foundRangeSize = it->second.first;
@@ -289,6 +365,64 @@ class RangeMapper {
  private:
   Map _map;
   bool _coallesceMatchingValues;
+  bool _isFrozen;
+  /*
+   * The following are indexed by Eytzinger slot, starting at 1, except for
+   * _frozenIterators, which is in increasing order of limit and indexed
+   * by the values in _frozenIndices.
+   */
+  std::vector<Offset> _frozenLimits;
+  std::vector<Offset> _frozenBases;
+  std::vector<ValueType> _frozenValues;
+  std::vector<size_t> _frozenIndices;
+  std::vector<MapConstIterator> _frozenIterators;
+
+  void Thaw() {
+    if (_isFrozen) {
+      _isFrozen = false;
+      std::vector<Offset>().swap(_frozenLimits);
+      std::vector<Offset>().swap(_frozenBases);
+      std::vector<ValueType>().swap(_frozenValues);
+      std::vector<size_t>().swap(_frozenIndices);
+      std::vector<MapConstIterator>().swap(_frozenIterators);
+    }
+  }
+
+  /*
+   * Fill the subtree rooted at the given slot with the ranges starting at
+   * the given index in increasing order, returning the index of the first
+   * range not used.
+   */
+  size_t FreezeSubtree(size_t index, size_t slot) {
+    if (slot < _frozenLimits.size()) {
+      index = FreezeSubtree(index, 2 * slot);
+      MapConstIterator it = _frozenIterators[index];
+      _frozenLimits[slot] = it->first;
+      _frozenBases[slot] = it->first - it->second.first;
+      _frozenValues[slot] = it->second.second;
+      _frozenIndices[slot] = index;
+      index = FreezeSubtree(index + 1, 2 * slot + 1);
+    }
+    return index;
+  }
+
+  /*
+   * Return the slot of the first range with limit after the given member,
+   * or 0 if there is no such range.
+   */
+  size_t FrozenUpperBound(Offset member) const {
+    size_t numSlots = _frozenLimits.size();
+    size_t slot = 1;
+    while (slot < numSlots) {
+      slot = 2 * slot + (_frozenLimits[slot] <= member);
+    }
+    /*
+     * Each step to the right appended a 1 bit, and the last step to the
+     * left, which found the answer, appended the lowest 0 bit, so drop
+     * the trailing 1 bits and that 0 bit.
+     */
+    return slot >> __builtin_ffsll(~(unsigned long long)(slot));
+  }
 };
 
 }  // namespace chap
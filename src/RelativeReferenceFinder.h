@@ -0,0 +1,294 @@
+// Copyright (c) 2021 VMware, Inc. All Rights Reserved.
+// SPDX-License-Identifier: GPL-2.0
+
+#pragma once
+#include <stdint.h>
+#include <string.h>
+#include <algorithm>
+#include <utility>
+#include <vector>
+#include "CandidateFilter.h"
+#include "VirtualAddressMap.h"
+#include "WorkerThreads.h"
+
+namespace chap {
+/*
+ * A RelativeReferenceFinder finds every address in the imaged memory that
+ * holds a signed 32-bit integer that, when added to the address just after
+ * the integer, yields one of a given set of targets.
+ *
+ * A 32-bit displacement can reach only addresses within 2 GiB of itself,
+ * so for each target only the part of the imaged memory within that window
+ * is checked.  In that part, the displacement that would reach the target
+ * decreases by one for each byte, so blocks of 32 consecutive byte offsets
+ * are compared against the expected displacements with vector instructions
+ * where possible, and only blocks with some match are checked one offset
+ * at a time.  The work is split into tasks that are run on multiple threads
+ * and the results are merged in increasing order of address.
+ */
+template <class Offset>
+class RelativeReferenceFinder {
+ public:
+  typedef VirtualAddressMap<Offset> AddressMap;
+  typedef typename CandidateFilter<Offset>::Implementation Implementation;
+  typedef std::pair<Offset, size_t> Match;  // address, index of target
+
+  RelativeReferenceFinder(const AddressMap& addressMap,
+                          const std::vector<Offset>& targets,
+                          Implementation implementation =
+                              CandidateFilter<Offset>::BEST_AVAILABLE)
+      : _addressMap(addressMap), _targets(targets) {
+    if (implementation == CandidateFilter<Offset>::BEST_AVAILABLE) {
+      implementation = CandidateFilter<Offset>::BestAvailable();
+    } else if (!CandidateFilter<Offset>::IsAvailable(implementation)) {
+      implementation = CandidateFilter<Offset>::SCALAR;
+    }
+    switch (implementation) {
+#ifdef CHAP_CANDIDATE_FILTER_X86
+      case CandidateFilter<Offset>::AVX2:
+        _blockHasMatch = AVX2BlockHasMatch;
+        break;
+      case CandidateFilter<Offset>::SSE2:
+        _blockHasMatch = SSE2BlockHasMatch;
+        break;
+#endif
+      default:
+        _blockHasMatch = ScalarBlockHasMatch;
+        break;
+    }
+  }
+
+  /*
+   * Call the given visitor with the address and the index of the target
+   * for each relative reference to any of the targets, in increasing order
+   * of address and then of target index.
+   */
+  template <typename Visitor>
+  void Visit(Visitor visitor) const {
+    std::vector<Task> tasks;
+    typename AddressMap::const_iterator itEnd = _addressMap.end();
+    for (typename AddressMap::const_iterator it = _addressMap.begin();
+         it != itEnd; ++it) {
+      const char* image = it.GetImage();
+      if (image == (const char*)0 || it.Size() < sizeof(int32_t)) {
+        continue;
+      }
+      Offset base = it.Base();
+      Offset limit = it.Limit() - (sizeof(int32_t) - 1);
+      for (size_t targetIndex = 0; targetIndex < _targets.size();
+           targetIndex++) {
+        AddTasks(image, base, limit, targetIndex, tasks);
+      }
+    }
+    std::vector<std::vector<Match> > matches(tasks.size());
+    WorkerThreads::Run(tasks.size(), [&](size_t taskIndex, size_t) {
+      RunTask(tasks[taskIndex], matches[taskIndex]);
+    });
+    std::vector<Match> merged;
+    for (const auto& taskMatches : matches) {
+      merged.insert(merged.end(), taskMatches.begin(), taskMatches.end());
+    }
+    if (_targets.size() > 1) {
+      std::sort(merged.begin(), merged.end());
+    }
+    for (const auto& match : merged) {
+      visitor(match.first, match.second);
+    }
+  }
+
+ private:
+  static constexpr Offset POSITIONS_PER_TASK = 1 << 24;
+  static constexpr int POSITIONS_PER_BLOCK = 32;
+  static constexpr uint64_t WINDOW_SIZE = ((uint64_t)(1)) << 32;
+  typedef bool (*BlockHasMatch)(const unsigned char* block,
+                                uint32_t expected);
+
+  struct Task {
+    Task(const unsigned char* image, Offset base, Offset limit,
+         size_t targetIndex)
+        : _image(image),
+          _base(base),
+          _limit(limit),
+          _targetIndex(targetIndex) {}
+    const unsigned char* _image;  // image of the int32_t at _base
+    Offset _base;
+    Offset _limit;
+    size_t _targetIndex;
+  };
+
+  const AddressMap& _addressMap;
+  const std::vector<Offset> _targets;
+  BlockHasMatch _blockHasMatch;
+
+  /*
+   * Add tasks for the addresses in [base, limit), where a displacement at
+   * base is in the given image, that are close enough to reach the given
+   * target.  An address a can reach target t if and only if
+   * t - (a + 4) + 2^31 < 2^32, which holds for the at most 2^32 addresses
+   * starting at t - 3 - 2^31, perhaps wrapping around at 2^64.
+   */
+  void AddTasks(const char* image, Offset base, Offset limit,
+                size_t targetIndex, std::vector<Task>& tasks) const {
+    uint64_t windowStart =
+        (uint64_t)(_targets[targetIndex]) - (sizeof(int32_t) - 1) -
+        (WINDOW_SIZE >> 1);
+    uint64_t startInWindow = (uint64_t)(base) - windowStart;
+    if (startInWindow < WINDOW_SIZE) {
+      uint64_t numInWindow = WINDOW_SIZE - startInWindow;
+      Offset pieceLimit =
+          ((uint64_t)(limit - base) <= numInWindow) ? limit
+                                                     : base + numInWindow;
+      AddPieceTasks(image, base, base, pieceLimit, targetIndex, tasks);
+    }
+    if (windowStart > (uint64_t)(base) && windowStart < (uint64_t)(limit)) {
+      Offset pieceBase = (Offset)(windowStart);
+      Offset pieceLimit = ((uint64_t)(limit - pieceBase) <= WINDOW_SIZE)
+                              ? limit
+                              : pieceBase + WINDOW_SIZE;
+      AddPieceTasks(image, base, pieceBase, pieceLimit, targetIndex, tasks);
+    }
+  }
+
+  void AddPieceTasks(const char* image, Offset base, Offset pieceBase,
+                     Offset pieceLimit, size_t targetIndex,
+                     std::vector<Task>& tasks) const {
+    const unsigned char* pieceImage =
+        (const unsigned char*)(image) + (pieceBase - base);
+    for (Offset taskBase = pieceBase; taskBase < pieceLimit;) {
+      Offset taskLimit = (pieceLimit - taskBase > POSITIONS_PER_TASK)
+                             ? taskBase + POSITIONS_PER_TASK
+                             : pieceLimit;
+      tasks.emplace_back(pieceImage + (taskBase - pieceBase), taskBase,
+                         taskLimit, targetIndex);
+      taskBase = taskLimit;
+    }
+  }
+
+  void RunTask(const Task& task, std::vector<Match>& matches) const {
+    Offset target = _targets[task._targetIndex];
+    Offset numPositions = task._limit - task._base;
+    /*
+     * Every address in the task can reach the target, so the expected
+     * displacement at address a is just the low 32 bits of t - (a + 4),
+     * which decreases by 1 for each following address.
+     */
+    uint32_t expected = (uint32_t)(target - task._base - sizeof(int32_t));
+    /*
+     * A displacement read entirely from pages known to be all zero is 0,
+     * which is expected only at the position given by the expected value
+     * at the start of the task, so such positions need not be read.
+     */
+    Offset zeroMatch = expected;
+    Offset checked = 0;
+    auto skipTo = [&](Offset position) {
+      if (zeroMatch >= checked && zeroMatch < position) {
+        matches.emplace_back(task._base + zeroMatch, task._targetIndex);
+      }
+      checked = position;
+    };
+    _addressMap.VisitSpansNotKnownZero(
+        task._base, task._limit + (sizeof(int32_t) - 1),
+        [&](Offset spanBase, Offset spanLimit) {
+          Offset first = spanBase - task._base;
+          first = (first > sizeof(int32_t) - 1) ? first - (sizeof(int32_t) - 1)
+                                                : 0;
+          Offset limit = spanLimit - task._base;
+          if (limit > numPositions) {
+            limit = numPositions;
+          }
+          if (first > checked) {
+            skipTo(first);
+          }
+          if (limit > checked) {
+            ScanPositions(task, checked, limit,
+                          expected - (uint32_t)(checked), matches);
+            checked = limit;
+          }
+        });
+    if (checked < numPositions) {
+      skipTo(numPositions);
+    }
+  }
+
+  /*
+   * Check the positions in [first, limit) of the given task, where the
+   * displacement expected at first is given, a block at a time.
+   */
+  void ScanPositions(const Task& task, Offset first, Offset limit,
+                     uint32_t expected, std::vector<Match>& matches) const {
+    Offset position = first;
+    for (; limit - position >= POSITIONS_PER_BLOCK;
+         position += POSITIONS_PER_BLOCK) {
+      uint32_t blockExpected = expected - (uint32_t)(position - first);
+      if (_blockHasMatch(task._image + position, blockExpected)) {
+        CheckPositions(task, position, position + POSITIONS_PER_BLOCK,
+                       blockExpected, matches);
+      }
+    }
+    CheckPositions(task, position, limit,
+                   expected - (uint32_t)(position - first), matches);
+  }
+
+  static void CheckPositions(const Task& task, Offset first, Offset limit,
+                             uint32_t expected,
+                             std::vector<Match>& matches) {
+    for (Offset position = first; position < limit; position++) {
+      uint32_t displacement;
+      memcpy(&displacement, task._image + position, sizeof(displacement));
+      if (displacement == expected) {
+        matches.emplace_back(task._base + position, task._targetIndex);
+      }
+      expected--;
+    }
+  }
+
+  /*
+   * Each of the following returns true if, for some i < POSITIONS_PER_BLOCK,
+   * the 32-bit value at block + i is expected - i.  The vector versions
+   * load the block four times, at offsets 0 through 3, so that the lanes of
+   * the load at offset k hold the values at k, k + 4, k + 8 and so on.
+   */
+
+  static bool ScalarBlockHasMatch(const unsigned char* block,
+                                  uint32_t expected) {
+    bool hasMatch = false;
+    for (int i = 0; i < POSITIONS_PER_BLOCK; i++) {
+      uint32_t displacement;
+      memcpy(&displacement, block + i, sizeof(displacement));
+      hasMatch |= (displacement == expected - i);
+    }
+    return hasMatch;
+  }
+
+#ifdef CHAP_CANDIDATE_FILTER_X86
+  __attribute__((target("sse2"))) static bool SSE2BlockHasMatch(
+      const unsigned char* block, uint32_t expected) {
+    const __m128i laneSteps = _mm_set_epi32(12, 8, 4, 0);
+    __m128i any = _mm_setzero_si128();
+    for (int half = 0; half < 2; half++) {
+      for (int k = 0; k < 4; k++) {
+        int first = half * 16 + k;
+        __m128i values = _mm_loadu_si128((const __m128i*)(block + first));
+        __m128i wanted = _mm_sub_epi32(
+            _mm_set1_epi32((int)(expected - first)), laneSteps);
+        any = _mm_or_si128(any, _mm_cmpeq_epi32(values, wanted));
+      }
+    }
+    return _mm_movemask_epi8(any) != 0;
+  }
+
+  __attribute__((target("avx2"))) static bool AVX2BlockHasMatch(
+      const unsigned char* block, uint32_t expected) {
+    const __m256i laneSteps = _mm256_set_epi32(28, 24, 20, 16, 12, 8, 4, 0);
+    __m256i any = _mm256_setzero_si256();
+    for (int k = 0; k < 4; k++) {
+      __m256i values = _mm256_loadu_si256((const __m256i*)(block + k));
+      __m256i wanted = _mm256_sub_epi32(
+          _mm256_set1_epi32((int)(expected - k)), laneSteps);
+      any = _mm256_or_si256(any, _mm256_cmpeq_epi32(values, wanted));
+    }
+    return !_mm256_testz_si256(any, any);
+  }
+#endif
+};
+}  // namespace chap
@@ -0,0 +1,201 @@
+// Copyright (c) 2021 VMware, Inc. All Rights Reserved.
+// SPDX-License-Identifier: GPL-2.0
+
+#pragma once
+extern "C" {
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+};
+#include <atomic>
+#include <iostream>
+#include <string>
+#include <vector>
+
+namespace chap {
+/*
+ * The values that all SpillableBuffers keep in memory share a single budget,
+ * so that the memory they use together stays bounded no matter how many
+ * buffers there are at once.
+ */
+class SpillableBufferBase {
+ public:
+  static constexpr size_t MAX_BYTES_IN_MEMORY = 1 << 28;
+
+ protected:
+  /*
+   * Charge the given number of bytes against the budget, returning false,
+   * without charging anything, if that would exceed the budget.
+   */
+  static bool TryCharge(size_t numBytes) {
+    std::atomic<size_t>& bytesInMemory = BytesInMemory();
+    size_t charged = bytesInMemory.load();
+    do {
+      if (charged + numBytes > MAX_BYTES_IN_MEMORY) {
+        return false;
+      }
+    } while (!bytesInMemory.compare_exchange_weak(charged, charged + numBytes));
+    return true;
+  }
+
+  /*
+   * Charge the given number of bytes even if that exceeds the budget, for
+   * values that must stay in memory because they could not be spilled.
+   */
+  static void Charge(size_t numBytes) { BytesInMemory() += numBytes; }
+
+  static void Release(size_t numBytes) { BytesInMemory() -= numBytes; }
+
+ private:
+  static std::atomic<size_t>& BytesInMemory() {
+    static std::atomic<size_t> bytesInMemory(0);
+    return bytesInMemory;
+  }
+};
+
+/*
+ * A SpillableBuffer is an append-only array of trivially copyable values
+ * that is used for temporary results that may be too large to be kept
+ * comfortably in memory.  Values are kept in memory until growing the buffer
+ * would take the memory used by all such buffers past the shared budget, at
+ * which point the values of this buffer are moved to a mapping of an
+ * unlinked temporary file, so that the kernel can write the pages back to
+ * the file rather than to swap if memory is tight.  If the temporary file
+ * cannot be created the buffer just stays in memory.
+ */
+template <typename T>
+class SpillableBuffer : public SpillableBufferBase {
+ public:
+  SpillableBuffer()
+      : _spillFailed(false),
+        _fd(-1),
+        _mapped(nullptr),
+        _mappedSize(0),
+        _mappedCapacity(0) {}
+
+  SpillableBuffer(const SpillableBuffer&) = delete;
+  SpillableBuffer& operator=(const SpillableBuffer&) = delete;
+
+  ~SpillableBuffer() { Clear(); }
+
+  void Append(const T* first, const T* limit) {
+    size_t numToAppend = limit - first;
+    if (numToAppend == 0) {
+      return;
+    }
+    if (_mapped == nullptr) {
+      size_t newSize = _inMemory.size() + numToAppend;
+      size_t capacity = _inMemory.capacity();
+      if (newSize <= capacity) {
+        _inMemory.insert(_inMemory.end(), first, limit);
+        return;
+      }
+      size_t newCapacity = (2 * capacity < newSize) ? newSize : 2 * capacity;
+      size_t growth = (newCapacity - capacity) * sizeof(T);
+      if (_spillFailed || TryCharge(growth) || !Spill(newSize)) {
+        if (_spillFailed) {
+          Charge(growth);
+        }
+        _inMemory.reserve(newCapacity);
+        _inMemory.insert(_inMemory.end(), first, limit);
+        return;
+      }
+    } else if (_mappedSize + numToAppend > _mappedCapacity &&
+               !Grow(_mappedSize + numToAppend)) {
+      std::cerr << "Failed to extend temporary file.\n";
+      abort();
+    }
+    memcpy(_mapped + _mappedSize, first, numToAppend * sizeof(T));
+    _mappedSize += numToAppend;
+  }
+
+  size_t Size() const {
+    return (_mapped == nullptr) ? _inMemory.size() : _mappedSize;
+  }
+
+  const T* Data() const {
+    return (_mapped == nullptr) ? _inMemory.data() : _mapped;
+  }
+
+  bool IsSpilled() const { return _mapped != nullptr; }
+
+  /*
+   * Discard all the values and release any associated memory or file.
+   */
+  void Clear() {
+    Release(_inMemory.capacity() * sizeof(T));
+    std::vector<T>().swap(_inMemory);
+    if (_mapped != nullptr) {
+      munmap(_mapped, _mappedCapacity * sizeof(T));
+      _mapped = nullptr;
+      _mappedSize = 0;
+      _mappedCapacity = 0;
+    }
+    if (_fd >= 0) {
+      close(_fd);
+      _fd = -1;
+    }
+  }
+
+ private:
+  std::vector<T> _inMemory;
+  bool _spillFailed;
+  int _fd;
+  T* _mapped;
+  size_t _mappedSize;
+  size_t _mappedCapacity;
+
+  bool Spill(size_t minCapacity) {
+    const char* tmpDir = getenv("TMPDIR");
+    std::string path((tmpDir != nullptr && tmpDir[0] != '\000') ? tmpDir
+                                                                 : "/tmp");
+    path.append("/chapXXXXXX");
+    std::vector<char> pathChars(path.begin(), path.end());
+    pathChars.push_back('\000');
+    _fd = mkstemp(pathChars.data());
+    if (_fd < 0) {
+      _spillFailed = true;
+      return false;
+    }
+    unlink(pathChars.data());
+    if (!Grow(minCapacity)) {
+      close(_fd);
+      _fd = -1;
+      _spillFailed = true;
+      return false;
+    }
+    _mappedSize = _inMemory.size();
+    memcpy(_mapped, _inMemory.data(), _mappedSize * sizeof(T));
+    Release(_inMemory.capacity() * sizeof(T));
+    std::vector<T>().swap(_inMemory);
+    return true;
+  }
+
+  bool Grow(size_t minCapacity) {
+    size_t newCapacity =
+        (_mappedCapacity == 0) ? _inMemory.capacity() : _mappedCapacity;
+    if (newCapacity == 0) {
+      newCapacity = 1;
+    }
+    while (newCapacity < minCapacity) {
+      newCapacity *= 2;
+    }
+    if (ftruncate(_fd, newCapacity * sizeof(T)) != 0) {
+      return false;
+    }
+    void* newMapped =
+        (_mapped == nullptr)
+            ? mmap(nullptr, newCapacity * sizeof(T), PROT_READ | PROT_WRITE,
+                   MAP_SHARED, _fd, 0)
+            : mremap(_mapped, _mappedCapacity * sizeof(T),
+                     newCapacity * sizeof(T), MREMAP_MAYMOVE);
+    if (newMapped == MAP_FAILED) {
+      return false;
+    }
+    _mapped = (T*)(newMapped);
+    _mappedCapacity = newCapacity;
+    return true;
+  }
+};
+}  // namespace chap
@@ -59,6 +59,12 @@ class StackRegistry {
     return false;
   }
 
+  /*
+   * Build the flat form of the stack ranges used to look up addresses.
+   * This should be called once all the stacks have been registered.
+   */
+  void Freeze() { _stacks.Freeze(); }
+
   template <typename Visitor>
   void VisitStacks(Visitor visitor) const {
     typename RangeMapper<Offset, size_t>::const_iterator itEnd = _stacks.end();
@@ -72,7 +72,7 @@ class UnfilledImages {
   const AddressMap &GetAddressMap() const { return _addressMap; }
 
  private:
-  const AddressMap _addressMap;
+  const AddressMap &_addressMap;
   UnfilledRanges _unfilledRanges;
 };
 
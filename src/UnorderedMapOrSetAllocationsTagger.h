@@ -18,6 +18,7 @@ class UnorderedMapOrSetAllocationsTagger : public Allocations::Tagger<Offset> {
   typedef typename Allocations::ContiguousImage<Offset> ContiguousImage;
   typedef typename Tagger::Phase Phase;
   typedef typename Directory::AllocationIndex AllocationIndex;
+  typedef typename Graph::Anchors Anchors;
   typedef typename Directory::Allocation Allocation;
   typedef typename VirtualAddressMap<Offset>::Reader Reader;
   typedef typename Allocations::TagHolder<Offset> TagHolder;
@@ -35,6 +36,24 @@ class UnorderedMapOrSetAllocationsTagger : public Allocations::Tagger<Offset> {
         _bucketsTagIndex(_tagHolder.RegisterTag("%UnorderedMapOrSetBuckets")),
         _nodeTagIndex(_tagHolder.RegisterTag("%UnorderedMapOrSetNode")) {}
 
+  UnorderedMapOrSetAllocationsTagger(
+      const UnorderedMapOrSetAllocationsTagger& other, TagHolder& tagHolder)
+      : _graph(other._graph),
+        _tagHolder(tagHolder),
+        _directory(other._directory),
+        _numAllocations(other._numAllocations),
+        _addressMap(other._addressMap),
+        _staticAnchorReader(_addressMap),
+        _stackAnchorReader(_addressMap),
+        _nodeReader(_addressMap),
+        _bucketsReader(_addressMap),
+        _bucketsTagIndex(other._bucketsTagIndex),
+        _nodeTagIndex(other._nodeTagIndex) {}
+
+  Tagger* Copy(TagHolder& tagHolder) const {
+    return new UnorderedMapOrSetAllocationsTagger(*this, tagHolder);
+  }
+
   bool TagFromAllocation(const ContiguousImage& contiguousImage, Reader& reader,
                          AllocationIndex index, Phase phase,
                          const Allocation& allocation, bool isUnsigned) {
@@ -291,6 +310,9 @@ class UnorderedMapOrSetAllocationsTagger : public Allocations::Tagger<Offset> {
     AllocationIndex nodeIndex = firstNodeIndex;
     while (node != 0) {
       if (!_tagHolder.TagAllocation(nodeIndex, _nodeTagIndex)) {
+        if (_tagHolder.DeferToOrderedRun()) {
+          return true;
+        }
         std::cerr << "Warning: failed to tag allocation at 0x" << std::hex
                   << node << " as %UnorderedMapOrSetNode."
                              "It was already tagged as "
@@ -403,7 +425,7 @@ class UnorderedMapOrSetAllocationsTagger : public Allocations::Tagger<Offset> {
   }
 
   bool CheckAnchors(Reader& bucketsReader, Reader& anchorReader,
-                    const std::vector<Offset>* anchors, AllocationIndex index,
+                    const Anchors* anchors, AllocationIndex index,
                     Offset address, Offset size) {
     if (anchors != nullptr) {
       for (Offset anchor : *anchors) {
@@ -18,6 +18,7 @@ class VectorAllocationsTagger : public Allocations::Tagger<Offset> {
   typedef typename Allocations::ContiguousImage<Offset> ContiguousImage;
   typedef typename Tagger::Phase Phase;
   typedef typename Directory::AllocationIndex AllocationIndex;
+  typedef typename Graph::Anchors Anchors;
   typedef typename Directory::Allocation Allocation;
   typedef typename VirtualAddressMap<Offset>::Reader Reader;
   typedef typename Allocations::TagHolder<Offset> TagHolder;
@@ -33,6 +34,20 @@ class VectorAllocationsTagger : public Allocations::Tagger<Offset> {
         _addressMap(graph.GetAddressMap()),
         _tagIndex(_tagHolder.RegisterTag("%VectorBody", false)) {}
 
+  VectorAllocationsTagger(const VectorAllocationsTagger& other,
+                          TagHolder& tagHolder)
+      : _graph(other._graph),
+        _tagHolder(tagHolder),
+        _signatureDirectory(other._signatureDirectory),
+        _directory(other._directory),
+        _numAllocations(other._numAllocations),
+        _addressMap(other._addressMap),
+        _tagIndex(other._tagIndex) {}
+
+  Tagger* Copy(TagHolder& tagHolder) const {
+    return new VectorAllocationsTagger(*this, tagHolder);
+  }
+
   bool TagFromAllocation(const ContiguousImage& contiguousImage,
                          Reader& /* reader */, AllocationIndex index,
                          Phase phase, const Allocation& allocation,
@@ -138,7 +153,7 @@ class VectorAllocationsTagger : public Allocations::Tagger<Offset> {
 
   bool CheckVectorBodyAnchorIn(AllocationIndex bodyIndex,
                                const Allocation& bodyAllocation,
-                               const std::vector<Offset>* anchors) {
+                               const Anchors* anchors) {
     Offset bodyAddress = bodyAllocation.Address();
     Offset bodyLimit = bodyAddress + bodyAllocation.Size();
     Offset minCapacity = _directory.MinRequestSize(bodyIndex);
@@ -15,6 +15,8 @@ class VectorBodyDescriber : public Allocations::PatternDescriber<Offset> {
       typename Allocations::Directory<Offset>::AllocationIndex AllocationIndex;
   typedef typename Allocations::PatternDescriber<Offset> Base;
   typedef typename Allocations::Directory<Offset>::Allocation Allocation;
+  typedef typename Allocations::Graph<Offset>::Anchors Anchors;
+  typedef typename Allocations::Graph<Offset>::EdgeIterator EdgeIterator;
   VectorBodyDescriber(const ProcessImage<Offset>& processImage)
       : Allocations::PatternDescriber<Offset>(processImage, "VectorBody") {}
 
@@ -28,12 +30,12 @@ class VectorBodyDescriber : public Allocations::PatternDescriber<Offset> {
     Offset allocationAddress = allocation.Address();
     Offset allocationLimit = allocationAddress + allocationSize;
 
-    const AllocationIndex* pFirstIncoming;
-    const AllocationIndex* pPastIncoming;
-    Base::_graph->GetIncoming(index, &pFirstIncoming, &pPastIncoming);
+    EdgeIterator pFirstIncoming;
+    EdgeIterator pPastIncoming;
+    Base::GetGraph().GetIncoming(index, &pFirstIncoming, &pPastIncoming);
 
     std::vector<VectorInfo> vectors;
-    for (const AllocationIndex* pNextIncoming = pFirstIncoming;
+    for (EdgeIterator pNextIncoming = pFirstIncoming;
          pNextIncoming < pPastIncoming; pNextIncoming++) {
       const Allocation* incoming =
           Base::_directory.AllocationAt(*pNextIncoming);
@@ -70,9 +72,9 @@ class VectorBodyDescriber : public Allocations::PatternDescriber<Offset> {
     }
 
     FindVectors(InStaticMemory, allocationAddress, allocationLimit,
-                Base::_graph->GetStaticAnchors(index), vectors);
+                Base::GetGraph().GetStaticAnchors(index), vectors);
     FindVectors(OnStack, allocationAddress, allocationLimit,
-                Base::_graph->GetStackAnchors(index), vectors);
+                Base::GetGraph().GetStackAnchors(index), vectors);
 
     if (vectors.empty()) {
       return;
@@ -127,7 +129,7 @@ class VectorBodyDescriber : public Allocations::PatternDescriber<Offset> {
     Offset _offsetInAllocation;
   };
   void FindVectors(LocationType locationType, Offset allocationAddress,
-                   Offset allocationLimit, const std::vector<Offset>* anchors,
+                   Offset allocationLimit, const Anchors* anchors,
                    std::vector<VectorInfo>& vectors) const {
     if (anchors != nullptr) {
       typename VirtualAddressMap<Offset>::Reader reader(Base::_addressMap);
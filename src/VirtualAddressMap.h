@@ -3,6 +3,7 @@
 
 #pragma once
 #include "FileImage.h"
+#include "KnownZeroPages.h"
 #include "RangeMapper.h"
 namespace chap {
 template <typename OffsetType>
@@ -88,8 +89,6 @@ class VirtualAddressMap {
    public:
     Reader(const VirtualAddressMap &map)
         : _map(map),
-          _iterator(map.end()),
-          _endIterator(map.end()),
           _image((const char *)0),
           _base(0),
           _limit(0) {}
@@ -104,20 +103,8 @@ class VirtualAddressMap {
         throw NotMapped(address);
       }
       if (_base > address || _limit < readLimit) {
-        _image = (char *)0;
-        _base = 0;
-        _limit = 0;
-        _iterator = _map.find(address);
-        if (_iterator != _endIterator) {
-          _image = _iterator.GetImage();
-          if (_image != (char *)0) {
-            _base = _iterator.Base();
-            _limit = _iterator.Limit();
-          } else {
-            throw NotMapped(address);
-          }
-        }
-        if (readLimit > _limit) {
+        if (!_map.FindImagedRange(address, &_image, &_base, &_limit) ||
+            readLimit > _limit) {
           throw NotMapped(address);
         }
       }
@@ -134,20 +121,8 @@ class VirtualAddressMap {
         return defaultValue;
       }
       if (_base > address || _limit < readLimit) {
-        _image = (char *)0;
-        _base = 0;
-        _limit = 0;
-        _iterator = _map.find(address);
-        if (_iterator != _endIterator) {
-          _image = _iterator.GetImage();
-          if (_image != (char *)0) {
-            _base = _iterator.Base();
-            _limit = _iterator.Limit();
-          } else {
-            return defaultValue;
-          }
-        }
-        if (readLimit > _limit) {
+        if (!_map.FindImagedRange(address, &_image, &_base, &_limit) ||
+            readLimit > _limit) {
           return defaultValue;
         }
       }
@@ -164,20 +139,8 @@ class VirtualAddressMap {
         throw NotMapped(address);
       }
       if (_base > address || _limit < readLimit) {
-        _image = (char *)0;
-        _base = 0;
-        _limit = 0;
-        _iterator = _map.find(address);
-        if (_iterator != _endIterator) {
-          _image = _iterator.GetImage();
-          if (_image != (char *)0) {
-            _base = _iterator.Base();
-            _limit = _iterator.Limit();
-          } else {
-            throw NotMapped(address);
-          }
-        }
-        if (readLimit > _limit) {
+        if (!_map.FindImagedRange(address, &_image, &_base, &_limit) ||
+            readLimit > _limit) {
           throw NotMapped(address);
         }
       }
@@ -193,20 +156,8 @@ class VirtualAddressMap {
         return defaultValue;
       }
       if (_base > address || _limit < readLimit) {
-        _image = (char *)0;
-        _base = 0;
-        _limit = 0;
-        _iterator = _map.find(address);
-        if (_iterator != _endIterator) {
-          _image = _iterator.GetImage();
-          if (_image != (char *)0) {
-            _base = _iterator.Base();
-            _limit = _iterator.Limit();
-          } else {
-            return defaultValue;
-          }
-        }
-        if (readLimit > _limit) {
+        if (!_map.FindImagedRange(address, &_image, &_base, &_limit) ||
+            readLimit > _limit) {
           return defaultValue;
         }
       }
@@ -223,20 +174,8 @@ class VirtualAddressMap {
         throw NotMapped(address);
       }
       if (_base > address || _limit < readLimit) {
-        _image = (char *)0;
-        _base = 0;
-        _limit = 0;
-        _iterator = _map.find(address);
-        if (_iterator != _endIterator) {
-          _image = _iterator.GetImage();
-          if (_image != (char *)0) {
-            _base = _iterator.Base();
-            _limit = _iterator.Limit();
-          } else {
-            throw NotMapped(address);
-          }
-        }
-        if (readLimit > _limit) {
+        if (!_map.FindImagedRange(address, &_image, &_base, &_limit) ||
+            readLimit > _limit) {
           throw NotMapped(address);
         }
       }
@@ -252,20 +191,8 @@ class VirtualAddressMap {
         return defaultValue;
       }
       if (_base > address || _limit < readLimit) {
-        _image = (char *)0;
-        _base = 0;
-        _limit = 0;
-        _iterator = _map.find(address);
-        if (_iterator != _endIterator) {
-          _image = _iterator.GetImage();
-          if (_image != (char *)0) {
-            _base = _iterator.Base();
-            _limit = _iterator.Limit();
-          } else {
-            return defaultValue;
-          }
-        }
-        if (readLimit > _limit) {
+        if (!_map.FindImagedRange(address, &_image, &_base, &_limit) ||
+            readLimit > _limit) {
           return defaultValue;
         }
       }
@@ -281,20 +208,8 @@ class VirtualAddressMap {
         return defaultValue;
       }
       if (_base > address || _limit < readLimit) {
-        _image = (char *)0;
-        _base = 0;
-        _limit = 0;
-        _iterator = _map.find(address);
-        if (_iterator != _endIterator) {
-          _image = _iterator.GetImage();
-          if (_image != (char *)0) {
-            _base = _iterator.Base();
-            _limit = _iterator.Limit();
-          } else {
-            return defaultValue;
-          }
-        }
-        if (readLimit > _limit) {
+        if (!_map.FindImagedRange(address, &_image, &_base, &_limit) ||
+            readLimit > _limit) {
           return defaultValue;
         }
       }
@@ -311,20 +226,8 @@ class VirtualAddressMap {
         throw NotMapped(address);
       }
       if (_base > address || _limit < readLimit) {
-        _image = (char *)0;
-        _base = 0;
-        _limit = 0;
-        _iterator = _map.find(address);
-        if (_iterator != _endIterator) {
-          _image = _iterator.GetImage();
-          if (_image != (char *)0) {
-            _base = _iterator.Base();
-            _limit = _iterator.Limit();
-          } else {
-            throw NotMapped(address);
-          }
-        }
-        if (readLimit > _limit) {
+        if (!_map.FindImagedRange(address, &_image, &_base, &_limit) ||
+            readLimit > _limit) {
           throw NotMapped(address);
         }
       }
@@ -340,20 +243,8 @@ class VirtualAddressMap {
         return defaultValue;
       }
       if (_base > address || _limit < readLimit) {
-        _image = (char *)0;
-        _base = 0;
-        _limit = 0;
-        _iterator = _map.find(address);
-        if (_iterator != _endIterator) {
-          _image = _iterator.GetImage();
-          if (_image != (char *)0) {
-            _base = _iterator.Base();
-            _limit = _iterator.Limit();
-          } else {
-            return defaultValue;
-          }
-        }
-        if (readLimit > _limit) {
+        if (!_map.FindImagedRange(address, &_image, &_base, &_limit) ||
+            readLimit > _limit) {
           return defaultValue;
         }
       }
@@ -370,20 +261,8 @@ class VirtualAddressMap {
         throw NotMapped(address);
       }
       if (_base > address || _limit < readLimit) {
-        _image = (char *)0;
-        _base = 0;
-        _limit = 0;
-        _iterator = _map.find(address);
-        if (_iterator != _endIterator) {
-          _image = _iterator.GetImage();
-          if (_image != (char *)0) {
-            _base = _iterator.Base();
-            _limit = _iterator.Limit();
-          } else {
-            throw NotMapped(address);
-          }
-        }
-        if (readLimit > _limit) {
+        if (!_map.FindImagedRange(address, &_image, &_base, &_limit) ||
+            readLimit > _limit) {
           throw NotMapped(address);
         }
       }
@@ -399,20 +278,8 @@ class VirtualAddressMap {
         return defaultValue;
       }
       if (_base > address || _limit < readLimit) {
-        _image = (char *)0;
-        _base = 0;
-        _limit = 0;
-        _iterator = _map.find(address);
-        if (_iterator != _endIterator) {
-          _image = _iterator.GetImage();
-          if (_image != (char *)0) {
-            _base = _iterator.Base();
-            _limit = _iterator.Limit();
-          } else {
-            return defaultValue;
-          }
-        }
-        if (readLimit > _limit) {
+        if (!_map.FindImagedRange(address, &_image, &_base, &_limit) ||
+            readLimit > _limit) {
           return defaultValue;
         }
       }
@@ -421,20 +288,8 @@ class VirtualAddressMap {
     template <typename T>
     void Read(Offset address, T *valueRead) {
       if (_base > address || _limit < address + sizeof(T)) {
-        _image = (char *)0;
-        _base = 0;
-        _limit = 0;
-        _iterator = _map.find(address);
-        if (_iterator != _endIterator) {
-          _image = _iterator.GetImage();
-          if (_image != (char *)0) {
-            _base = _iterator.Base();
-            _limit = _iterator.Limit();
-          } else {
-            throw NotMapped(address);
-          }
-        }
-        if (address + sizeof(T) > _limit) {
+        if (!_map.FindImagedRange(address, &_image, &_base, &_limit) ||
+            address + sizeof(T) > _limit) {
           throw NotMapped(address);
         }
       }
@@ -443,14 +298,14 @@ class VirtualAddressMap {
 
    private:
     const VirtualAddressMap &_map;
-    typename VirtualAddressMap::const_iterator _iterator;
-    typename VirtualAddressMap::const_iterator _endIterator;
     const char *_image;
     Offset _base;
     Offset _limit;
   };
   VirtualAddressMap(const FileImage &fileImage)
-      : _fileImage(fileImage), _fileSize((Offset)(fileImage.GetFileSize())) {}
+      : _fileImage(fileImage),
+        _fileSize((Offset)(fileImage.GetFileSize())),
+        _knownZeroPages(fileImage) {}
 
   ~VirtualAddressMap() {}
 
@@ -475,19 +330,138 @@ class VirtualAddressMap {
   }
 
   Offset FindMappedMemoryImage(Offset addr, const char **image) const {
-    const_iterator it = find(addr);
-    if (it != end()) {
-      const char *rangeImage = it.GetImage();
-      if (rangeImage != (const char *)0) {
-        Offset discard = addr - it.Base();
-        *image = rangeImage + discard;
-        return it.Size() - discard;
-      }
+    Offset base;
+    Offset limit;
+    if (FindImagedRange(addr, image, &base, &limit)) {
+      *image += addr - base;
+      return limit - addr;
     }
-    *image = (const char *)0;
     return 0;
   }
 
+  /*
+   * If the given address is in a range that has an image in the core, set
+   * *image, *base and *limit to the image, base and limit of that range and
+   * return true.  Otherwise set them to 0 and return false.
+   */
+  bool FindImagedRange(Offset addr, const char **image, Offset *base,
+                       Offset *limit) const {
+    Offset size;
+    RangeAttributes attributes;
+    if (_ranges.FindRange(addr, *base, size, attributes) &&
+        (attributes._flags &
+         (RangeAttributes::IS_MAPPED | RangeAttributes::IS_TRUNCATED)) ==
+            RangeAttributes::IS_MAPPED) {
+      // See RangeIterator::GetImage() about the parenthesis.
+      *image = _fileImage.GetImage() + (*base + attributes._adjustToFileOffset);
+      *limit = *base + size;
+      return true;
+    }
+    *image = (const char *)0;
+    *base = 0;
+    *limit = 0;
+    return false;
+  }
+
+  /*
+   * Call the given visitor with the base and limit of each maximal part of
+   * [base, limit) that is not known to be all zero, in increasing order of
+   * address.  Scans that would find nothing in memory that is all zero can
+   * use this to skip such memory without reading it.  Only memory in pages
+   * whose images in the core are all zero is ever left out, so any part of
+   * [base, limit) that has no image is passed to the visitor.
+   */
+  template <typename Visitor>
+  void VisitSpansNotKnownZero(Offset base, Offset limit,
+                              Visitor visitor) const {
+    const Offset pageMask = (Offset)(KnownZeroPages::BYTES_PER_PAGE - 1);
+    Offset spanBase = base;
+    Offset addr = base;
+    while (addr < limit) {
+      const char *image;
+      Offset rangeBase;
+      Offset rangeLimit;
+      if (!FindImagedRange(addr, &image, &rangeBase, &rangeLimit)) {
+        break;
+      }
+      Offset pieceLimit = (rangeLimit < limit) ? rangeLimit : limit;
+      uint64_t fileOffset = (uint64_t)(image - _fileImage.GetImage()) +
+                            (uint64_t)(addr - rangeBase);
+      /*
+       * A page of the address space is a single tracked page in the file
+       * only if the two are aligned the same way.
+       */
+      uint64_t pageFileOffset = fileOffset - (addr & pageMask);
+      if ((pageFileOffset & pageMask) == _knownZeroPages.GetPageOffset()) {
+        Offset page = addr & ~pageMask;
+        while (true) {
+          bool isLastPage = (pieceLimit - page <= pageMask + 1);
+          if (_knownZeroPages.IsZeroPage(pageFileOffset)) {
+            Offset zeroBase = (page < addr) ? addr : page;
+            if (spanBase < zeroBase) {
+              visitor(spanBase, zeroBase);
+            }
+            spanBase = isLastPage ? pieceLimit : page + pageMask + 1;
+          }
+          if (isLastPage) {
+            break;
+          }
+          page += pageMask + 1;
+          pageFileOffset += pageMask + 1;
+        }
+      }
+      addr = pieceLimit;
+    }
+    if (spanBase < limit) {
+      visitor(spanBase, limit);
+    }
+  }
+
+  /*
+   * This is the same as VisitSpansNotKnownZero, but for the given image of
+   * the words starting at the given address, calling the visitor with the
+   * first and limit of each run of words not known to be all zero.
+   */
+  template <typename Word, typename Visitor>
+  void VisitWordsNotKnownZero(Offset address, const Word *first,
+                              const Word *limit, Visitor visitor) const {
+    const Word *visited = first;
+    VisitSpansNotKnownZero(
+        address, address + (Offset)((limit - first) * sizeof(Word)),
+        [&](Offset spanBase, Offset spanLimit) {
+          const Word *spanFirst = first + (spanBase - address) / sizeof(Word);
+          const Word *spanLimitWord =
+              first + (spanLimit - address + sizeof(Word) - 1) / sizeof(Word);
+          if (spanFirst < visited) {
+            spanFirst = visited;
+          }
+          visitor(spanFirst, spanLimitWord);
+          visited = spanLimitWord;
+        });
+  }
+
+  /*
+   * Build the flat form of the ranges used to look up addresses.  This
+   * should be called once all the ranges have been added.
+   */
+  void Freeze() {
+    _ranges.Freeze();
+    /*
+     * The pages known to be zero are tracked at the alignment of the first
+     * range with an image, because cores generally keep the images of all
+     * the ranges aligned the same way in the file.
+     */
+    for (const_iterator it = begin(); it != end(); ++it) {
+      const char *image = it.GetImage();
+      if (image != nullptr) {
+        _knownZeroPages.SetPageOffset(
+            ((uint64_t)(image - _fileImage.GetImage()) - it.Base()) &
+            (KnownZeroPages::BYTES_PER_PAGE - 1));
+        break;
+      }
+    }
+  }
+
   const_reverse_iterator rbegin() const {
     return const_reverse_iterator(_ranges.rbegin(), _fileImage.GetImage());
   }
@@ -545,12 +519,11 @@ class VirtualAddressMap {
   }
 
   // TODO: resolve error handling for references
-  // TODO: handle 0-page omission where dump format allows it and it
-  //       makes sense
 
  private:
   const FileImage &_fileImage;
   Offset _fileSize;
   RangeFileOffsetMapper _ranges;
+  KnownZeroPages _knownZeroPages;
 };
 }  // namespace chap
@@ -4,6 +4,7 @@
 #pragma once
 #include "../Commands/Runner.h"
 #include "../Commands/Subcommand.h"
+#include "../ProcessImage.h"
 #include "../VirtualAddressMap.h"
 namespace chap {
 namespace VirtualAddressMapCommands {
@@ -11,10 +12,12 @@ template <class Offset>
 class DescribePointers : public Commands::Subcommand {
  public:
   typedef VirtualAddressMap<Offset> AddressMap;
-  DescribePointers(const AddressMap& addressMap,
+  typedef typename PointerIndex<Offset>::Entry Entry;
+  DescribePointers(const ProcessImage<Offset>& processImage,
                    const CompoundDescriber<Offset>& describer)
       : Commands::Subcommand("describe", "pointers"),
-        _addressMap(addressMap),
+        _processImage(processImage),
+        _addressMap(processImage.GetVirtualAddressMap()),
         _describer(describer) {}
 
   void ShowHelpMessage(Commands::Context& context) {
@@ -33,29 +36,50 @@ class DescribePointers : public Commands::Subcommand {
       return;
     }
     Commands::Output& output = context.GetOutput();
+    const PointerIndex<Offset>* pointerIndex =
+        _processImage.GetPointerIndex(context.GetError());
+    const Entry* first;
+    const Entry* limit;
+    if (pointerIndex != nullptr &&
+        pointerIndex->Find(valueToMatch, &first, &limit)) {
+      for (; first != limit; ++first) {
+        _describer.Describe(context, first->second, false, true);
+        output << "\n";
+      }
+      return;
+    }
     typename AddressMap::const_iterator itEnd = _addressMap.end();
     for (typename AddressMap::const_iterator it = _addressMap.begin();
          it != itEnd; ++it) {
       Offset numCandidates = it.Size() / sizeof(Offset);
       const char* rangeImage = it.GetImage();
       if (rangeImage != (const char*)0) {
-        const Offset* nextCandidate = (const Offset*)(rangeImage);
-
-        for (const Offset* limit = nextCandidate + numCandidates;
-             nextCandidate < limit; nextCandidate++) {
-          if (*nextCandidate == valueToMatch) {
-            _describer.Describe(
-                context,
-                ((it.Base()) + ((const char*)nextCandidate - rangeImage)),
-                false, true);
-            output << "\n";
+        const Offset* firstCandidate = (const Offset*)(rangeImage);
+        auto describeMatches = [&](const Offset* nextCandidate,
+                                   const Offset* limit) {
+          for (; nextCandidate < limit; nextCandidate++) {
+            if (*nextCandidate == valueToMatch) {
+              _describer.Describe(
+                  context,
+                  ((it.Base()) + ((const char*)nextCandidate - rangeImage)),
+                  false, true);
+              output << "\n";
+            }
           }
+        };
+        if (valueToMatch == 0) {
+          describeMatches(firstCandidate, firstCandidate + numCandidates);
+        } else {
+          _addressMap.VisitWordsNotKnownZero(
+              it.Base(), firstCandidate, firstCandidate + numCandidates,
+              describeMatches);
         }
       }
     }
   }
 
  private:
+  const ProcessImage<Offset>& _processImage;
   const AddressMap& _addressMap;
   const CompoundDescriber<Offset>& _describer;
 };
@@ -4,6 +4,7 @@
 #pragma once
 #include "../Commands/Runner.h"
 #include "../Commands/Subcommand.h"
+#include "../RelativeReferenceFinder.h"
 #include "../VirtualAddressMap.h"
 namespace chap {
 namespace VirtualAddressMapCommands {
@@ -35,26 +36,13 @@ class DescribeRelRefs : public Commands::Subcommand {
       return;
     }
     Commands::Output& output = context.GetOutput();
-    typename AddressMap::const_iterator itEnd = _addressMap.end();
-    for (typename AddressMap::const_iterator it = _addressMap.begin();
-         it != itEnd; ++it) {
-      const char* rangeImage = it.GetImage();
-      if (rangeImage != (const char*)0) {
-        const unsigned char* nextCandidate = (const unsigned char*)(rangeImage);
-
-        Offset addr = it.Base();
-        for (const unsigned char* limit =
-                 nextCandidate + it.Size() - sizeof(int) + 1;
-             nextCandidate < limit; nextCandidate++) {
-          if (addr + sizeof(int) + *(int*)(nextCandidate) == valueToMatch) {
-            output << std::hex << addr << "\n";
-            _describer.Describe(context, addr, false, true);
-            output << "\n";
-          }
-          addr++;
-        }
-      }
-    }
+    RelativeReferenceFinder<Offset> finder(
+        _addressMap, std::vector<Offset>(1, valueToMatch));
+    finder.Visit([&](Offset addr, size_t) {
+      output << std::hex << addr << "\n";
+      _describer.Describe(context, addr, false, true);
+      output << "\n";
+    });
   }
 
  private:
@@ -2,8 +2,10 @@
 // SPDX-License-Identifier: GPL-2.0
 
 #pragma once
+#include "../CandidateFilter.h"
 #include "../Commands/Runner.h"
 #include "../Commands/Subcommand.h"
+#include "../ProcessImage.h"
 #include "../VirtualAddressMap.h"
 namespace chap {
 namespace VirtualAddressMapCommands {
@@ -11,9 +13,11 @@ template <class Offset>
 class EnumeratePointers : public Commands::Subcommand {
  public:
   typedef VirtualAddressMap<Offset> AddressMap;
-  EnumeratePointers(const AddressMap& addressMap)
+  typedef typename PointerIndex<Offset>::Entry Entry;
+  EnumeratePointers(const ProcessImage<Offset>& processImage)
       : Commands::Subcommand("enumerate", "pointers"),
-        _addressMap(addressMap) {}
+        _processImage(processImage),
+        _addressMap(processImage.GetVirtualAddressMap()) {}
 
   void ShowHelpMessage(Commands::Context& context) {
     context.GetOutput() << "Use \"enumerate pointers <address>\" to enumerate "
@@ -31,26 +35,46 @@ class EnumeratePointers : public Commands::Subcommand {
     }
     Commands::Output& output = context.GetOutput();
     output << std::hex;
+    const PointerIndex<Offset>* pointerIndex =
+        _processImage.GetPointerIndex(context.GetError());
+    const Entry* first;
+    const Entry* limit;
+    if (pointerIndex != nullptr &&
+        pointerIndex->Find(valueToMatch, &first, &limit)) {
+      for (; first != limit; ++first) {
+        output << first->second << "\n";
+      }
+      return;
+    }
+    CandidateFilter<Offset> filter(valueToMatch, 1);
     typename AddressMap::const_iterator itEnd = _addressMap.end();
     for (typename AddressMap::const_iterator it = _addressMap.begin();
          it != itEnd; ++it) {
       Offset numCandidates = it.Size() / sizeof(Offset);
       const char* rangeImage = it.GetImage();
       if (rangeImage != (const char*)0) {
-        const Offset* nextCandidate = (const Offset*)(rangeImage);
-
-        for (const Offset* limit = nextCandidate + numCandidates;
-             nextCandidate < limit; nextCandidate++) {
-          if (*nextCandidate == valueToMatch) {
-            output << ((it.Base()) + ((const char*)nextCandidate - rangeImage))
-                   << "\n";
-          }
+        const Offset* firstCandidate = (const Offset*)(rangeImage);
+        auto visitMatches = [&](const Offset* first, const Offset* limit) {
+          filter.Visit(first, limit, [&](const Offset* match) {
+            output << ((it.Base()) + ((const char*)match - rangeImage)) << "\n";
+          });
+        };
+        /*
+         * A page known to be all zero can hold a match only for 0.
+         */
+        if (valueToMatch == 0) {
+          visitMatches(firstCandidate, firstCandidate + numCandidates);
+        } else {
+          _addressMap.VisitWordsNotKnownZero(
+              it.Base(), firstCandidate, firstCandidate + numCandidates,
+              visitMatches);
         }
       }
     }
   }
 
  private:
+  const ProcessImage<Offset>& _processImage;
   const AddressMap& _addressMap;
 };
 }  // namespace VirtualAddressMapCommands
@@ -108,6 +108,16 @@ class VirtualMemoryPartition {
       _claimedInaccessibleRanges.MapRange(range._base, range._size, UNKNOWN);
     }
     _unclaimedInaccessibleRanges.clear();
+
+    /*
+     * All ranges are claimed at this point, so the claimed ranges are not
+     * expected to change.
+     */
+    _claimedRanges.Freeze();
+    _claimedWritableRanges.Freeze();
+    _claimedRxOnlyRanges.Freeze();
+    _claimedReadOnlyRanges.Freeze();
+    _claimedInaccessibleRanges.Freeze();
   }
   void ClearStaticAnchorCandidates(Offset base, Offset size) {
     _staticAnchorCandidates.UnmapRange(base, size);
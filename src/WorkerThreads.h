@@ -0,0 +1,101 @@
+// Copyright (c) 2021 VMware, Inc. All Rights Reserved.
+// SPDX-License-Identifier: GPL-2.0
+
+#pragma once
+#include <atomic>
+#include <exception>
+#include <functional>
+#include <thread>
+#include <vector>
+
+namespace chap {
+/*
+ * This provides a very simple way to split a phase of the analysis into
+ * independent tasks that can be run on multiple threads.  The number of
+ * threads to use is normally set just once, based on the command line, and
+ * applies to all such phases.
+ */
+class WorkerThreads {
+ public:
+  /*
+   * A Task is called with the index of the task to run and the index of the
+   * worker running it.  The worker index is always less than the value
+   * returned by NumWorkersFor() for the same number of tasks, so that the
+   * caller can provide per-worker state, such as buffers, without locking.
+   */
+  typedef std::function<void(size_t,   // task index
+                             size_t)>  // worker index
+      Task;
+
+  static size_t DefaultNumThreads() {
+    size_t numThreads = std::thread::hardware_concurrency();
+    return (numThreads == 0) ? 1 : numThreads;
+  }
+
+  static size_t GetNumThreads() { return NumThreads(); }
+
+  static void SetNumThreads(size_t numThreads) {
+    NumThreads() = (numThreads == 0) ? 1 : numThreads;
+  }
+
+  /*
+   * Return the number of workers that would be used to run the given number
+   * of tasks.
+   */
+  static size_t NumWorkersFor(size_t numTasks) {
+    size_t numThreads = NumThreads();
+    return (numTasks < numThreads) ? ((numTasks == 0) ? 1 : numTasks)
+                                   : numThreads;
+  }
+
+  /*
+   * Run the given task once for each task index in [0, numTasks).  Tasks are
+   * started in increasing order of task index but may finish in any order.
+   * The calling thread acts as worker 0, so no threads are created if only
+   * one worker is needed.  If any task throws, the first exception caught is
+   * rethrown after all the workers have finished.
+   */
+  static void Run(size_t numTasks, Task task) {
+    size_t numWorkers = NumWorkersFor(numTasks);
+    if (numWorkers == 1) {
+      for (size_t taskIndex = 0; taskIndex < numTasks; taskIndex++) {
+        task(taskIndex, 0);
+      }
+      return;
+    }
+    std::atomic<size_t> nextTask(0);
+    std::vector<std::exception_ptr> failures(numWorkers);
+    auto work = [&](size_t workerIndex) {
+      try {
+        for (size_t taskIndex = nextTask++; taskIndex < numTasks;
+             taskIndex = nextTask++) {
+          task(taskIndex, workerIndex);
+        }
+      } catch (...) {
+        failures[workerIndex] = std::current_exception();
+        nextTask = numTasks;
+      }
+    };
+    std::vector<std::thread> threads;
+    threads.reserve(numWorkers - 1);
+    for (size_t workerIndex = 1; workerIndex < numWorkers; workerIndex++) {
+      threads.emplace_back(work, workerIndex);
+    }
+    work(0);
+    for (auto& thread : threads) {
+      thread.join();
+    }
+    for (auto& failure : failures) {
+      if (failure != nullptr) {
+        std::rethrow_exception(failure);
+      }
+    }
+  }
+
+ private:
+  static size_t& NumThreads() {
+    static size_t numThreads = DefaultNumThreads();
+    return numThreads;
+  }
+};
+}  // namespace chap
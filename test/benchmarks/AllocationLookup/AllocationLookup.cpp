@@ -0,0 +1,180 @@
+// Copyright (c) 2021 VMware, Inc. All Rights Reserved.
+// SPDX-License-Identifier: GPL-2.0
+
+/*
+ * This compares the ways that chap can map a candidate pointer to the index
+ * of the allocation that contains it, using synthetic allocation directories
+ * of various densities and candidate words roughly resembling the contents
+ * of allocations, where most words are not pointers into the heap.
+ * Candidates are looked up one at a time, either by binary search or with
+ * the page index, or resolved a batch at a time by sorting the batch and
+ * merging it with the allocations, as Graph::FindEdges may do.
+ */
+
+#include <stdint.h>
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <map>
+#include <random>
+#include <vector>
+#include "../../../src/Allocations/Directory.h"
+#include "../../../src/Allocations/SortedTargetResolver.h"
+
+namespace {
+typedef uint64_t Offset;
+typedef chap::Allocations::Directory<Offset> Directory;
+typedef Directory::AllocationIndex Index;
+typedef chap::Allocations::SortedTargetResolver<Offset> Resolver;
+
+class SyntheticFinder : public Directory::Finder {
+ public:
+  SyntheticFinder(const std::vector<std::pair<Offset, Offset> >& allocations)
+      : _allocations(allocations), _next(0) {}
+  virtual bool Finished() { return _next == _allocations.size(); }
+  virtual Offset NextAddress() { return _allocations[_next].first; }
+  virtual Offset NextSize() { return _allocations[_next].second; }
+  virtual bool NextIsUsed() { return true; }
+  virtual void Advance() { _next++; }
+  virtual Offset MinRequestSize(Offset size) { return size; }
+
+ private:
+  const std::vector<std::pair<Offset, Offset> >& _allocations;
+  size_t _next;
+};
+
+struct Density {
+  const char* _name;
+  Offset _minSize;
+  Offset _maxSize;
+  Offset _maxGap;
+};
+
+template <typename Lookup>
+double TimeLookups(const std::vector<Offset>& candidates, Lookup lookup,
+                   std::vector<Index>& results) {
+  auto start = std::chrono::steady_clock::now();
+  for (size_t i = 0; i < candidates.size(); i++) {
+    results[i] = lookup(candidates[i]);
+  }
+  std::chrono::duration<double> elapsed =
+      std::chrono::steady_clock::now() - start;
+  return elapsed.count();
+}
+
+/*
+ * Resolve the candidates in batches of the given size, counting the time
+ * to build the resolver, which is done once per graph.
+ */
+double TimeMerges(const Directory& directory,
+                  const std::vector<Offset>& candidates, size_t batchSize,
+                  std::vector<Index>& results) {
+  auto start = std::chrono::steady_clock::now();
+  Resolver resolver(directory);
+  std::vector<Resolver::Candidate> batch;
+  std::vector<Resolver::Candidate> scratch;
+  for (size_t base = 0; base < candidates.size(); base += batchSize) {
+    size_t limit = std::min(candidates.size(), base + batchSize);
+    batch.clear();
+    for (size_t i = base; i < limit; i++) {
+      if (resolver.InEnvelope(candidates[i])) {
+        batch.push_back({candidates[i], (Index)(i - base), 0});
+      } else {
+        results[i] = directory.NumAllocations();
+      }
+    }
+    if (!batch.empty()) {
+      resolver.Resolve(batch, scratch);
+    }
+    for (const Resolver::Candidate& candidate : batch) {
+      results[base + candidate._source] = candidate._target;
+    }
+  }
+  std::chrono::duration<double> elapsed =
+      std::chrono::steady_clock::now() - start;
+  return elapsed.count();
+}
+}  // namespace
+
+int main(int argc, char** argv) {
+  size_t numAllocations = (argc > 1) ? strtoul(argv[1], nullptr, 0) : 4000000;
+  size_t numCandidates = (argc > 2) ? strtoul(argv[2], nullptr, 0) : 20000000;
+  size_t batchSize = (argc > 3) ? strtoul(argv[3], nullptr, 0) : 0x40000;
+  const Density densities[] = {{"dense small", 0x20, 0x80, 0},
+                               {"mixed", 0x20, 0x1000, 0x40},
+                               {"sparse large", 0x1000, 0x40000, 0x100000}};
+  for (const Density& density : densities) {
+    std::mt19937_64 random(1);
+    std::vector<std::pair<Offset, Offset> > allocations;
+    allocations.reserve(numAllocations);
+    Offset address = 0x555555560000;
+    for (size_t i = 0; i < numAllocations; i++) {
+      Offset size = (density._minSize +
+                     random() % (density._maxSize - density._minSize + 1)) &
+                    ~0xf;
+      allocations.emplace_back(address, size);
+      address += size;
+      if (density._maxGap != 0) {
+        address += (random() % density._maxGap) & ~0xf;
+      }
+    }
+    Offset heapBase = allocations.front().first;
+    Offset heapSize = address - heapBase;
+
+    Directory directory;
+    SyntheticFinder finder(allocations);
+    directory.AddFinder(&finder);
+    directory.ResolveAllocationBoundaries();
+
+    std::vector<Offset> candidates;
+    candidates.reserve(numCandidates);
+    for (size_t i = 0; i < numCandidates; i++) {
+      uint64_t r = random();
+      switch (r % 10) {
+        case 0:
+        case 1:
+        case 2:
+          candidates.push_back(heapBase + ((r >> 8) % heapSize & ~7));
+          break;
+        case 3:
+          candidates.push_back(r);
+          break;
+        default:
+          candidates.push_back((r >> 8) & 0xffff);
+          break;
+      }
+    }
+
+    std::vector<Index> binaryResults(numCandidates);
+    std::vector<Index> pagedResults(numCandidates);
+    std::vector<Index> mergedResults(numCandidates);
+    double binarySeconds = TimeLookups(
+        candidates,
+        [&](Offset addr) { return directory.AllocationIndexOf(addr); },
+        binaryResults);
+    double pagedSeconds = TimeLookups(
+        candidates,
+        [&](Offset addr) { return directory.PagedAllocationIndexOf(addr); },
+        pagedResults);
+    double mergeSeconds =
+        TimeMerges(directory, candidates, batchSize, mergedResults);
+    std::cout << density._name << ": " << numAllocations << " allocations, "
+              << numCandidates << " candidates\n"
+              << "  binary search: " << binarySeconds << " s\n"
+              << "  page index:    " << pagedSeconds << " s"
+              << (directory.HasPageIndex() ? "\n" : " (no index built)\n")
+              << "  sort-merge:    " << mergeSeconds << " s\n"
+              << "  chosen for FindEdges: "
+              << (Resolver::IsPreferredFor(directory) ? "sort-merge\n"
+                                                      : "page index\n");
+    if (pagedResults != binaryResults) {
+      std::cout << "  Page index results differ from binary search!\n";
+      return 1;
+    }
+    if (mergedResults != binaryResults) {
+      std::cout << "  Sort-merge results differ from binary search!\n";
+      return 1;
+    }
+  }
+  return 0;
+}
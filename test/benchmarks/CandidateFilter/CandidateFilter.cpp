@@ -0,0 +1,86 @@
+// Copyright (c) 2021 VMware, Inc. All Rights Reserved.
+// SPDX-License-Identifier: GPL-2.0
+
+/*
+ * This compares the available implementations of the CandidateFilter, for
+ * both 32 bit and 64 bit words, on synthetic images in which a given
+ * fraction of the words fall in the accepted range, and checks that all
+ * the implementations accept the same words.
+ */
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <chrono>
+#include <iostream>
+#include <random>
+#include <vector>
+#include "../../../src/CandidateFilter.h"
+
+namespace {
+template <class Offset>
+bool CompareImplementations(size_t numWords, unsigned percentAccepted) {
+  typedef chap::CandidateFilter<Offset> Filter;
+  const Offset base = (Offset)(0x5555555560000ULL);
+  const Offset size = (Offset)(0x10000000);
+  std::mt19937_64 random(1);
+  std::vector<Offset> words(numWords);
+  for (Offset& word : words) {
+    uint64_t r = random();
+    if (r % 100 < percentAccepted) {
+      word = base + (Offset)((r >> 8) % size);
+    } else if (r & 0x80) {
+      word = (Offset)((r >> 8) & 0xffff);
+    } else {
+      word = (Offset)(r >> 8);
+    }
+  }
+  /*
+   * Include the values on either side of each boundary.
+   */
+  words[0] = base - 1;
+  words[1] = base;
+  words[2] = base + size - 1;
+  words[3] = base + size;
+
+  const char* names[] = {"scalar", "SSE2", "AVX2"};
+  std::vector<const Offset*> expected;
+  bool allMatch = true;
+  for (int i = Filter::SCALAR; i <= Filter::AVX2; i++) {
+    typename Filter::Implementation implementation =
+        (typename Filter::Implementation)(i);
+    if (!Filter::IsAvailable(implementation)) {
+      std::cout << "  " << names[i] << ": not available\n";
+      continue;
+    }
+    Filter filter(base, size, implementation);
+    std::vector<const Offset*> accepted;
+    accepted.reserve(numWords);
+    auto start = std::chrono::steady_clock::now();
+    filter.Visit(words.data(), words.data() + numWords,
+                 [&](const Offset* word) { accepted.push_back(word); });
+    std::chrono::duration<double> elapsed =
+        std::chrono::steady_clock::now() - start;
+    std::cout << "  " << names[i] << ": " << elapsed.count() << " s, "
+              << accepted.size() << " accepted\n";
+    if (i == Filter::SCALAR) {
+      expected.swap(accepted);
+    } else if (accepted != expected) {
+      std::cout << "  " << names[i] << " results differ from scalar!\n";
+      allMatch = false;
+    }
+  }
+  return allMatch;
+}
+}  // namespace
+
+int main(int argc, char** argv) {
+  size_t numWords = (argc > 1) ? strtoul(argv[1], nullptr, 0) : 100000003;
+  bool allMatch = true;
+  for (unsigned percentAccepted : {1, 10, 50}) {
+    std::cout << "64 bit words, " << percentAccepted << "% accepted:\n";
+    allMatch &= CompareImplementations<uint64_t>(numWords, percentAccepted);
+    std::cout << "32 bit words, " << percentAccepted << "% accepted:\n";
+    allMatch &= CompareImplementations<uint32_t>(numWords, percentAccepted);
+  }
+  return allMatch ? 0 : 1;
+}
@@ -0,0 +1,33 @@
+#include <vector>
+struct Shape {
+  virtual ~Shape() {}
+  virtual double Area() const { return 0; }
+};
+struct Square : Shape {
+  double _side = 3;
+  double Area() const override { return _side * _side; }
+};
+namespace geometry {
+struct Circle : Shape {
+  double _radius = 2;
+  double Area() const override { return 3.14159 * _radius * _radius; }
+};
+}  // namespace geometry
+static const long limits[4] = {1, 2, 3, 4};
+struct Limited {
+  const long *_limits;
+  long _count;
+};
+static Shape *shapes[4];
+std::vector<Shape *> *allShapes;
+Limited *someLimited;
+int main(int, char **, char **) {
+  shapes[1] = new Square;
+  shapes[3] = new geometry::Circle;
+  allShapes = new std::vector<Shape *>;
+  for (int i = 0; i < 3; i++) {
+    allShapes->push_back(new Square);
+  }
+  someLimited = new Limited{limits, 4};
+  *((int *)(0)) = 92;
+}
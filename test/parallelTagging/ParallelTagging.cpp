@@ -0,0 +1,113 @@
+// Copyright (c) 2021 VMware, Inc. All Rights Reserved.
+// SPDX-License-Identifier: GPL-2.0
+
+/*
+ * This checks that the tags calculated for the allocations in each of the
+ * given cores are the same when the tagging is done on multiple threads as
+ * when it is done on a single thread.
+ */
+
+extern "C" {
+#include <elf.h>
+};
+#include <stdlib.h>
+#include <iostream>
+#include <memory>
+#include <vector>
+#include "../../src/FileImage.h"
+#include "../../src/Linux/ELFImage.h"
+#include "../../src/Linux/LinuxProcessImage.h"
+#include "../../src/WorkerThreads.h"
+
+namespace {
+template <class ElfImage>
+void GetTags(const chap::FileImage& fileImage, size_t numThreads,
+             std::vector<size_t>& tags) {
+  chap::WorkerThreads::SetNumThreads(numThreads);
+  /*
+   * These are allocated as chap does, rather than on the stack, because
+   * they are large.
+   */
+  std::unique_ptr<ElfImage> elfImage(new ElfImage(fileImage));
+  std::unique_ptr<chap::Linux::LinuxProcessImage<ElfImage> > processImage(
+      new chap::Linux::LinuxProcessImage<ElfImage>(*elfImage, false));
+  tags.clear();
+  const auto* tagHolder = processImage->GetAllocationTagHolder();
+  if (tagHolder == nullptr) {
+    return;
+  }
+  size_t numAllocations =
+      processImage->GetAllocationDirectory().NumAllocations();
+  tags.reserve(numAllocations);
+  for (size_t i = 0; i < numAllocations; i++) {
+    tags.push_back(tagHolder->GetTagIndex(i));
+  }
+}
+
+template <class ElfImage>
+bool CompareTags(const chap::FileImage& fileImage, size_t numThreads) {
+  const std::string& path = fileImage.GetFileName();
+  std::vector<size_t> serialTags;
+  std::vector<size_t> parallelTags;
+  GetTags<ElfImage>(fileImage, 1, serialTags);
+  GetTags<ElfImage>(fileImage, numThreads, parallelTags);
+  if (serialTags.size() != parallelTags.size()) {
+    std::cerr << path << ": " << serialTags.size()
+              << " allocations were tagged on 1 thread but "
+              << parallelTags.size() << " on " << numThreads << ".\n";
+    return false;
+  }
+  size_t numTagged = 0;
+  size_t numMismatched = 0;
+  for (size_t i = 0; i < serialTags.size(); i++) {
+    if (serialTags[i] != 0) {
+      numTagged++;
+    }
+    if (serialTags[i] != parallelTags[i] && ++numMismatched <= 10) {
+      std::cerr << path << ": allocation " << i << " has tag "
+                << serialTags[i] << " on 1 thread but " << parallelTags[i]
+                << " on " << numThreads << ".\n";
+    }
+  }
+  if (numMismatched != 0) {
+    std::cerr << path << ": " << numMismatched << " of " << serialTags.size()
+              << " tags differ.\n";
+    return false;
+  }
+  std::cout << path << ": " << numTagged << " of " << serialTags.size()
+            << " allocations tagged, the same on 1 and " << numThreads
+            << " threads.\n";
+  return true;
+}
+}  // namespace
+
+int main(int argc, char** argv) {
+  if (argc < 2) {
+    std::cerr << "Usage: ParallelTagging <core>...\n";
+    return 1;
+  }
+  /*
+   * Use at least a few threads, even on a small server, so that the results
+   * of tagging speculatively on other threads are actually checked.
+   */
+  size_t numThreads = chap::WorkerThreads::DefaultNumThreads();
+  if (numThreads < 4) {
+    numThreads = 4;
+  }
+  bool allMatch = true;
+  for (int argIndex = 1; argIndex < argc; argIndex++) {
+    try {
+      chap::FileImage fileImage(argv[argIndex]);
+      if (fileImage.GetFileSize() > EI_CLASS &&
+          fileImage.GetImage()[EI_CLASS] == ELFCLASS32) {
+        allMatch &= CompareTags<chap::Linux::Elf32>(fileImage, numThreads);
+      } else {
+        allMatch &= CompareTags<chap::Linux::Elf64>(fileImage, numThreads);
+      }
+    } catch (...) {
+      std::cerr << argv[argIndex] << ": failed to analyze the core.\n";
+      allMatch = false;
+    }
+  }
+  return allMatch ? 0 : 1;
+}